@@ -32,7 +32,10 @@
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <cstdlib>
@@ -69,6 +72,13 @@ static const unsigned int kMinimumUntranslatedVersion = 16;
 static const unsigned int kMinimumCompatibleVersion_LLVM_3_0 = 14;
 static const unsigned int kMinimumCompatibleVersion_LLVM_2_7 = 11;
 
+/**
+ * Version of the translation, part of the key of cached translated bitcode.
+ * Bump it whenever the translated bitcode for a given input changes (legacy
+ * readers, attribute stripping, 3.2 writer).
+ */
+static const unsigned int kTranslatorCacheVersion = 1;
+
 
 static void stripUnknownAttributes(llvm::Module *M) {
   for (llvm::Function &F : *M)
@@ -78,13 +88,16 @@ static void stripUnknownAttributes(llvm::Module *M) {
 BitcodeTranslator::BitcodeTranslator(const char *bitcode, size_t bitcodeSize,
                                      unsigned int version)
     : mBitcode(bitcode), mBitcodeSize(bitcodeSize), mTranslatedBitcode(nullptr),
-      mTranslatedBitcodeSize(0), mVersion(version) {
+      mTranslatedBitcodeSize(0), mVersion(version), mCachedBitcode(nullptr) {
   return;
 }
 
 
 BitcodeTranslator::~BitcodeTranslator() {
-  if (mVersion < kMinimumUntranslatedVersion) {
+  if (mCachedBitcode) {
+    // mTranslatedBitcode points into the cached buffer.
+    delete mCachedBitcode;
+  } else if (mVersion < kMinimumUntranslatedVersion) {
     // We didn't actually do a translation in the alternate case, so deleting
     // the bitcode would be improper.
     delete [] mTranslatedBitcode;
@@ -100,7 +113,7 @@ bool BitcodeTranslator::translate() {
     return false;
   }
 
-  BitcodeWrapper BCWrapper(mBitcode, mBitcodeSize);
+  BitcodeWrapperHeader BCWrapper(mBitcode, mBitcodeSize);
   if (BCWrapper.getTargetAPI() != mVersion) {
     ALOGE("Bitcode wrapper (%u) and translator (%u) disagree about target API",
           BCWrapper.getTargetAPI(), mVersion);
@@ -123,61 +136,163 @@ bool BitcodeTranslator::translate() {
     return true;
   }
 
-  // Do the actual transcoding by invoking a 2.7-era bitcode reader that can
-  // then write the bitcode back out in a more modern (acceptable) version.
-  std::unique_ptr<llvm::LLVMContext> mContext(new llvm::LLVMContext());
-  std::unique_ptr<llvm::MemoryBuffer> MEM(
-    llvm::MemoryBuffer::getMemBuffer(
-      llvm::StringRef(mBitcode, mBitcodeSize), "", false));
-  std::string error;
-  llvm::ErrorOr<llvm::MemoryBufferRef> MBOrErr = MEM->getMemBufferRef();
-
-  llvm::ErrorOr<llvm::Module *> MOrErr(nullptr);
-
-  if (mVersion >= kMinimumCompatibleVersion_LLVM_3_0) {
-    MOrErr = llvm_3_0::parseBitcodeFile(*MBOrErr, *mContext);
-  } else if (mVersion >= kMinimumCompatibleVersion_LLVM_2_7) {
-    MOrErr = llvm_2_7::parseBitcodeFile(*MBOrErr, *mContext);
-  } else {
-    ALOGE("No compatible bitcode reader for API version %d", mVersion);
-    return false;
+  std::string cachePath;
+  if (!mCacheDir.empty()) {
+    cachePath = getCachePath();
+    if (loadFromCache(cachePath)) {
+      return true;
+    }
   }
 
-  if (std::error_code EC = MOrErr.getError()) {
-    ALOGE("Could not parse bitcode file");
-    ALOGE("%s", EC.message().c_str());
-    return false;
+  // Do the actual transcoding by invoking a 2.7-era bitcode reader that can
+  // then write the bitcode back out in a more modern (acceptable) version.
+  // The translated bitcode is written right after space for its wrapper,
+  // which is filled in once the module (and its context) are gone, so that
+  // the module, the translated bitcode and the returned copy are never all
+  // alive at once.
+  llvm::SmallVector<char, 0> Translated(sizeof(AndroidBitcodeWrapper));
+  {
+    std::unique_ptr<llvm::LLVMContext> mContext(new llvm::LLVMContext());
+    std::unique_ptr<llvm::MemoryBuffer> MEM(
+      llvm::MemoryBuffer::getMemBuffer(
+        llvm::StringRef(mBitcode, mBitcodeSize), "", false));
+
+    // Load the module lazily, and materialize its functions one at a time,
+    // so that a function body that cannot be parsed is reported by name.
+    llvm::ErrorOr<llvm::Module *> MOrErr(nullptr);
+
+    if (mVersion >= kMinimumCompatibleVersion_LLVM_3_0) {
+      MOrErr = llvm_3_0::getLazyBitcodeModule(std::move(MEM), *mContext);
+    } else if (mVersion >= kMinimumCompatibleVersion_LLVM_2_7) {
+      MOrErr = llvm_2_7::getLazyBitcodeModule(std::move(MEM), *mContext);
+    } else {
+      ALOGE("No compatible bitcode reader for API version %d", mVersion);
+      return false;
+    }
+
+    if (std::error_code EC = MOrErr.getError()) {
+      ALOGE("Could not parse bitcode file");
+      ALOGE("%s", EC.message().c_str());
+      return false;
+    }
+
+    // Module ownership is handled by the context, so we don't need to free it.
+    llvm::Module *module = MOrErr.get();
+
+    for (llvm::Function &F : *module) {
+      if (std::error_code EC = F.materialize()) {
+        ALOGE("Could not parse bitcode of function %s", F.getName().str().c_str());
+        ALOGE("%s", EC.message().c_str());
+        return false;
+      }
+    }
+    // Read the rest of the module, and finish upgrading intrinsics.
+    if (std::error_code EC = module->materializeAll()) {
+      ALOGE("Could not parse bitcode file");
+      ALOGE("%s", EC.message().c_str());
+      return false;
+    }
+
+    stripUnknownAttributes(module);
+
+    llvm::raw_svector_ostream OS(Translated);
+    // Use the LLVM 3.2 bitcode writer, instead of the top-of-tree version.
+    llvm_3_2::WriteBitcodeToFile(module, OS);
   }
 
-  // Module ownership is handled by the context, so we don't need to free it.
-  llvm::Module *module = MOrErr.get();
-
-  stripUnknownAttributes(module);
-
-  std::string Buffer;
-
-  llvm::raw_string_ostream OS(Buffer);
-  // Use the LLVM 3.2 bitcode writer, instead of the top-of-tree version.
-  llvm_3_2::WriteBitcodeToFile(module, OS);
-  OS.flush();
-
   AndroidBitcodeWrapper wrapper;
   size_t actualWrapperLen = writeAndroidBitcodeWrapper(
-      &wrapper, Buffer.size(), kMinimumUntranslatedVersion,
+      &wrapper, Translated.size() - sizeof(wrapper), kMinimumUntranslatedVersion,
       BCWrapper.getCompilerVersion(), BCWrapper.getOptimizationLevel());
   if (!actualWrapperLen) {
     ALOGE("Couldn't produce bitcode wrapper!");
     return false;
   }
 
-  mTranslatedBitcodeSize = actualWrapperLen + Buffer.size();
+  mTranslatedBitcodeSize = Translated.size();
   char *c = new char[mTranslatedBitcodeSize];
   memcpy(c, &wrapper, actualWrapperLen);
-  memcpy(c + actualWrapperLen, Buffer.c_str(), Buffer.size());
+  memcpy(c + actualWrapperLen, Translated.data() + actualWrapperLen,
+         mTranslatedBitcodeSize - actualWrapperLen);
 
   mTranslatedBitcode = c;
 
+  if (!cachePath.empty()) {
+    storeInCache(cachePath);
+  }
+
   return true;
 }
 
+
+std::string BitcodeTranslator::getCachePath() const {
+  llvm::MD5 hash;
+  const uint32_t key[] = { kTranslatorCacheVersion, mVersion };
+  hash.update(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(key), sizeof(key)));
+  hash.update(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(mBitcode), mBitcodeSize));
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> digest;
+  llvm::MD5::stringifyResult(result, digest);
+
+  llvm::SmallString<256> path(mCacheDir);
+  llvm::sys::path::append(path, "bcinfo-" + digest.str().str() + ".bc");
+  return path.str();
+}
+
+
+bool BitcodeTranslator::loadFromCache(const std::string &path) {
+  // Large files are mapped rather than read.
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> MBOrErr =
+      llvm::MemoryBuffer::getFile(path, -1, false);
+  if (!MBOrErr) {
+    return false;
+  }
+  std::unique_ptr<llvm::MemoryBuffer> MB = std::move(MBOrErr.get());
+
+  // Reject truncated or otherwise damaged entries; they are overwritten
+  // once the bitcode is translated again.
+  BitcodeWrapperHeader header(MB->getBufferStart(), MB->getBufferSize());
+  if (header.getBCFileType() != BC_WRAPPER ||
+      header.getTargetAPI() != kMinimumUntranslatedVersion ||
+      static_cast<uint64_t>(header.getBitcodeOffset()) + header.getBitcodeSize() !=
+          MB->getBufferSize()) {
+    ALOGW("Ignoring invalid translated bitcode in cache: %s", path.c_str());
+    return false;
+  }
+
+  mTranslatedBitcode = MB->getBufferStart();
+  mTranslatedBitcodeSize = MB->getBufferSize();
+  mCachedBitcode = MB.release();
+  return true;
+}
+
+
+void BitcodeTranslator::storeInCache(const std::string &path) const {
+  // Write to a temporary file and rename it into place, so that concurrent
+  // translations never see a partial entry.
+  int fd;
+  llvm::SmallString<256> tempPath;
+  if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%", fd, tempPath)) {
+    ALOGW("Could not create translated bitcode cache entry: %s", path.c_str());
+    return;
+  }
+
+  bool ok;
+  {
+    llvm::raw_fd_ostream OS(fd, /* shouldClose */ true);
+    OS.write(mTranslatedBitcode, mTranslatedBitcodeSize);
+    OS.close();
+    ok = !OS.has_error();
+    OS.clear_error();
+  }
+
+  if (!ok || llvm::sys::fs::rename(tempPath, path)) {
+    ALOGW("Could not write translated bitcode cache entry: %s", path.c_str());
+    llvm::sys::fs::remove(tempPath);
+  }
+}
+
 }  // namespace bcinfo
@@ -15,31 +15,112 @@
  */
 
 #include "bcinfo/BitcodeWrapper.h"
-#include "bcinfo/Wrap/bitcode_wrapperer.h"
-#include "bcinfo/Wrap/in_memory_wrapper_input.h"
 
-#include "llvm/Bitcode/ReaderWriter.h"
+namespace bcinfo {
 
-#include <cstdlib>
-#include <cstring>
+namespace {
+
+const uint32_t kWordSize = 4;
+
+// Magic, version, bitcode offset and size.
+const uint32_t kLLVMFields = 4;
+
+// The LLVM fields, followed by the header version, target API and PNaCl
+// version.
+const uint32_t kFixedFields = 7;
+
+const uint32_t kWrapperMagicNumber = 0x0B17C0DE;
+const uint32_t kLLVMVersionNumber = 0;
+const uint32_t kPnaclBitcodeVersion = 0;
+
+const uint32_t kDefaultOptimizationLevel = 3;
+
+// Tag and length of a variable field.
+const uint32_t kFieldTagLenSize = 2 * sizeof(BCHeaderField::FixedSubfield);
+
+// The wrapper is always little-endian; assemble the values byte by byte,
+// which also keeps the loads safe for unaligned buffers.
+inline uint16_t readLE16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readLE32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+}  // end anonymous namespace
+
+BitcodeWrapperHeader::BitcodeWrapperHeader(const char *bitcode, size_t bitcodeSize)
+    : mFileType(BC_NOT_BC), mBitcodeOffset(0), mBitcodeSize(0),
+      mHeaderVersion(0), mTargetAPI(0), mCompilerVersion(0),
+      mOptimizationLevel(kDefaultOptimizationLevel) {
+  const uint8_t *buf = reinterpret_cast<const uint8_t *>(bitcode);
+  if (buf == nullptr || bitcodeSize < kWordSize) {
+    return;
+  }
+
+  if (bitcodeSize >= kLLVMFields * kWordSize &&
+      readLE32(buf) == kWrapperMagicNumber &&
+      readLE32(buf + kWordSize) == kLLVMVersionNumber) {
+    mFileType = BC_WRAPPER;
+    mBitcodeOffset = readLE32(buf + 2 * kWordSize);
+    mBitcodeSize = readLE32(buf + 3 * kWordSize);
+    if (bitcodeSize < kFixedFields * kWordSize) {
+      return;
+    }
+    mHeaderVersion = readLE32(buf + 4 * kWordSize);
+    mTargetAPI = readLE32(buf + 5 * kWordSize);
+    if (readLE32(buf + 6 * kWordSize) != kPnaclBitcodeVersion) {
+      return;
+    }
+
+    // The variable fields lie between the fixed fields and the bitcode, each
+    // padded to a word.
+    size_t end = mBitcodeOffset < bitcodeSize ? mBitcodeOffset : bitcodeSize;
+    size_t pos = kFixedFields * kWordSize;
+    while (pos + kFieldTagLenSize <= end) {
+      uint16_t tag = readLE16(buf + pos);
+      uint16_t len = readLE16(buf + pos + sizeof(BCHeaderField::FixedSubfield));
+      const uint8_t *data = buf + pos + kFieldTagLenSize;
+      if (pos + kFieldTagLenSize + len > end) {
+        break;
+      }
+      if (len >= kWordSize) {
+        switch (tag) {
+          case BCHeaderField::kAndroidCompilerVersion:
+            mCompilerVersion = readLE32(data);
+            break;
+          case BCHeaderField::kAndroidOptimizationLevel:
+            mOptimizationLevel = readLE32(data);
+            break;
+          default:
+            break;
+        }
+      }
+      pos += (kFieldTagLenSize + len + 3) & ~3;
+    }
+  } else if (buf[0] == 'B' && buf[1] == 'C' && buf[2] == 0xc0 && buf[3] == 0xde) {
+    mFileType = BC_RAW;
+    mBitcodeSize = bitcodeSize;
+  }
+}
 
-namespace bcinfo {
 
 BitcodeWrapper::BitcodeWrapper(const char *bitcode, size_t bitcodeSize)
     : mFileType(BC_NOT_BC), mBitcode(bitcode),
       mBitcodeSize(bitcodeSize),
       mHeaderVersion(0), mTargetAPI(0), mCompilerVersion(0),
-      mOptimizationLevel(3) {
-  InMemoryWrapperInput inMem(mBitcode, mBitcodeSize);
-  BitcodeWrapperer wrapperer(&inMem, nullptr);
-  if (wrapperer.IsInputBitcodeWrapper()) {
-    mFileType = BC_WRAPPER;
-    mHeaderVersion = wrapperer.getAndroidHeaderVersion();
-    mTargetAPI = wrapperer.getAndroidTargetAPI();
-    mCompilerVersion = wrapperer.getAndroidCompilerVersion();
-    mOptimizationLevel = wrapperer.getAndroidOptimizationLevel();
-  } else if (wrapperer.IsInputBitcodeFile()) {
-    mFileType = BC_RAW;
+      mOptimizationLevel(kDefaultOptimizationLevel) {
+  BitcodeWrapperHeader header(mBitcode, mBitcodeSize);
+  mFileType = header.getBCFileType();
+  if (mFileType == BC_WRAPPER) {
+    mHeaderVersion = header.getHeaderVersion();
+    mTargetAPI = header.getTargetAPI();
+    mCompilerVersion = header.getCompilerVersion();
+    mOptimizationLevel = header.getOptimizationLevel();
   }
 }
 
@@ -54,4 +135,3 @@ bool BitcodeWrapper::unwrap() {
 }
 
 }  // namespace bcinfo
-
@@ -189,7 +189,7 @@ MetadataExtractor::MetadataExtractor(const char *bitcode, size_t bitcodeSize)
       mObjectSlotCount(0), mObjectSlotList(nullptr),
       mRSFloatPrecision(RS_FP_Full), mIsThreadable(true),
       mBuildChecksum(nullptr), mHasDebugInfo(false) {
-  BitcodeWrapper wrapper(bitcode, bitcodeSize);
+  BitcodeWrapperHeader wrapper(bitcode, bitcodeSize);
   mCompilerVersion = wrapper.getCompilerVersion();
   mOptimizationLevel = wrapper.getOptimizationLevel();
 }
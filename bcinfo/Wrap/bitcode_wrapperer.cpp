@@ -72,8 +72,10 @@ BitcodeWrapperer::BitcodeWrapperer(WrapperInput* infile, WrapperOutput* outfile)
       error_(false) {
   buffer_.resize(kBitcodeWrappererBufferSize);
   if (IsInputBitcodeWrapper()) {
-    ParseWrapperHeader();
-  } else if (IsInputBitcodeFile()) {
+    if (!ParseWrapperHeader()) {
+      error_ = true;
+    }
+  } else if (IsInputBitcodeFile() && GetInFileSize() >= 0) {
     wrapper_bc_offset_ = kWordSize * kFixedFields;
     wrapper_bc_size_ = GetInFileSize();
   } else {
@@ -366,11 +368,33 @@ void BitcodeWrapperer::PrintWrapperHeader() {
   for (size_t i = 0; i < header_fields_.size(); i++) header_fields_[i].Print();
 }
 
+bool BitcodeWrapperer::CopyInToOut(uint32_t pos, uint32_t size) {
+  off_t in_size = GetInFileSize();
+  if (outfile_ == nullptr || in_size < 0 ||
+      static_cast<uint64_t>(pos) + size > static_cast<uint64_t>(in_size)) {
+    return Seek(pos) && BufferCopyInToOut(size);
+  }
+
+  size_t copied = outfile_->CopyFrom(infile_, pos, size);
+  if (copied < size) {
+    const uint8_t* data = infile_->Data();
+    if (data != nullptr) {
+      if (!outfile_->Write(data + pos + copied, size - copied)) {
+        return false;
+      }
+      copied = size;
+    }
+  }
+  if (copied < size) {
+    return Seek(pos + copied) && BufferCopyInToOut(size - copied);
+  }
+  return true;
+}
+
 bool BitcodeWrapperer::GenerateWrappedBitcodeFile() {
   if (!error_ &&
       WriteBitcodeWrapperHeader() &&
-      Seek(infile_bc_offset_) &&
-      BufferCopyInToOut(wrapper_bc_size_)) {
+      CopyInToOut(infile_bc_offset_, wrapper_bc_size_)) {
     off_t dangling = wrapper_bc_size_ & 3;
     if (dangling) {
       return outfile_->Write((const uint8_t*) "\0\0\0\0", 4 - dangling);
@@ -381,6 +405,5 @@ bool BitcodeWrapperer::GenerateWrappedBitcodeFile() {
 }
 
 bool BitcodeWrapperer::GenerateRawBitcodeFile() {
-  return !error_ && Seek(infile_bc_offset_) &&
-      BufferCopyInToOut(wrapper_bc_size_);
+  return !error_ && CopyInToOut(infile_bc_offset_, wrapper_bc_size_);
 }
@@ -15,7 +15,6 @@
  */
 
 #include <sys/stat.h>
-#include <stdlib.h>
 
 #include "bcinfo/Wrap/file_wrapper_input.h"
 
@@ -24,15 +23,20 @@ FileWrapperInput::FileWrapperInput(const char* name) :
   _file = fopen(name, "rb");
   if (_file == nullptr) {
     fprintf(stderr, "Unable to open: %s\n", name);
-    exit(1);
+    _at_eof = true;
   }
 }
 
 FileWrapperInput::~FileWrapperInput() {
-  fclose(_file);
+  if (_file != nullptr) {
+    fclose(_file);
+  }
 }
 
 size_t FileWrapperInput::Read(uint8_t* buffer, size_t wanted) {
+  if (_file == nullptr) {
+    return 0;
+  }
   size_t found = fread((char*) buffer, 1, wanted, _file);
   if (feof(_file) || ferror(_file)) {
     _at_eof = true;
@@ -47,18 +51,22 @@ bool FileWrapperInput::AtEof() {
 off_t FileWrapperInput::Size() {
   if (_size_found) return _size;
   struct stat st;
-  if (stat(_name, &st) == 0) {
+  if (_file != nullptr && fstat(fileno(_file), &st) == 0) {
     _size_found = true;
     _size = st.st_size;
     return _size;
-  } else {
-    fprintf(stderr, "Unable to compute file size: %s\n", _name);
-    exit(1);
   }
-  // NOT REACHABLE.
-  return 0;
+  fprintf(stderr, "Unable to compute file size: %s\n", _name);
+  return -1;
 }
 
 bool FileWrapperInput::Seek(uint32_t pos) {
+  if (_file == nullptr) {
+    return false;
+  }
   return fseek(_file, (long) pos, SEEK_SET) == 0; // NOLINT
 }
+
+int FileWrapperInput::Fd() {
+  return _file != nullptr ? fileno(_file) : -1;
+}
@@ -14,29 +14,46 @@
  * limitations under the License.
  */
 
-#include <stdlib.h>
-
 #include "bcinfo/Wrap/file_wrapper_output.h"
 
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 FileWrapperOutput::FileWrapperOutput(const char* name)
     : _name(name) {
   _file = fopen(name, "wb");
   if (nullptr == _file) {
     fprintf(stderr, "Unable to open: %s\n", name);
-    exit(1);
   }
 }
 
 FileWrapperOutput::~FileWrapperOutput() {
-  fclose(_file);
+  Close();
+}
+
+bool FileWrapperOutput::Close() {
+  if (nullptr == _file) {
+    return false;
+  }
+  bool ok = !ferror(_file);
+  ok = (fclose(_file) == 0) && ok;
+  _file = nullptr;
+  return ok;
 }
 
 bool FileWrapperOutput::Write(uint8_t byte) {
+  if (nullptr == _file) {
+    return false;
+  }
   return EOF != fputc(byte, _file);
 }
 
 bool FileWrapperOutput::Write(const uint8_t* buffer, size_t buffer_size) {
-  if (!buffer) {
+  if (!buffer || nullptr == _file) {
     return false;
   }
 
@@ -46,3 +63,42 @@ bool FileWrapperOutput::Write(const uint8_t* buffer, size_t buffer_size) {
     return true;
   }
 }
+
+size_t FileWrapperOutput::CopyFrom(WrapperInput* input, off_t pos,
+                                   size_t size) {
+#if defined(__linux__)
+  int in_fd = input->Fd();
+  if (nullptr == _file || in_fd < 0 || fflush(_file) != 0) {
+    return 0;
+  }
+  int out_fd = fileno(_file);
+
+  // Both calls take the input offset explicitly, and advance the output
+  // file offset. copy_file_range may be unsupported by the kernel (or
+  // across file systems), in which case sendfile takes over.
+  size_t copied = 0;
+#if defined(__NR_copy_file_range)
+  while (copied < size) {
+    loff_t in_off = pos + copied;
+    ssize_t n = syscall(__NR_copy_file_range, in_fd, &in_off, out_fd, nullptr,
+                        size - copied, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    copied += n;
+  }
+#endif
+  while (copied < size) {
+    off_t in_off = pos + copied;
+    ssize_t n = sendfile(out_fd, in_fd, &in_off, size - copied);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    copied += n;
+  }
+
+  // Resynchronize stdio with the file offset.
+  fseek(_file, 0, SEEK_END);
+  return copied;
+#else
+  return 0;
+#endif
+}
@@ -58,3 +58,7 @@ bool InMemoryWrapperInput::Seek(uint32_t pos) {
     return false;
   }
 }
+
+const uint8_t* InMemoryWrapperInput::Data() {
+  return reinterpret_cast<const uint8_t*>(_buffer);
+}
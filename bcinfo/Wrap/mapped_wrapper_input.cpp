@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcinfo/Wrap/mapped_wrapper_input.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(_WIN32)
+#include <stdlib.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if !defined(O_BINARY)
+#define O_BINARY 0
+#endif
+
+MappedWrapperInput::MappedWrapperInput(const char* name)
+    : _fd(-1), _data(nullptr), _size(0), _pos(0) {
+  int fd = open(name, O_RDONLY | O_BINARY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Unable to open: %s\n", name);
+    if (fd >= 0) close(fd);
+    return;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+
+  uint8_t* data = nullptr;
+  if (size > 0) {
+#if defined(_WIN32)
+    // No mmap: read the file instead.
+    data = static_cast<uint8_t*>(malloc(size));
+    size_t got = 0;
+    while (data != nullptr && got < size) {
+      int n = read(fd, data + got, size - got);
+      if (n <= 0) {
+        free(data);
+        data = nullptr;
+      } else {
+        got += n;
+      }
+    }
+#else
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      data = static_cast<uint8_t*>(map);
+    }
+#endif
+    if (data == nullptr) {
+      fprintf(stderr, "Unable to map: %s\n", name);
+      close(fd);
+      return;
+    }
+  }
+
+  _fd = fd;
+  _data = data;
+  _size = size;
+}
+
+MappedWrapperInput::~MappedWrapperInput() {
+  if (_data != nullptr) {
+#if defined(_WIN32)
+    free(_data);
+#else
+    munmap(_data, _size);
+#endif
+  }
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+size_t MappedWrapperInput::Read(uint8_t* buffer, size_t wanted) {
+  if (!buffer || _pos >= _size) {
+    return 0;
+  }
+  size_t found = (_size - _pos < wanted) ? _size - _pos : wanted;
+  memcpy(buffer, _data + _pos, found);
+  _pos += found;
+  return found;
+}
+
+bool MappedWrapperInput::AtEof() {
+  return _pos >= _size;
+}
+
+off_t MappedWrapperInput::Size() {
+  return IsOpen() ? static_cast<off_t>(_size) : -1;
+}
+
+bool MappedWrapperInput::Seek(uint32_t pos) {
+  if (pos < _size) {
+    _pos = pos;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+const uint8_t* MappedWrapperInput::Data() {
+  return _data;
+}
+
+int MappedWrapperInput::Fd() {
+  return _fd;
+}
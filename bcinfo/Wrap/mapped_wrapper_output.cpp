@@ -0,0 +1,167 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcinfo/Wrap/mapped_wrapper_output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(_WIN32)
+#include <stdlib.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if !defined(O_BINARY)
+#define O_BINARY 0
+#endif
+
+// The smallest size the file is grown to.
+static const size_t kMinCapacity = 64 * 1024;
+
+#if !defined(_WIN32)
+// Grows the file from its current size, from, to size, allocating the
+// blocks on disk: storing to a page of the mapping that the file system
+// cannot back raises SIGBUS, whereas this fails. Returns false if the
+// blocks cannot be allocated.
+static bool AllocateFile(int fd, size_t from, size_t size) {
+#if !defined(__APPLE__)
+  int err = posix_fallocate(fd, static_cast<off_t>(from),
+                            static_cast<off_t>(size - from));
+  if (err == 0) {
+    return true;
+  }
+  if (err != EINVAL && err != EOPNOTSUPP) {
+    return false;
+  }
+  // The file system does not support fallocate: write the zeros instead.
+#endif
+  static const uint8_t kZeros[4096] = {};
+  while (from < size) {
+    size_t count =
+        (size - from < sizeof(kZeros)) ? size - from : sizeof(kZeros);
+    ssize_t n = pwrite(fd, kZeros, count, static_cast<off_t>(from));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    from += n;
+  }
+  return true;
+}
+#endif
+
+MappedWrapperOutput::MappedWrapperOutput(const char* name, size_t size_hint)
+    : _fd(-1), _data(nullptr), _capacity(0), _size(0), _error(false) {
+  _fd = open(name, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+  if (_fd < 0) {
+    fprintf(stderr, "Unable to open: %s\n", name);
+    return;
+  }
+  if (size_hint > 0 && !Reserve(size_hint)) {
+    fprintf(stderr, "Unable to map: %s\n", name);
+    _error = true;
+  }
+}
+
+MappedWrapperOutput::~MappedWrapperOutput() {
+  Close();
+}
+
+bool MappedWrapperOutput::Reserve(size_t size) {
+  if (size <= _capacity) {
+    return true;
+  }
+  size_t capacity = (_capacity * 2 > kMinCapacity) ? _capacity * 2 : kMinCapacity;
+  if (capacity < size) {
+    capacity = size;
+  }
+
+#if defined(_WIN32)
+  // No mmap: keep the contents in memory until Close.
+  uint8_t* data = static_cast<uint8_t*>(realloc(_data, capacity));
+  if (data == nullptr) {
+    return false;
+  }
+#else
+  if (!AllocateFile(_fd, _capacity, capacity)) {
+    return false;
+  }
+  void* map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   _fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  uint8_t* data = static_cast<uint8_t*>(map);
+  if (_data != nullptr) {
+    munmap(_data, _capacity);
+  }
+#endif
+  _data = data;
+  _capacity = capacity;
+  return true;
+}
+
+bool MappedWrapperOutput::Close() {
+  if (_fd < 0) {
+    return false;
+  }
+  bool ok = !_error;
+#if defined(_WIN32)
+  size_t written = 0;
+  while (ok && written < _size) {
+    int n = write(_fd, _data + written, _size - written);
+    if (n <= 0) {
+      ok = false;
+    } else {
+      written += n;
+    }
+  }
+  free(_data);
+#else
+  if (_data != nullptr) {
+    munmap(_data, _capacity);
+  }
+  ok = (ftruncate(_fd, static_cast<off_t>(_size)) == 0) && ok;
+#endif
+  ok = (close(_fd) == 0) && ok;
+  _fd = -1;
+  _data = nullptr;
+  _capacity = 0;
+  return ok;
+}
+
+bool MappedWrapperOutput::Write(uint8_t byte) {
+  return Write(&byte, 1);
+}
+
+bool MappedWrapperOutput::Write(const uint8_t* buffer, size_t buffer_size) {
+  if (!buffer || _fd < 0 || _error) {
+    return false;
+  }
+  if (!Reserve(_size + buffer_size)) {
+    _error = true;
+    return false;
+  }
+  memcpy(_data + _size, buffer, buffer_size);
+  _size += buffer_size;
+  return true;
+}
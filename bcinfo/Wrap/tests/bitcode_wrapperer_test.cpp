@@ -0,0 +1,324 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Wraps and unwraps bitcode files through each input and output backend,
+// and checks that the backends and BitcodeWrapperer report missing,
+// malformed and unwritable files instead of exiting.
+
+#include "bcinfo/Wrap/bitcode_wrapperer.h"
+#include "bcinfo/Wrap/file_wrapper_input.h"
+#include "bcinfo/Wrap/file_wrapper_output.h"
+#include "bcinfo/Wrap/mapped_wrapper_input.h"
+#include "bcinfo/Wrap/mapped_wrapper_output.h"
+
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Size of the wrapper header written by BitcodeWrapperer, without
+// variable fields.
+const size_t kHeaderSize = 7 * 4;
+
+// Not a multiple of 4, so that the wrapped bitcode is padded.
+const size_t kBitcodeSize = 3 * 64 * 1024 + 3;
+
+class BitcodeWrappererTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    for (size_t i = 0; i < mFiles.size(); ++i) {
+      unlink(mFiles[i].c_str());
+    }
+  }
+
+  // Returns the path of a scratch file, removed after the test.
+  std::string TempFile(const char* name) {
+    std::string path = ::testing::TempDir() + "libLLVMWrap_test_" +
+                       std::to_string(getpid()) + "_" + name;
+    mFiles.push_back(path);
+    return path;
+  }
+
+  static void WriteFile(const std::string& path,
+                        const std::vector<uint8_t>& contents) {
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file != nullptr);
+    if (!contents.empty()) {
+      ASSERT_EQ(contents.size(),
+                fwrite(contents.data(), 1, contents.size(), file));
+    }
+    ASSERT_EQ(0, fclose(file));
+  }
+
+  static std::vector<uint8_t> ReadFile(const std::string& path) {
+    std::vector<uint8_t> contents;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      return contents;
+    }
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      contents.insert(contents.end(), buffer, buffer + n);
+    }
+    fclose(file);
+    return contents;
+  }
+
+  static std::vector<uint8_t> MakeBitcode() {
+    std::vector<uint8_t> bitcode(kBitcodeSize);
+    bitcode[0] = 'B';
+    bitcode[1] = 'C';
+    bitcode[2] = 0xc0;
+    bitcode[3] = 0xde;
+    for (size_t i = 4; i < bitcode.size(); ++i) {
+      bitcode[i] = static_cast<uint8_t>(i * 7);
+    }
+    return bitcode;
+  }
+
+  static uint32_t ReadWord(const std::vector<uint8_t>& contents, size_t i) {
+    return contents[i * 4] | (contents[i * 4 + 1] << 8) |
+           (contents[i * 4 + 2] << 16) |
+           (static_cast<uint32_t>(contents[i * 4 + 3]) << 24);
+  }
+
+  // Checks that wrapped is bitcode, wrapped and padded to a word.
+  static void ExpectWrapped(const std::vector<uint8_t>& wrapped,
+                            const std::vector<uint8_t>& bitcode) {
+    ASSERT_EQ(kHeaderSize + (bitcode.size() + 3) / 4 * 4, wrapped.size());
+    EXPECT_EQ(0x0B17C0DEu, ReadWord(wrapped, 0));
+    EXPECT_EQ(kHeaderSize, ReadWord(wrapped, 2));
+    EXPECT_EQ(bitcode.size(), ReadWord(wrapped, 3));
+    EXPECT_TRUE(std::equal(bitcode.begin(), bitcode.end(),
+                           wrapped.begin() + kHeaderSize));
+    for (size_t i = kHeaderSize + bitcode.size(); i < wrapped.size(); ++i) {
+      EXPECT_EQ(0, wrapped[i]);
+    }
+  }
+
+ private:
+  std::vector<std::string> mFiles;
+};
+
+TEST_F(BitcodeWrappererTest, MappedInputAndOutput) {
+  std::vector<uint8_t> bitcode = MakeBitcode();
+  std::string raw = TempFile("mapped.bc");
+  std::string wrapped = TempFile("mapped.wrapped.bc");
+  std::string unwrapped = TempFile("mapped.unwrapped.bc");
+  WriteFile(raw, bitcode);
+
+  {
+    MappedWrapperInput in(raw.c_str());
+    MappedWrapperOutput out(wrapped.c_str());
+    ASSERT_TRUE(in.IsOpen());
+    ASSERT_TRUE(out.IsOpen());
+    EXPECT_EQ(static_cast<off_t>(bitcode.size()), in.Size());
+    ASSERT_TRUE(in.Data() != nullptr);
+    BitcodeWrapperer wrapperer(&in, &out);
+    EXPECT_FALSE(wrapperer.HasError());
+    EXPECT_TRUE(wrapperer.GenerateWrappedBitcodeFile());
+    EXPECT_TRUE(out.Close());
+  }
+  ExpectWrapped(ReadFile(wrapped), bitcode);
+
+  {
+    // Large enough a hint that the output is never remapped.
+    MappedWrapperInput in(wrapped.c_str());
+    MappedWrapperOutput out(unwrapped.c_str(), 1024 * 1024);
+    BitcodeWrapperer wrapperer(&in, &out);
+    EXPECT_FALSE(wrapperer.HasError());
+    EXPECT_TRUE(wrapperer.GenerateRawBitcodeFile());
+    EXPECT_TRUE(out.Close());
+  }
+  EXPECT_EQ(bitcode, ReadFile(unwrapped));
+}
+
+TEST_F(BitcodeWrappererTest, FileInputAndOutput) {
+  std::vector<uint8_t> bitcode = MakeBitcode();
+  std::string raw = TempFile("file.bc");
+  std::string wrapped = TempFile("file.wrapped.bc");
+  std::string unwrapped = TempFile("file.unwrapped.bc");
+  WriteFile(raw, bitcode);
+
+  {
+    FileWrapperInput in(raw.c_str());
+    FileWrapperOutput out(wrapped.c_str());
+    ASSERT_TRUE(in.IsOpen());
+    ASSERT_TRUE(out.IsOpen());
+    BitcodeWrapperer wrapperer(&in, &out);
+    EXPECT_FALSE(wrapperer.HasError());
+    EXPECT_TRUE(wrapperer.GenerateWrappedBitcodeFile());
+    EXPECT_TRUE(out.Close());
+  }
+  ExpectWrapped(ReadFile(wrapped), bitcode);
+
+  {
+    FileWrapperInput in(wrapped.c_str());
+    FileWrapperOutput out(unwrapped.c_str());
+    BitcodeWrapperer wrapperer(&in, &out);
+    EXPECT_FALSE(wrapperer.HasError());
+    EXPECT_TRUE(wrapperer.GenerateRawBitcodeFile());
+    EXPECT_TRUE(out.Close());
+  }
+  EXPECT_EQ(bitcode, ReadFile(unwrapped));
+}
+
+TEST_F(BitcodeWrappererTest, MissingInput) {
+  std::string missing = TempFile("missing.bc");
+  std::string output = TempFile("missing.wrapped.bc");
+
+  MappedWrapperInput mapped(missing.c_str());
+  EXPECT_FALSE(mapped.IsOpen());
+  EXPECT_EQ(-1, mapped.Size());
+  EXPECT_TRUE(mapped.Data() == nullptr);
+  EXPECT_EQ(-1, mapped.Fd());
+  uint8_t byte;
+  EXPECT_EQ(0u, mapped.Read(&byte, 1));
+  EXPECT_TRUE(mapped.AtEof());
+
+  FileWrapperInput file(missing.c_str());
+  EXPECT_FALSE(file.IsOpen());
+  EXPECT_EQ(-1, file.Size());
+  EXPECT_EQ(-1, file.Fd());
+  EXPECT_EQ(0u, file.Read(&byte, 1));
+  EXPECT_FALSE(file.Seek(0));
+
+  MappedWrapperOutput out(output.c_str());
+  BitcodeWrapperer wrapperer(&mapped, &out);
+  EXPECT_TRUE(wrapperer.HasError());
+  EXPECT_FALSE(wrapperer.GenerateWrappedBitcodeFile());
+  EXPECT_FALSE(wrapperer.GenerateRawBitcodeFile());
+}
+
+TEST_F(BitcodeWrappererTest, NotBitcode) {
+  std::string text = TempFile("text.bc");
+  std::string output = TempFile("text.wrapped.bc");
+  WriteFile(text, std::vector<uint8_t>(100, 'x'));
+
+  MappedWrapperInput in(text.c_str());
+  MappedWrapperOutput out(output.c_str());
+  EXPECT_TRUE(in.IsOpen());
+  BitcodeWrapperer wrapperer(&in, &out);
+  EXPECT_TRUE(wrapperer.HasError());
+  EXPECT_FALSE(wrapperer.GenerateWrappedBitcodeFile());
+}
+
+TEST_F(BitcodeWrappererTest, TruncatedWrapper) {
+  // The LLVM fields of the header, without the Android ones.
+  const uint8_t header[] = {
+    0xde, 0xc0, 0x17, 0x0b, 0, 0, 0, 0, 28, 0, 0, 0, 4, 0, 0, 0,
+  };
+  std::string truncated = TempFile("truncated.bc");
+  std::string output = TempFile("truncated.unwrapped.bc");
+  WriteFile(truncated, std::vector<uint8_t>(header, header + sizeof(header)));
+
+  MappedWrapperInput in(truncated.c_str());
+  MappedWrapperOutput out(output.c_str());
+  BitcodeWrapperer wrapperer(&in, &out);
+  EXPECT_TRUE(wrapperer.IsInputBitcodeWrapper());
+  EXPECT_TRUE(wrapperer.HasError());
+  EXPECT_FALSE(wrapperer.GenerateRawBitcodeFile());
+}
+
+TEST_F(BitcodeWrappererTest, UnwritableOutput) {
+  std::string unwritable = TempFile("missing_dir/out.bc");
+  const uint8_t byte = 0;
+
+  MappedWrapperOutput mapped(unwritable.c_str());
+  EXPECT_FALSE(mapped.IsOpen());
+  EXPECT_FALSE(mapped.Write(byte));
+  EXPECT_FALSE(mapped.Write(&byte, 1));
+  EXPECT_FALSE(mapped.Close());
+
+  FileWrapperOutput file(unwritable.c_str());
+  EXPECT_FALSE(file.IsOpen());
+  EXPECT_FALSE(file.Write(byte));
+  EXPECT_FALSE(file.Write(&byte, 1));
+  EXPECT_FALSE(file.Close());
+}
+
+TEST_F(BitcodeWrappererTest, Close) {
+  std::string mappedPath = TempFile("close.mapped");
+  std::string filePath = TempFile("close.file");
+  const uint8_t bytes[] = { 1, 2, 3 };
+
+  MappedWrapperOutput mapped(mappedPath.c_str());
+  EXPECT_TRUE(mapped.Write(bytes, sizeof(bytes)));
+  EXPECT_TRUE(mapped.Close());
+  EXPECT_FALSE(mapped.IsOpen());
+  EXPECT_FALSE(mapped.Write(bytes, sizeof(bytes)));
+  EXPECT_FALSE(mapped.Close());
+  // The file is truncated to the bytes written.
+  EXPECT_EQ(std::vector<uint8_t>(bytes, bytes + sizeof(bytes)),
+            ReadFile(mappedPath));
+
+  FileWrapperOutput file(filePath.c_str());
+  EXPECT_TRUE(file.Write(bytes, sizeof(bytes)));
+  EXPECT_TRUE(file.Close());
+  EXPECT_FALSE(file.IsOpen());
+  EXPECT_FALSE(file.Write(bytes, sizeof(bytes)));
+  EXPECT_FALSE(file.Close());
+  EXPECT_EQ(std::vector<uint8_t>(bytes, bytes + sizeof(bytes)),
+            ReadFile(filePath));
+}
+
+TEST_F(BitcodeWrappererTest, EmptyMappedOutput) {
+  std::string path = TempFile("empty.mapped");
+  {
+    MappedWrapperOutput out(path.c_str(), 4096);
+    EXPECT_TRUE(out.IsOpen());
+  }
+  EXPECT_TRUE(ReadFile(path).empty());
+}
+
+TEST_F(BitcodeWrappererTest, MappedOutputOutOfSpace) {
+  std::string path = TempFile("full.mapped");
+  std::vector<uint8_t> bytes(256 * 1024, 0x5a);
+
+  // Stand in for a full disk with a file size limit, reported by the
+  // failing call instead of a signal.
+  struct rlimit limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &limit));
+  struct rlimit lowered = limit;
+  lowered.rlim_cur = 128 * 1024;
+  void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &lowered));
+
+  MappedWrapperOutput out(path.c_str());
+  EXPECT_TRUE(out.Write(bytes.data(), 1000));
+  // The blocks of the mapped part of the file are allocated.
+  struct stat st;
+  EXPECT_EQ(0, stat(path.c_str(), &st));
+  EXPECT_GE(static_cast<off_t>(st.st_blocks) * 512, 64 * 1024);
+  EXPECT_FALSE(out.Write(bytes.data(), bytes.size()));
+  EXPECT_FALSE(out.Write(bytes.data(), 1));
+  EXPECT_FALSE(out.Close());
+
+  EXPECT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+  signal(SIGXFSZ, handler);
+}
+
+}  // end anonymous namespace
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput of the bitcode readers, the translator and MetadataExtractor,
+// in bytes of input per second and heap allocations per MiB of input.
+//
+// The benchmarks run over generated modules of a few sizes, and over the
+// bitcode files named on the command line, e.g.
+//   bcinfo_reader_benchmarks tests/libbcc/*.bc legacy/*.bc
+// or, if none are named, over the legacy samples installed next to the
+// binary (see bcinfo_legacy_bitcode_samples).
+// Files whose wrapper targets an API level below 16 are run through the
+// 2.7 or 3.0 reader and the translator; the others through the lazy reader
+// (as used by bcc::Source::CreateFromBuffer), the translator and
+// MetadataExtractor.
+
+#include "bcinfo/BitcodeTranslator.h"
+#include "bcinfo/BitcodeWrapper.h"
+#include "bcinfo/MetadataExtractor.h"
+
+#include "BitReader_2_7/BitReader_2_7.h"
+#include "BitReader_3_0/BitReader_3_0.h"
+
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Count heap allocations, for allocations per MiB.
+static std::atomic<size_t> gAllocations(0);
+
+void *operator new(size_t size) {
+  ++gAllocations;
+  void *p = malloc(size ? size : 1);
+  if (p == nullptr) {
+    abort();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+namespace {
+
+// Target API of current bitcode, for the translator.
+const unsigned kCurrentAPIVersion = 10000;
+
+// Installed next to the binary by bcinfo_legacy_bitcode_samples.
+const char *const kLegacySamples[] = { "legacy_2_7.bc", "legacy_3_0.bc" };
+
+typedef bool (*ReadFunction)(const std::vector<char> &bitcode, unsigned targetAPI);
+
+// A generated module of numKernels exported kernels, each doing
+// numInstructions floating point operations, wrapped for API 24.
+std::vector<char> makeBitcode(unsigned numKernels, unsigned numInstructions) {
+  llvm::LLVMContext context;
+  llvm::Module module("generated", context);
+  llvm::IRBuilder<> builder(context);
+  llvm::Type *floatTy = builder.getFloatTy();
+  llvm::FunctionType *kernelTy = llvm::FunctionType::get(floatTy, {floatTy}, false);
+
+  llvm::NamedMDNode *names = module.getOrInsertNamedMetadata("#rs_export_foreach_name");
+  llvm::NamedMDNode *signatures = module.getOrInsertNamedMetadata("#rs_export_foreach");
+  for (unsigned i = 0; i < numKernels; ++i) {
+    std::string name = "kernel" + std::to_string(i);
+    llvm::Function *kernel = llvm::Function::Create(
+        kernelTy, llvm::GlobalValue::ExternalLinkage, name, &module);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", kernel));
+    llvm::Value *value = &*kernel->arg_begin();
+    for (unsigned j = 0; j < numInstructions; ++j) {
+      llvm::Value *constant = llvm::ConstantFP::get(floatTy, 1.0 + j);
+      value = (j % 2) ? builder.CreateFAdd(value, constant)
+                      : builder.CreateFMul(value, constant);
+    }
+    builder.CreateRet(value);
+
+    names->addOperand(llvm::MDNode::get(context, {llvm::MDString::get(context, name)}));
+    // IN | OUT | KERNEL
+    signatures->addOperand(llvm::MDNode::get(context, {llvm::MDString::get(context, "35")}));
+  }
+
+  std::string bitcode;
+  llvm::raw_string_ostream OS(bitcode);
+  llvm::WriteBitcodeToFile(&module, OS);
+  OS.flush();
+
+  std::vector<char> buffer(sizeof(bcinfo::AndroidBitcodeWrapper) + bitcode.size());
+  bcinfo::writeAndroidBitcodeWrapper(
+      reinterpret_cast<bcinfo::AndroidBitcodeWrapper *>(buffer.data()),
+      bitcode.size(), 24, 2300, 3);
+  std::copy(bitcode.begin(), bitcode.end(), buffer.begin() + sizeof(bcinfo::AndroidBitcodeWrapper));
+  return buffer;
+}
+
+bool readFile(const char *path, std::vector<char> *buffer) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    buffer->insert(buffer->end(), chunk, chunk + n);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+llvm::MemoryBufferRef getBufferRef(const std::vector<char> &bitcode) {
+  return llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), "");
+}
+
+bool read_2_7(const std::vector<char> &bitcode, unsigned) {
+  llvm::LLVMContext context;
+  return bool(llvm_2_7::parseBitcodeFile(getBufferRef(bitcode), context));
+}
+
+bool read_3_0(const std::vector<char> &bitcode, unsigned) {
+  llvm::LLVMContext context;
+  return bool(llvm_3_0::parseBitcodeFile(getBufferRef(bitcode), context));
+}
+
+// As bcc::Source::CreateFromBuffer, then materializing the functions, as
+// compiling the script does.
+bool readLazy(const std::vector<char> &bitcode, unsigned) {
+  llvm::LLVMContext context;
+  llvm::ErrorOr<std::unique_ptr<llvm::Module>> module = llvm::getLazyBitcodeModule(
+      llvm::MemoryBuffer::getMemBuffer(getBufferRef(bitcode), false), context);
+  return module && !module.get()->materializeAll();
+}
+
+bool translate(const std::vector<char> &bitcode, unsigned targetAPI) {
+  bcinfo::BitcodeTranslator translator(bitcode.data(), bitcode.size(), targetAPI);
+  return translator.translate();
+}
+
+bool extractMetadata(const std::vector<char> &bitcode, unsigned) {
+  bcinfo::MetadataExtractor extractor(bitcode.data(), bitcode.size());
+  return extractor.extract();
+}
+
+void runRead(benchmark::State &state, ReadFunction read, unsigned targetAPI,
+             std::shared_ptr<std::vector<char>> bitcode) {
+  size_t allocations = 0;
+  while (state.KeepRunning()) {
+    size_t before = gAllocations;
+    if (!read(*bitcode, targetAPI)) {
+      state.SkipWithError("could not read bitcode");
+      break;
+    }
+    allocations += gAllocations - before;
+  }
+
+  double bytes = static_cast<double>(state.iterations()) * bitcode->size();
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+  if (bytes > 0) {
+    state.counters["allocs/MiB"] = allocations / (bytes / (1024 * 1024));
+  }
+}
+
+void registerReads(const std::string &sample, std::shared_ptr<std::vector<char>> bitcode) {
+  // Unwrapped bitcode is taken to be current.
+  bcinfo::BitcodeWrapperHeader header(bitcode->data(), bitcode->size());
+  unsigned targetAPI = (header.getBCFileType() == bcinfo::BC_WRAPPER) ?
+      header.getTargetAPI() : kCurrentAPIVersion;
+  bool is_2_7 = targetAPI >= 11 && targetAPI < 14;
+  bool is_3_0 = targetAPI >= 14 && targetAPI < 16;
+  bool isCurrent = !is_2_7 && !is_3_0;
+
+  const struct {
+    const char *name;
+    ReadFunction read;
+    bool applies;
+  } reads[] = {
+    { "BM_Read_2_7",        read_2_7,        is_2_7 },
+    { "BM_Read_3_0",        read_3_0,        is_3_0 },
+    { "BM_ReadLazy",        readLazy,        isCurrent },
+    { "BM_Translate",       translate,       true },
+    { "BM_ExtractMetadata", extractMetadata, isCurrent },
+  };
+  for (const auto &read : reads) {
+    if (read.applies) {
+      benchmark::RegisterBenchmark((std::string(read.name) + "/" + sample).c_str(),
+                                   runRead, read.read, targetAPI, bitcode);
+    }
+  }
+}
+
+}  // end anonymous namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+
+  const unsigned sizes[][2] = { { 8, 16 }, { 64, 256 }, { 256, 1024 } };
+  for (const auto &size : sizes) {
+    std::string name = "generated_" + std::to_string(size[0]) + "x" + std::to_string(size[1]);
+    registerReads(name, std::make_shared<std::vector<char>>(makeBitcode(size[0], size[1])));
+  }
+
+  std::vector<std::string> files(argv + 1, argv + argc);
+  if (files.empty()) {
+    std::string dir(argv[0]);
+    size_t slash = dir.rfind('/');
+    dir = (slash == std::string::npos) ? "." : dir.substr(0, slash);
+    for (const char *sample : kLegacySamples) {
+      files.push_back(dir + "/" + sample);
+    }
+  }
+
+  for (const std::string &file : files) {
+    auto bitcode = std::make_shared<std::vector<char>>();
+    if (!readFile(file.c_str(), bitcode.get())) {
+      fprintf(stderr, "Could not read %s\n", file.c_str());
+      return 1;
+    }
+    registerReads(file, bitcode);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
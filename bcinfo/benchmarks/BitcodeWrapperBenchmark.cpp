@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cost of reading the wrapper of a bitcode buffer, which every compile does
+// several times (RSCompilerDriver::build, Source::CreateFromBuffer,
+// MetadataExtractor, BitcodeTranslator).  BM_BitcodeWrapperer measures the
+// previous implementation, which copied the start of the buffer into a
+// 1024-byte heap buffer.
+
+#include "bcinfo/BitcodeWrapper.h"
+#include "bcinfo/Wrap/bitcode_wrapperer.h"
+#include "bcinfo/Wrap/in_memory_wrapper_input.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+// A wrapped module of 16KiB of (fake) bitcode.
+std::vector<char> makeWrappedBitcode() {
+  std::vector<char> buffer(sizeof(bcinfo::AndroidBitcodeWrapper) + 16 * 1024);
+  bcinfo::writeAndroidBitcodeWrapper(
+      reinterpret_cast<bcinfo::AndroidBitcodeWrapper *>(buffer.data()),
+      buffer.size() - sizeof(bcinfo::AndroidBitcodeWrapper), 24, 2300, 3);
+  return buffer;
+}
+
+void BM_BitcodeWrapperer(benchmark::State &state) {
+  std::vector<char> buffer = makeWrappedBitcode();
+  while (state.KeepRunning()) {
+    InMemoryWrapperInput inMem(buffer.data(), buffer.size());
+    BitcodeWrapperer wrapperer(&inMem, nullptr);
+    benchmark::DoNotOptimize(wrapperer.IsInputBitcodeWrapper());
+    benchmark::DoNotOptimize(wrapperer.getAndroidCompilerVersion());
+  }
+}
+BENCHMARK(BM_BitcodeWrapperer);
+
+void BM_BitcodeWrapper(benchmark::State &state) {
+  std::vector<char> buffer = makeWrappedBitcode();
+  while (state.KeepRunning()) {
+    bcinfo::BitcodeWrapper wrapper(buffer.data(), buffer.size());
+    benchmark::DoNotOptimize(wrapper.getCompilerVersion());
+  }
+}
+BENCHMARK(BM_BitcodeWrapper);
+
+void BM_BitcodeWrapperHeader(benchmark::State &state) {
+  std::vector<char> buffer = makeWrappedBitcode();
+  while (state.KeepRunning()) {
+    bcinfo::BitcodeWrapperHeader header(buffer.data(), buffer.size());
+    benchmark::DoNotOptimize(header.getCompilerVersion());
+  }
+}
+BENCHMARK(BM_BitcodeWrapperHeader);
+
+}  // end anonymous namespace
+
+BENCHMARK_MAIN();
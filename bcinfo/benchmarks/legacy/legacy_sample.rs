@@ -0,0 +1,49 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compiled for target APIs 13 and 15, which llvm-rs-cc writes in the
+// formats of the 2.7 and 3.0 readers, as sample input of
+// bcinfo_reader_benchmarks.  Only uses APIs available at level 11.
+
+#pragma version(1)
+#pragma rs java_package_name(com.android.rs.bcinfo.benchmarks)
+
+float gain = 1.f;
+float3 tint;
+int radius = 2;
+rs_allocation input;
+
+static float3 blur(uint32_t x, uint32_t y) {
+    float3 sum = 0.f;
+    int count = 0;
+    for (int dy = -radius; dy <= radius; dy++) {
+        for (int dx = -radius; dx <= radius; dx++) {
+            const uchar4 *p = (const uchar4 *) rsGetElementAt(input, x + dx, y + dy);
+            sum += rsUnpackColor8888(*p).rgb;
+            count++;
+        }
+    }
+    return sum / (float) count;
+}
+
+void root(const uchar4 *in, uchar4 *out, uint32_t x, uint32_t y) {
+    float3 color = blur(x, y) * tint * gain;
+    *out = rsPackColorTo8888(clamp(color, 0.f, 1.f));
+}
+
+void setGain(float g) {
+    gain = g;
+}
@@ -18,6 +18,11 @@
 #define __ANDROID_BCINFO_BITCODETRANSLATOR_H__
 
 #include <cstddef>
+#include <string>
+
+namespace llvm {
+  class MemoryBuffer;
+}  // end namespace llvm
 
 namespace bcinfo {
 
@@ -29,6 +34,15 @@ class BitcodeTranslator {
   size_t mTranslatedBitcodeSize;
   unsigned int mVersion;
 
+  // Directory of the translated bitcode cache (empty if disabled).
+  std::string mCacheDir;
+  // Cached translated bitcode that mTranslatedBitcode points into, if any.
+  llvm::MemoryBuffer *mCachedBitcode;
+
+  std::string getCachePath() const;
+  bool loadFromCache(const std::string &path);
+  void storeInCache(const std::string &path) const;
+
  public:
   /**
    * Translates \p bitcode of a particular \p version to the latest version.
@@ -42,6 +56,21 @@ class BitcodeTranslator {
 
   ~BitcodeTranslator();
 
+  /**
+   * Enables the cache of translated bitcode in \p cacheDir.
+   *
+   * Legacy bitcode (target API below 16) is normally parsed with the
+   * matching legacy reader and written back out on every translation.  With
+   * a cache directory, the result is stored there, keyed on the content of
+   * the bitcode, its target API and the version of the translator, and later
+   * translations of the same bitcode map the stored result instead.
+   *
+   * \param cacheDir - an existing directory writable by the caller.
+   */
+  void setCacheDir(const char *cacheDir) {
+    mCacheDir = cacheDir ? cacheDir : "";
+  }
+
   /**
    * Translate the supplied bitcode to the latest supported version.
    *
@@ -46,6 +46,88 @@ enum BCFileType {
   BC_RAW = 2
 };
 
+/**
+ * Non-owning view of the header of a (possibly wrapped) bitcode buffer.
+ *
+ * The AndroidBitcodeWrapper fields are decoded in place, as little-endian
+ * words regardless of the host byte order, without copying the buffer or
+ * allocating memory.
+ */
+class BitcodeWrapperHeader {
+ private:
+  enum BCFileType mFileType;
+  uint32_t mBitcodeOffset;
+  uint32_t mBitcodeSize;
+
+  uint32_t mHeaderVersion;
+  uint32_t mTargetAPI;
+  uint32_t mCompilerVersion;
+  uint32_t mOptimizationLevel;
+
+ public:
+  /**
+   * Decodes the header of \p bitcode.
+   *
+   * \param bitcode - input bitcode string.
+   * \param bitcodeSize - length of \p bitcode string (in bytes).
+   */
+  BitcodeWrapperHeader(const char *bitcode, size_t bitcodeSize);
+
+  /**
+   * \return type of bitcode file.
+   */
+  enum BCFileType getBCFileType() const {
+    return mFileType;
+  }
+
+  /**
+   * \return offset of the raw bitcode in the buffer (0 if unwrapped).
+   */
+  uint32_t getBitcodeOffset() const {
+    return mBitcodeOffset;
+  }
+
+  /**
+   * \return size of the raw bitcode, as recorded in the wrapper (or the
+   * size of the buffer if unwrapped).
+   */
+  uint32_t getBitcodeSize() const {
+    return mBitcodeSize;
+  }
+
+  /**
+   * \return header version of bitcode wrapper.
+   */
+  uint32_t getHeaderVersion() const {
+    return mHeaderVersion;
+  }
+
+  /**
+   * \return target API version for this bitcode.
+   */
+  uint32_t getTargetAPI() const {
+    return mTargetAPI;
+  }
+
+  /**
+   * \return compiler version that generated this bitcode.
+   */
+  uint32_t getCompilerVersion() const {
+    return mCompilerVersion;
+  }
+
+  /**
+   * \return compiler optimization level for this bitcode.
+   */
+  uint32_t getOptimizationLevel() const {
+    return mOptimizationLevel;
+  }
+};
+
+/**
+ * Wrapper information of a bitcode buffer.  Kept for existing callers; new
+ * code should use BitcodeWrapperHeader.
+ */
 class BitcodeWrapper {
  private:
   enum BCFileType mFileType;
@@ -72,6 +72,11 @@ class BitcodeWrapperer {
   // outfile. Return true on success.
   bool GenerateRawBitcodeFile();
 
+  // Returns true if the input could not be read, or is not bitcode.
+  bool HasError() const {
+    return error_;
+  }
+
   // Print current wrapper header fields to stderr for debugging.
   void PrintWrapperHeader();
 
@@ -153,6 +158,11 @@ class BitcodeWrapperer {
   // Copies size bytes of infile to outfile, using the buffer.
   bool BufferCopyInToOut(uint32_t size);
 
+  // Copies size bytes at offset pos of infile to outfile, within the
+  // kernel or straight from memory if the input and output allow it,
+  // and through the buffer otherwise.
+  bool CopyInToOut(uint32_t pos, uint32_t size);
+
   // Discards the old infile and replaces it with the given file.
   void ReplaceInFile(WrapperInput* new_infile);
 
@@ -29,17 +29,21 @@ class FileWrapperInput : public WrapperInput {
  public:
   explicit FileWrapperInput(const char* _name);
   ~FileWrapperInput();
+  // Returns true if the file was opened. If not, reads fail.
+  bool IsOpen() const { return _file != nullptr; }
   // Tries to read the requested number of bytes into the buffer. Returns the
   // actual number of bytes read.
   virtual size_t Read(uint8_t* buffer, size_t wanted);
   // Returns true if at end of file. Note: May return false
   // until Read is called, and returns 0.
   virtual bool AtEof();
-  // Returns the size of the file (in bytes).
+  // Returns the size of the file (in bytes), or -1 if unknown.
   virtual off_t Size();
   // Moves to the given offset within the file. Returns
   // false if unable to move to that position.
   virtual bool Seek(uint32_t pos);
+  // Returns the file descriptor of the file.
+  virtual int Fd();
  private:
   // The name of the file.
   const char* _name;
@@ -29,11 +29,18 @@ class FileWrapperOutput : public WrapperOutput {
  public:
   explicit FileWrapperOutput(const char* name);
   ~FileWrapperOutput();
+  // Returns true if the file was opened. If not, writes fail.
+  bool IsOpen() const { return _file != nullptr; }
+  // Flushes and closes the file. Returns false if any write failed.
+  bool Close();
   // Writes a single byte, returning false if unable to write.
   virtual bool Write(uint8_t byte);
   // Writes the specified number of bytes in the buffer to
   // output. Returns false if unable to write.
   virtual bool Write(const uint8_t* buffer, size_t buffer_size);
+  // Copies size bytes at offset pos of input with copy_file_range or
+  // sendfile, if input is a file. Returns the number of bytes copied.
+  virtual size_t CopyFrom(WrapperInput* input, off_t pos, size_t size);
  private:
   // The name of the file
   const char* _name;
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Defines utility allowing memory-mapped files for bitcode input wrapping.
+
+#ifndef MAPPED_WRAPPER_INPUT_H__
+#define MAPPED_WRAPPER_INPUT_H__
+
+#include "bcinfo/Wrap/support_macros.h"
+#include "bcinfo/Wrap/wrapper_input.h"
+
+// Define a class to wrap named files, mapping them in memory so that the
+// bitcode can be copied out of them in one go (or within the kernel).
+class MappedWrapperInput : public WrapperInput {
+ public:
+  explicit MappedWrapperInput(const char* name);
+  ~MappedWrapperInput();
+  // Returns true if the file was opened and mapped. If not, reads fail.
+  bool IsOpen() const { return _fd >= 0; }
+  // Tries to read the requested number of bytes into the buffer. Returns the
+  // actual number of bytes read.
+  virtual size_t Read(uint8_t* buffer, size_t wanted);
+  // Returns true if at end of file.
+  virtual bool AtEof();
+  // Returns the size of the file (in bytes), or -1 if it could not be
+  // mapped.
+  virtual off_t Size();
+  // Moves to the given offset within the file. Returns
+  // false if unable to move to that position.
+  virtual bool Seek(uint32_t pos);
+  // Returns the contents of the file.
+  virtual const uint8_t* Data();
+  // Returns the file descriptor of the file.
+  virtual int Fd();
+ private:
+  // The corresponding (opened) file.
+  int _fd;
+  // The mapped contents of the file.
+  uint8_t* _data;
+  // The size of the file.
+  size_t _size;
+  // The position in the file.
+  size_t _pos;
+ private:
+  DISALLOW_CLASS_COPY_AND_ASSIGN(MappedWrapperInput);
+};
+
+#endif // MAPPED_WRAPPER_INPUT_H__
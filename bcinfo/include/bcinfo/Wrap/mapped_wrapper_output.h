@@ -0,0 +1,63 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Defines utility allowing memory-mapped files for bitcode output wrapping.
+
+#ifndef MAPPED_WRAPPER_OUTPUT_H__
+#define MAPPED_WRAPPER_OUTPUT_H__
+
+#include "bcinfo/Wrap/support_macros.h"
+#include "bcinfo/Wrap/wrapper_output.h"
+
+// Define a class to wrap named files, mapping them in memory so that each
+// write is a single copy into the file. The file is grown (and remapped)
+// as needed, and truncated to the bytes written when it is closed. Growing
+// the file allocates its blocks, so that running out of space fails the
+// write instead of faulting in the copy.
+class MappedWrapperOutput : public WrapperOutput {
+ public:
+  // size_hint is the expected size of the output, if known, to avoid
+  // remapping the file while writing it.
+  explicit MappedWrapperOutput(const char* name, size_t size_hint = 0);
+  ~MappedWrapperOutput();
+  // Returns true if the file was opened. If not, writes fail.
+  bool IsOpen() const { return _fd >= 0; }
+  // Unmaps, truncates and closes the file. Returns false if any write
+  // failed.
+  bool Close();
+  // Writes a single byte, returning false if unable to write.
+  virtual bool Write(uint8_t byte);
+  // Writes the specified number of bytes in the buffer to
+  // output. Returns false if unable to write.
+  virtual bool Write(const uint8_t* buffer, size_t buffer_size);
+ private:
+  // Grows the file and its mapping to hold at least size bytes.
+  bool Reserve(size_t size);
+  // The corresponding (opened) file.
+  int _fd;
+  // The mapped contents of the file.
+  uint8_t* _data;
+  // The size of the file (and of the mapping).
+  size_t _capacity;
+  // The number of bytes written.
+  size_t _size;
+  // True if a write failed.
+  bool _error;
+ private:
+  DISALLOW_CLASS_COPY_AND_ASSIGN(MappedWrapperOutput);
+};
+
+#endif // MAPPED_WRAPPER_OUTPUT_H__
@@ -42,6 +42,12 @@ class WrapperInput {
   // Moves to the given offset within the input region. Returns false
   // if unable to move to that position.
   virtual bool Seek(uint32_t pos) = 0;
+  // Returns the whole input if it is in memory (so that it can be
+  // copied without going through Read), or nullptr.
+  virtual const uint8_t* Data() { return nullptr; }
+  // Returns the file descriptor of the input if it is a file (so that
+  // it can be copied within the kernel), or -1.
+  virtual int Fd() { return -1; }
  private:
   DISALLOW_CLASS_COPY_AND_ASSIGN(WrapperInput);
 };
@@ -25,6 +25,7 @@
 #include <stddef.h>
 
 #include "bcinfo/Wrap/support_macros.h"
+#include "bcinfo/Wrap/wrapper_input.h"
 
 // The following is a generic interface to a file/memory region
 // that contains a generated bitcode file, wrapped bitcode file,
@@ -38,6 +39,13 @@ class WrapperOutput {
   // Writes the specified number of bytes in the buffer to
   // output. Returns false if unable to write.
   virtual bool Write(const uint8_t* buffer, size_t buffer_size);
+  // Copies size bytes at offset pos of input to the output without
+  // going through user space, if both sides allow it. Returns the
+  // number of bytes copied, which is less than size (possibly 0) if the
+  // rest must be copied through Write.
+  virtual size_t CopyFrom(WrapperInput* input, off_t pos, size_t size) {
+    return 0;
+  }
  private:
   DISALLOW_CLASS_COPY_AND_ASSIGN(WrapperOutput);
 };
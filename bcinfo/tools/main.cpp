@@ -43,15 +43,29 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 
 // This file corresponds to the standalone bcinfo tool. It prints a variety of
 // information about a supplied bitcode input file.
+//
+// With -J, it instead processes any number of input files and directories
+// (searched for .bc files) on several threads, and writes a JSON document
+// describing each input.  Disassembly (.ll files) is then only written if -v
+// is given.
 
 std::string inFile;
 std::string outFile;
 std::string infoFile;
+std::string cacheDir;
+
+// Batch mode.
+std::vector<std::string> inFiles;
+std::string jsonFile;
+unsigned jobs = 0;
 
 extern int opterr;
 extern int optind;
@@ -59,10 +73,19 @@ extern int optind;
 bool translateFlag = false;
 bool infoFlag = false;
 bool verbose = true;
+bool verboseFlag = false;
+
+static std::string getOutputName(const std::string &in, const char *ext) {
+  int l = in.length();
+  if (l > 3 && in[l-3] == '.' && in[l-2] == 'b' && in[l-1] == 'c') {
+    return std::string(in.begin(), in.end() - 3) + ext;
+  }
+  return in + ext;
+}
 
 static int parseOption(int argc, char** argv) {
   int c;
-  while ((c = getopt(argc, argv, "itv")) != -1) {
+  while ((c = getopt(argc, argv, "itvc:J:j:")) != -1) {
     opterr = 0;
 
     switch(c) {
@@ -82,6 +105,23 @@ static int parseOption(int argc, char** argv) {
 
       case 'v':
         verbose = true;
+        verboseFlag = true;
+        break;
+
+      case 'J':
+        // Batch mode: write a JSON description of all inputs to this file
+        // ("-" for stdout).
+        jsonFile = optarg;
+        break;
+
+      case 'j':
+        // Number of threads for batch mode (default: one per CPU).
+        jobs = strtoul(optarg, nullptr, 10);
+        break;
+
+      case 'c':
+        // Cache translated legacy bitcode in this directory.
+        cacheDir = optarg;
         break;
 
       default:
@@ -96,16 +136,19 @@ static int parseOption(int argc, char** argv) {
     return 0;
   }
 
-  inFile = argv[optind];
+  if (!jsonFile.empty()) {
+    inFiles.assign(argv + optind, argv + argc);
+    return 1;
+  }
 
-  int l = inFile.length();
-  if (l > 3 && inFile[l-3] == '.' && inFile[l-2] == 'b' && inFile[l-1] == 'c') {
-    outFile = std::string(inFile.begin(), inFile.end() - 3) + ".ll";
-    infoFile = std::string(inFile.begin(), inFile.end() - 3) + ".bcinfo";
-  } else {
-    outFile = inFile + ".ll";
-    infoFile = inFile + ".bcinfo";
+  if (optind + 1 < argc) {
+    fprintf(stderr, "multiple input files require -J\n");
+    return 0;
   }
+
+  inFile = argv[optind];
+  outFile = getOutputName(inFile, ".ll");
+  infoFile = getOutputName(inFile, ".bcinfo");
   return 1;
 }
 
@@ -115,7 +158,8 @@ static void dumpReduceInfo(FILE *info, const char *Kind, const char *Name) {
     fprintf(info, "  %s(%s)\n", Kind, Name);
 }
 
-static int dumpInfo(bcinfo::MetadataExtractor *ME) {
+static int dumpInfo(bcinfo::MetadataExtractor *ME,
+                    const std::string &infoFile) {
   if (!ME) {
     return 1;
   }
@@ -249,7 +293,7 @@ static void dumpMetadata(bcinfo::MetadataExtractor *ME) {
 }
 
 
-static size_t readBitcode(const char **bitcode) {
+static size_t readBitcode(const std::string &inFile, const char **bitcode) {
   if (!inFile.length()) {
     fprintf(stderr, "input file required\n");
     return 0;
@@ -257,12 +301,14 @@ static size_t readBitcode(const char **bitcode) {
 
   struct stat statInFile;
   if (stat(inFile.c_str(), &statInFile) < 0) {
-    fprintf(stderr, "Unable to stat input file: %s\n", strerror(errno));
+    fprintf(stderr, "Unable to stat input file %s: %s\n", inFile.c_str(),
+            strerror(errno));
     return 0;
   }
 
   if (!S_ISREG(statInFile.st_mode)) {
-    fprintf(stderr, "Input file should be a regular file.\n");
+    fprintf(stderr, "Input file %s should be a regular file.\n",
+            inFile.c_str());
     return 0;
   }
 
@@ -293,6 +339,368 @@ static void releaseBitcode(const char **bitcode) {
   return;
 }
 
+// Appends pString to pOut as a JSON string (or null).
+static void appendJSONString(std::string &pOut, const char *pString) {
+  if (!pString) {
+    pOut += "null";
+    return;
+  }
+
+  pOut += '"';
+  for (const char *c = pString; *c; ++c) {
+    switch (*c) {
+      case '"':  pOut += "\\\""; break;
+      case '\\': pOut += "\\\\"; break;
+      case '\n': pOut += "\\n"; break;
+      case '\t': pOut += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(*c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x",
+                   static_cast<unsigned char>(*c));
+          pOut += escaped;
+        } else {
+          pOut += *c;
+        }
+        break;
+    }
+  }
+  pOut += '"';
+}
+
+static void appendJSONKey(std::string &pOut, const char *pKey) {
+  appendJSONString(pOut, pKey);
+  pOut += ": ";
+}
+
+static void appendJSONNumber(std::string &pOut, unsigned long pNumber) {
+  char number[32];
+  snprintf(number, sizeof(number), "%lu", pNumber);
+  pOut += number;
+}
+
+static void appendJSONStringList(std::string &pOut, const char **pList,
+                                 size_t pCount) {
+  pOut += "[";
+  for (size_t i = 0; i < pCount; i++) {
+    if (i) {
+      pOut += ", ";
+    }
+    appendJSONString(pOut, pList[i]);
+  }
+  pOut += "]";
+}
+
+// Appends the JSON description of the metadata of one input (without the
+// enclosing braces).
+static void appendJSONMetadata(std::string &out,
+                               const bcinfo::MetadataExtractor *ME) {
+  appendJSONKey(out, "floatPrecision");
+  appendJSONString(out,
+                   ME->getRSFloatPrecision() == bcinfo::RS_FP_Relaxed ?
+                   "relaxed" : "full");
+
+  out += ",\n    ";
+  appendJSONKey(out, "exportVars");
+  appendJSONStringList(out, ME->getExportVarNameList(),
+                       ME->getExportVarCount());
+
+  out += ",\n    ";
+  appendJSONKey(out, "exportFuncs");
+  appendJSONStringList(out, ME->getExportFuncNameList(),
+                       ME->getExportFuncCount());
+
+  out += ",\n    ";
+  appendJSONKey(out, "exportForEach");
+  out += "[";
+  const char **nameList = ME->getExportForEachNameList();
+  const uint32_t *sigList = ME->getExportForEachSignatureList();
+  const uint32_t *inputCountList = ME->getExportForEachInputCountList();
+  for (size_t i = 0; i < ME->getExportForEachSignatureCount(); i++) {
+    out += i ? ", {" : "{";
+    appendJSONKey(out, "name");
+    appendJSONString(out, nameList[i]);
+    out += ", ";
+    appendJSONKey(out, "signature");
+    appendJSONNumber(out, sigList[i]);
+    out += ", ";
+    appendJSONKey(out, "inputCount");
+    appendJSONNumber(out, inputCountList[i]);
+    out += "}";
+  }
+  out += "]";
+
+  out += ",\n    ";
+  appendJSONKey(out, "exportReduce");
+  out += "[";
+  const bcinfo::MetadataExtractor::Reduce *reduceList =
+      ME->getExportReduceList();
+  for (size_t i = 0; i < ME->getExportReduceCount(); i++) {
+    const bcinfo::MetadataExtractor::Reduce &reduce = reduceList[i];
+    out += i ? ", {" : "{";
+    appendJSONKey(out, "name");
+    appendJSONString(out, reduce.mReduceName);
+    out += ", ";
+    appendJSONKey(out, "signature");
+    appendJSONNumber(out, reduce.mSignature);
+    out += ", ";
+    appendJSONKey(out, "inputCount");
+    appendJSONNumber(out, reduce.mInputCount);
+    out += ", ";
+    appendJSONKey(out, "accumulatorDataSize");
+    appendJSONNumber(out, reduce.mAccumulatorDataSize);
+    out += ", ";
+    appendJSONKey(out, "initializer");
+    appendJSONString(out, reduce.mInitializerName);
+    out += ", ";
+    appendJSONKey(out, "accumulator");
+    appendJSONString(out, reduce.mAccumulatorName);
+    out += ", ";
+    appendJSONKey(out, "combiner");
+    appendJSONString(out, reduce.mCombinerName);
+    out += ", ";
+    appendJSONKey(out, "outconverter");
+    appendJSONString(out, reduce.mOutConverterName);
+    out += ", ";
+    appendJSONKey(out, "halter");
+    appendJSONString(out, reduce.mHalterName);
+    out += "}";
+  }
+  out += "]";
+
+  out += ",\n    ";
+  appendJSONKey(out, "pragmas");
+  out += "[";
+  const char **keyList = ME->getPragmaKeyList();
+  const char **valueList = ME->getPragmaValueList();
+  for (size_t i = 0; i < ME->getPragmaCount(); i++) {
+    out += i ? ", {" : "{";
+    appendJSONKey(out, "key");
+    appendJSONString(out, keyList[i]);
+    out += ", ";
+    appendJSONKey(out, "value");
+    appendJSONString(out, valueList[i]);
+    out += "}";
+  }
+  out += "]";
+
+  out += ",\n    ";
+  appendJSONKey(out, "objectSlots");
+  out += "[";
+  const uint32_t *slotList = ME->getObjectSlotList();
+  for (size_t i = 0; i < ME->getObjectSlotCount(); i++) {
+    if (i) {
+      out += ", ";
+    }
+    appendJSONNumber(out, slotList[i]);
+  }
+  out += "]";
+
+  out += ",\n    ";
+  appendJSONKey(out, "threadable");
+  out += ME->isThreadable() ? "true" : "false";
+
+  out += ",\n    ";
+  appendJSONKey(out, "buildChecksum");
+  appendJSONString(out, ME->getBuildChecksum());
+}
+
+// Processes one input of batch mode with the context of the calling worker,
+// setting pJSON to its JSON description.  Only the metadata is read from the
+// bitcode unless disassembly (-v) was requested.
+static bool processBatchInput(const std::string &inFile,
+                              llvm::LLVMContext &ctx, std::string *pJSON) {
+  std::string &out = *pJSON;
+  out = "  {";
+  appendJSONKey(out, "file");
+  appendJSONString(out, inFile.c_str());
+  out += ",\n    ";
+
+  const char *bitcode = nullptr;
+  size_t bitcodeSize = readBitcode(inFile, &bitcode);
+  if (!bitcodeSize) {
+    releaseBitcode(&bitcode);
+    appendJSONKey(out, "error");
+    appendJSONString(out, "failed to read bitcode");
+    out += "}";
+    return false;
+  }
+
+  unsigned int version = 0;
+  bcinfo::BitcodeWrapperHeader bcWrapper(bitcode, bitcodeSize);
+  if (bcWrapper.getBCFileType() == bcinfo::BC_WRAPPER) {
+    version = bcWrapper.getTargetAPI();
+  } else if (translateFlag) {
+    version = 12;
+  }
+
+  appendJSONKey(out, "targetAPI");
+  appendJSONNumber(out, version);
+  out += ", ";
+  appendJSONKey(out, "compilerVersion");
+  appendJSONNumber(out, bcWrapper.getCompilerVersion());
+  out += ", ";
+  appendJSONKey(out, "optimizationLevel");
+  appendJSONNumber(out, bcWrapper.getOptimizationLevel());
+  out += ",\n    ";
+
+  const char *error = nullptr;
+  std::unique_ptr<bcinfo::BitcodeTranslator> BT(
+      new bcinfo::BitcodeTranslator(bitcode, bitcodeSize, version));
+  if (!cacheDir.empty()) {
+    BT->setCacheDir(cacheDir.c_str());
+  }
+  if (!BT->translate()) {
+    error = "failed to translate bitcode";
+  }
+
+  std::unique_ptr<llvm::Module> module;
+  if (!error) {
+    std::unique_ptr<llvm::MemoryBuffer> mem =
+        llvm::MemoryBuffer::getMemBuffer(
+            llvm::StringRef(BT->getTranslatedBitcode(),
+                            BT->getTranslatedBitcodeSize()),
+            inFile.c_str(), false);
+    // Function bodies are only needed for disassembly.
+    llvm::ErrorOr<std::unique_ptr<llvm::Module> > moduleOrError =
+        verboseFlag ? llvm::parseBitcodeFile(mem->getMemBufferRef(), ctx)
+                    : llvm::getLazyBitcodeModule(std::move(mem), ctx);
+    if (moduleOrError) {
+      module = std::move(moduleOrError.get());
+    } else {
+      error = "failed to parse bitcode";
+    }
+  }
+
+  std::unique_ptr<bcinfo::MetadataExtractor> ME;
+  if (!error) {
+    ME.reset(new bcinfo::MetadataExtractor(module.get()));
+    if (!ME->extract()) {
+      error = "failed to get metadata";
+    }
+  }
+
+  if (!error && verboseFlag) {
+    std::error_code ec;
+    llvm::tool_output_file tof(getOutputName(inFile, ".ll").c_str(), ec,
+                               llvm::sys::fs::F_None);
+    if (ec) {
+      error = "failed to write disassembly";
+    } else {
+      module->print(tof.os(), nullptr);
+      tof.keep();
+    }
+  }
+
+  if (!error && infoFlag &&
+      dumpInfo(ME.get(), getOutputName(inFile, ".bcinfo")) != 0) {
+    error = "failed to write info file";
+  }
+
+  if (error) {
+    fprintf(stderr, "%s: %s\n", inFile.c_str(), error);
+    appendJSONKey(out, "error");
+    appendJSONString(out, error);
+  } else {
+    appendJSONMetadata(out, ME.get());
+  }
+  out += "}";
+
+  // The metadata refers to the module, which may refer to the bitcode.
+  ME.reset();
+  module.reset();
+  BT.reset();
+  releaseBitcode(&bitcode);
+  return error == nullptr;
+}
+
+// Adds the input pPath, or the .bc files under it if it is a directory, to
+// pInputs.
+static bool collectBatchInputs(const std::string &pPath,
+                               std::vector<std::string> &pInputs) {
+  if (!llvm::sys::fs::is_directory(pPath)) {
+    pInputs.push_back(pPath);
+    return true;
+  }
+
+  std::vector<std::string> found;
+  std::error_code ec;
+  for (llvm::sys::fs::recursive_directory_iterator it(pPath, ec), end;
+       it != end && !ec; it.increment(ec)) {
+    llvm::StringRef path = it->path();
+    if (path.endswith(".bc") && !llvm::sys::fs::is_directory(path)) {
+      found.push_back(path.str());
+    }
+  }
+  if (ec) {
+    fprintf(stderr, "Could not read directory %s: %s\n", pPath.c_str(),
+            ec.message().c_str());
+    return false;
+  }
+
+  // Directory order is unspecified; keep the output stable.
+  std::sort(found.begin(), found.end());
+  pInputs.insert(pInputs.end(), found.begin(), found.end());
+  return true;
+}
+
+// Processes inFiles on a pool of jobs threads, each with its own
+// LLVMContext, and writes their descriptions, in order, to jsonFile.
+static int runBatch() {
+  std::vector<std::string> inputs;
+  for (const std::string &path : inFiles) {
+    if (!collectBatchInputs(path, inputs)) {
+      return 1;
+    }
+  }
+
+  unsigned threadCount = jobs ? jobs : std::thread::hardware_concurrency();
+  threadCount = std::max(1u, std::min<unsigned>(threadCount, inputs.size()));
+
+  std::vector<std::string> results(inputs.size());
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> failures(0);
+  auto worker = [&]() {
+    llvm::LLVMContext ctx;
+    for (size_t i = next++; i < inputs.size(); i = next++) {
+      if (!processBatchInput(inputs[i], ctx, &results[i])) {
+        failures++;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < threadCount; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  FILE *json = (jsonFile == "-") ? stdout : fopen(jsonFile.c_str(), "w");
+  if (!json) {
+    fprintf(stderr, "Could not open JSON file %s\n", jsonFile.c_str());
+    return 2;
+  }
+  fprintf(json, "{\"inputs\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    fprintf(json, "%s%s\n", results[i].c_str(),
+            (i + 1 < results.size()) ? "," : "");
+  }
+  fprintf(json, "]}\n");
+  if (json != stdout) {
+    fclose(json);
+  }
+
+  if (failures) {
+    fprintf(stderr, "%zu of %zu inputs failed\n", failures.load(),
+            inputs.size());
+    return 7;
+  }
+  return 0;
+}
+
 
 int main(int argc, char** argv) {
   if(!parseOption(argc, argv)) {
@@ -300,12 +708,17 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (!jsonFile.empty()) {
+    llvm::llvm_shutdown_obj called_on_exit;
+    return runBatch();
+  }
+
   const char *bitcode = nullptr;
-  size_t bitcodeSize = readBitcode(&bitcode);
+  size_t bitcodeSize = readBitcode(inFile, &bitcode);
 
   unsigned int version = 0;
 
-  bcinfo::BitcodeWrapper bcWrapper((const char *)bitcode, bitcodeSize);
+  bcinfo::BitcodeWrapperHeader bcWrapper((const char *)bitcode, bitcodeSize);
   if (bcWrapper.getBCFileType() == bcinfo::BC_WRAPPER) {
     version = bcWrapper.getTargetAPI();
     if (verbose) {
@@ -323,6 +736,9 @@ int main(int argc, char** argv) {
 
   std::unique_ptr<bcinfo::BitcodeTranslator> BT;
   BT.reset(new bcinfo::BitcodeTranslator(bitcode, bitcodeSize, version));
+  if (!cacheDir.empty()) {
+    BT->setCacheDir(cacheDir.c_str());
+  }
   if (!BT->translate()) {
     fprintf(stderr, "failed to translate bitcode\n");
     return 3;
@@ -381,7 +797,7 @@ int main(int argc, char** argv) {
   }
 
   if (infoFlag) {
-    if (dumpInfo(ME.get()) != 0) {
+    if (dumpInfo(ME.get(), infoFile) != 0) {
       fprintf(stderr, "Error dumping info file\n");
       return 6;
     }
@@ -17,6 +17,9 @@
 #ifndef BCC_COMPILER_H
 #define BCC_COMPILER_H
 
+#include <string>
+#include <vector>
+
 namespace llvm {
 
 class raw_ostream;
@@ -78,15 +81,22 @@ private:
   llvm::TargetMachine *mTarget;
   // Optimization is enabled by default.
   bool mEnableOpt;
+  // CPU feature levels to compile expanded kernels for (see CompilerConfig).
+  std::vector<std::string> mFeatureLevels;
 
   enum ErrorCode runPasses(Script &pScript, llvm::raw_pwrite_stream &pResult);
 
   bool addInternalizeSymbolsPass(Script &pScript, llvm::legacy::PassManager &pPM);
-  void addExpandKernelPass(llvm::legacy::PassManager &pPM);
+  void addAllocationAccessPass(llvm::legacy::PassManager &pPM);
+  void addExpandKernelPass(Script &pScript, llvm::legacy::PassManager &pPM);
   void addDebugInfoPass(Script &pScript, llvm::legacy::PassManager &pPM);
   void addGlobalInfoPass(Script &pScript, llvm::legacy::PassManager &pPM);
   void addInvariantPass(llvm::legacy::PassManager &pPM);
+  void addMultiversionPass(llvm::legacy::PassManager &pPM);
+  void addProfilePass(Script &pScript, llvm::legacy::PassManager &pPM);
+  void addRelaxedPrecisionPass(llvm::legacy::PassManager &pPM);
   void addInvokeHelperPass(llvm::legacy::PassManager &pPM);
+  void addSpecializeGlobalsPass(Script &pScript, llvm::legacy::PassManager &pPM);
 
 public:
   Compiler();
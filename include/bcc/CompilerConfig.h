@@ -58,6 +58,11 @@ private:
   // be a list of strings starting with '+' (enable) or '-' (disable).
   std::string mFeatureString;
 
+  // Names of additional CPU feature levels (e.g., "sse4.2", "avx2") to
+  // compile expanded kernels for, from lowest to highest.  The best level
+  // supported by the running CPU is selected at run time.
+  std::vector<std::string> mFeatureLevels;
+
   //===--------------------------------------------------------------------===//
   // These are generated by CompilerConfig during initialize().
   //===--------------------------------------------------------------------===//
@@ -118,6 +123,11 @@ public:
   { return mFeatureString; }
   void setFeatureString(const std::vector<std::string> &pAttrs);
 
+  inline const std::vector<std::string> &getFeatureLevels() const
+  { return mFeatureLevels; }
+  inline void setFeatureLevels(const std::vector<std::string> &pLevels)
+  { mFeatureLevels = pLevels; }
+
   explicit CompilerConfig(const std::string &pTriple);
 
   virtual ~CompilerConfig() { }
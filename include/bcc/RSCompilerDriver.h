@@ -33,6 +33,20 @@ class CompilerConfig;
 class RSCompilerDriver;
 class Source;
 
+// A kernel launch in a script group, as seen by
+// RSCompilerDriver::planScriptGroupFusion().
+struct ScriptGroupKernel {
+  // Index of the source containing the kernel, and the kernel's foreach slot.
+  int source;
+  int slot;
+  // For each input of the kernel, the index (into the list of kernels of the
+  // script group) of the kernel producing it, or -1 if the input comes from
+  // outside the script group. Producers must precede their consumers.
+  std::vector<int> inputProducers;
+  // Whether the output of the kernel is needed after the script group runs.
+  bool outputLive;
+};
+
 // Type signature for dynamically loaded initialization of an RSCompilerDriver.
 typedef void (*RSCompilerDriverInit_t) (bcc::RSCompilerDriver *);
 // Name of the function that we attempt to dynamically load/execute.
@@ -56,6 +70,10 @@ private:
   // and work with.
   bool mEnableGlobalMerge;
 
+  // Is the global merge option left for the caller to set, through
+  // setGlobalMergeOption(), instead of being set by each compilation?
+  bool mGlobalMergeSetByCaller;
+
   // Specifies whether we should embed global variable information in the
   // code via special RS variables that can be examined later by the driver.
   bool mEmbedGlobalInfo;
@@ -64,6 +82,27 @@ private:
   // when potentially embedding information about globals.
   bool mEmbedGlobalInfoSkipConstant;
 
+  // Specifies whether we should also embed a hash index of the names of the
+  // global variables when embedding information about globals.
+  bool mEmbedGlobalInfoIndex;
+
+  // Specifies whether the script information embedded in the code (.rs.info)
+  // should also be emitted in binary form (.rs.info.bin).
+  bool mEmbedBinaryInfo;
+
+  // Exported global variables to specialize the next builds for.
+  SpecializedGlobalMap mSpecializedGlobals;
+
+  // Foreach kernels to emit shape-specialized expanded functions for in the
+  // next builds.
+  ExpandShapeHintMap mExpandShapeHints;
+
+  // Do we instrument the next builds to collect an execution profile?
+  bool mProfileInstrument;
+
+  // Execution profile to optimize the next builds for.
+  std::vector<uint8_t> mProfileData;
+
   // Setup the compiler config for the given script. Return true if mConfig has
   // been changed and false if it remains unchanged.
   bool setupConfig(const Script &pScript);
@@ -111,6 +150,21 @@ public:
     return mEnableGlobalMerge;
   }
 
+  // The global merge setting is an LLVM option, shared by all drivers: each
+  // compilation sets it from its driver's setting, so drivers that compile
+  // concurrently race on it. Such drivers must all have the same setting, set
+  // it once with setGlobalMergeOption() before compiling, and be told not to
+  // set it themselves with setGlobalMergeSetByCaller(true).
+  static void setGlobalMergeOption(bool v);
+
+  void setGlobalMergeSetByCaller(bool v) {
+    mGlobalMergeSetByCaller = v;
+  }
+
+  bool getGlobalMergeSetByCaller() const {
+    return mGlobalMergeSetByCaller;
+  }
+
   const CompilerConfig * getConfig() const {
     return mConfig;
   }
@@ -137,6 +191,82 @@ public:
     return mEmbedGlobalInfoSkipConstant;
   }
 
+  // Set to true if we should also embed a hash index of the names of the
+  // global variables, when embedding information about globals.
+  void setEmbedGlobalInfoIndex(bool v) {
+    mEmbedGlobalInfoIndex = v;
+  }
+
+  // Returns true if we should also embed a hash index of the names of the
+  // global variables, when embedding information about globals.
+  bool getEmbedGlobalInfoIndex() const {
+    return mEmbedGlobalInfoIndex;
+  }
+
+  // Set to true if we should also embed the script information in binary form.
+  void setEmbedBinaryInfo(bool v) {
+    mEmbedBinaryInfo = v;
+  }
+
+  // Returns true if we should also embed the script information in binary form.
+  bool getEmbedBinaryInfo() const {
+    return mEmbedBinaryInfo;
+  }
+
+  // Compile the exported global variable pName as a constant with the
+  // pSize-byte value pValue (laid out as in memory), so that code using it
+  // can be folded. The script must not change the variable afterwards.
+  // Applies to all subsequent builds until clearSpecializedGlobals().
+  void setSpecializedGlobal(const char *pName, const void *pValue,
+                            size_t pSize);
+
+  void clearSpecializedGlobals() {
+    mSpecializedGlobals.clear();
+  }
+
+  // Also emit "<kernel>.expand.w<dimX>a<alignment>" for the foreach kernel
+  // pKernelName: a variant of "<kernel>.expand" for rows of pDimX cells
+  // starting at pAlignment-byte aligned addresses in every input and output,
+  // which ignores its x1 and x2 arguments. The driver may only call it for
+  // whole rows of that shape. Applies to all subsequent builds until
+  // clearExpandShapeHints().
+  void setExpandShapeHint(const char *pKernelName, uint32_t pDimX,
+                          uint32_t pAlignment);
+
+  void clearExpandShapeHints() {
+    mExpandShapeHints.clear();
+  }
+
+  // Set to true to instrument the next builds to count function calls,
+  // branch directions and common divisors in the exported .rs.profile
+  // variable (and section). The runtime can dump its contents after a
+  // representative run, for setProfileData().
+  void setProfileInstrument(bool v) {
+    mProfileInstrument = v;
+  }
+
+  bool getProfileInstrument() const {
+    return mProfileInstrument;
+  }
+
+  // Optimize the next builds (inlining, block placement, loop unrolling) for
+  // the profile pData, the pSize-byte contents of .rs.profile dumped from an
+  // instrumented build of the same script. A profile that does not match the
+  // script is ignored.
+  void setProfileData(const void *pData, size_t pSize);
+
+  void clearProfileData() {
+    mProfileData.clear();
+  }
+
+  // Returns a key identifying the values of the specialized globals, the
+  // shape hints and the profiling mode and data, or an empty string if there
+  // are none. When it is not empty,
+  // build() embeds "<build checksum>-<key>" as the build checksum, so that
+  // callers caching the object must include the key in the checksum they
+  // expect.
+  std::string getSpecializationKey() const;
+
   // FIXME: This method accompany with loadScript and compileScript should
   //        all be const-methods. They're not now because the getAddress() in
   //        SymbolResolverInterface is not a const-method.
@@ -154,7 +284,25 @@ public:
       const std::list<std::list<std::pair<int, int>>>& toFuse,
       const std::list<std::string>& fused,
       const std::list<std::list<std::pair<int, int>>>& invokes,
-      const std::list<std::string>& invokeBatchNames);
+      const std::list<std::string>& invokeBatchNames,
+      // Like toFuse and fused, except that the last pair of each list names a
+      // general reduce kernel (as source and reduce slot) consuming the
+      // results of the kernels before it.
+      const std::list<std::list<std::pair<int, int>>>& toFuseIntoReduce =
+          std::list<std::list<std::pair<int, int>>>(),
+      const std::list<std::string>& fusedReduce = std::list<std::string>());
+
+  // Chooses chains of kernels of a script group to fuse, and appends them to
+  // toFuse and fused in the form expected by buildScriptGroup(). The fused
+  // kernels are named namePrefix followed by a number. If report is not null,
+  // it receives a human-readable description of the chosen plan.
+  // Returns false if the script group is malformed.
+  bool planScriptGroupFusion(const std::vector<Source*>& sources,
+                             const std::vector<ScriptGroupKernel>& kernels,
+                             const std::string& namePrefix,
+                             std::list<std::list<std::pair<int, int>>>* toFuse,
+                             std::list<std::string>* fused,
+                             std::string* report = nullptr);
 
   // Returns true if script is successfully compiled.
   bool buildForCompatLib(Script &pScript, const char *pOut,
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_RS_INFO_BINARY_H
+#define BCC_RS_INFO_BINARY_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace bcc {
+
+/*
+ * Binary form of the script information in .rs.info, emitted on request as
+ * the constant global .rs.info.bin, in a section of the same name.  Unlike
+ * the text form, it needs no parsing: records have fixed sizes, names are
+ * offsets into a string table, and a hash table indexes the exported
+ * symbols by name, so a loader can use it in place (e.g., from a mapping of
+ * the shared object).
+ *
+ * All fields are 32-bit little-endian integers, and offsets are in bytes
+ * from the start of the blob, which is 4-byte aligned.  The blob holds:
+ *   RSInfoBinaryHeader
+ *   the tables of records, in RSInfoBinaryKind order:
+ *     RSInfoBinarySymbol  (exported variables, functions, foreach kernels)
+ *     RSInfoBinaryReduce  (general reduction kernels)
+ *     RSInfoBinaryPragma
+ *     uint32_t            (object slots)
+ *   RSInfoBinaryHashEntry[mHash.mCount]
+ *   the string table (NUL-terminated strings)
+ *
+ * Later versions may only add fields at the end of the header (mHeaderSize
+ * tells how large it is) and tables after the existing ones.
+ */
+
+const char kRSInfoBinaryName[] = ".rs.info.bin";
+
+const uint32_t kRSInfoBinaryMagic = 0x49535223;  // "#RSI"
+const uint32_t kRSInfoBinaryVersion = 1;
+
+// Value of string fields that are absent.
+const uint32_t kRSInfoBinaryNoString = 0xFFFFFFFF;
+
+// Bits of RSInfoBinaryHeader::mFlags.
+const uint32_t kRSInfoBinaryThreadable = 1 << 0;
+
+enum RSInfoBinaryKind {
+  kRSInfoBinaryVar = 0,
+  kRSInfoBinaryFunc,
+  kRSInfoBinaryForEach,
+  kRSInfoBinaryReduce,
+  kRSInfoBinaryPragma,
+  kRSInfoBinaryObjectSlot,
+  kRSInfoBinaryKindCount
+};
+
+struct RSInfoBinaryTable {
+  uint32_t mOffset;
+  uint32_t mCount;  // Number of records (of bytes, for the string table).
+};
+
+struct RSInfoBinaryHeader {
+  uint32_t mMagic;          // kRSInfoBinaryMagic
+  uint32_t mVersion;        // kRSInfoBinaryVersion
+  uint32_t mHeaderSize;     // sizeof(RSInfoBinaryHeader) for mVersion
+  uint32_t mSize;           // Size of the whole blob.
+  uint32_t mFlags;
+  uint32_t mBuildChecksum;  // String offset (or kRSInfoBinaryNoString).
+  uint32_t mBccVersion;     // String offset.
+  uint32_t mSlangVersion;   // String offset (or kRSInfoBinaryNoString).
+  RSInfoBinaryTable mTables[kRSInfoBinaryKindCount];
+  RSInfoBinaryTable mHash;
+  RSInfoBinaryTable mStrings;
+};
+
+// Exported variable, function or foreach kernel.
+struct RSInfoBinarySymbol {
+  uint32_t mName;       // String offset.
+  uint32_t mSignature;  // Foreach signature; 0 for variables and functions.
+};
+
+// General reduction kernel.  Omitted functions are kRSInfoBinaryNoString,
+// except the combiner, which is named after the accumulator if omitted.
+struct RSInfoBinaryReduce {
+  uint32_t mName;
+  uint32_t mSignature;
+  uint32_t mAccumulatorDataSize;
+  uint32_t mInitializer;
+  uint32_t mAccumulator;
+  uint32_t mCombiner;
+  uint32_t mOutConverter;
+  uint32_t mHalter;
+};
+
+struct RSInfoBinaryPragma {
+  uint32_t mKey;    // String offset.
+  uint32_t mValue;  // String offset.
+};
+
+// Open-addressed (linear probing) hash table of the variables, functions,
+// foreach kernels and reduction kernels, by name.
+struct RSInfoBinaryHashEntry {
+  uint32_t mHash;    // rsInfoBinaryHash of the name.
+  uint32_t mSymbol;  // Kind << 24 | index in its table, or kRSInfoBinaryNoString.
+};
+
+// FNV-1a.
+inline uint32_t rsInfoBinaryHash(const char *pName) {
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *c = reinterpret_cast<const unsigned char *>(pName); *c; ++c) {
+    hash = (hash ^ *c) * 16777619u;
+  }
+  return hash;
+}
+
+// Returns the index of the symbol pName of kind pKind (variable, function,
+// foreach or reduction kernel) in its table of pInfo, or -1 if absent.
+inline int32_t rsInfoBinaryLookup(const void *pInfo, RSInfoBinaryKind pKind,
+                                  const char *pName) {
+  const uint8_t *base = static_cast<const uint8_t *>(pInfo);
+  const RSInfoBinaryHeader *header = static_cast<const RSInfoBinaryHeader *>(pInfo);
+  const RSInfoBinaryHashEntry *entries =
+      reinterpret_cast<const RSInfoBinaryHashEntry *>(base + header->mHash.mOffset);
+  const char *strings = reinterpret_cast<const char *>(base + header->mStrings.mOffset);
+  const uint32_t mask = header->mHash.mCount - 1;
+  if (header->mHash.mCount == 0) {
+    return -1;
+  }
+
+  const uint32_t hash = rsInfoBinaryHash(pName);
+  for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+    const RSInfoBinaryHashEntry &entry = entries[i];
+    if (entry.mSymbol == kRSInfoBinaryNoString) {
+      return -1;
+    }
+    if (entry.mHash != hash || (entry.mSymbol >> 24) != static_cast<uint32_t>(pKind)) {
+      continue;
+    }
+
+    const uint32_t index = entry.mSymbol & 0xFFFFFF;
+    const uint8_t *table = base + header->mTables[pKind].mOffset;
+    // The name is the first field of both RSInfoBinarySymbol and
+    // RSInfoBinaryReduce.
+    const size_t recordSize = (pKind == kRSInfoBinaryReduce) ?
+        sizeof(RSInfoBinaryReduce) : sizeof(RSInfoBinarySymbol);
+    uint32_t name;
+    memcpy(&name, table + index * recordSize, sizeof(name));
+    if (strcmp(strings + name, pName) == 0) {
+      return static_cast<int32_t>(index);
+    }
+  }
+}
+
+} // end namespace bcc
+
+#endif // BCC_RS_INFO_BINARY_H
@@ -22,6 +22,12 @@
 #include <llvm/Support/CodeGen.h>
 #include "bcc/Source.h"
 
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
 namespace llvm {
 class Module;
 }
@@ -32,6 +38,21 @@ class Script;
 class Source;
 class CompilerConfig;
 
+// Maps the names of exported global variables to the values (raw bytes, laid
+// out as in target memory) they are specialized for.
+typedef std::map<std::string, std::vector<uint8_t> > SpecializedGlobalMap;
+
+// Shape of the launches of a foreach kernel known at build time: every row
+// spans dimX cells, and starts at an address aligned to alignment bytes in
+// every input and output Allocation.
+struct ExpandShapeHint {
+  uint32_t dimX;
+  uint32_t alignment;
+};
+
+// Maps the names of foreach kernels to their shape hints.
+typedef std::map<std::string, ExpandShapeHint> ExpandShapeHintMap;
+
 typedef llvm::Module *(*RSLinkRuntimeCallback)(bcc::Script *, llvm::Module *,
                                                llvm::Module *);
 
@@ -48,6 +69,10 @@ private:
 
   bool mEmbedInfo;
 
+  // Specifies whether the embedded script information (mEmbedInfo) should
+  // also be emitted in binary form, as .rs.info.bin.
+  bool mEmbedBinaryInfo;
+
   // Specifies whether we should embed global variable information in the
   // code via special RS variables that can be examined later by the driver.
   bool mEmbedGlobalInfo;
@@ -56,6 +81,24 @@ private:
   // when potentially embedding information about globals.
   bool mEmbedGlobalInfoSkipConstant;
 
+  // Specifies whether we should also embed a hash index of the names of the
+  // global variables when embedding information about globals.
+  bool mEmbedGlobalInfoIndex;
+
+  // Exported global variables whose value is known at build time.
+  SpecializedGlobalMap mSpecializedGlobals;
+
+  // Foreach kernels to emit shape-specialized expanded functions for.
+  ExpandShapeHintMap mExpandShapeHints;
+
+  // Specifies whether we should instrument the code to collect an execution
+  // profile in the .rs.profile section.
+  bool mProfileInstrument;
+
+  // Contents of the .rs.profile section of an instrumented build of this
+  // script, after a representative run, to optimize for.
+  std::vector<uint8_t> mProfileData;
+
 public:
   explicit Script(Source *pSource);
 
@@ -87,6 +130,12 @@ public:
 
   bool getEmbedInfo() const { return mEmbedInfo; }
 
+  // Set to true if we should also embed the script information in binary form.
+  void setEmbedBinaryInfo(bool pEnable) { mEmbedBinaryInfo = pEnable; }
+
+  // Returns true if we should also embed the script information in binary form.
+  bool getEmbedBinaryInfo() const { return mEmbedBinaryInfo; }
+
   // Set to true if we should embed global variable information in the code.
   void setEmbedGlobalInfo(bool pEnable) { mEmbedGlobalInfo = pEnable; }
 
@@ -105,6 +154,52 @@ public:
     return mEmbedGlobalInfoSkipConstant;
   }
 
+  // Set to true if we should also embed a hash index of the names of the
+  // global variables, when embedding information about globals.
+  void setEmbedGlobalInfoIndex(bool pEnable) {
+    mEmbedGlobalInfoIndex = pEnable;
+  }
+
+  // Returns true if we should also embed a hash index of the names of the
+  // global variables, when embedding information about globals.
+  bool getEmbedGlobalInfoIndex() const { return mEmbedGlobalInfoIndex; }
+
+  // Set the exported global variables to compile for a known value. The
+  // script must not change these values after it is created.
+  void setSpecializedGlobals(const SpecializedGlobalMap &pGlobals) {
+    mSpecializedGlobals = pGlobals;
+  }
+
+  const SpecializedGlobalMap &getSpecializedGlobals() const {
+    return mSpecializedGlobals;
+  }
+
+  // Set the foreach kernels to emit shape-specialized expanded functions
+  // for, in addition to the general ones.
+  void setExpandShapeHints(const ExpandShapeHintMap &pHints) {
+    mExpandShapeHints = pHints;
+  }
+
+  const ExpandShapeHintMap &getExpandShapeHints() const {
+    return mExpandShapeHints;
+  }
+
+  // Set to true if we should instrument the code to collect an execution
+  // profile.
+  void setProfileInstrument(bool pEnable) { mProfileInstrument = pEnable; }
+
+  bool getProfileInstrument() const { return mProfileInstrument; }
+
+  // Set the profile collected by an instrumented build of this script. It
+  // is ignored if it does not match the script.
+  void setProfileData(const std::vector<uint8_t> &pProfileData) {
+    mProfileData = pProfileData;
+  }
+
+  const std::vector<uint8_t> &getProfileData() const {
+    return mProfileData;
+  }
+
   // Merge (or link) another source into the current source associated with
   // this Script object. Return false on error.
   //
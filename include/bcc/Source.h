@@ -21,6 +21,7 @@
 
 namespace llvm {
   class Module;
+  template <typename T> class SmallVectorImpl;
 }
 
 namespace bcinfo {
@@ -68,6 +69,14 @@ public:
                                   uint32_t optimizationLevel,
                                   bool pNoDelete = false);
 
+  // Create a Source object from bitcode written by writeBitcode(), without
+  // verifying it again; this copies a Source to another context (e.g., one
+  // per thread).  pBitcode must outlive the returned object.
+  static Source *CreateFromVerifiedBuffer(BCCContext &pContext,
+                                          const char *pName,
+                                          const char *pBitcode,
+                                          size_t pBitcodeSize);
+
   const std::string& getName() const { return mName; }
 
   // Merge the current source with pSource. pSource
@@ -97,6 +106,9 @@ public:
 
   void addBuildChecksumMetadata(const char *) const;
 
+  // Write mModule (including its wrapper information) as bitcode to pBitcode.
+  void writeBitcode(llvm::SmallVectorImpl<char> &pBitcode) const;
+
   // Get whether debugging has been enabled for this module by checking
   // for presence of debug info in the module.
   bool getDebugInfoEnabled() const;
@@ -199,6 +199,8 @@ enum Compiler::ErrorCode Compiler::config(const CompilerConfig &pConfig) {
   delete mTarget;
   mTarget = new_target;
 
+  mFeatureLevels = pConfig.getFeatureLevels();
+
   // Adjust register allocation policy according to the optimization level.
   //  createFastRegisterAllocator: fast but bad quality
   //  createLinearScanRegisterAllocator: not so fast but good quality
@@ -231,14 +233,19 @@ enum Compiler::ErrorCode Compiler::runPasses(Script &script,
 
   // Add some initial custom passes.
   addInvokeHelperPass(transformPasses);
-  addExpandKernelPass(transformPasses);
+  addSpecializeGlobalsPass(script, transformPasses);
+  addAllocationAccessPass(transformPasses);
+  addExpandKernelPass(script, transformPasses);
   addDebugInfoPass(script, transformPasses);
   addInvariantPass(transformPasses);
+  addRelaxedPrecisionPass(transformPasses);
   if (mTarget->getOptLevel() != llvm::CodeGenOpt::None) {
     if (!addInternalizeSymbolsPass(script, transformPasses))
       return kErrCustomPasses;
   }
   addGlobalInfoPass(script, transformPasses);
+  addProfilePass(script, transformPasses);
+  addMultiversionPass(transformPasses);
 
   if (mTarget->getOptLevel() == llvm::CodeGenOpt::None) {
     transformPasses.add(llvm::createGlobalOptimizerPass());
@@ -277,7 +284,7 @@ enum Compiler::ErrorCode Compiler::runPasses(Script &script,
   // RSEmbedInfoPass needs to come after we have scanned for non-threadable
   // functions.
   if (script.getEmbedInfo())
-    transformPasses.add(createRSEmbedInfoPass());
+    transformPasses.add(createRSEmbedInfoPass(script.getEmbedBinaryInfo()));
 
   // Execute the passes.
   transformPasses.run(script.getSource().getModule());
@@ -388,6 +395,9 @@ bool Compiler::addInternalizeSymbolsPass(Script &script, llvm::legacy::PassManag
     kRsGlobalAddresses,  // Optional global variable address info.
     kRsGlobalSizes,      // Optional global variable size info.
     kRsGlobalProperties, // Optional global variable properties.
+    kRsGlobalNameHashes, // Optional hashes of the global variable names.
+    kRsGlobalIndexEntries, // Optional size of the global variable name index.
+    kRsGlobalIndex,      // Optional global variable name index.
     nullptr              // Must be nullptr-terminated.
   };
   const char **special_functions = sf;
@@ -428,6 +438,11 @@ bool Compiler::addInternalizeSymbolsPass(Script &script, llvm::legacy::PassManag
   for (i = 0; i < exportForEachCount; ++i) {
     keep_funcs.push_back(std::string(exportForEachNameList[i]) + ".expand");
   }
+  // So should the shape-specialized variants of expanded foreach functions.
+  for (const auto &hint : script.getExpandShapeHints()) {
+    keep_funcs.push_back(nameExpandShapeVariant(hint.first, hint.second.dimX,
+                                                hint.second.alignment));
+  }
   auto keepFuncsPushBackIfPresent = [&keep_funcs](const char *Name) {
     if (Name) keep_funcs.push_back(Name);
   };
@@ -467,25 +482,72 @@ void Compiler::addDebugInfoPass(Script &script, llvm::legacy::PassManager &pPM)
     pPM.add(createRSAddDebugInfoPass());
 }
 
-void Compiler::addExpandKernelPass(llvm::legacy::PassManager &pPM) {
+void Compiler::addAllocationAccessPass(llvm::legacy::PassManager &pPM) {
+  // Expose rsGetElementAt() address arithmetic to LTO.  Should run after
+  // the runtime is linked and before ExpandKernel, so that the latter can
+  // keep TBAA enabled for kernels whose accesses were rewritten.
+  if (mTarget->getOptLevel() != llvm::CodeGenOpt::None) {
+    pPM.add(createRSAllocationAccessPass());
+  }
+}
+
+void Compiler::addSpecializeGlobalsPass(Script &script, llvm::legacy::PassManager &pPM) {
+  // Fold the exported globals whose value is known at build time.  Should
+  // run before ExpandKernel and LTO, so that both see the constants.
+  if (!script.getSpecializedGlobals().empty()) {
+    pPM.add(createRSSpecializeGlobalsPass(script.getSpecializedGlobals()));
+  }
+}
+
+void Compiler::addExpandKernelPass(Script &script, llvm::legacy::PassManager &pPM) {
   // Expand ForEach and reduce on CPU path to reduce launch overhead.
   bool pEnableStepOpt = true;
-  pPM.add(createRSKernelExpandPass(pEnableStepOpt));
+  pPM.add(createRSKernelExpandPass(pEnableStepOpt, script.getExpandShapeHints()));
 }
 
 void Compiler::addGlobalInfoPass(Script &script, llvm::legacy::PassManager &pPM) {
   // Add additional information about RS global variables inside the Module.
   if (script.getEmbedGlobalInfo()) {
-    pPM.add(createRSGlobalInfoPass(script.getEmbedGlobalInfoSkipConstant()));
+    pPM.add(createRSGlobalInfoPass(script.getEmbedGlobalInfoSkipConstant(),
+                                   script.getEmbedGlobalInfoIndex()));
+  }
+}
+
+void Compiler::addMultiversionPass(llvm::legacy::PassManager &pPM) {
+  // Compile expanded kernels for each CPU feature level.  Should run after
+  // internalization and RSGlobalInfo, and before LTO.
+  if (!mFeatureLevels.empty() && mTarget->getOptLevel() != llvm::CodeGenOpt::None) {
+    pPM.add(createRSMultiversionPass(mFeatureLevels, mTarget->getTargetCPU(),
+                                     mTarget->getTargetFeatureString()));
+  }
+}
+
+void Compiler::addProfilePass(Script &script, llvm::legacy::PassManager &pPM) {
+  // Instrument the script, or annotate it with the profile of an instrumented
+  // build.  Both must run at the same point: after RSGlobalInfo, so that the
+  // counters are not reported as script globals, and before LTO, so that
+  // inlining, block placement and loop unrolling see the annotations.
+  if (script.getProfileInstrument()) {
+    pPM.add(createRSProfileInstrumentPass());
+  } else if (!script.getProfileData().empty()) {
+    pPM.add(createRSProfileUsePass(script.getProfileData()));
   }
 }
 
 void Compiler::addInvariantPass(llvm::legacy::PassManager &pPM) {
-  // Mark Loads from RsExpandKernelDriverInfo as "load.invariant".
+  // Mark Loads from RsExpandKernelDriverInfo, Allocation fields and
+  // read-only script globals as "load.invariant".
   // Should run after ExpandForEach and before inlining.
   pPM.add(createRSInvariantPass());
 }
 
+void Compiler::addRelaxedPrecisionPass(llvm::legacy::PassManager &pPM) {
+  // Compile the functions of relaxed precision scripts merged into a full
+  // precision module for relaxed precision.  Should run after ExpandForEach
+  // and before inlining.
+  pPM.add(createRSRelaxedPrecisionPass());
+}
+
 enum Compiler::ErrorCode Compiler::screenGlobalFunctions(Script &script) {
   llvm::Module &module = script.getSource().getModule();
 
@@ -0,0 +1,378 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Log.h"
+#include "RSTransforms.h"
+#include "RSUtils.h"
+
+#include "bcinfo/MetadataExtractor.h"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+namespace {
+
+const char kKernelCloneSuffix[] = ".kernel";
+
+/*
+ * RSAllocationAccessPass - This pass makes element accesses through
+ * rsGetElementAt*() transparent to the optimizer, so that the
+ * Allocation base pointer and stride can be loaded once per expanded
+ * loop instead of once per access (which matters for stencil and
+ * convolution kernels that gather from a global Allocation).
+ *
+ * Once the run-time library has been linked into the Module, the
+ * rsGetElementAt*() functions are ordinary definitions that compute the
+ * element address from fields of the Allocation (mallocPtr, stride,
+ * element size, ...).  The driver never changes these fields while a
+ * kernel runs, so:
+ *
+ * - Calls to rsGetElementAt(), rsGetElementAt_*() and rsGetElementAtYuv_*()
+ *   made by a kernel are redirected to a copy of the accessor in which the
+ *   loads of these fields are marked "invariant.load".  After LTO inlines
+ *   the kernel into its .expand function, and the accessor into the
+ *   kernel, LICM and GVN can hoist them out of the loop whenever the
+ *   rs_allocation itself is loop-invariant, leaving only the address
+ *   arithmetic in the loop.  The same goes for the Allocation queries
+ *   (rsAllocationGetDim*(), rsAllocationGetElement()) and the vector
+ *   loads (rsAllocationVLoadX_*()), which read the same fields.
+ *   Only foreach kernels and reduce accumulators that no code calls
+ *   directly (so that they only run as part of a launch) and that call no
+ *   rsAllocationIo*() function are considered.  Other functions, such as
+ *   invokables, may run between an rsAllocationIoReceive() and the next
+ *   access, and keep calling the unmarked accessors.
+ *
+ * - Calls to the untyped rsGetElementAt(), which return a pointer into
+ *   the Allocation, are inlined when the pointer is only used to address
+ *   loads and stores.  Those loads and stores are annotated with the same
+ *   "allocation" TBAA type that RSKernelExpandPass uses for the kernel
+ *   inputs and output (the typed accessors already are).  As the call is
+ *   gone, RSKernelExpandPass no longer considers the kernel to expose
+ *   pointers into Allocations, and can keep TBAA enabled for it.
+ *
+ * This pass should be run
+ * - after the run-time library has been linked, so that the accessors
+ *   have bodies,
+ * - before foreachexp, so that its TBAA decision sees the inlined calls,
+ * - before LTO inlining, so that the accessors are still recognizable.
+ *
+ * WARNINGS:
+ * - If the driver can change the layout or contents of an Allocation
+ *   (for example, resize it) while a script function runs, this pass
+ *   MAY ALLOW ILLEGAL OPTIMIZATION.
+ * - If the run-time library computes element addresses in a different
+ *   way (for example, through calls into the driver), this pass may be
+ *   ineffective.
+ */
+class RSAllocationAccessPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  RSAllocationAccessPass()
+      : ModulePass(ID), EmptyMDNode(nullptr), TBAAAllocation(nullptr) { }
+
+  virtual bool runOnModule(llvm::Module &M) override {
+    llvm::LLVMContext &Context = M.getContext();
+    llvm::MDBuilder MDHelper(Context);
+
+    EmptyMDNode = llvm::MDNode::get(Context, llvm::None);
+
+    // Same node as RSKernelExpandPass attaches to Allocation accesses
+    // when the kernel may see pointers into Allocations.
+    llvm::MDNode *TBAARenderScript = MDHelper.createTBAANode(
+        kRenderScriptTBAANodeName, MDHelper.createTBAARoot(kRenderScriptTBAARootName));
+    TBAAAllocation = MDHelper.createTBAAScalarTypeNode("allocation", TBAARenderScript);
+    TBAAAllocation = MDHelper.createTBAAStructTagNode(TBAAAllocation, TBAAAllocation, 0);
+
+    bcinfo::MetadataExtractor me(&M);
+    if (!me.extract()) {
+      ALOGE("Could not extract metadata from module!");
+      return false;
+    }
+
+    bool Changed = false;
+    llvm::SmallVector<llvm::Function *, 4> UntypedAccessors;
+
+    for (llvm::Function &F : M) {
+      if (isAccessor(F) && getUnmangledFunctionName(F.getName()).equals("rsGetElementAt"))
+        UntypedAccessors.push_back(&F);
+    }
+
+    const char **ForEachNames = me.getExportForEachNameList();
+    for (size_t i = 0; i < me.getExportForEachSignatureCount(); ++i) {
+      Changed |= useKernelAccessors(M.getFunction(ForEachNames[i]));
+    }
+    const bcinfo::MetadataExtractor::Reduce *Reduces = me.getExportReduceList();
+    for (size_t i = 0; i < me.getExportReduceCount(); ++i) {
+      Changed |= useKernelAccessors(M.getFunction(Reduces[i].mAccumulatorName));
+    }
+
+    // Kernels now call the copies of the untyped accessors, if any.
+    for (size_t i = 0, e = UntypedAccessors.size(); i != e; ++i) {
+      if (llvm::Function *Clone = KernelClones.lookup(UntypedAccessors[i]))
+        UntypedAccessors.push_back(Clone);
+    }
+
+    for (llvm::Function *F : UntypedAccessors) {
+      llvm::SmallVector<llvm::CallInst *, 8> Calls;
+      for (llvm::User *U : F->users()) {
+        auto Call = llvm::dyn_cast<llvm::CallInst>(U);
+        if (Call && Call->getCalledFunction() == F && Call->getParent()->getParent() != F)
+          Calls.push_back(Call);
+      }
+
+      for (llvm::CallInst *Call : Calls) {
+        Changed |= inlineUntypedAccess(Call);
+      }
+    }
+
+    return Changed;
+  }
+
+  virtual const char *getPassName() const override {
+    return "Renderscript Allocation Access Lowering";
+  }
+
+private:
+  // Returns whether F is a linked run-time function that reads the fields
+  // of the Allocation passed as its first argument: an element accessor,
+  // or an Allocation query.
+  static bool isAccessor(const llvm::Function &F) {
+    if (F.isDeclaration() || getAllocationArg(F) == nullptr)
+      return false;
+
+    llvm::StringRef Name = getUnmangledFunctionName(F.getName());
+    return Name.equals("rsGetElementAt") || Name.startswith("rsGetElementAt_") ||
+           Name.startswith("rsGetElementAtYuv_") ||
+           Name.equals("rsAllocationGetDimX") || Name.equals("rsAllocationGetDimY") ||
+           Name.equals("rsAllocationGetDimZ") || Name.equals("rsAllocationGetElement") ||
+           Name.startswith("rsAllocationVLoadX_");
+  }
+
+  // Returns the rs_allocation argument of the accessor F, which comes
+  // first, after the pointer to the result for functions that return an
+  // rs_element (or a large vector) through memory.
+  static llvm::Argument *getAllocationArg(const llvm::Function &F) {
+    for (const llvm::Argument &Arg : F.args()) {
+      if (!Arg.hasStructRetAttr())
+        return const_cast<llvm::Argument *>(&Arg);
+    }
+    return nullptr;
+  }
+
+  /*
+   * Returns whether the Allocations that Kernel reads through the accessors
+   * keep their layout for the whole execution of Kernel: Kernel is only
+   * run as part of a launch (no code calls it), and does not itself call
+   * rsAllocationIoSend() or rsAllocationIoReceive(), which may move the
+   * buffer of an Allocation.
+   */
+  static bool isLaunchedOnly(const llvm::Function &Kernel) {
+    if (Kernel.isDeclaration() || !Kernel.use_empty())
+      return false;
+
+    for (const llvm::Instruction &I : llvm::instructions(Kernel)) {
+      auto Call = llvm::dyn_cast<llvm::CallInst>(&I);
+      if (Call == nullptr)
+        continue;
+
+      const llvm::Function *Callee = Call->getCalledFunction();
+      if (Callee == nullptr ||
+          getUnmangledFunctionName(Callee->getName()).startswith("rsAllocationIo"))
+        return false;
+    }
+    return true;
+  }
+
+  // Returns the copy of the accessor F whose Allocation field loads are
+  // marked invariant, creating it if needed.
+  llvm::Function *getKernelClone(llvm::Function *F) {
+    llvm::Function *&Clone = KernelClones[F];
+    if (Clone != nullptr)
+      return Clone;
+
+    llvm::ValueToValueMapTy VMap;
+    Clone = llvm::CloneFunction(F, VMap, false);
+    Clone->setName(F->getName() + kKernelCloneSuffix);
+    Clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+    F->getParent()->getFunctionList().push_back(Clone);
+    markDescriptorLoads(*Clone);
+    return Clone;
+  }
+
+  // Make the kernel Kernel (null if it is not defined in the module) call
+  // the copies of the accessors whose Allocation field loads are invariant.
+  bool useKernelAccessors(llvm::Function *Kernel) {
+    if (Kernel == nullptr || !isLaunchedOnly(*Kernel))
+      return false;
+
+    bool Changed = false;
+    for (llvm::Instruction &I : llvm::instructions(*Kernel)) {
+      auto Call = llvm::dyn_cast<llvm::CallInst>(&I);
+      llvm::Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+      if (Callee != nullptr && isAccessor(*Callee)) {
+        Call->setCalledFunction(getKernelClone(Callee));
+        Changed = true;
+      }
+    }
+    return Changed;
+  }
+
+  /*
+   * Follow def->use chains rooted at Value through calculations "based
+   * on" Value, and call Callback on every Load whose pointer operand is
+   * reached.  Only the opcodes appearing in the run-time accessors are
+   * followed: casts, getelementptr and extractvalue (for ABIs that pass
+   * rs_allocation as an array of integers).
+   */
+  template <typename CallbackTy>
+  static void forEachBasedLoad(llvm::Value *Value, CallbackTy Callback) {
+    for (llvm::Use &Use : Value->uses()) {
+      llvm::Instruction *Inst = llvm::dyn_cast<llvm::Instruction>(Use.getUser());
+      if (!Inst)
+        continue;
+
+      if (llvm::isa<llvm::BitCastInst>(Inst) || llvm::isa<llvm::IntToPtrInst>(Inst) ||
+          llvm::isa<llvm::ExtractValueInst>(Inst)) {
+        forEachBasedLoad(Inst, Callback);
+      } else if (auto GetElementPtr = llvm::dyn_cast<llvm::GetElementPtrInst>(Inst)) {
+        if (Use.get() == GetElementPtr->getPointerOperand())
+          forEachBasedLoad(GetElementPtr, Callback);
+      } else if (auto Load = llvm::dyn_cast<llvm::LoadInst>(Inst)) {
+        if (Use.get() == Load->getPointerOperand())
+          Callback(Load);
+      }
+    }
+  }
+
+  /*
+   * Mark the loads of Allocation fields in the accessor copy F as
+   * "invariant.load".  The rs_allocation argument of F is passed either
+   * by value (as an integer aggregate holding the
+   * Allocation pointer) or by pointer to a copy of the rs_allocation.
+   * In the latter case, the load of the Allocation pointer from that
+   * copy is not invariant and is left alone.
+   */
+  bool markDescriptorLoads(llvm::Function &F) {
+    llvm::Argument *Handle = getAllocationArg(F);
+
+    llvm::SmallVector<llvm::Value *, 2> AllocationPtrs;
+    if (Handle->getType()->isPointerTy()) {
+      forEachBasedLoad(Handle, [&AllocationPtrs](llvm::LoadInst *Load) {
+        AllocationPtrs.push_back(Load);
+      });
+    } else {
+      AllocationPtrs.push_back(Handle);
+    }
+
+    bool Changed = false;
+    for (llvm::Value *AllocationPtr : AllocationPtrs) {
+      forEachBasedLoad(AllocationPtr, [this, &Changed](llvm::LoadInst *Load) {
+        Load->setMetadata(llvm::LLVMContext::MD_invariant_load, EmptyMDNode);
+        Changed = true;
+      });
+    }
+
+    if (!Changed) {
+      ALOGV("No Allocation field loads recognized in %s", F.getName().str().c_str());
+    }
+    return Changed;
+  }
+
+  /*
+   * Collect the loads and stores addressed by the element pointer Value.
+   * Returns false if the pointer has any other use (it is stored, passed
+   * to a call, compared, ...), in which case the accesses made through it
+   * cannot all be annotated.
+   */
+  static bool collectElementAccesses(llvm::Value *Value,
+                                     llvm::SmallVectorImpl<llvm::Instruction *> &Accesses) {
+    for (llvm::Use &Use : Value->uses()) {
+      llvm::Instruction *Inst = llvm::dyn_cast<llvm::Instruction>(Use.getUser());
+      if (!Inst)
+        return false;
+
+      if (llvm::isa<llvm::BitCastInst>(Inst)) {
+        if (!collectElementAccesses(Inst, Accesses))
+          return false;
+      } else if (auto GetElementPtr = llvm::dyn_cast<llvm::GetElementPtrInst>(Inst)) {
+        if (Use.get() != GetElementPtr->getPointerOperand() ||
+            !collectElementAccesses(GetElementPtr, Accesses))
+          return false;
+      } else if (auto Load = llvm::dyn_cast<llvm::LoadInst>(Inst)) {
+        if (Load->isVolatile())
+          return false;
+        Accesses.push_back(Load);
+      } else if (auto Store = llvm::dyn_cast<llvm::StoreInst>(Inst)) {
+        if (Use.get() != Store->getPointerOperand() || Store->isVolatile())
+          return false;
+        Accesses.push_back(Store);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool inlineUntypedAccess(llvm::CallInst *Call) {
+    llvm::SmallVector<llvm::Instruction *, 8> Accesses;
+    if (!collectElementAccesses(Call, Accesses))
+      return false;
+
+    llvm::InlineFunctionInfo IFI;
+    if (!llvm::InlineFunction(Call, IFI))
+      return false;
+
+    for (llvm::Instruction *Access : Accesses) {
+      Access->setMetadata(llvm::LLVMContext::MD_tbaa, TBAAAllocation);
+    }
+    return true;
+  }
+
+  // Pointer to empty metadata node used for "invariant.load" marking.
+  llvm::MDNode *EmptyMDNode;
+
+  // TBAA tag for accesses to Allocation elements.
+  llvm::MDNode *TBAAAllocation;
+
+  // Copies of the accessors called by kernels, by original accessor.
+  llvm::DenseMap<llvm::Function *, llvm::Function *> KernelClones;
+}; // end RSAllocationAccessPass
+
+char RSAllocationAccessPass::ID = 0;
+llvm::RegisterPass<RSAllocationAccessPass> X("rsallocaccess", "RS Allocation Access Pass");
+
+} // end anonymous namespace
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSAllocationAccessPass() {
+  return new RSAllocationAccessPass();
+}
+
+} // end namespace bcc
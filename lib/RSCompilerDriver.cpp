@@ -20,6 +20,7 @@
 #include "FileMutex.h"
 #include "Log.h"
 #include "RSScriptGroupFusion.h"
+#include "RSUtils.h"
 #include "slang_version.h"
 
 #include "bcc/BCCContext.h"
@@ -34,10 +35,12 @@
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
+#include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 #include "llvm/Linker/Linker.h"
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
@@ -50,7 +53,11 @@ using namespace bcc;
 RSCompilerDriver::RSCompilerDriver() :
     mConfig(nullptr), mCompiler(), mDebugContext(false),
     mLinkRuntimeCallback(nullptr), mEnableGlobalMerge(true),
-    mEmbedGlobalInfo(false), mEmbedGlobalInfoSkipConstant(false) {
+    mGlobalMergeSetByCaller(false),
+    mEmbedGlobalInfo(false), mEmbedGlobalInfoSkipConstant(false),
+    mEmbedGlobalInfoIndex(false),
+    mEmbedBinaryInfo(false),
+    mProfileInstrument(false) {
   init::Initialize();
 }
 
@@ -58,18 +65,151 @@ RSCompilerDriver::~RSCompilerDriver() {
   delete mConfig;
 }
 
+namespace {
+
+void updateHash(llvm::MD5 &hash, const std::string &name) {
+  // Include the terminating NUL so that consecutive fields cannot run into
+  // each other.
+  hash.update(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(name.c_str()), name.size() + 1));
+}
+
+void updateHash(llvm::MD5 &hash, uint32_t value) {
+  const uint8_t bytes[] = {
+    static_cast<uint8_t>(value),
+    static_cast<uint8_t>(value >> 8),
+    static_cast<uint8_t>(value >> 16),
+    static_cast<uint8_t>(value >> 24)
+  };
+  hash.update(bytes);
+}
+
+// Returns a digest of the build-time specializations (values of globals,
+// kernel shape hints and profiling), or an empty string if there are none.
+std::string computeSpecializationKey(const SpecializedGlobalMap &pGlobals,
+                                     const ExpandShapeHintMap &pShapeHints,
+                                     bool pProfileInstrument,
+                                     const std::vector<uint8_t> &pProfileData) {
+  if (pGlobals.empty() && pShapeHints.empty() && !pProfileInstrument &&
+      pProfileData.empty()) {
+    return std::string();
+  }
+
+  llvm::MD5 hash;
+  for (const auto &global : pGlobals) {
+    updateHash(hash, global.first);
+    updateHash(hash, static_cast<uint32_t>(global.second.size()));
+    hash.update(global.second);
+  }
+  for (const auto &hint : pShapeHints) {
+    updateHash(hash, hint.first);
+    updateHash(hash, hint.second.dimX);
+    updateHash(hash, hint.second.alignment);
+  }
+  if (pProfileInstrument) {
+    updateHash(hash, std::string("profile-instrument"));
+  } else if (!pProfileData.empty()) {
+    updateHash(hash, std::string("profile-use"));
+    hash.update(pProfileData);
+  }
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> key;
+  llvm::MD5::stringifyResult(result, key);
+  return key.str();
+}
+
+// Marks the functions defined in pModule as relaxed precision, for
+// RSRelaxedPrecisionPass.
+void markRelaxedPrecision(llvm::Module &pModule) {
+  for (llvm::Function &function : pModule) {
+    if (!function.isDeclaration()) {
+      function.addFnAttr(kRelaxedPrecisionAttrName);
+    }
+  }
+}
+
+// Replaces the floating point precision pragmas that the merged module got
+// from its sources with a single one: rs_fp_relaxed if pRelaxed, none (i.e.,
+// full precision) otherwise.
+void setPrecisionPragma(llvm::Module &pModule, bool pRelaxed) {
+  llvm::LLVMContext &context = pModule.getContext();
+  llvm::NamedMDNode *pragmas = pModule.getOrInsertNamedMetadata("#pragma");
+
+  std::vector<llvm::MDNode *> kept;
+  for (unsigned i = 0; i < pragmas->getNumOperands(); i++) {
+    llvm::MDNode *pragma = pragmas->getOperand(i);
+    llvm::MDString *key = (pragma->getNumOperands() == 2) ?
+        llvm::dyn_cast_or_null<llvm::MDString>(pragma->getOperand(0)) : nullptr;
+    if (key == nullptr || !key->getString().startswith("rs_fp_")) {
+      kept.push_back(pragma);
+    }
+  }
+
+  pragmas->dropAllReferences();
+  for (llvm::MDNode *pragma : kept) {
+    pragmas->addOperand(pragma);
+  }
+  if (pRelaxed) {
+    llvm::Metadata *relaxed[] = {
+      llvm::MDString::get(context, "rs_fp_relaxed"),
+      llvm::MDString::get(context, "")
+    };
+    pragmas->addOperand(llvm::MDNode::get(context, relaxed));
+  }
+}
+
+} // end anonymous namespace
+
+void RSCompilerDriver::setSpecializedGlobal(const char *pName,
+                                            const void *pValue,
+                                            size_t pSize) {
+  const uint8_t *value = static_cast<const uint8_t *>(pValue);
+  mSpecializedGlobals[pName].assign(value, value + pSize);
+}
+
+void RSCompilerDriver::setExpandShapeHint(const char *pKernelName,
+                                          uint32_t pDimX,
+                                          uint32_t pAlignment) {
+  ExpandShapeHint &hint = mExpandShapeHints[pKernelName];
+  hint.dimX = pDimX;
+  hint.alignment = pAlignment;
+}
+
+void RSCompilerDriver::setProfileData(const void *pData, size_t pSize) {
+  const uint8_t *data = static_cast<const uint8_t *>(pData);
+  mProfileData.assign(data, data + pSize);
+}
+
+std::string RSCompilerDriver::getSpecializationKey() const {
+  return computeSpecializationKey(mSpecializedGlobals, mExpandShapeHints,
+                                  mProfileInstrument, mProfileData);
+}
+
 
 #if defined(PROVIDE_ARM_CODEGEN)
 extern llvm::cl::opt<bool> EnableGlobalMerge;
 #endif
 
+void RSCompilerDriver::setGlobalMergeOption(bool v) {
+#if defined(PROVIDE_ARM_CODEGEN)
+  EnableGlobalMerge = v;
+#endif
+}
+
 bool RSCompilerDriver::setupConfig(const Script &pScript) {
   bool changed = false;
 
   const llvm::CodeGenOpt::Level script_opt_level = pScript.getOptimizationLevel();
 
 #if defined(PROVIDE_ARM_CODEGEN)
-  EnableGlobalMerge = mEnableGlobalMerge;
+  // The option is shared by all drivers (see setGlobalMergeSetByCaller()):
+  // only write it when it changes, so that a driver never writes it while
+  // another one, with the same setting, is compiling.
+  if (!mGlobalMergeSetByCaller && EnableGlobalMerge != mEnableGlobalMerge) {
+    EnableGlobalMerge = mEnableGlobalMerge;
+  }
 #endif
 
   if (mConfig != nullptr) {
@@ -111,9 +251,20 @@ Compiler::ErrorCode RSCompilerDriver::compileScript(Script& pScript, const char*
                                                     const char* pRuntimePath,
                                                     const char* pBuildChecksum,
                                                     bool pDumpIR) {
-  // embed build checksum metadata into the source
+  // embed build checksum metadata into the source.  An object specialized
+  // for the values of some globals, for the shapes of some kernels, or for
+  // a profile (or instrumented) is only valid for these, so they are part
+  // of its checksum.
   if (pBuildChecksum != nullptr && strlen(pBuildChecksum) > 0) {
-    pScript.getSource().addBuildChecksumMetadata(pBuildChecksum);
+    std::string checksum(pBuildChecksum);
+    std::string key = computeSpecializationKey(pScript.getSpecializedGlobals(),
+                                               pScript.getExpandShapeHints(),
+                                               pScript.getProfileInstrument(),
+                                               pScript.getProfileData());
+    if (!key.empty()) {
+      checksum.append("-").append(key);
+    }
+    pScript.getSource().addBuildChecksumMetadata(checksum.c_str());
   }
 
   // Verify that the only external functions in pScript are Renderscript
@@ -268,9 +419,15 @@ bool RSCompilerDriver::build(BCCContext &pContext,
 
   script.setEmbedGlobalInfo(mEmbedGlobalInfo);
   script.setEmbedGlobalInfoSkipConstant(mEmbedGlobalInfoSkipConstant);
+  script.setEmbedGlobalInfoIndex(mEmbedGlobalInfoIndex);
+  script.setEmbedBinaryInfo(mEmbedBinaryInfo);
+  script.setSpecializedGlobals(mSpecializedGlobals);
+  script.setExpandShapeHints(mExpandShapeHints);
+  script.setProfileInstrument(mProfileInstrument);
+  script.setProfileData(mProfileData);
 
   // Read optimization level from bitcode wrapper.
-  bcinfo::BitcodeWrapper wrapper(pBitcode, pBitcodeSize);
+  bcinfo::BitcodeWrapperHeader wrapper(pBitcode, pBitcodeSize);
   script.setOptimizationLevel(static_cast<llvm::CodeGenOpt::Level>(
                               wrapper.getOptimizationLevel()));
 
@@ -300,6 +457,23 @@ bool RSCompilerDriver::build(BCCContext &pContext,
   return status == Compiler::kSuccess;
 }
 
+bool RSCompilerDriver::planScriptGroupFusion(
+    const std::vector<Source*>& sources,
+    const std::vector<ScriptGroupKernel>& kernels,
+    const std::string& namePrefix,
+    std::list<std::list<std::pair<int, int>>>* toFuse,
+    std::list<std::string>* fused,
+    std::string* report) {
+  for (Source* source : sources) {
+    if (source->getMetadata() == nullptr && !source->extractMetadata()) {
+      ALOGE("Cannot extract metadata from module");
+      return false;
+    }
+  }
+
+  return planFusion(sources, kernels, namePrefix, toFuse, fused, report);
+}
+
 bool RSCompilerDriver::buildScriptGroup(
     BCCContext& Context, const char* pOutputFilepath, const char* pRuntimePath,
     const char* pRuntimeRelaxedPath, bool dumpIR, const char* buildChecksum,
@@ -307,7 +481,9 @@ bool RSCompilerDriver::buildScriptGroup(
     const std::list<std::list<std::pair<int, int>>>& toFuse,
     const std::list<std::string>& fused,
     const std::list<std::list<std::pair<int, int>>>& invokes,
-    const std::list<std::string>& invokeBatchNames) {
+    const std::list<std::string>& invokeBatchNames,
+    const std::list<std::list<std::pair<int, int>>>& toFuseIntoReduce,
+    const std::list<std::string>& fusedReduce) {
 
   // Read and store metadata before linking the modules together
   std::vector<bcinfo::MetadataExtractor*> metadata;
@@ -318,6 +494,19 @@ bool RSCompilerDriver::buildScriptGroup(
     }
   }
 
+  // Precision is a property of each script.  If all sources agree, the
+  // merged module simply keeps it; otherwise it is compiled for full
+  // precision, and the functions of the relaxed sources are compiled for
+  // relaxed precision by RSRelaxedPrecisionPass.
+  bool anyRelaxed = false, allRelaxed = true;
+  for (Source* source : sources) {
+    const bool relaxed =
+        source->getMetadata()->getRSFloatPrecision() == bcinfo::RS_FP_Relaxed;
+    anyRelaxed |= relaxed;
+    allRelaxed &= relaxed;
+  }
+  const bool mixedPrecision = anyRelaxed && !allRelaxed;
+
   // ---------------------------------------------------------------------------
   // Link all input modules into a single module
   // ---------------------------------------------------------------------------
@@ -341,6 +530,10 @@ bool RSCompilerDriver::buildScriptGroup(
       wrapperOptimizationLevel = sourceWrapperOptimizationLevel;
       gotFirstSource = true;
     }
+    if (mixedPrecision &&
+        source->getMetadata()->getRSFloatPrecision() == bcinfo::RS_FP_Relaxed) {
+      markRelaxedPrecision(source->getModule());
+    }
     std::unique_ptr<llvm::Module> sourceModule(&source->getModule());
     if (linker.linkInModule(std::move(sourceModule))) {
       ALOGE("Linking for module in source failed.");
@@ -356,6 +549,7 @@ bool RSCompilerDriver::buildScriptGroup(
     bccAssert(wrapperMDNode != nullptr);
     module.eraseNamedMetadata(wrapperMDNode);
   }
+  setPrecisionPragma(module, allRelaxed);
 
   // ---------------------------------------------------------------------------
   // Create fused kernels
@@ -378,17 +572,51 @@ bool RSCompilerDriver::buildScriptGroup(
   }
 
   // ---------------------------------------------------------------------------
-  // Rename invokes
+  // Create fused reduce kernels
+  // ---------------------------------------------------------------------------
+
+  auto reduceInputIter = toFuseIntoReduce.begin();
+  for (const std::string& nameOfFused : fusedReduce) {
+    auto inputKernels = *reduceInputIter++;
+    if (inputKernels.size() < 2) {
+      ALOGE("Fused reduce kernel %s needs at least one kernel and a reduce kernel",
+            nameOfFused.c_str());
+      return false;
+    }
+
+    const std::pair<int, int> reduceKernel = inputKernels.back();
+    inputKernels.pop_back();
+
+    std::vector<Source*> sourcesToFuse;
+    std::vector<int> slots;
+
+    for (auto p : inputKernels) {
+      sourcesToFuse.push_back(sources[p.first]);
+      slots.push_back(p.second);
+    }
+
+    if (!fuseKernelsIntoReduce(Context, sourcesToFuse, slots, sources[reduceKernel.first],
+                               reduceKernel.second, nameOfFused, &module)) {
+      return false;
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Batch invokes
   // ---------------------------------------------------------------------------
 
   auto invokeIter = invokes.begin();
   for (const std::string& newName : invokeBatchNames) {
-    auto inputInvoke = *invokeIter++;
-    auto p = inputInvoke.front();
-    Source* source = sources[p.first];
-    int slot = p.second;
+    auto inputInvokes = *invokeIter++;
+    std::vector<Source*> sourcesToBatch;
+    std::vector<int> slots;
+
+    for (auto p : inputInvokes) {
+      sourcesToBatch.push_back(sources[p.first]);
+      slots.push_back(p.second);
+    }
 
-    if (!renameInvoke(Context, source, slot, newName, &module)) {
+    if (!batchInvokes(Context, sourcesToBatch, slots, newName, &module)) {
       return false;
     }
   }
@@ -410,6 +638,12 @@ bool RSCompilerDriver::buildScriptGroup(
   script.setOptimizationLevel(llvm::CodeGenOpt::Level::Aggressive);
   script.setEmbedGlobalInfo(mEmbedGlobalInfo);
   script.setEmbedGlobalInfoSkipConstant(mEmbedGlobalInfoSkipConstant);
+  script.setEmbedGlobalInfoIndex(mEmbedGlobalInfoIndex);
+  script.setEmbedBinaryInfo(mEmbedBinaryInfo);
+  script.setSpecializedGlobals(mSpecializedGlobals);
+  script.setExpandShapeHints(mExpandShapeHints);
+  script.setProfileInstrument(mProfileInstrument);
+  script.setProfileData(mProfileData);
 
   llvm::SmallString<80> output_path(pOutputFilepath);
   llvm::sys::path::replace_extension(output_path, ".o");
@@ -440,6 +674,12 @@ bool RSCompilerDriver::buildForCompatLib(Script &pScript, const char *pOut,
 
   pScript.setEmbedGlobalInfo(mEmbedGlobalInfo);
   pScript.setEmbedGlobalInfoSkipConstant(mEmbedGlobalInfoSkipConstant);
+  pScript.setEmbedGlobalInfoIndex(mEmbedGlobalInfoIndex);
+  pScript.setEmbedBinaryInfo(mEmbedBinaryInfo);
+  pScript.setSpecializedGlobals(mSpecializedGlobals);
+  pScript.setExpandShapeHints(mExpandShapeHints);
+  pScript.setProfileInstrument(mProfileInstrument);
+  pScript.setProfileData(mProfileData);
   pScript.setLinkRuntimeCallback(getLinkRuntimeCallback());
 
   Compiler::ErrorCode status = compileScript(pScript, pOut, pOut, pRuntimePath,
@@ -21,10 +21,13 @@
 #include "rsDefines.h"
 
 #include "bcc/Config.h"
+#include "bcc/RSInfoBinary.h"
 #include "bcinfo/MetadataExtractor.h"
 
 #include <string>
+#include <cstddef>
 #include <cstdlib>
+#include <map>
 #include <vector>
 
 #include <llvm/IR/DerivedTypes.h>
@@ -47,6 +50,10 @@ namespace {
  * because the standalone compiler + compatibility driver or system driver
  * will be using the same format (i.e. bcc_compat + libRSSupport.so or
  * bcc + libRSCpuRef are always paired together for installation).
+ *
+ * If requested, the same information is also embedded in binary form as
+ * .rs.info.bin (see bcc/RSInfoBinary.h), for runtimes that can look it up in
+ * place instead of parsing .rs.info.
  */
 class RSEmbedInfoPass : public llvm::ModulePass {
 private:
@@ -55,16 +62,84 @@ private:
   llvm::Module *M;
   llvm::LLVMContext *C;
 
+  bool mEmbedBinary;
+
+  // Builds the words of a .rs.info.bin blob, with a string table of
+  // distinct strings.
+  class BinaryInfoWriter {
+  private:
+    std::vector<uint32_t> mWords;
+    std::string mStrings;
+    std::map<std::string, uint32_t> mStringOffsets;
+
+  public:
+    uint32_t addString(llvm::StringRef pString) {
+      auto it = mStringOffsets.find(pString);
+      if (it != mStringOffsets.end()) {
+        return it->second;
+      }
+      uint32_t offset = mStrings.size();
+      mStrings.append(pString.data(), pString.size());
+      mStrings.push_back('\0');
+      mStringOffsets[pString] = offset;
+      return offset;
+    }
+
+    uint32_t addOptionalString(const char *pString) {
+      return pString ? addString(pString) : bcc::kRSInfoBinaryNoString;
+    }
+
+    // Appends a word, returning its index.
+    size_t add(uint32_t pWord) {
+      mWords.push_back(pWord);
+      return mWords.size() - 1;
+    }
+
+    void set(size_t pIndex, uint32_t pWord) { mWords[pIndex] = pWord; }
+
+    uint32_t get(size_t pIndex) const { return mWords[pIndex]; }
+
+    uint32_t currentOffset() const { return mWords.size() * sizeof(uint32_t); }
+
+    uint32_t stringsSize() const { return mStrings.size(); }
+
+    // Returns the blob: the words (little-endian), then the string table.
+    std::string finish() const {
+      std::string blob;
+      blob.reserve(currentOffset() + mStrings.size());
+      for (uint32_t word : mWords) {
+        for (int shift = 0; shift < 32; shift += 8) {
+          blob.push_back(static_cast<char>((word >> shift) & 0xFF));
+        }
+      }
+      blob.append(mStrings);
+      return blob;
+    }
+  };
+
 public:
-  RSEmbedInfoPass()
+  explicit RSEmbedInfoPass(bool pEmbedBinary = false)
       : ModulePass(ID),
-        M(nullptr) {
+        M(nullptr), mEmbedBinary(pEmbedBinary) {
   }
 
   virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
     AU.setPreservesAll();
   }
 
+  // Returns the version of slang that produced the module, if recorded.
+  static llvm::StringRef getSlangVersion(const llvm::Module *module) {
+    if (auto nmd = module->getNamedMetadata("slang.llvm.version")) {
+      if (auto md = nmd->getOperand(0)) {
+        if (const auto ver =
+                llvm::dyn_cast<llvm::MDString>(md->getOperand(0))) {
+          return ver->getString();
+        }
+      }
+    }
+    return llvm::StringRef();
+  }
+
   static std::string getRSInfoString(const llvm::Module *module) {
     std::string str;
     llvm::raw_string_ostream s(str);
@@ -163,14 +238,9 @@ public:
       // As per `exportReduceCount`'s linewise fields, we use the literal `"."`
       // to signify the empty field. This makes it easy to parse when it's
       // missing.
-      llvm::StringRef slangVersion(".");
-      if (auto nmd = module->getNamedMetadata("slang.llvm.version")) {
-        if (auto md = nmd->getOperand(0)) {
-          if (const auto ver =
-                  llvm::dyn_cast<llvm::MDString>(md->getOperand(0))) {
-            slangVersion = ver->getString();
-          }
-        }
+      llvm::StringRef slangVersion = getSlangVersion(module);
+      if (slangVersion.empty()) {
+        slangVersion = ".";
       }
       s << "versionInfo: 2\n";
       s << "bcc - " << LLVM_VERSION_STRING << "\n";
@@ -189,6 +259,118 @@ public:
     return str;
   }
 
+  static std::string getRSInfoBinary(const llvm::Module *module) {
+    bcinfo::MetadataExtractor me(module);
+    if (!me.extract()) {
+      bccAssert(false && "Could not extract RS metadata for module!");
+      return std::string("");
+    }
+
+    BinaryInfoWriter w;
+    size_t i;
+
+    // Header; offsets and counts of the tables are filled in below.
+    const size_t headerWords = sizeof(bcc::RSInfoBinaryHeader) / sizeof(uint32_t);
+    for (i = 0; i < headerWords; ++i) {
+      w.add(0);
+    }
+    const size_t tablesWord = offsetof(bcc::RSInfoBinaryHeader, mTables) / sizeof(uint32_t);
+    const size_t hashWord = offsetof(bcc::RSInfoBinaryHeader, mHash) / sizeof(uint32_t);
+    const size_t stringsWord = offsetof(bcc::RSInfoBinaryHeader, mStrings) / sizeof(uint32_t);
+
+    llvm::StringRef slangVersion = getSlangVersion(module);
+    w.set(0, bcc::kRSInfoBinaryMagic);
+    w.set(1, bcc::kRSInfoBinaryVersion);
+    w.set(2, sizeof(bcc::RSInfoBinaryHeader));
+    w.set(4, me.isThreadable() ? bcc::kRSInfoBinaryThreadable : 0);
+    w.set(5, (me.getBuildChecksum() != nullptr && me.getBuildChecksum()[0]) ?
+             w.addString(me.getBuildChecksum()) : bcc::kRSInfoBinaryNoString);
+    w.set(6, w.addString(LLVM_VERSION_STRING));
+    w.set(7, slangVersion.empty() ? bcc::kRSInfoBinaryNoString
+                                  : w.addString(slangVersion));
+
+    // Names of the hashed symbols, with their kind << 24 | index.
+    std::vector<std::pair<const char *, uint32_t> > symbols;
+    auto beginTable = [&](bcc::RSInfoBinaryKind kind, size_t count) {
+      w.set(tablesWord + 2 * kind, w.currentOffset());
+      w.set(tablesWord + 2 * kind + 1, count);
+    };
+    auto addSymbols = [&](bcc::RSInfoBinaryKind kind, size_t count,
+                          const char **names, const uint32_t *signatures) {
+      beginTable(kind, count);
+      for (size_t i = 0; i < count; ++i) {
+        w.add(w.addString(names[i]));
+        w.add(signatures ? signatures[i] : 0);
+        symbols.push_back(std::make_pair(names[i], (kind << 24) | i));
+      }
+    };
+
+    addSymbols(bcc::kRSInfoBinaryVar, me.getExportVarCount(),
+               me.getExportVarNameList(), nullptr);
+    addSymbols(bcc::kRSInfoBinaryFunc, me.getExportFuncCount(),
+               me.getExportFuncNameList(), nullptr);
+    addSymbols(bcc::kRSInfoBinaryForEach, me.getExportForEachSignatureCount(),
+               me.getExportForEachNameList(), me.getExportForEachSignatureList());
+
+    beginTable(bcc::kRSInfoBinaryReduce, me.getExportReduceCount());
+    for (i = 0; i < me.getExportReduceCount(); ++i) {
+      const bcinfo::MetadataExtractor::Reduce &reduce = me.getExportReduceList()[i];
+      w.add(w.addString(reduce.mReduceName));
+      w.add(reduce.mSignature);
+      w.add(reduce.mAccumulatorDataSize);
+      w.add(w.addOptionalString(reduce.mInitializerName));
+      w.add(w.addOptionalString(reduce.mAccumulatorName));
+      w.add(w.addString((reduce.mCombinerName != nullptr)
+                        ? reduce.mCombinerName
+                        : nameReduceCombinerFromAccumulator(reduce.mAccumulatorName)));
+      w.add(w.addOptionalString(reduce.mOutConverterName));
+      w.add(w.addOptionalString(reduce.mHalterName));
+      symbols.push_back(std::make_pair(reduce.mReduceName,
+                                       (bcc::kRSInfoBinaryReduce << 24) | i));
+    }
+
+    beginTable(bcc::kRSInfoBinaryPragma, me.getPragmaCount());
+    for (i = 0; i < me.getPragmaCount(); ++i) {
+      w.add(w.addString(me.getPragmaKeyList()[i]));
+      w.add(w.addString(me.getPragmaValueList()[i]));
+    }
+
+    beginTable(bcc::kRSInfoBinaryObjectSlot, me.getObjectSlotCount());
+    for (i = 0; i < me.getObjectSlotCount(); ++i) {
+      w.add(me.getObjectSlotList()[i]);
+    }
+
+    // Hash table, at most half full.
+    size_t hashSize = 0;
+    if (!symbols.empty()) {
+      hashSize = 1;
+      while (hashSize < 2 * symbols.size()) {
+        hashSize *= 2;
+      }
+    }
+    w.set(hashWord, w.currentOffset());
+    w.set(hashWord + 1, hashSize);
+    const size_t hashStart = w.currentOffset() / sizeof(uint32_t);
+    for (i = 0; i < hashSize; ++i) {
+      w.add(0);
+      w.add(bcc::kRSInfoBinaryNoString);
+    }
+    for (const auto &symbol : symbols) {
+      uint32_t hash = bcc::rsInfoBinaryHash(symbol.first);
+      size_t slot = hash & (hashSize - 1);
+      while (w.get(hashStart + 2 * slot + 1) != bcc::kRSInfoBinaryNoString) {
+        slot = (slot + 1) & (hashSize - 1);
+      }
+      w.set(hashStart + 2 * slot, hash);
+      w.set(hashStart + 2 * slot + 1, symbol.second);
+    }
+
+    w.set(stringsWord, w.currentOffset());
+    w.set(stringsWord + 1, w.stringsSize());
+    w.set(3, w.currentOffset() + w.stringsSize());
+    return w.finish();
+  }
+
   virtual bool runOnModule(llvm::Module &M) {
     this->M = &M;
     C = &M.getContext();
@@ -203,6 +385,17 @@ public:
                                  kRsInfo);
     (void) InfoGV;
 
+    if (mEmbedBinary) {
+      llvm::Constant *BinaryInit =
+          llvm::ConstantDataArray::getString(*C, getRSInfoBinary(&M), false);
+      llvm::GlobalVariable *BinaryInfoGV =
+          new llvm::GlobalVariable(M, BinaryInit->getType(), true,
+                                   llvm::GlobalValue::ExternalLinkage, BinaryInit,
+                                   bcc::kRSInfoBinaryName);
+      BinaryInfoGV->setSection(bcc::kRSInfoBinaryName);
+      BinaryInfoGV->setAlignment(alignof(bcc::RSInfoBinaryHeader));
+    }
+
     return true;
   }
 
@@ -219,8 +412,8 @@ char RSEmbedInfoPass::ID = 0;
 namespace bcc {
 
 llvm::ModulePass *
-createRSEmbedInfoPass() {
-  return new RSEmbedInfoPass();
+createRSEmbedInfoPass(bool pEmbedBinary) {
+  return new RSEmbedInfoPass(pEmbedBinary);
 }
 
 }  // end namespace bcc
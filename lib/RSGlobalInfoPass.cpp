@@ -18,6 +18,7 @@
 #include "Log.h"
 #include "RSUtils.h"
 
+#include "bcc/RSInfoBinary.h"
 #include "rsDefines.h"
 
 #include <llvm/IR/Constant.h>
@@ -26,6 +27,7 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
 
 #include <sstream>
 #include <vector>
@@ -34,6 +36,16 @@ namespace {
 
 const bool kDebugGlobalInfo = false;
 
+// Only used when the pass is run through opt; bcc passes the setting of the
+// script to the pass directly.
+llvm::cl::opt<bool>
+EmbedGlobalIndexOpt("rs-embed-global-index",
+                    llvm::cl::desc("Also embed a hash index of the names of "
+                                   "the global variables"));
+
+// Value of the empty entries of .rs.global_index.
+const uint32_t kGlobalIndexEmpty = 0xFFFFFFFF;
+
 /* RSGlobalInfoPass: Embeds additional information about RenderScript global
  * variables into the Module. The 5 variables added are specified as follows:
  * 1) .rs.global_entries
@@ -62,6 +74,24 @@ const bool kDebugGlobalInfo = false;
  *        17    Static (1 is static, 0 is extern)
  *        16    Constant (1 is const, 0 is non-const)
  *    15 - 0    RsDataType (see frameworks/rs/rsDefines.h for more info)
+ *
+ * If requested, the name index is embedded as well, so that a global variable
+ * can be found by name without scanning .rs.global_names:
+ * 6) .rs.global_name_hashes
+ *    [N * i32]
+ *    Each entry is the hash of the name of 1 of the N global variables,
+ *    computed with bcc::rsInfoBinaryHash (FNV-1a, see bcc/RSInfoBinary.h).
+ * 7) .rs.global_index_entries
+ *    i32 - int
+ *    Number of entries M of .rs.global_index, a power of 2 (or 0 if N is 0).
+ * 8) .rs.global_index
+ *    [M * i32]
+ *    Open-addressed hash table of the global variables: the entries for a
+ *    name with hash H are probed from H & (M - 1) on, each the index of a
+ *    global variable in the tables above or 0xFFFFFFFF (empty), which ends
+ *    the search. At most half the entries are used. Comparing hashes
+ *    (.rs.global_name_hashes) first leaves one string comparison per lookup
+ *    in the common case.
  */
 class RSGlobalInfoPass: public llvm::ModulePass {
 private:
@@ -69,6 +99,10 @@ private:
   // in our various exported data structures.
   bool mSkipConstants;
 
+  // If true, we also embed the name index (.rs.global_name_hashes,
+  // .rs.global_index_entries and .rs.global_index).
+  bool mEmbedIndex;
+
   // Encodes properties of the GlobalVariable into a uint32_t.
   // These values are used to populate the .rs.global_properties array.
   static uint32_t getEncodedProperties(const llvm::GlobalVariable &GV) {
@@ -95,11 +129,73 @@ private:
     return result;
   }
 
+  // Embeds .rs.global_name_hashes, .rs.global_index_entries and
+  // .rs.global_index for the global variables named pNames (in table order).
+  static void embedIndex(llvm::Module &M,
+                         const std::vector<std::string> &pNames) {
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(M.getContext());
+
+    std::vector<uint32_t> Hashes;
+    for (const auto &Name : pNames) {
+      Hashes.push_back(bcc::rsInfoBinaryHash(Name.c_str()));
+    }
+
+    size_t IndexEntries = 0;
+    if (!pNames.empty()) {
+      IndexEntries = 1;
+      while (IndexEntries < 2 * pNames.size()) {
+        IndexEntries *= 2;
+      }
+    }
+    std::vector<uint32_t> Index(IndexEntries, kGlobalIndexEmpty);
+    for (size_t I = 0; I < Hashes.size(); ++I) {
+      size_t Slot = Hashes[I] & (IndexEntries - 1);
+      while (Index[Slot] != kGlobalIndexEmpty) {
+        Slot = (Slot + 1) & (IndexEntries - 1);
+      }
+      Index[Slot] = I;
+    }
+
+    // 6) @.rs.global_name_hashes = constant [N * i32] [...]
+    llvm::Value *V = M.getOrInsertGlobal(
+        kRsGlobalNameHashes, llvm::ArrayType::get(Int32Ty, Hashes.size()));
+    llvm::GlobalVariable *GlobalNameHashes =
+        llvm::dyn_cast<llvm::GlobalVariable>(V);
+    GlobalNameHashes->setInitializer(
+        llvm::ConstantDataArray::get(M.getContext(), Hashes));
+    GlobalNameHashes->setConstant(true);
+
+    // 7) @.rs.global_index_entries = constant i32 M
+    V = M.getOrInsertGlobal(kRsGlobalIndexEntries, Int32Ty);
+    llvm::GlobalVariable *GlobalIndexEntries =
+        llvm::dyn_cast<llvm::GlobalVariable>(V);
+    GlobalIndexEntries->setInitializer(
+        llvm::ConstantInt::get(Int32Ty, IndexEntries));
+    GlobalIndexEntries->setConstant(true);
+
+    // 8) @.rs.global_index = constant [M * i32] [...]
+    V = M.getOrInsertGlobal(kRsGlobalIndex,
+                            llvm::ArrayType::get(Int32Ty, Index.size()));
+    llvm::GlobalVariable *GlobalIndex =
+        llvm::dyn_cast<llvm::GlobalVariable>(V);
+    GlobalIndex->setInitializer(
+        llvm::ConstantDataArray::get(M.getContext(), Index));
+    GlobalIndex->setConstant(true);
+
+    if (kDebugGlobalInfo) {
+      GlobalNameHashes->dump();
+      GlobalIndexEntries->dump();
+      GlobalIndex->dump();
+    }
+  }
+
 public:
   static char ID;
 
-  explicit RSGlobalInfoPass(bool pSkipConstants = false)
-    : ModulePass (ID), mSkipConstants(pSkipConstants) {
+  explicit RSGlobalInfoPass(bool pSkipConstants = false,
+                            bool pEmbedIndex = EmbedGlobalIndexOpt)
+    : ModulePass (ID), mSkipConstants(pSkipConstants),
+      mEmbedIndex(pEmbedIndex) {
   }
 
   void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
@@ -260,6 +356,10 @@ public:
       GlobalProperties->dump();
     }
 
+    if (mEmbedIndex) {
+      embedIndex(M, GVNameStrings);
+    }
+
     // Upon completion, this pass has always modified the Module.
     return true;
   }
@@ -274,8 +374,9 @@ static llvm::RegisterPass<RSGlobalInfoPass> X("embed-rs-global-info",
 
 namespace bcc {
 
-llvm::ModulePass * createRSGlobalInfoPass(bool pSkipConstants) {
-  return new RSGlobalInfoPass(pSkipConstants);
+llvm::ModulePass * createRSGlobalInfoPass(bool pSkipConstants,
+                                          bool pEmbedIndex) {
+  return new RSGlobalInfoPass(pSkipConstants, pEmbedIndex);
 }
 
 }
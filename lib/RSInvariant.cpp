@@ -17,10 +17,16 @@
 #include "RSTransforms.h"
 #include "RSUtils.h"
 
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
 #include <llvm/IR/Type.h>
 #include <llvm/Pass.h>
 
@@ -43,6 +49,13 @@ namespace {
  * rs_kernel_context_t is opaque to user code, so there cannot be any
  * Loads from it in user code.
  *
+ * The pass also marks as "invariant.load" the Loads of script globals
+ * that no code of the script can write: every use of the global is a
+ * (non-volatile, non-atomic) Load, the source of a memory copy, or a
+ * cast or getelementptr whose uses are such.  The driver only sets these
+ * globals between launches.  (Allocation fields are handled by
+ * RSAllocationAccessPass.)
+ *
  * This pass should be run
  * - after foreachexp, so that it can see the Loads generated within
  *   .expand functions
@@ -52,6 +65,8 @@ namespace {
  * WARNINGS:
  * - If user code or APIs can modify RsExpandKernelDriverInfo
  *   instances, this pass MAY ALLOW ILLEGAL OPTIMIZATION.
+ * - If the driver can change a script global while a function of the
+ *   script runs, this pass MAY ALLOW ILLEGAL OPTIMIZATION.
  * - If this pass runs at a different time, it may be ineffective
  *   (fail to mark some or all eligible Loads, and thereby cost
  *   performance).
@@ -65,10 +80,17 @@ class RSInvariantPass : public llvm::FunctionPass {
 public:
   static char ID;
 
-  RSInvariantPass() : FunctionPass(ID), EmptyMDNode(nullptr) { }
+  RSInvariantPass() : FunctionPass(ID), EmptyMDNode(nullptr), DL(nullptr) { }
 
   virtual bool doInitialization(llvm::Module &M) {
     EmptyMDNode = llvm::MDNode::get(M.getContext(), llvm::None);
+    DL = &M.getDataLayout();
+
+    ReadOnlyGlobals.clear();
+    for (llvm::GlobalVariable &GV : M.globals()) {
+      if (!GV.isDeclaration() && !GV.isThreadLocal() && isNeverWritten(&GV))
+        ReadOnlyGlobals.insert(&GV);
+    }
     return true;
   }
 
@@ -90,6 +112,9 @@ public:
       }
     }
 
+    if (!ReadOnlyGlobals.empty())
+      Changed |= markReadOnlyGlobalLoads(F);
+
     return Changed;
   }
 
@@ -134,8 +159,60 @@ private:
     return Changed;
   }
 
+  /*
+   * Returns whether no code of the module can write to the memory that
+   * Value, a pointer into a global, points to.
+   */
+  static bool isNeverWritten(llvm::Value *Value) {
+    for (llvm::Use &Use : Value->uses()) {
+      llvm::User *User = Use.getUser();
+      if (auto Load = llvm::dyn_cast<llvm::LoadInst>(User)) {
+        if (!Load->isSimple())
+          return false;
+      } else if (auto Copy = llvm::dyn_cast<llvm::MemTransferInst>(User)) {
+        if (Use.get() != Copy->getRawSource() || Copy->isVolatile())
+          return false;
+      } else if (llvm::isa<llvm::BitCastOperator>(User)) {
+        if (!isNeverWritten(User))
+          return false;
+      } else if (auto GEP = llvm::dyn_cast<llvm::GEPOperator>(User)) {
+        if (Use.get() != GEP->getPointerOperand() || !isNeverWritten(GEP))
+          return false;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Mark the Loads of F from globals that are never written.
+  bool markReadOnlyGlobalLoads(llvm::Function &F) {
+    bool Changed = false;
+    for (llvm::BasicBlock &BB : F) {
+      for (llvm::Instruction &Inst : BB) {
+        auto Load = llvm::dyn_cast<llvm::LoadInst>(&Inst);
+        if (Load == nullptr || !Load->isSimple())
+          continue;
+
+        llvm::Value *Base = llvm::GetUnderlyingObject(Load->getPointerOperand(), *DL);
+        auto GV = llvm::dyn_cast<llvm::GlobalVariable>(Base);
+        if (GV != nullptr && ReadOnlyGlobals.count(GV)) {
+          Load->setMetadata("invariant.load", EmptyMDNode);
+          Changed = true;
+        }
+      }
+    }
+    return Changed;
+  }
+
   // Pointer to empty metadata node used for "invariant.load" marking.
   llvm::MDNode *EmptyMDNode;
+
+  // DataLayout of the module.
+  const llvm::DataLayout *DL;
+
+  // Defined globals that no code of the module writes.
+  llvm::SmallPtrSet<llvm::GlobalVariable *, 16> ReadOnlyGlobals;
 }; // end RSInvariantPass
 
 char RSInvariantPass::ID = 0;
@@ -24,17 +24,24 @@
 
 #include "slang_version.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <functional>
 #include <unordered_set>
 
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/IR/CallSite.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Function.h>
@@ -47,14 +54,43 @@ const int kNumExpandedForeachParams = 4;
 const int kNumExpandedReduceAccumulatorParams = 4;
 #endif
 
-const char kRenderScriptTBAARootName[] = "RenderScript Distinct TBAA";
-const char kRenderScriptTBAANodeName[] = "RenderScript TBAA";
+const char kRenderScriptKernelTBAANodeName[] = "RenderScript Kernel TBAA";
+const char kCTBAARootName[] = "Simple C/C++ TBAA";
 
 using namespace bcc;
 
 namespace {
 
 static const bool gEnableRsTbaa = true;
+static const bool gEnableRsNoAliasScopes = true;
+
+// Number of accumulator calls between two consecutive calls to the halter of
+// a general reduce kernel. A value of 0 disables the halter check entirely.
+static llvm::cl::opt<unsigned>
+ReduceHalterStride("rs-reduce-halter-stride",
+                   llvm::cl::desc("Number of accumulator calls between calls "
+                                  "to a general reduce kernel's halter "
+                                  "(0 disables early exit)"),
+                   llvm::cl::init(64));
+
+// Recognized general reduce accumulators (sum, product, minimum, ...) are
+// expanded into a vector loop followed by a horizontal reduction.
+static llvm::cl::opt<bool>
+EnableSimdReduce("rs-simd-reduce",
+                 llvm::cl::desc("Vectorize the expanded accumulators of "
+                                "recognized general reduce kernels"),
+                 llvm::cl::init(true));
+
+// Only used when the pass is run through opt; bcc passes the hints of the
+// script to the pass directly.
+static llvm::cl::list<std::string>
+ExpandShapeOpts("rs-expand-shape",
+                llvm::cl::desc("Also expand a foreach kernel for a launch "
+                               "shape, given as <kernel>:<dimX>:<alignment>"),
+                llvm::cl::value_desc("shape"), llvm::cl::ZeroOrMore);
+
+// Width of the vectors used by the SIMD accumulator expansion.
+static const unsigned kSimdReduceWidthInBits = 128;
 
 /* RSKernelExpandPass
  *
@@ -79,7 +115,20 @@ static const bool gEnableRsTbaa = true;
  * foreach kernel; and the code for <ACCUMFN>.expand depends only on
  * <ACCUMFN>, not on any other properties of the reduction kernel, so
  * any reduction kernels that share the accumulator <ACCUMFN> can
- * share <ACCUMFN>.expand also.
+ * share <ACCUMFN>.expand also. (The one exception is the halter: it
+ * is only called from <ACCUMFN>.expand if all reduction kernels
+ * sharing <ACCUMFN> also share the same halter.)
+ *
+ * A foreach kernel can also have a shape hint, stating that it is
+ * launched over rows of a known number of cells, which start at
+ * addresses of a known alignment in every input and output.  In that
+ * case, a second function "<NAME>.expand.w<DIMX>a<ALIGNMENT>" (see
+ * nameExpandShapeVariant()) is generated besides "<NAME>.expand".  It
+ * has the same signature, but ignores its x1 and x2 arguments and
+ * processes cells 0 to <DIMX> - 1, so that LTO sees a constant trip
+ * count and aligned accesses.  The driver may call it instead of
+ * "<NAME>.expand" only for a span covering a whole row of that shape,
+ * and must use "<NAME>.expand" for anything else.
  *
  * Note that this pass does not delete the original function <NAME> or
  * <ACCUMFN>. However, if it is inlined into the newly-generated
@@ -141,6 +190,15 @@ private:
   // Turns on optimization of allocation stride values.
   bool mEnableStepOpt;
 
+  // Computed by allocPointersExposed(): whether pointers into allocations
+  // may be visible anywhere in the module, and the functions that can
+  // see such pointers directly.
+  bool mAllocPointersExposed;
+  FunctionSet mAllocPointerExposers;
+
+  // Foreach kernels to emit shape-specialized expanded functions for.
+  bcc::ExpandShapeHintMap mShapeHints;
+
   uint32_t getRootSignature(llvm::Function *Function) {
     const llvm::NamedMDNode *ExportForEachMetadata =
         Module->getNamedMetadata("#rs_export_foreach");
@@ -338,11 +396,16 @@ private:
   ///   void (const RsForEachStubParamStruct *p, uint32_t x1, uint32_t x2,
   ///         uint32_t outstep)
   ///
-  llvm::Function *createEmptyExpandedForEachKernel(llvm::StringRef OldName) {
+  /// The function is named NewName, or "<OldName>.expand" if NewName is
+  /// empty.
+  ///
+  llvm::Function *createEmptyExpandedForEachKernel(llvm::StringRef OldName,
+                                                   llvm::StringRef NewName = "") {
+    std::string Name = NewName.empty() ? (OldName + ".expand").str() : NewName.str();
     llvm::Function *ExpandedFunction =
       llvm::Function::Create(ExpandedForEachType,
                              llvm::GlobalValue::ExternalLinkage,
-                             OldName + ".expand", Module);
+                             Name, Module);
     bccAssert(ExpandedFunction->arg_size() == kNumExpandedForeachParams);
     llvm::Function::arg_iterator AI = ExpandedFunction->arg_begin();
     (AI++)->setName("p");
@@ -440,7 +503,16 @@ private:
 
     // decltype(LowerBound) *ivvar = alloca(sizeof(int))
     // *ivvar = LowerBound
-    IVVar = Builder.CreateAlloca(LowerBound->getType(), nullptr, BCC_INDEX_VAR_NAME);
+    //
+    // The alloca must live in the entry block to be promoted to a register
+    // later on, even if the loop itself does not start there.
+    llvm::BasicBlock *EntryBB = &CondBB->getParent()->getEntryBlock();
+    if (CondBB == EntryBB) {
+      IVVar = Builder.CreateAlloca(LowerBound->getType(), nullptr, BCC_INDEX_VAR_NAME);
+    } else {
+      llvm::IRBuilder<> EntryBuilder(EntryBB, EntryBB->getFirstInsertionPt());
+      IVVar = EntryBuilder.CreateAlloca(LowerBound->getType(), nullptr, BCC_INDEX_VAR_NAME);
+    }
     Builder.CreateStore(LowerBound, IVVar);
 
     // if (LowerBound < Upperbound)
@@ -538,10 +610,23 @@ private:
   }
 
 public:
-  explicit RSKernelExpandPass(bool pEnableStepOpt = true)
+  explicit RSKernelExpandPass(bool pEnableStepOpt = true,
+                              const bcc::ExpandShapeHintMap &pShapeHints =
+                                  bcc::ExpandShapeHintMap())
       : ModulePass(ID), Module(nullptr), Context(nullptr),
-        mEnableStepOpt(pEnableStepOpt) {
-
+        mEnableStepOpt(pEnableStepOpt), mAllocPointersExposed(true),
+        mShapeHints(pShapeHints) {
+    for (const std::string &Opt : ExpandShapeOpts) {
+      size_t First = Opt.find(':');
+      size_t Second = Opt.rfind(':');
+      if (First == std::string::npos || First == Second) {
+        ALOGE("Invalid kernel shape '%s'", Opt.c_str());
+        continue;
+      }
+      bcc::ExpandShapeHint &Hint = mShapeHints[Opt.substr(0, First)];
+      Hint.dimX = strtoul(Opt.substr(First + 1, Second - First - 1).c_str(), nullptr, 10);
+      Hint.alignment = strtoul(Opt.substr(Second + 1).c_str(), nullptr, 10);
+    }
   }
 
   virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
@@ -635,6 +720,7 @@ public:
   //                       calling convention dictates that a value must be passed
   //                       by reference, and so we need a stacked temporary to hold
   //                       a copy of that value)
+  // InBufAlignment - if greater than 1, the known alignment of each InBufPtrs[] element
   void ExpandInputsLoopInvariant(llvm::IRBuilder<> &Builder, llvm::BasicBlock *LoopHeader,
                                  llvm::Value *Arg_p,
                                  llvm::MDNode *TBAAPointer,
@@ -642,7 +728,8 @@ public:
                                  const size_t NumInputs,
                                  llvm::SmallVectorImpl<llvm::Type *> &InTypes,
                                  llvm::SmallVectorImpl<llvm::Value *> &InBufPtrs,
-                                 llvm::SmallVectorImpl<llvm::Value *> &InStructTempSlots) {
+                                 llvm::SmallVectorImpl<llvm::Value *> &InStructTempSlots,
+                                 unsigned InBufAlignment = 0) {
     bccAssert(NumInputs <= RS_KERNEL_INPUT_LIMIT);
 
     // Extract information about input slots. The work done
@@ -694,6 +781,10 @@ public:
         InBufPtr->setMetadata("tbaa", TBAAPointer);
       }
 
+      if (InBufAlignment > 1) {
+        Builder.CreateAlignmentAssumption(Module->getDataLayout(), InBufPtr, InBufAlignment);
+      }
+
       InTypes.push_back(InType);
       InBufPtrs.push_back(CastInBufPtr);
     }
@@ -714,6 +805,8 @@ public:
   // InBufPtrs[] - this function consumes the information produced by ExpandInputsLoopInvariant()
   // InStructTempSlots[] - this function consumes the information produced by ExpandInputsLoopInvariant()
   // IndVar - value of loop induction variable (X coordinate) for a given loop iteration
+  // InAliasScopes[] - if not empty, "alias.scope" metadata for the load from each input
+  // InNoAlias - "noalias" metadata for the loads from the inputs, used with InAliasScopes[]
   //
   // RootArgs - this function sets this to the list of outgoing argument values corresponding
   //            to the inputs
@@ -725,7 +818,9 @@ public:
                         const llvm::SmallVectorImpl<llvm::Value *> &InBufPtrs,
                         const llvm::SmallVectorImpl<llvm::Value *> &InStructTempSlots,
                         llvm::Value *IndVar,
-                        llvm::SmallVectorImpl<llvm::Value *> &RootArgs) {
+                        llvm::SmallVectorImpl<llvm::Value *> &RootArgs,
+                        llvm::ArrayRef<llvm::MDNode *> InAliasScopes = llvm::None,
+                        llvm::MDNode *InNoAlias = nullptr) {
     llvm::Value *Offset = Builder.CreateSub(IndVar, Arg_x1);
     llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*Context);
 
@@ -753,6 +848,11 @@ public:
         InputLoad->setMetadata("tbaa", TBAAAllocation);
       }
 
+      if (!InAliasScopes.empty()) {
+        InputLoad->setMetadata(llvm::LLVMContext::MD_alias_scope, InAliasScopes[Index]);
+        InputLoad->setMetadata(llvm::LLVMContext::MD_noalias, InNoAlias);
+      }
+
       if (llvm::Value *TemporarySlot = InStructTempSlots[Index]) {
         // Pass a pointer to a temporary on the stack, rather than
         // passing a pointer to the original value. We do not want
@@ -914,8 +1014,12 @@ public:
   }
 
   /* Expand a pass-by-value foreach kernel.
+   *
+   * If Shape is not null, the "<NAME>.expand.w<DIMX>a<ALIGNMENT>" variant
+   * for that launch shape is generated instead of "<NAME>.expand".
    */
-  bool ExpandForEach(llvm::Function *Function, uint32_t Signature) {
+  bool ExpandForEach(llvm::Function *Function, uint32_t Signature,
+                     const bcc::ExpandShapeHint *Shape = nullptr) {
     bccAssert(bcinfo::MetadataExtractor::hasForEachSignatureKernel(Signature));
     ALOGV("Expanding kernel Function %s", Function->getName().str().c_str());
 
@@ -924,10 +1028,12 @@ public:
     if (!mStructExplicitlyPaddedBySlang && (Module->getTargetTriple() == DEFAULT_X86_TRIPLE_STRING)) {
       DL.reset(X86_CUSTOM_DL_STRING);
     }
-    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*Context);
 
     llvm::Function *ExpandedFunction =
-      createEmptyExpandedForEachKernel(Function->getName());
+      createEmptyExpandedForEachKernel(
+          Function->getName(),
+          Shape ? nameExpandShapeVariant(Function->getName(), Shape->dimX, Shape->alignment)
+                : std::string());
 
     /*
      * Extract the expanded function's parameters.  It is guaranteed by
@@ -947,22 +1053,17 @@ public:
     // Construct the actual function body.
     llvm::IRBuilder<> Builder(&*ExpandedFunction->getEntryBlock().begin());
 
-    // Create TBAA meta-data.
-    llvm::MDNode *TBAARenderScriptDistinct, *TBAARenderScript,
-                 *TBAAAllocation, *TBAAPointer;
-    llvm::MDBuilder MDHelper(*Context);
+    // A shape-specialized function always processes a whole row.
+    unsigned BufAlignment = 0;
+    if (Shape) {
+      Arg_x1 = Builder.getInt32(0);
+      Arg_x2 = Builder.getInt32(Shape->dimX);
+      BufAlignment = Shape->alignment;
+    }
 
-    TBAARenderScriptDistinct =
-      MDHelper.createTBAARoot(kRenderScriptTBAARootName);
-    TBAARenderScript = MDHelper.createTBAANode(kRenderScriptTBAANodeName,
-        TBAARenderScriptDistinct);
-    TBAAAllocation = MDHelper.createTBAAScalarTypeNode("allocation",
-                                                       TBAARenderScript);
-    TBAAAllocation = MDHelper.createTBAAStructTagNode(TBAAAllocation,
-                                                      TBAAAllocation, 0);
-    TBAAPointer = MDHelper.createTBAAScalarTypeNode("pointer",
-                                                    TBAARenderScript);
-    TBAAPointer = MDHelper.createTBAAStructTagNode(TBAAPointer, TBAAPointer, 0);
+    // Create TBAA meta-data.
+    llvm::MDNode *TBAAAllocation, *TBAAPointer;
+    createKernelTBAA(Function, TBAAAllocation, TBAAPointer);
 
     /*
      * Collect and construct the arguments for the kernel().
@@ -1005,6 +1106,10 @@ public:
         OutBasePtr->setMetadata("tbaa", TBAAPointer);
       }
 
+      if (BufAlignment > 1) {
+        Builder.CreateAlignmentAssumption(Module->getDataLayout(), OutBasePtr, BufAlignment);
+      }
+
       if (mStructExplicitlyPaddedBySlang || (Module->getTargetTriple() != DEFAULT_X86_TRIPLE_STRING)) {
         CastedOutBasePtr = Builder.CreatePointerCast(OutBasePtr, OutTy, "casted_out");
       } else {
@@ -1018,12 +1123,178 @@ public:
       }
     }
 
+    bccAssert(NumRemainingInputs <= RS_KERNEL_INPUT_LIMIT);
+
+    // The remaining arguments of the kernel are one argument for each
+    // array entry from the InPtr field of the DriverInfo structure,
+    // followed by the special arguments (see ExpandSpecialArguments()).
+    const size_t NumInPtrArguments = NumRemainingInputs - getNumSpecialArguments(Signature);
+
+    // Scoped alias metadata for the loop, separating each input from the
+    // output.  Only used if the kernel returns its output (otherwise the
+    // stores to the output are in the kernel, where we cannot annotate
+    // them).
+    llvm::SmallVector<llvm::MDNode*, 8> InAliasScopes;
+    llvm::MDNode *OutAliasScope = nullptr, *OutNoAlias = nullptr;
+
+    if (gEnableRsNoAliasScopes && CastedOutBasePtr && !PassOutByPointer &&
+        NumInPtrArguments > 0) {
+      llvm::MDBuilder MDHelper(*Context);
+      llvm::MDNode *Domain = MDHelper.createAliasScopeDomain(ExpandedFunction->getName());
+      llvm::MDNode *OutScope = MDHelper.createAliasScope("output", Domain);
+      llvm::SmallVector<llvm::Metadata*, 8> InScopes;
+      for (size_t Index = 0; Index < NumInPtrArguments; ++Index) {
+        llvm::MDNode *InScope =
+            MDHelper.createAliasScope("input" + std::to_string(Index), Domain);
+        InScopes.push_back(InScope);
+        InAliasScopes.push_back(llvm::MDNode::get(*Context, InScope));
+      }
+      OutAliasScope = llvm::MDNode::get(*Context, OutScope);
+      OutNoAlias = llvm::MDNode::get(*Context, InScopes);
+
+      // The driver does not promise that the output allocation is distinct
+      // from the inputs, so check the address ranges of this span at run
+      // time, and fall back to a loop without the scoped alias metadata if
+      // they overlap:
+      //
+      //   if (no overlap)
+      //     NoAlias:  <loop with alias.scope/noalias metadata>
+      //   else
+      //     MayAlias: <loop without alias.scope/noalias metadata>
+      llvm::Value *NoOverlap =
+          createNoOverlapCheck(Builder, DL, Arg_p, Arg_x1, Arg_x2, OutBasePtr, OutTy,
+                               ArgIter, NumInPtrArguments, TBAAPointer);
+
+      llvm::BasicBlock *EntryBB = Builder.GetInsertBlock();
+      llvm::BasicBlock *ExitBB =
+          llvm::SplitBlock(EntryBB, &*Builder.GetInsertPoint(), nullptr, nullptr);
+      llvm::BasicBlock *NoAliasBB =
+          llvm::BasicBlock::Create(*Context, "NoAlias", ExpandedFunction, ExitBB);
+      llvm::BasicBlock *MayAliasBB =
+          llvm::BasicBlock::Create(*Context, "MayAlias", ExpandedFunction, ExitBB);
+
+      EntryBB->getTerminator()->eraseFromParent();
+      Builder.SetInsertPoint(EntryBB);
+      Builder.CreateCondBr(NoOverlap, NoAliasBB, MayAliasBB);
+      Builder.SetInsertPoint(MayAliasBB);
+      Builder.CreateBr(ExitBB);
+      Builder.SetInsertPoint(NoAliasBB);
+      Builder.CreateBr(ExitBB);
+
+      Builder.SetInsertPoint(NoAliasBB->getTerminator());
+      ExpandForEachLoop(Builder, Function, Signature, Arg_p, Arg_x1, Arg_x2, DL,
+                        CastedOutBasePtr, OutTy, PassOutByPointer, ArgIter, NumInPtrArguments,
+                        BufAlignment, TBAAAllocation, TBAAPointer,
+                        InAliasScopes, OutAliasScope, OutNoAlias);
+
+      Builder.SetInsertPoint(MayAliasBB->getTerminator());
+      InAliasScopes.clear();
+      OutAliasScope = OutNoAlias = nullptr;
+    }
+
+    ExpandForEachLoop(Builder, Function, Signature, Arg_p, Arg_x1, Arg_x2, DL,
+                      CastedOutBasePtr, OutTy, PassOutByPointer, ArgIter, NumInPtrArguments,
+                      BufAlignment, TBAAAllocation, TBAAPointer,
+                      InAliasScopes, OutAliasScope, OutNoAlias);
+
+    return true;
+  }
+
+  static bool isValidShapeHint(const char *Name, const bcc::ExpandShapeHint &Shape) {
+    if (Shape.dimX == 0 || (Shape.alignment & (Shape.alignment - 1)) != 0) {
+      ALOGW("Ignoring invalid shape hint for kernel %s (dimX %u, alignment %u)",
+            Name, Shape.dimX, Shape.alignment);
+      return false;
+    }
+    return true;
+  }
+
+  // Return the number of special arguments (see ExpandSpecialArguments())
+  // taken by a kernel with the given signature.
+  static size_t getNumSpecialArguments(uint32_t Signature) {
+    return bcinfo::MetadataExtractor::hasForEachSignatureCtxt(Signature) +
+           bcinfo::MetadataExtractor::hasForEachSignatureX(Signature) +
+           bcinfo::MetadataExtractor::hasForEachSignatureY(Signature) +
+           bcinfo::MetadataExtractor::hasForEachSignatureZ(Signature);
+  }
+
+  // Generate code that checks whether the output cells written by an
+  // expanded kernel for the span [x1, x2) overlap with the input cells it
+  // reads.  Returns an i1 value that is true if there is no overlap.
+  //
+  // DL - data layout used to address the input and output buffers
+  // OutBasePtr - first byte of the output buffer
+  // OutTy - pointer to the output type
+  // ArgIter - iterator pointing to first input of the kernel
+  // NumInputs - number of inputs
+  llvm::Value *createNoOverlapCheck(llvm::IRBuilder<> &Builder, const llvm::DataLayout &DL,
+                                    llvm::Value *Arg_p, llvm::Value *Arg_x1, llvm::Value *Arg_x2,
+                                    llvm::Value *OutBasePtr, llvm::Type *OutTy,
+                                    llvm::Function::arg_iterator ArgIter, size_t NumInputs,
+                                    llvm::MDNode *TBAAPointer) {
+    llvm::Type *IntPtrTy = DL.getIntPtrType(*Context);
+    llvm::Value *Count = Builder.CreateZExt(Builder.CreateSub(Arg_x2, Arg_x1), IntPtrTy);
+
+    auto GetEnd = [&](llvm::Value *Begin, llvm::Type *ElementTy) {
+      uint64_t Size = DL.getTypeAllocSize(ElementTy);
+      return Builder.CreateAdd(Begin, Builder.CreateMul(Count, llvm::ConstantInt::get(IntPtrTy, Size)));
+    };
+
+    llvm::Value *OutBegin = Builder.CreatePtrToInt(OutBasePtr, IntPtrTy, "out_begin");
+    llvm::Value *OutEnd = GetEnd(OutBegin, OutTy->getPointerElementType());
+
+    llvm::Value *NoOverlap = Builder.getTrue();
+    for (size_t InputIndex = 0; InputIndex < NumInputs; ++InputIndex, ArgIter++) {
+      // Inputs passed by pointer are structs copied to the stack (see
+      // ExpandInputsLoopInvariant()).
+      llvm::Type *InTy = ArgIter->getType();
+      if (auto PtrType = llvm::dyn_cast<llvm::PointerType>(InTy)) {
+        InTy = PtrType->getElementType();
+      }
+
+      SmallGEPIndices InBufPtrGEP(GEPHelper({0, RsExpandKernelDriverInfoPfxFieldInPtr,
+                                             static_cast<int32_t>(InputIndex)}));
+      llvm::Value    *InBufPtrAddr = Builder.CreateInBoundsGEP(Arg_p, InBufPtrGEP, "in_begin.gep");
+      llvm::LoadInst *InBufPtr = Builder.CreateLoad(InBufPtrAddr, "in_buf");
+      if (gEnableRsTbaa) {
+        InBufPtr->setMetadata("tbaa", TBAAPointer);
+      }
+
+      llvm::Value *InBegin = Builder.CreatePtrToInt(InBufPtr, IntPtrTy, "in_begin");
+      llvm::Value *InEnd = GetEnd(InBegin, InTy);
+      NoOverlap = Builder.CreateAnd(NoOverlap,
+                                    Builder.CreateOr(Builder.CreateICmpULE(InEnd, OutBegin),
+                                                     Builder.CreateICmpULE(OutEnd, InBegin)));
+    }
+
+    return NoOverlap;
+  }
+
+  // Generate the loop of an expanded pass-by-value foreach kernel (see
+  // ExpandForEach()) at the insertion point of Builder.
+  //
+  // InBufAlignment - if greater than 1, the known alignment of the first
+  //   cell of each input
+  // InAliasScopes, OutAliasScope, OutNoAlias - if InAliasScopes is not
+  //   empty, scoped alias metadata stating that the loads from the inputs
+  //   and the store to the output do not alias
+  void ExpandForEachLoop(llvm::IRBuilder<> &Builder, llvm::Function *Function,
+                         uint32_t Signature, llvm::Value *Arg_p,
+                         llvm::Value *Arg_x1, llvm::Value *Arg_x2,
+                         const llvm::DataLayout &DL,
+                         llvm::Value *CastedOutBasePtr, llvm::Type *OutTy,
+                         bool PassOutByPointer,
+                         llvm::Function::arg_iterator ArgIter,
+                         const size_t NumInPtrArguments, unsigned InBufAlignment,
+                         llvm::MDNode *TBAAAllocation, llvm::MDNode *TBAAPointer,
+                         llvm::ArrayRef<llvm::MDNode*> InAliasScopes,
+                         llvm::MDNode *OutAliasScope, llvm::MDNode *OutNoAlias) {
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*Context);
+
     llvm::SmallVector<llvm::Type*,  8> InTypes;
     llvm::SmallVector<llvm::Value*, 8> InBufPtrs;
     llvm::SmallVector<llvm::Value*, 8> InStructTempSlots;
 
-    bccAssert(NumRemainingInputs <= RS_KERNEL_INPUT_LIMIT);
-
     // Create the loop structure.
     llvm::BasicBlock *LoopHeader = Builder.GetInsertBlock();
     llvm::Value *IV;
@@ -1032,18 +1303,11 @@ public:
     llvm::SmallVector<llvm::Value*, 8> CalleeArgs;
     const int CalleeArgsContextIdx =
       ExpandSpecialArguments(Signature, IV, Arg_p, Builder, CalleeArgs,
-                             [&NumRemainingInputs]() { --NumRemainingInputs; },
-                             LoopHeader->getTerminator());
-
-    // After ExpandSpecialArguments() gets called, NumRemainingInputs
-    // counts the number of arguments to the kernel that correspond to
-    // an array entry from the InPtr field of the DriverInfo
-    // structure.
-    const size_t NumInPtrArguments = NumRemainingInputs;
+                             [](){}, LoopHeader->getTerminator());
 
     if (NumInPtrArguments > 0) {
       ExpandInputsLoopInvariant(Builder, LoopHeader, Arg_p, TBAAPointer, ArgIter, NumInPtrArguments,
-                                InTypes, InBufPtrs, InStructTempSlots);
+                                InTypes, InBufPtrs, InStructTempSlots, InBufAlignment);
     }
 
     // Populate the actual call to kernel().
@@ -1078,7 +1342,8 @@ public:
 
     if (NumInPtrArguments > 0) {
       ExpandInputsBody(Builder, Arg_x1, TBAAAllocation, NumInPtrArguments,
-                       InTypes, InBufPtrs, InStructTempSlots, IV, RootArgs);
+                       InTypes, InBufPtrs, InStructTempSlots, IV, RootArgs,
+                       InAliasScopes, OutAliasScope);
     }
 
     finishArgList(RootArgs, CalleeArgs, CalleeArgsContextIdx, *Function, Builder);
@@ -1091,9 +1356,11 @@ public:
       if (gEnableRsTbaa) {
         Store->setMetadata("tbaa", TBAAAllocation);
       }
+      if (!InAliasScopes.empty()) {
+        Store->setMetadata(llvm::LLVMContext::MD_alias_scope, OutAliasScope);
+        Store->setMetadata(llvm::LLVMContext::MD_noalias, OutNoAlias);
+      }
     }
-
-    return true;
   }
 
   // Certain categories of functions that make up a general
@@ -1119,6 +1386,575 @@ public:
     return false;
   }
 
+  // Describes an accumulator function that matchSimdReduction() recognized
+  // as a reduction that can be computed with vector instructions.
+  struct SimdReduction {
+    enum KindTy {
+      // *accum = *accum <Opcode> in
+      KindBinOp,
+      // *accum = Pred(*accum, in) ? *accum : in
+      KindMinMax,
+      // if (Pred(in, accum->val)) { accum->val = in; accum->idx = x; }
+      KindArgMinMax
+    } Kind;
+
+    llvm::Instruction::BinaryOps Opcode;
+    llvm::CmpInst::Predicate Pred;
+    llvm::FastMathFlags FMF;
+
+    // Type of the accumulated value (of the field "val" for KindArgMinMax).
+    llvm::Type *ValTy;
+  };
+
+  // Returns true if Pred orders its operands, so that "Pred(a, b) ? a : b"
+  // computes a minimum or a maximum.
+  static bool isMinMaxPredicate(llvm::CmpInst::Predicate Pred) {
+    switch (Pred) {
+      case llvm::CmpInst::ICMP_SLT: case llvm::CmpInst::ICMP_SLE:
+      case llvm::CmpInst::ICMP_SGT: case llvm::CmpInst::ICMP_SGE:
+      case llvm::CmpInst::ICMP_ULT: case llvm::CmpInst::ICMP_ULE:
+      case llvm::CmpInst::ICMP_UGT: case llvm::CmpInst::ICMP_UGE:
+      case llvm::CmpInst::FCMP_OLT: case llvm::CmpInst::FCMP_OLE:
+      case llvm::CmpInst::FCMP_OGT: case llvm::CmpInst::FCMP_OGE:
+      case llvm::CmpInst::FCMP_ULT: case llvm::CmpInst::FCMP_ULE:
+      case llvm::CmpInst::FCMP_UGT: case llvm::CmpInst::FCMP_UGE:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Returns the strict version of a predicate accepted by isMinMaxPredicate().
+  static llvm::CmpInst::Predicate getStrictPredicate(llvm::CmpInst::Predicate Pred) {
+    switch (Pred) {
+      case llvm::CmpInst::ICMP_SLE: return llvm::CmpInst::ICMP_SLT;
+      case llvm::CmpInst::ICMP_SGE: return llvm::CmpInst::ICMP_SGT;
+      case llvm::CmpInst::ICMP_ULE: return llvm::CmpInst::ICMP_ULT;
+      case llvm::CmpInst::ICMP_UGE: return llvm::CmpInst::ICMP_UGT;
+      case llvm::CmpInst::FCMP_OLE: return llvm::CmpInst::FCMP_OLT;
+      case llvm::CmpInst::FCMP_OGE: return llvm::CmpInst::FCMP_OGT;
+      case llvm::CmpInst::FCMP_ULE: return llvm::CmpInst::FCMP_ULT;
+      case llvm::CmpInst::FCMP_UGE: return llvm::CmpInst::FCMP_UGT;
+      default:                      return Pred;
+    }
+  }
+
+  // Returns true if Ptr points to field FieldNo of the struct Base points to.
+  static bool isAccumFieldPointer(llvm::Value *Ptr, llvm::Value *Base, unsigned FieldNo) {
+    // Note that stripPointerCasts() also strips all-zero GEPs, i.e.,
+    // the address of field 0.
+    Ptr = Ptr->stripPointerCasts();
+    if (Ptr == Base)
+      return FieldNo == 0;
+
+    auto *GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(Ptr);
+    if (!GEP || GEP->getPointerOperand() != Base || GEP->getNumIndices() != 2)
+      return false;
+    auto *Idx0 = llvm::dyn_cast<llvm::ConstantInt>(GEP->getOperand(1));
+    auto *Idx1 = llvm::dyn_cast<llvm::ConstantInt>(GEP->getOperand(2));
+    return Idx0 && Idx1 && Idx0->isZero() && Idx1->getZExtValue() == FieldNo;
+  }
+
+  // Returns the number of values of type ValTy that fit into one vector
+  // of kSimdReduceWidthInBits bits, or 0 if ValTy is not a primitive
+  // type (or a vector of a primitive type) suitable for SIMD reduction.
+  unsigned getSimdReductionFactor(llvm::Type *ValTy) {
+    llvm::Type *ElementTy = ValTy->getScalarType();
+    if (ElementTy->isIntegerTy()) {
+      unsigned Bits = ElementTy->getIntegerBitWidth();
+      if (Bits != 8 && Bits != 16 && Bits != 32 && Bits != 64)
+        return 0;
+    } else if (!ElementTy->isHalfTy() && !ElementTy->isFloatTy() && !ElementTy->isDoubleTy()) {
+      return 0;
+    }
+
+    // Three-element vectors are padded to four elements in allocations,
+    // so consecutive cells cannot be loaded as one wider vector.
+    const llvm::DataLayout &DL = Module->getDataLayout();
+    uint64_t Bits = DL.getTypeSizeInBits(ValTy);
+    if (DL.getTypeAllocSizeInBits(ValTy) != Bits || !llvm::isPowerOf2_64(Bits))
+      return 0;
+
+    unsigned Factor = kSimdReduceWidthInBits / Bits;
+    return Factor >= 2 ? Factor : 0;
+  }
+
+  // Recognize an accumulator of the form
+  //
+  //   define void @func(T* %accum, T %in) {
+  //     %a = load T, T* %accum
+  //     %r = <op> T %a, %in        ; or: select (cmp %a, %in), %a, %in
+  //     store T %r, T* %accum
+  //     ret void
+  //   }
+  //
+  // where <op> is associative and commutative.  Floating point addition
+  // and multiplication are only accepted if they allow reassociation, and
+  // floating point minimum and maximum only if they ignore NaNs and signed
+  // zeros, because the SIMD expansion does not preserve the order of
+  // evaluation.
+  bool matchSimdAccumulate(llvm::Function *FnAccumulator, SimdReduction &Reduction) {
+    if (FnAccumulator->arg_size() != 2 || FnAccumulator->size() != 1)
+      return false;
+
+    auto ArgIter = FnAccumulator->arg_begin();
+    llvm::Argument *Accum = &*(ArgIter++);
+    llvm::Argument *In    = &*(ArgIter++);
+    llvm::Type *ValTy = In->getType();
+    if (!getSimdReductionFactor(ValTy) || Accum->getType() != ValTy->getPointerTo())
+      return false;
+
+    llvm::LoadInst *Load = nullptr;
+    llvm::StoreInst *Store = nullptr;
+    size_t NumInstructions = 0;
+    for (llvm::Instruction &I : FnAccumulator->getEntryBlock()) {
+      if (llvm::isa<llvm::DbgInfoIntrinsic>(I) || llvm::isa<llvm::ReturnInst>(I))
+        continue;
+      ++NumInstructions;
+      if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(&I)) {
+        if (Load || !LI->isSimple() || LI->getPointerOperand() != Accum)
+          return false;
+        Load = LI;
+      } else if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(&I)) {
+        if (Store || !SI->isSimple() || SI->getPointerOperand() != Accum)
+          return false;
+        Store = SI;
+      } else if (I.mayHaveSideEffects()) {
+        return false;
+      }
+    }
+    if (!Load || !Store)
+      return false;
+
+    auto IsOperand = [Load, In](llvm::Value *V) { return V == Load || V == In; };
+    llvm::Value *Result = Store->getValueOperand();
+
+    if (auto *BinOp = llvm::dyn_cast<llvm::BinaryOperator>(Result)) {
+      if (NumInstructions != 3 || BinOp->getOperand(0) == BinOp->getOperand(1) ||
+          !IsOperand(BinOp->getOperand(0)) || !IsOperand(BinOp->getOperand(1)))
+        return false;
+
+      switch (BinOp->getOpcode()) {
+        case llvm::Instruction::Add:
+        case llvm::Instruction::Mul:
+        case llvm::Instruction::And:
+        case llvm::Instruction::Or:
+        case llvm::Instruction::Xor:
+          break;
+        case llvm::Instruction::FAdd:
+        case llvm::Instruction::FMul:
+          if (!BinOp->hasUnsafeAlgebra())
+            return false;
+          Reduction.FMF = BinOp->getFastMathFlags();
+          break;
+        default:
+          return false;
+      }
+
+      Reduction.Kind = SimdReduction::KindBinOp;
+      Reduction.Opcode = BinOp->getOpcode();
+    } else if (auto *Select = llvm::dyn_cast<llvm::SelectInst>(Result)) {
+      auto *Cmp = llvm::dyn_cast<llvm::CmpInst>(Select->getCondition());
+      llvm::Value *First = Select->getTrueValue();
+      llvm::Value *Second = Select->getFalseValue();
+      if (NumInstructions != 4 || !Cmp || First == Second ||
+          !IsOperand(First) || !IsOperand(Second))
+        return false;
+
+      llvm::CmpInst::Predicate Pred = Cmp->getPredicate();
+      if (Cmp->getOperand(0) == Second && Cmp->getOperand(1) == First)
+        Pred = llvm::CmpInst::getSwappedPredicate(Pred);
+      else if (Cmp->getOperand(0) != First || Cmp->getOperand(1) != Second)
+        return false;
+
+      if (!isMinMaxPredicate(Pred))
+        return false;
+      if (llvm::isa<llvm::FCmpInst>(Cmp) && !Cmp->hasUnsafeAlgebra() &&
+          !(Cmp->hasNoNaNs() && Cmp->hasNoSignedZeros()))
+        return false;
+
+      Reduction.Kind = SimdReduction::KindMinMax;
+      Reduction.Pred = Pred;
+    } else {
+      return false;
+    }
+
+    Reduction.ValTy = ValTy;
+    return true;
+  }
+
+  // Recognize an argmin/argmax style accumulator of the form
+  //
+  //   define void @func({ T, i32 }* %accum, T %in, i32 %x) {
+  //     if (Pred(%in, %accum->val)) {
+  //       %accum->val = %in;
+  //       %accum->idx = %x;
+  //     }
+  //   }
+  //
+  // written either with a conditional branch or with a pair of selects.
+  // Floating point comparisons must ignore NaNs.
+  bool matchSimdArgMinMax(llvm::Function *FnAccumulator, SimdReduction &Reduction) {
+    if (FnAccumulator->arg_size() != 3)
+      return false;
+
+    auto ArgIter = FnAccumulator->arg_begin();
+    llvm::Argument *Accum = &*(ArgIter++);
+    llvm::Argument *In    = &*(ArgIter++);
+    llvm::Argument *X     = &*(ArgIter++);
+    llvm::Type *ValTy = In->getType();
+    if (ValTy->isVectorTy() || !getSimdReductionFactor(ValTy) ||
+        !X->getType()->isIntegerTy(32))
+      return false;
+
+    auto *AccumTy = llvm::dyn_cast<llvm::StructType>(Accum->getType()->getPointerElementType());
+    if (!AccumTy || AccumTy->getNumElements() != 2 ||
+        AccumTy->getElementType(0) != ValTy || AccumTy->getElementType(1) != X->getType())
+      return false;
+
+    llvm::LoadInst *ValLoad = nullptr, *IdxLoad = nullptr;
+    llvm::StoreInst *ValStore = nullptr, *IdxStore = nullptr;
+    for (llvm::BasicBlock &BB : *FnAccumulator) {
+      for (llvm::Instruction &I : BB) {
+        if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(&I)) {
+          if (!LI->isSimple())
+            return false;
+          llvm::Value *Ptr = LI->getPointerOperand();
+          if (!ValLoad && LI->getType() == ValTy && isAccumFieldPointer(Ptr, Accum, 0))
+            ValLoad = LI;
+          else if (!IdxLoad && LI->getType() == X->getType() && isAccumFieldPointer(Ptr, Accum, 1))
+            IdxLoad = LI;
+          else
+            return false;
+        } else if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(&I)) {
+          if (!SI->isSimple())
+            return false;
+          llvm::Value *Ptr = SI->getPointerOperand();
+          llvm::Type *StoredTy = SI->getValueOperand()->getType();
+          if (!ValStore && StoredTy == ValTy && isAccumFieldPointer(Ptr, Accum, 0))
+            ValStore = SI;
+          else if (!IdxStore && StoredTy == X->getType() && isAccumFieldPointer(Ptr, Accum, 1))
+            IdxStore = SI;
+          else
+            return false;
+        } else if (I.mayHaveSideEffects() && !llvm::isa<llvm::DbgInfoIntrinsic>(I)) {
+          return false;
+        }
+      }
+    }
+    if (!ValLoad || !ValStore || !IdxStore || ValStore->getParent() != IdxStore->getParent())
+      return false;
+
+    llvm::Value *Cond = nullptr;
+    bool UpdateWhenTrue = true;
+    llvm::Value *StoredVal = ValStore->getValueOperand();
+    llvm::Value *StoredIdx = IdxStore->getValueOperand();
+    if (StoredVal == In && StoredIdx == X) {
+      // Branch form: the stores are guarded by a conditional branch in the
+      // entry block, and both paths join in a block that just returns.
+      llvm::BasicBlock *StoreBB = ValStore->getParent();
+      llvm::BasicBlock *EntryBB = &FnAccumulator->getEntryBlock();
+      auto *Br = llvm::dyn_cast<llvm::BranchInst>(EntryBB->getTerminator());
+      if (FnAccumulator->size() != 3 || IdxLoad || !Br || !Br->isConditional() ||
+          StoreBB->getSinglePredecessor() != EntryBB)
+        return false;
+
+      UpdateWhenTrue = (Br->getSuccessor(0) == StoreBB);
+      llvm::BasicBlock *JoinBB = Br->getSuccessor(UpdateWhenTrue ? 1 : 0);
+      if (StoreBB->getSingleSuccessor() != JoinBB ||
+          !llvm::isa<llvm::ReturnInst>(JoinBB->getFirstNonPHIOrDbg()))
+        return false;
+      Cond = Br->getCondition();
+    } else {
+      // Select form: both values are selected by the same condition.
+      auto *ValSelect = llvm::dyn_cast<llvm::SelectInst>(StoredVal);
+      auto *IdxSelect = llvm::dyn_cast<llvm::SelectInst>(StoredIdx);
+      if (FnAccumulator->size() != 1 || !ValSelect || !IdxSelect || !IdxLoad ||
+          ValSelect->getCondition() != IdxSelect->getCondition())
+        return false;
+
+      UpdateWhenTrue = (ValSelect->getTrueValue() == In);
+      llvm::Value *NewVal = UpdateWhenTrue ? ValSelect->getTrueValue() : ValSelect->getFalseValue();
+      llvm::Value *OldVal = UpdateWhenTrue ? ValSelect->getFalseValue() : ValSelect->getTrueValue();
+      llvm::Value *NewIdx = UpdateWhenTrue ? IdxSelect->getTrueValue() : IdxSelect->getFalseValue();
+      llvm::Value *OldIdx = UpdateWhenTrue ? IdxSelect->getFalseValue() : IdxSelect->getTrueValue();
+      if (NewVal != In || OldVal != ValLoad || NewIdx != X || OldIdx != IdxLoad)
+        return false;
+      Cond = ValSelect->getCondition();
+    }
+
+    auto *Cmp = llvm::dyn_cast<llvm::CmpInst>(Cond);
+    if (!Cmp)
+      return false;
+
+    llvm::CmpInst::Predicate Pred = Cmp->getPredicate();
+    if (Cmp->getOperand(0) == ValLoad && Cmp->getOperand(1) == In)
+      Pred = llvm::CmpInst::getSwappedPredicate(Pred);
+    else if (Cmp->getOperand(0) != In || Cmp->getOperand(1) != ValLoad)
+      return false;
+    if (!UpdateWhenTrue)
+      Pred = llvm::CmpInst::getInversePredicate(Pred);
+
+    if (!isMinMaxPredicate(Pred))
+      return false;
+    if (llvm::isa<llvm::FCmpInst>(Cmp) && !Cmp->hasUnsafeAlgebra() && !Cmp->hasNoNaNs())
+      return false;
+
+    Reduction.Kind = SimdReduction::KindArgMinMax;
+    Reduction.Pred = Pred;
+    Reduction.ValTy = ValTy;
+    return true;
+  }
+
+  // Check whether the accumulator of a general reduce kernel computes a
+  // reduction that ExpandSimdReduction() knows how to vectorize.
+  bool matchSimdReduction(llvm::Function *FnAccumulator, uint32_t Signature,
+                          size_t NumInputs, SimdReduction &Reduction) {
+    if (NumInputs != 1 ||
+        bcinfo::MetadataExtractor::hasForEachSignatureCtxt(Signature) ||
+        bcinfo::MetadataExtractor::hasForEachSignatureY(Signature) ||
+        bcinfo::MetadataExtractor::hasForEachSignatureZ(Signature))
+      return false;
+
+    // On x86, inputs are addressed with explicit byte offsets that do not
+    // follow the module's data layout (see ExpandInputsBody()).
+    if (!mStructExplicitlyPaddedBySlang &&
+        (Module->getTargetTriple() == DEFAULT_X86_TRIPLE_STRING))
+      return false;
+
+    if (bcinfo::MetadataExtractor::hasForEachSignatureX(Signature))
+      return matchSimdArgMinMax(FnAccumulator, Reduction);
+    return matchSimdAccumulate(FnAccumulator, Reduction);
+  }
+
+  // Combine two partial results of a KindBinOp or KindMinMax reduction.
+  llvm::Value *createSimdReductionStep(llvm::IRBuilder<> &Builder,
+                                       const SimdReduction &Reduction,
+                                       llvm::Value *A, llvm::Value *B) {
+    if (Reduction.Kind == SimdReduction::KindBinOp)
+      return Builder.CreateBinOp(Reduction.Opcode, A, B);
+
+    bccAssert(Reduction.Kind == SimdReduction::KindMinMax);
+    llvm::Value *Cmp = llvm::CmpInst::isFPPredicate(Reduction.Pred)
+                           ? Builder.CreateFCmp(Reduction.Pred, A, B)
+                           : Builder.CreateICmp(Reduction.Pred, A, B);
+    return Builder.CreateSelect(Cmp, A, B);
+  }
+
+  // Return the condition under which the KindArgMinMax candidate
+  // (BVal, BIdx) is preferred over the candidate (AVal, AIdx), such that
+  // the result does not depend on the order in which candidates are
+  // combined: on ties, a strict predicate keeps the smaller index (the
+  // first occurrence), a non-strict one keeps the larger index (the last
+  // occurrence), exactly as the scalar accumulator would.
+  llvm::Value *createSimdArgPreferred(llvm::IRBuilder<> &Builder,
+                                      const SimdReduction &Reduction,
+                                      llvm::Value *AVal, llvm::Value *AIdx,
+                                      llvm::Value *BVal, llvm::Value *BIdx) {
+    llvm::CmpInst::Predicate Strict = getStrictPredicate(Reduction.Pred);
+    llvm::Value *Better, *Tie;
+    if (llvm::CmpInst::isFPPredicate(Strict)) {
+      Better = Builder.CreateFCmp(Strict, BVal, AVal);
+      Tie = Builder.CreateFCmpOEQ(BVal, AVal);
+    } else {
+      Better = Builder.CreateICmp(Strict, BVal, AVal);
+      Tie = Builder.CreateICmpEQ(BVal, AVal);
+    }
+    llvm::Value *TieWins = (Strict == Reduction.Pred) ? Builder.CreateICmpULT(BIdx, AIdx)
+                                                      : Builder.CreateICmpUGT(BIdx, AIdx);
+    return Builder.CreateOr(Better, Builder.CreateAnd(Tie, TieWins));
+  }
+
+  // Return a shufflevector mask selecting Width consecutive lanes starting
+  // at First.
+  llvm::Constant *getLaneMask(unsigned First, unsigned Width) {
+    llvm::SmallVector<uint32_t, 16> Mask;
+    for (unsigned Lane = First; Lane < First + Width; ++Lane)
+      Mask.push_back(Lane);
+    return llvm::ConstantDataVector::get(*Context, Mask);
+  }
+
+  // Emit the vectorized part of an expanded accumulator for a reduction
+  // recognized by matchSimdReduction().
+  //
+  // The builder must be positioned before the terminator of the function's
+  // entry block.  The generated code is equivalent to
+  //
+  //   n = x2 - x1 rounded down to a multiple of VF
+  //   if (n != 0) {
+  //     v = <in[0], ..., in[VF-1]>
+  //     for (i = VF; i < n; i += VF)
+  //       v = op(v, <in[i], ..., in[i+VF-1]>)
+  //     *accum = op(*accum, horizontal_op(v))
+  //   }
+  //
+  // using shufflevector halving for the horizontal reduction.  The first
+  // vector of inputs seeds the partial results, so no identity value is
+  // needed for the operation.  The builder is left in the block following
+  // the vector code, and the returned value is the first X coordinate
+  // that still has to be processed by the scalar loop.
+  llvm::Value *ExpandSimdReduction(llvm::IRBuilder<> &Builder, const SimdReduction &Reduction,
+                                   llvm::Value *Arg_p, llvm::Value *Arg_x1, llvm::Value *Arg_x2,
+                                   llvm::Value *Arg_accum,
+                                   llvm::MDNode *TBAAPointer, llvm::MDNode *TBAAAllocation) {
+    const llvm::DataLayout &DL = Module->getDataLayout();
+    llvm::Type *ValTy = Reduction.ValTy;
+    const unsigned ValLanes = ValTy->isVectorTy() ? ValTy->getVectorNumElements() : 1;
+    const unsigned VF = getSimdReductionFactor(ValTy);
+    const unsigned Lanes = VF * ValLanes;
+    const unsigned Align = DL.getABITypeAlignment(ValTy);
+    llvm::VectorType *VecTy = llvm::VectorType::get(ValTy->getScalarType(), Lanes);
+    llvm::VectorType *IdxVecTy = llvm::VectorType::get(Builder.getInt32Ty(), VF);
+    const bool IsArg = (Reduction.Kind == SimdReduction::KindArgMinMax);
+    bccAssert(VF >= 2 && llvm::isPowerOf2_32(VF));
+
+    Builder.setFastMathFlags(Reduction.FMF);
+
+    // Loop-invariant setup.
+    SmallGEPIndices InBufPtrGEP(GEPHelper({0, RsExpandKernelDriverInfoPfxFieldInPtr, 0}));
+    llvm::Value *InBufPtrAddr = Builder.CreateInBoundsGEP(Arg_p, InBufPtrGEP, "simd_input_buf.gep");
+    llvm::LoadInst *InBufPtr = Builder.CreateLoad(InBufPtrAddr, "simd_input_buf");
+    if (gEnableRsTbaa) {
+      InBufPtr->setMetadata("tbaa", TBAAPointer);
+    }
+    llvm::Value *InPtr = Builder.CreatePointerCast(InBufPtr, ValTy->getPointerTo(), "simd_casted_in");
+
+    llvm::Value *Count = Builder.CreateSub(Arg_x2, Arg_x1, "simd_count");
+    llvm::Value *VecCount = Builder.CreateAnd(Count, ~(VF - 1), "simd_vec_count");
+    llvm::Value *HasVector = Builder.CreateAnd(Builder.CreateICmpULT(Arg_x1, Arg_x2),
+                                               Builder.CreateICmpNE(VecCount, Builder.getInt32(0)));
+
+    auto LoadVector = [&](llvm::Value *Offset) {
+      llvm::Value *Ptr = Builder.CreateInBoundsGEP(InPtr, Offset);
+      Ptr = Builder.CreatePointerCast(Ptr, VecTy->getPointerTo());
+      llvm::LoadInst *Load = Builder.CreateAlignedLoad(Ptr, Align, "simd_input");
+      if (gEnableRsTbaa) {
+        Load->setMetadata("tbaa", TBAAAllocation);
+      }
+      return Load;
+    };
+    auto IndexVector = [&](llvm::Value *Offset) {
+      llvm::SmallVector<uint32_t, 16> Steps;
+      for (unsigned Lane = 0; Lane < VF; ++Lane)
+        Steps.push_back(Lane);
+      llvm::Value *Base = Builder.CreateNUWAdd(Arg_x1, Offset);
+      return Builder.CreateNUWAdd(Builder.CreateVectorSplat(VF, Base),
+                                  llvm::ConstantDataVector::get(*Context, Steps),
+                                  "simd_x");
+    };
+
+    llvm::BasicBlock *EntryBB = Builder.GetInsertBlock();
+    llvm::Function *Parent = EntryBB->getParent();
+    llvm::BasicBlock *ExitBB =
+        llvm::SplitBlock(EntryBB, &*Builder.GetInsertPoint(), nullptr, nullptr);
+    ExitBB->setName("SimdExit");
+    llvm::BasicBlock *PreheaderBB =
+        llvm::BasicBlock::Create(*Context, "SimdPreheader", Parent, ExitBB);
+    llvm::BasicBlock *LoopBB = llvm::BasicBlock::Create(*Context, "SimdLoop", Parent, ExitBB);
+    llvm::BasicBlock *ReduceBB = llvm::BasicBlock::Create(*Context, "SimdReduce", Parent, ExitBB);
+
+    EntryBB->getTerminator()->eraseFromParent();
+    Builder.SetInsertPoint(EntryBB);
+    Builder.CreateCondBr(HasVector, PreheaderBB, ExitBB);
+
+    // SimdPreheader: seed the partial results with the first vector.
+    Builder.SetInsertPoint(PreheaderBB);
+    llvm::Value *InitVal = LoadVector(Builder.getInt32(0));
+    llvm::Value *InitIdx = IsArg ? IndexVector(Builder.getInt32(0)) : nullptr;
+    llvm::Value *FirstOffset = Builder.getInt32(VF);
+    Builder.CreateCondBr(Builder.CreateICmpULT(FirstOffset, VecCount), LoopBB, ReduceBB);
+
+    // SimdLoop: accumulate one vector per iteration.
+    Builder.SetInsertPoint(LoopBB);
+    llvm::PHINode *Offset = Builder.CreatePHI(Builder.getInt32Ty(), 2, "simd_index");
+    llvm::PHINode *Val = Builder.CreatePHI(VecTy, 2, "simd_accum");
+    llvm::PHINode *Idx = IsArg ? Builder.CreatePHI(IdxVecTy, 2, "simd_accum_x") : nullptr;
+    llvm::Value *In = LoadVector(Offset);
+    llvm::Value *NextVal, *NextIdx = nullptr;
+    if (IsArg) {
+      llvm::Value *Update = llvm::CmpInst::isFPPredicate(Reduction.Pred)
+                                ? Builder.CreateFCmp(Reduction.Pred, In, Val)
+                                : Builder.CreateICmp(Reduction.Pred, In, Val);
+      NextVal = Builder.CreateSelect(Update, In, Val);
+      NextIdx = Builder.CreateSelect(Update, IndexVector(Offset), Idx);
+    } else {
+      NextVal = createSimdReductionStep(Builder, Reduction, Val, In);
+    }
+    llvm::Value *NextOffset = Builder.CreateNUWAdd(Offset, Builder.getInt32(VF));
+    Builder.CreateCondBr(Builder.CreateICmpULT(NextOffset, VecCount), LoopBB, ReduceBB);
+
+    Offset->addIncoming(FirstOffset, PreheaderBB);
+    Offset->addIncoming(NextOffset, LoopBB);
+    Val->addIncoming(InitVal, PreheaderBB);
+    Val->addIncoming(NextVal, LoopBB);
+    if (IsArg) {
+      Idx->addIncoming(InitIdx, PreheaderBB);
+      Idx->addIncoming(NextIdx, LoopBB);
+    }
+
+    // SimdReduce: horizontal reduction, then fold into *accum.
+    Builder.SetInsertPoint(ReduceBB);
+    llvm::PHINode *ResultVal = Builder.CreatePHI(VecTy, 2, "simd_result");
+    ResultVal->addIncoming(InitVal, PreheaderBB);
+    ResultVal->addIncoming(NextVal, LoopBB);
+    llvm::Value *Result = ResultVal, *ResultIdx = nullptr;
+    if (IsArg) {
+      llvm::PHINode *ResultIdxPHI = Builder.CreatePHI(IdxVecTy, 2, "simd_result_x");
+      ResultIdxPHI->addIncoming(InitIdx, PreheaderBB);
+      ResultIdxPHI->addIncoming(NextIdx, LoopBB);
+      ResultIdx = ResultIdxPHI;
+    }
+
+    for (unsigned Width = Lanes / 2; Width >= ValLanes; Width /= 2) {
+      llvm::Value *Undef = llvm::UndefValue::get(Result->getType());
+      llvm::Value *Lo = Builder.CreateShuffleVector(Result, Undef, getLaneMask(0, Width));
+      llvm::Value *Hi = Builder.CreateShuffleVector(Result, Undef, getLaneMask(Width, Width));
+      if (IsArg) {
+        llvm::Value *UndefIdx = llvm::UndefValue::get(ResultIdx->getType());
+        llvm::Value *LoIdx = Builder.CreateShuffleVector(ResultIdx, UndefIdx, getLaneMask(0, Width));
+        llvm::Value *HiIdx = Builder.CreateShuffleVector(ResultIdx, UndefIdx, getLaneMask(Width, Width));
+        llvm::Value *TakeHi = createSimdArgPreferred(Builder, Reduction, Lo, LoIdx, Hi, HiIdx);
+        Result = Builder.CreateSelect(TakeHi, Hi, Lo);
+        ResultIdx = Builder.CreateSelect(TakeHi, HiIdx, LoIdx);
+      } else {
+        Result = createSimdReductionStep(Builder, Reduction, Lo, Hi);
+      }
+    }
+    if (!ValTy->isVectorTy()) {
+      Result = Builder.CreateExtractElement(Result, Builder.getInt32(0));
+      if (IsArg)
+        ResultIdx = Builder.CreateExtractElement(ResultIdx, Builder.getInt32(0));
+    }
+
+    if (IsArg) {
+      // The elements of this span come after the value already held in
+      // *accum, so it is replaced under the accumulator's own predicate.
+      llvm::Value *ValPtr = Builder.CreateStructGEP(nullptr, Arg_accum, 0);
+      llvm::Value *IdxPtr = Builder.CreateStructGEP(nullptr, Arg_accum, 1);
+      llvm::Value *AccumVal = Builder.CreateLoad(ValPtr);
+      llvm::Value *AccumIdx = Builder.CreateLoad(IdxPtr);
+      llvm::Value *Update = llvm::CmpInst::isFPPredicate(Reduction.Pred)
+                                ? Builder.CreateFCmp(Reduction.Pred, Result, AccumVal)
+                                : Builder.CreateICmp(Reduction.Pred, Result, AccumVal);
+      Builder.CreateStore(Builder.CreateSelect(Update, Result, AccumVal), ValPtr);
+      Builder.CreateStore(Builder.CreateSelect(Update, ResultIdx, AccumIdx), IdxPtr);
+    } else {
+      llvm::Value *AccumVal = Builder.CreateLoad(Arg_accum);
+      Builder.CreateStore(createSimdReductionStep(Builder, Reduction, AccumVal, Result), Arg_accum);
+    }
+    llvm::Value *ScalarLower = Builder.CreateNUWAdd(Arg_x1, VecCount, "simd_x1");
+    Builder.CreateBr(ExitBB);
+
+    // SimdExit: the scalar loop handles the remaining elements.
+    Builder.SetInsertPoint(&*ExitBB->begin());
+    llvm::PHINode *Lower = Builder.CreatePHI(Builder.getInt32Ty(), 2, "scalar_x1");
+    Lower->addIncoming(Arg_x1, EntryBB);
+    Lower->addIncoming(ScalarLower, ReduceBB);
+
+    Builder.clearFastMathFlags();
+    return Lower;
+  }
+
   // Expand the accumulator function for a general reduce-style kernel.
   //
   // The input is a function of the form
@@ -1139,28 +1975,30 @@ public:
   //     func(%accum,
   //          *((foo1 *)p->inPtr[0] + i)[, ... *((fooN *)p->inPtr[N-1] + i)
   //          [, p] [, i] [, p->current.y] [, p->current.z]);
+  //     [if (((i - %x1 + 1) % stride) == 0 && halter(%accum)) break;]
   //   }
   //
   // This is very similar to foreach kernel expansion with no output.
-  bool ExpandReduceAccumulator(llvm::Function *FnAccumulator, uint32_t Signature, size_t NumInputs) {
+  //
+  // If the accumulator is recognized by matchSimdReduction(), most of the
+  // span is instead processed by the vector code from ExpandSimdReduction(),
+  // and the loop above only handles the remaining elements.
+  //
+  // If FnHalter is non-null, it is called every ReduceHalterStride
+  // iterations, and the loop is left early once it returns true.  The
+  // halter is only a hint that the accumulator value can no longer
+  // change, so leaving it out never affects the result.
+  bool ExpandReduceAccumulator(llvm::Function *FnAccumulator, llvm::Function *FnHalter,
+                               uint32_t Signature, size_t NumInputs) {
     ALOGV("Expanding accumulator %s for general reduce kernel",
           FnAccumulator->getName().str().c_str());
 
     // Create TBAA meta-data.
-    llvm::MDNode *TBAARenderScriptDistinct, *TBAARenderScript,
-                 *TBAAAllocation, *TBAAPointer;
-    llvm::MDBuilder MDHelper(*Context);
-    TBAARenderScriptDistinct =
-      MDHelper.createTBAARoot(kRenderScriptTBAARootName);
-    TBAARenderScript = MDHelper.createTBAANode(kRenderScriptTBAANodeName,
-        TBAARenderScriptDistinct);
-    TBAAAllocation = MDHelper.createTBAAScalarTypeNode("allocation",
-                                                       TBAARenderScript);
-    TBAAAllocation = MDHelper.createTBAAStructTagNode(TBAAAllocation,
-                                                      TBAAAllocation, 0);
-    TBAAPointer = MDHelper.createTBAAScalarTypeNode("pointer",
-                                                    TBAARenderScript);
-    TBAAPointer = MDHelper.createTBAAStructTagNode(TBAAPointer, TBAAPointer, 0);
+    llvm::MDNode *TBAAAllocation, *TBAAPointer;
+    if (FnHalter && ReduceHalterStride > 0)
+      createKernelTBAA({FnAccumulator, FnHalter}, TBAAAllocation, TBAAPointer);
+    else
+      createKernelTBAA(FnAccumulator, TBAAAllocation, TBAAPointer);
 
     auto AccumulatorArgIter = FnAccumulator->arg_begin();
 
@@ -1182,10 +2020,21 @@ public:
     // Construct the actual function body.
     llvm::IRBuilder<> Builder(&*FnExpandedAccumulator->getEntryBlock().begin());
 
+    // The halter has to be checked between individual elements, so only
+    // accumulators without one are vectorized.
+    llvm::Value *LoopLower = Arg_x1;
+    SimdReduction Reduction;
+    if (EnableSimdReduce && !(FnHalter && ReduceHalterStride > 0) &&
+        matchSimdReduction(FnAccumulator, Signature, NumInputs, Reduction)) {
+      ALOGV("Vectorizing accumulator %s", FnAccumulator->getName().str().c_str());
+      LoopLower = ExpandSimdReduction(Builder, Reduction, Arg_p, Arg_x1, Arg_x2, Arg_accum,
+                                      TBAAPointer, TBAAAllocation);
+    }
+
     // Create the loop structure.
     llvm::BasicBlock *LoopHeader = Builder.GetInsertBlock();
     llvm::Value *IndVar;
-    createLoop(Builder, Arg_x1, Arg_x2, &IndVar);
+    llvm::BasicBlock *LoopExit = createLoop(Builder, LoopLower, Arg_x2, &IndVar);
 
     llvm::SmallVector<llvm::Value*, 8> CalleeArgs;
     const int CalleeArgsContextIdx =
@@ -1206,9 +2055,93 @@ public:
     finishArgList(RootArgs, CalleeArgs, CalleeArgsContextIdx, *FnAccumulator, Builder);
     Builder.CreateCall(FnAccumulator, RootArgs);
 
+    if (FnHalter && ReduceHalterStride > 0) {
+      createHalterCheck(Builder, FnHalter, Arg_accum, Arg_x1, IndVar, LoopExit);
+    }
+
     return true;
   }
 
+  /// @brief Add a periodic halter check to an expanded accumulator loop
+  ///
+  /// The builder must be positioned at the end of the loop body created
+  /// by createLoop(), i.e., right before the increment of the induction
+  /// variable. The loop latch is split off, and every ReduceHalterStride
+  /// iterations the halter is called on the accumulator; if it returns
+  /// true, control is transferred to LoopExit.
+  void createHalterCheck(llvm::IRBuilder<> &Builder, llvm::Function *FnHalter,
+                         llvm::Value *Arg_accum, llvm::Value *LowerBound,
+                         llvm::Value *IndVar, llvm::BasicBlock *LoopExit) {
+    llvm::BasicBlock *BodyBB = Builder.GetInsertBlock();
+    llvm::Function *Parent = BodyBB->getParent();
+    llvm::BasicBlock *LatchBB =
+        llvm::SplitBlock(BodyBB, &*Builder.GetInsertPoint(), nullptr, nullptr);
+    LatchBB->setName("Latch");
+    llvm::BasicBlock *HalterBB =
+        llvm::BasicBlock::Create(*Context, "Halter", Parent, LatchBB);
+
+    // if (((i - x1 + 1) % stride) == 0)
+    //   goto Halter
+    // else
+    //   goto Latch
+    BodyBB->getTerminator()->eraseFromParent();
+    Builder.SetInsertPoint(BodyBB);
+    llvm::Value *Count =
+        Builder.CreateNUWAdd(Builder.CreateNUWSub(IndVar, LowerBound),
+                             Builder.getInt32(1), "halter.count");
+    llvm::Value *Rem = Builder.CreateURem(Count, Builder.getInt32(ReduceHalterStride));
+    Builder.CreateCondBr(Builder.CreateICmpEQ(Rem, Builder.getInt32(0)),
+                         HalterBB, LatchBB);
+
+    // Halter:
+    //   if (halter(accum))
+    //     goto Exit
+    //   else
+    //     goto Latch
+    Builder.SetInsertPoint(HalterBB);
+    llvm::Value *HalterArg = Arg_accum;
+    llvm::Type *HalterArgTy = FnHalter->getFunctionType()->getParamType(0);
+    if (HalterArg->getType() != HalterArgTy) {
+      HalterArg = Builder.CreatePointerCast(HalterArg, HalterArgTy);
+    }
+    llvm::Value *Halted = Builder.CreateCall(FnHalter, HalterArg);
+    Builder.CreateCondBr(Builder.CreateIsNotNull(Halted), LoopExit, LatchBB);
+
+    Builder.SetInsertPoint(&*LatchBB->begin());
+  }
+
+  // Return the halter to call from the expanded accumulator FnAccumulator,
+  // or nullptr if the accumulator must run over the whole span.
+  //
+  // Expanded accumulators are shared between all reduce kernels that
+  // share the accumulator (see RSKernelExpandPass above), so a halter is
+  // only used when every such kernel agrees on it.
+  llvm::Function *getReduceHalter(llvm::Function *FnAccumulator,
+                                  const bcinfo::MetadataExtractor::Reduce *ExportReduceList,
+                                  size_t ExportReduceCount) {
+    llvm::Function *FnHalter = nullptr;
+    for (size_t i = 0; i < ExportReduceCount; ++i) {
+      if (Module->getFunction(ExportReduceList[i].mAccumulatorName) != FnAccumulator)
+        continue;
+      if (!ExportReduceList[i].mHalterName)
+        return nullptr;
+      llvm::Function *Fn = Module->getFunction(ExportReduceList[i].mHalterName);
+      if (!Fn || (FnHalter && Fn != FnHalter))
+        return nullptr;
+      FnHalter = Fn;
+    }
+
+    if (FnHalter && (FnHalter->arg_size() != 1 ||
+                     !FnHalter->getReturnType()->isIntegerTy() ||
+                     !FnHalter->arg_begin()->getType()->isPointerTy())) {
+      ALOGW("Ignoring halter %s with unexpected signature",
+            FnHalter->getName().str().c_str());
+      return nullptr;
+    }
+
+    return FnHalter;
+  }
+
   // Create a combiner function for a general reduce-style kernel that lacks one,
   // by calling the accumulator function.
   //
@@ -1293,16 +2226,33 @@ public:
   /// are all annotated with RenderScript TBAA metadata, only then we
   /// can safely use TBAA to distinguish between generic and from-allocation
   /// pointers.
+  ///
+  /// The functions that gain access to such pointers (old-style kernels
+  /// and callers of the run-time functions below) are recorded in
+  /// mAllocPointerExposers, so that kernels which cannot reach any of them
+  /// can still use TBAA (see kernelAllocPointersExposed()). This function
+  /// only returns true if such a pointer may escape from the function that
+  /// obtained it, e.g., into a global variable, in which case no kernel of
+  /// the module is safe.
   bool allocPointersExposed(llvm::Module &Module) {
+    mAllocPointerExposers.clear();
+
     // Old style kernel function can expose pointers to elements within
     // allocations.
     // TODO: Extend analysis to allow simple cases of old-style kernels.
     for (size_t i = 0; i < mExportForEachCount; ++i) {
       const char *Name = mExportForEachNameList[i];
       uint32_t Signature = mExportForEachSignatureList[i];
-      if (Module.getFunction(Name) &&
+      llvm::Function *Kernel = Module.getFunction(Name);
+      if (Kernel &&
           !bcinfo::MetadataExtractor::hasForEachSignatureKernel(Signature)) {
-        return true;
+        mAllocPointerExposers.insert(Kernel);
+        for (llvm::Argument &Arg : Kernel->args()) {
+          if (Arg.getType()->isPointerTy() &&
+              llvm::PointerMayBeCaptured(&Arg, true, true)) {
+            return true;
+          }
+        }
       }
     }
 
@@ -1337,14 +2287,109 @@ public:
         return true;
       }
 
-      if (Function->getNumUses() > 0) {
+      // Calls may go through a bitcast of the function if the prototype
+      // seen by the caller differs.
+      llvm::SmallVector<llvm::User *, 8> Users(Function->user_begin(), Function->user_end());
+      while (!Users.empty()) {
+        llvm::User *U = Users.pop_back_val();
+        if (llvm::isa<llvm::BitCastOperator>(U)) {
+          Users.append(U->user_begin(), U->user_end());
+          continue;
+        }
+
+        llvm::CallSite CS(U);
+        if (!CS || CS.getCalledValue()->stripPointerCasts() != Function) {
+          // The address of the function is taken.
+          return true;
+        }
+
+        mAllocPointerExposers.insert(CS.getInstruction()->getParent()->getParent());
+        if (CS.getType()->isPointerTy() &&
+            llvm::PointerMayBeCaptured(CS.getInstruction(), true, true)) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  /// @brief Checks if a kernel can see pointers to allocation internals
+  ///
+  /// Returns true if any function in the call graph reachable from Kernel
+  /// is in mAllocPointerExposers, or if the call graph cannot be determined
+  /// because of an indirect call.
+  bool kernelAllocPointersExposed(llvm::Function *Kernel) {
+    FunctionSet Visited;
+    llvm::SmallVector<llvm::Function *, 16> Worklist;
+    Worklist.push_back(Kernel);
+
+    while (!Worklist.empty()) {
+      llvm::Function *Fn = Worklist.pop_back_val();
+      if (!Visited.insert(Fn).second)
+        continue;
+      if (mAllocPointerExposers.count(Fn))
         return true;
+
+      for (llvm::BasicBlock &BB : *Fn) {
+        for (llvm::Instruction &I : BB) {
+          llvm::CallSite CS(&I);
+          if (!CS)
+            continue;
+          llvm::Function *Callee =
+              llvm::dyn_cast<llvm::Function>(CS.getCalledValue()->stripPointerCasts());
+          if (!Callee) {
+            if (CS.isInlineAsm())
+              continue;
+            return true;
+          }
+          Worklist.push_back(Callee);
+        }
       }
     }
 
     return false;
   }
 
+  /// @brief Create the TBAA access tags for an expanded kernel calling Callees
+  ///
+  /// Loads and stores of allocation data are tagged "allocation", loads
+  /// of pointers out of the driver info structure are tagged "pointer".
+  /// Both normally live in the "RenderScript TBAA" tree, which is shared
+  /// with the run-time library and is only connected to the C/C++ tree
+  /// (see connectRenderScriptTBAAMetadata()) if no function in the module
+  /// can see pointers into allocations. Otherwise, kernels that cannot
+  /// reach any such function use the "RenderScript Kernel TBAA" tree, which
+  /// is always part of the C/C++ tree but is used by no other code, so that
+  /// they still keep their accesses apart from those to C/C++ types.
+  void createKernelTBAA(llvm::ArrayRef<llvm::Function *> Callees,
+                        llvm::MDNode *&TBAAAllocation, llvm::MDNode *&TBAAPointer) {
+    llvm::MDBuilder MDHelper(*Context);
+    llvm::MDNode *TBAARenderScript;
+
+    if (!mAllocPointersExposed && !mAllocPointerExposers.empty() &&
+        std::none_of(Callees.begin(), Callees.end(), [this](llvm::Function *Fn) {
+          return kernelAllocPointersExposed(Fn);
+        })) {
+      llvm::MDNode *TBAARoot = MDHelper.createTBAARoot(kCTBAARootName);
+      TBAARenderScript = MDHelper.createTBAANode(kRenderScriptKernelTBAANodeName,
+                                                 TBAARoot);
+    } else {
+      llvm::MDNode *TBAARenderScriptDistinct =
+        MDHelper.createTBAARoot(kRenderScriptTBAARootName);
+      TBAARenderScript = MDHelper.createTBAANode(kRenderScriptTBAANodeName,
+                                                 TBAARenderScriptDistinct);
+    }
+
+    TBAAAllocation = MDHelper.createTBAAScalarTypeNode("allocation",
+                                                       TBAARenderScript);
+    TBAAAllocation = MDHelper.createTBAAStructTagNode(TBAAAllocation,
+                                                      TBAAAllocation, 0);
+    TBAAPointer = MDHelper.createTBAAScalarTypeNode("pointer",
+                                                    TBAARenderScript);
+    TBAAPointer = MDHelper.createTBAAStructTagNode(TBAAPointer, TBAAPointer, 0);
+  }
+
   /// @brief Connect RenderScript TBAA metadata to C/C++ metadata
   ///
   /// The TBAA metadata used to annotate loads/stores from RenderScript
@@ -1358,10 +2403,10 @@ public:
   void connectRenderScriptTBAAMetadata(llvm::Module &Module) {
     llvm::MDBuilder MDHelper(*Context);
     llvm::MDNode *TBAARenderScriptDistinct =
-      MDHelper.createTBAARoot("RenderScript Distinct TBAA");
+      MDHelper.createTBAARoot(kRenderScriptTBAARootName);
     llvm::MDNode *TBAARenderScript = MDHelper.createTBAANode(
-        "RenderScript TBAA", TBAARenderScriptDistinct);
-    llvm::MDNode *TBAARoot     = MDHelper.createTBAARoot("Simple C/C++ TBAA");
+        kRenderScriptTBAANodeName, TBAARenderScriptDistinct);
+    llvm::MDNode *TBAARoot     = MDHelper.createTBAARoot(kCTBAARootName);
     TBAARenderScript->replaceOperandWith(1, TBAARoot);
   }
 
@@ -1385,6 +2430,9 @@ public:
     mExportForEachNameList = me.getExportForEachNameList();
     mExportForEachSignatureList = me.getExportForEachSignatureList();
 
+    // The TBAA tree used by each expanded kernel depends on this.
+    mAllocPointersExposed = allocPointersExposed(Module);
+
     for (size_t i = 0; i < mExportForEachCount; ++i) {
       const char *name = mExportForEachNameList[i];
       uint32_t signature = mExportForEachSignatureList[i];
@@ -1392,6 +2440,10 @@ public:
       if (kernel) {
         if (bcinfo::MetadataExtractor::hasForEachSignatureKernel(signature)) {
           Changed |= ExpandForEach(kernel, signature);
+          auto Shape = mShapeHints.find(name);
+          if (Shape != mShapeHints.end() && isValidShapeHint(name, Shape->second)) {
+            Changed |= ExpandForEach(kernel, signature, &Shape->second);
+          }
           kernel->setLinkage(llvm::GlobalValue::InternalLinkage);
         } else if (kernel->getReturnType()->isVoidTy()) {
           Changed |= ExpandOldStyleForEach(kernel, signature);
@@ -1420,6 +2472,8 @@ public:
       bccAssert(accumulator != nullptr);
       if (ExpandedAccumulators.insert(accumulator).second)
         Changed |= ExpandReduceAccumulator(accumulator,
+                                           getReduceHalter(accumulator, ExportReduceList,
+                                                           ExportReduceCount),
                                            ExportReduceList[i].mSignature,
                                            ExportReduceList[i].mInputCount);
       if (!ExportReduceList[i].mCombinerName) {
@@ -1428,7 +2482,7 @@ public:
       }
     }
 
-    if (gEnableRsTbaa && !allocPointersExposed(Module)) {
+    if (gEnableRsTbaa && !mAllocPointersExposed && mAllocPointerExposers.empty()) {
       connectRenderScriptTBAAMetadata(Module);
     }
 
@@ -1451,8 +2505,8 @@ namespace bcc {
 const char BCC_INDEX_VAR_NAME[] = "rsIndex";
 
 llvm::ModulePass *
-createRSKernelExpandPass(bool pEnableStepOpt) {
-  return new RSKernelExpandPass(pEnableStepOpt);
+createRSKernelExpandPass(bool pEnableStepOpt, const ExpandShapeHintMap &pShapeHints) {
+  return new RSKernelExpandPass(pEnableStepOpt, pShapeHints);
 }
 
 } // end namespace bcc
@@ -0,0 +1,436 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Log.h"
+#include "RSTransforms.h"
+#include "RSUtils.h"
+
+#include "bcinfo/MetadataExtractor.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// Only used when the pass is run through opt; bcc passes the feature levels
+// of its CompilerConfig to the pass directly.
+static llvm::cl::list<std::string>
+FeatureLevelOpts("rs-feature-level",
+                 llvm::cl::desc("Also compile expanded kernels for a CPU "
+                                "feature level, selected at run time"),
+                 llvm::cl::value_desc("level"), llvm::cl::ZeroOrMore);
+
+const char kResolverName[] = ".rs.multiversion.resolve";
+
+// x86 CPUID bits (see the Intel SDM, Vol. 2A, CPUID).
+const uint32_t kCpuid1EcxFma     = 1u << 12;
+const uint32_t kCpuid1EcxSse42   = 1u << 20;
+const uint32_t kCpuid1EcxPopcnt  = 1u << 23;
+const uint32_t kCpuid1EcxOsxsave = 1u << 27;
+const uint32_t kCpuid1EcxAvx     = 1u << 28;
+const uint32_t kCpuid7EbxAvx2    = 1u << 5;
+// XCR0 bits for the SSE and AVX register state.
+const uint32_t kXcr0SseAvx       = 0x6;
+
+// AArch64 getauxval(AT_HWCAP) bits (see <asm/hwcap.h>).
+const uint64_t kAtHwcap          = 16;
+const uint64_t kHwcapFphp        = 1u << 9;
+const uint64_t kHwcapAsimdhp     = 1u << 10;
+
+enum FeatureLevelKind {
+  kFeatureLevelSse42,
+  kFeatureLevelAvx2,
+  kFeatureLevelFp16
+};
+
+struct FeatureLevel {
+  const char *Name;
+  FeatureLevelKind Kind;
+  // Whether the level applies to x86 and x86_64 (otherwise, to AArch64).
+  bool IsX86;
+  // Subtarget features enabled on top of those of the baseline.
+  const char *Features;
+};
+
+const FeatureLevel kFeatureLevels[] = {
+  { "sse4.2",  kFeatureLevelSse42,   true,  "+sse4.2,+popcnt" },
+  { "avx2",    kFeatureLevelAvx2,    true,  "+avx,+avx2,+fma" },
+  { "fp16",    kFeatureLevelFp16,    false, "+fullfp16" },
+};
+
+/*
+ * RSMultiversionPass - This pass compiles every expanded kernel function
+ * ("<NAME>.expand", "<NAME>.expand.*" and "<ACCUMFN>.expand") for several
+ * CPU feature levels, so that a single object can use the vector units of
+ * the device it runs on.
+ *
+ * For each such function F, the pass creates internal copies
+ * "<F>.baseline" (compiled for the configured CPU and features) and
+ * "<F>.<LEVEL>" for each configured level (compiled with the features of
+ * that level in addition), and replaces the body of F with a stub that
+ * calls through the function pointer "<F>.impl".  The pointers are set by
+ * ".rs.multiversion.resolve", which checks the features of the running
+ * CPU (with CPUID on x86, getauxval(AT_HWCAP) on AArch64), and selects the
+ * last configured level that is supported, or the baseline.  The stub runs
+ * the resolver on its first call, so that no load-time constructor is
+ * needed; as all calls to the resolver store the same values, concurrent
+ * first calls are harmless.
+ *
+ * Levels are listed from lowest to highest, and must be among
+ * kFeatureLevels for the target architecture; others are ignored.
+ *
+ * This pass should be run after internalization (so that it only sees the
+ * expanded functions that are actually exported) and after RSGlobalInfo
+ * (so that the function pointers are not reported as script globals), and
+ * before LTO, so that each copy gets its own inlined kernel.
+ *
+ * WARNINGS:
+ * - Calls from a copy to functions that are not inlined into it, with
+ *   arguments of vector types wider than the baseline supports, do not
+ *   follow the baseline calling convention.  Kernels are normally inlined
+ *   into their expanded functions entirely.
+ */
+class RSMultiversionPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  RSMultiversionPass()
+      : ModulePass(ID), mLevelNames(FeatureLevelOpts.begin(), FeatureLevelOpts.end()) { }
+
+  RSMultiversionPass(const std::vector<std::string> &pLevels,
+                     const std::string &pCPU, const std::string &pFeatures)
+      : ModulePass(ID), mLevelNames(pLevels), mCPU(pCPU), mFeatures(pFeatures) { }
+
+  virtual bool runOnModule(llvm::Module &M) override {
+    llvm::Triple::ArchType Arch = llvm::Triple(M.getTargetTriple()).getArch();
+    bool IsX86 = (Arch == llvm::Triple::x86 || Arch == llvm::Triple::x86_64);
+    if (!IsX86 && Arch != llvm::Triple::aarch64)
+      return false;
+
+    llvm::SmallVector<const FeatureLevel *, 4> Levels;
+    for (const std::string &Name : mLevelNames) {
+      const FeatureLevel *Level = nullptr;
+      for (const FeatureLevel &Candidate : kFeatureLevels) {
+        if (Name == Candidate.Name && Candidate.IsX86 == IsX86)
+          Level = &Candidate;
+      }
+      if (Level == nullptr) {
+        ALOGW("Ignoring feature level '%s' for %s", Name.c_str(),
+              M.getTargetTriple().c_str());
+        continue;
+      }
+      Levels.push_back(Level);
+    }
+    if (Levels.empty())
+      return false;
+
+    llvm::SmallVector<llvm::Function *, 8> Functions;
+    if (!collectExpandedFunctions(M, Functions))
+      return false;
+    if (Functions.empty())
+      return false;
+
+    llvm::LLVMContext &Context = M.getContext();
+    llvm::Function *Resolver =
+        llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(Context), false),
+                               llvm::GlobalValue::InternalLinkage, kResolverName, &M);
+    Resolver->addFnAttr(llvm::Attribute::NoInline);
+
+    // The versions of each function: the baseline, then one per level.
+    std::vector<llvm::SmallVector<llvm::Function *, 4> > Versions;
+    std::vector<llvm::GlobalVariable *> Pointers;
+    for (llvm::Function *F : Functions) {
+      Versions.emplace_back();
+      Versions.back().push_back(cloneFunction(F, F->getName() + ".baseline", nullptr));
+      for (const FeatureLevel *Level : Levels) {
+        Versions.back().push_back(
+            cloneFunction(F, F->getName() + "." + Level->Name, Level));
+      }
+
+      llvm::PointerType *PtrTy = F->getFunctionType()->getPointerTo();
+      Pointers.push_back(new llvm::GlobalVariable(
+          M, PtrTy, false, llvm::GlobalValue::InternalLinkage,
+          llvm::ConstantPointerNull::get(PtrTy), F->getName() + ".impl"));
+
+      createDispatcher(F, Pointers.back(), Resolver);
+    }
+
+    // Resolver body.
+    llvm::BasicBlock *Entry = llvm::BasicBlock::Create(Context, "Begin", Resolver);
+    llvm::IRBuilder<> Builder(Entry);
+    llvm::SmallVector<llvm::Value *, 4> Supported;
+    for (const FeatureLevel *Level : Levels) {
+      Supported.push_back(createFeatureCheck(Builder, M, *Level));
+    }
+    for (size_t i = 0; i < Functions.size(); ++i) {
+      llvm::Value *Impl = Versions[i][0];
+      for (size_t j = 0; j < Levels.size(); ++j) {
+        Impl = Builder.CreateSelect(Supported[j], Versions[i][j + 1], Impl);
+      }
+      llvm::StoreInst *Store = Builder.CreateStore(Impl, Pointers[i]);
+      Store->setAlignment(M.getDataLayout().getPointerABIAlignment());
+      Store->setAtomic(llvm::AtomicOrdering::Monotonic);
+    }
+    Builder.CreateRetVoid();
+
+    return true;
+  }
+
+  virtual const char *getPassName() const override {
+    return "Renderscript Kernel Multiversioning";
+  }
+
+private:
+  /*
+   * Collect the exported expanded functions of the foreach and general
+   * reduce kernels of M.
+   */
+  static bool collectExpandedFunctions(llvm::Module &M,
+                                       llvm::SmallVectorImpl<llvm::Function *> &Functions) {
+    bcinfo::MetadataExtractor me(&M);
+    if (!me.extract()) {
+      ALOGE("Could not extract metadata from module!");
+      return false;
+    }
+
+    std::vector<std::string> Names, Prefixes;
+    for (size_t i = 0; i < me.getExportForEachSignatureCount(); ++i) {
+      Names.push_back(std::string(me.getExportForEachNameList()[i]) + ".expand");
+      Prefixes.push_back(Names.back() + ".");
+    }
+    for (size_t i = 0; i < me.getExportReduceCount(); ++i) {
+      Names.push_back(std::string(me.getExportReduceList()[i].mAccumulatorName) + ".expand");
+    }
+
+    for (llvm::Function &F : M) {
+      if (F.isDeclaration() || F.hasLocalLinkage())
+        continue;
+
+      llvm::StringRef Name = F.getName();
+      bool Expanded = false;
+      for (const std::string &N : Names)
+        Expanded |= (Name == N);
+      for (const std::string &P : Prefixes)
+        Expanded |= Name.startswith(P);
+      if (Expanded)
+        Functions.push_back(&F);
+    }
+    return true;
+  }
+
+  /*
+   * Create an internal copy of F named Name, compiled for the subtarget
+   * features of Level in addition to the baseline ones (or for the
+   * baseline, if Level is null).
+   */
+  llvm::Function *cloneFunction(llvm::Function *F, const llvm::Twine &Name,
+                                const FeatureLevel *Level) {
+    llvm::Function *Clone =
+        llvm::Function::Create(F->getFunctionType(), llvm::GlobalValue::InternalLinkage,
+                               Name, F->getParent());
+    Clone->setCallingConv(F->getCallingConv());
+
+    llvm::ValueToValueMapTy VMap;
+    llvm::Function::arg_iterator CloneArg = Clone->arg_begin();
+    for (llvm::Argument &Arg : F->args()) {
+      CloneArg->setName(Arg.getName());
+      VMap[&Arg] = &*CloneArg++;
+    }
+
+    llvm::SmallVector<llvm::ReturnInst *, 4> Returns;
+    llvm::CloneFunctionInto(Clone, F, VMap, false, Returns);
+    Clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+    if (Level != nullptr) {
+      std::string Features = mFeatures;
+      if (!Features.empty())
+        Features += ",";
+      Features += Level->Features;
+      Clone->addFnAttr("target-features", Features);
+      if (!mCPU.empty())
+        Clone->addFnAttr("target-cpu", mCPU);
+    }
+    return Clone;
+  }
+
+  /*
+   * Replace the body of F with:
+   *
+   *   impl = atomic load Pointer
+   *   if (impl == null) {
+   *     Resolver()
+   *     impl = atomic load Pointer
+   *   }
+   *   tail call impl(args...)
+   */
+  static void createDispatcher(llvm::Function *F, llvm::GlobalVariable *Pointer,
+                               llvm::Function *Resolver) {
+    llvm::LLVMContext &Context = F->getContext();
+    unsigned PointerAlign = F->getParent()->getDataLayout().getPointerABIAlignment();
+
+    F->deleteBody();
+    llvm::BasicBlock *Entry = llvm::BasicBlock::Create(Context, "Begin", F);
+    llvm::BasicBlock *Resolve = llvm::BasicBlock::Create(Context, "Resolve", F);
+    llvm::BasicBlock *Call = llvm::BasicBlock::Create(Context, "Call", F);
+
+    auto CreatePointerLoad = [&](llvm::IRBuilder<> &Builder) {
+      llvm::LoadInst *Load = Builder.CreateLoad(Pointer, "impl");
+      Load->setAlignment(PointerAlign);
+      Load->setAtomic(llvm::AtomicOrdering::Monotonic);
+      return Load;
+    };
+
+    llvm::IRBuilder<> Builder(Entry);
+    llvm::Value *Impl = CreatePointerLoad(Builder);
+    Builder.CreateCondBr(Builder.CreateIsNull(Impl), Resolve, Call);
+
+    Builder.SetInsertPoint(Resolve);
+    Builder.CreateCall(Resolver);
+    llvm::Value *ResolvedImpl = CreatePointerLoad(Builder);
+    Builder.CreateBr(Call);
+
+    Builder.SetInsertPoint(Call);
+    llvm::PHINode *Callee = Builder.CreatePHI(Impl->getType(), 2, "callee");
+    Callee->addIncoming(Impl, Entry);
+    Callee->addIncoming(ResolvedImpl, Resolve);
+
+    llvm::SmallVector<llvm::Value *, 4> Args;
+    for (llvm::Argument &Arg : F->args())
+      Args.push_back(&Arg);
+    llvm::CallInst *Forward = Builder.CreateCall(Callee, Args);
+    Forward->setCallingConv(F->getCallingConv());
+    Forward->setTailCall();
+    Builder.CreateRetVoid();
+  }
+
+  // Returns { eax, ebx, ecx, edx } of CPUID for Leaf and Subleaf.
+  static llvm::Value *createCpuid(llvm::IRBuilder<> &Builder, uint32_t Leaf, uint32_t Subleaf) {
+    llvm::Type *Int32Ty = Builder.getInt32Ty();
+    llvm::Type *ResultTy = llvm::StructType::get(Int32Ty, Int32Ty, Int32Ty, Int32Ty, nullptr);
+    llvm::Type *ArgTys[] = { Int32Ty, Int32Ty };
+    llvm::InlineAsm *Cpuid = llvm::InlineAsm::get(
+        llvm::FunctionType::get(ResultTy, ArgTys, false), "cpuid",
+        "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}", false);
+    llvm::Value *Args[] = { Builder.getInt32(Leaf), Builder.getInt32(Subleaf) };
+    return Builder.CreateCall(Cpuid, Args, "cpuid");
+  }
+
+  // Returns whether all bits of Mask are set in Value.
+  static llvm::Value *createHasBits(llvm::IRBuilder<> &Builder, llvm::Value *Value,
+                                    uint64_t Mask) {
+    llvm::Constant *MaskValue = llvm::ConstantInt::get(Value->getType(), Mask);
+    return Builder.CreateICmpEQ(Builder.CreateAnd(Value, MaskValue), MaskValue);
+  }
+
+  /*
+   * Generate code at the insertion point of Builder that checks whether
+   * the running CPU supports Level, and return the resulting i1.  Builder
+   * is left at the end of the check, which may span several blocks.
+   */
+  static llvm::Value *createFeatureCheck(llvm::IRBuilder<> &Builder, llvm::Module &M,
+                                         const FeatureLevel &Level) {
+    switch (Level.Kind) {
+      case kFeatureLevelSse42: {
+        llvm::Value *Ecx = Builder.CreateExtractValue(createCpuid(Builder, 1, 0), 2);
+        return createHasBits(Builder, Ecx, kCpuid1EcxSse42 | kCpuid1EcxPopcnt);
+      }
+
+      case kFeatureLevelAvx2: {
+        // XGETBV faults unless the OS enables it (OSXSAVE), and CPUID leaf 7
+        // is only meaningful if it is supported, so check these first.
+        llvm::Value *MaxLeaf = Builder.CreateExtractValue(createCpuid(Builder, 0, 0), 0);
+        llvm::Value *Ecx = Builder.CreateExtractValue(createCpuid(Builder, 1, 0), 2);
+        llvm::Value *CanCheck = Builder.CreateAnd(
+            createHasBits(Builder, Ecx, kCpuid1EcxOsxsave | kCpuid1EcxAvx | kCpuid1EcxFma),
+            Builder.CreateICmpUGE(MaxLeaf, Builder.getInt32(7)));
+
+        llvm::Function *F = Builder.GetInsertBlock()->getParent();
+        llvm::BasicBlock *Before = Builder.GetInsertBlock();
+        llvm::BasicBlock *Check = llvm::BasicBlock::Create(M.getContext(), "CheckAvx2", F);
+        llvm::BasicBlock *After = llvm::BasicBlock::Create(M.getContext(), "CheckedAvx2", F);
+        Builder.CreateCondBr(CanCheck, Check, After);
+
+        Builder.SetInsertPoint(Check);
+        llvm::Type *Int32Ty = Builder.getInt32Ty();
+        llvm::InlineAsm *Xgetbv = llvm::InlineAsm::get(
+            llvm::FunctionType::get(llvm::StructType::get(Int32Ty, Int32Ty, nullptr),
+                                    Int32Ty, false),
+            "xgetbv", "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}", false);
+        llvm::Value *Xcr0 = Builder.CreateExtractValue(
+            Builder.CreateCall(Xgetbv, Builder.getInt32(0), "xgetbv"), 0);
+        llvm::Value *Ebx = Builder.CreateExtractValue(createCpuid(Builder, 7, 0), 1);
+        llvm::Value *HasAvx2 = Builder.CreateAnd(createHasBits(Builder, Xcr0, kXcr0SseAvx),
+                                                 createHasBits(Builder, Ebx, kCpuid7EbxAvx2));
+        Builder.CreateBr(After);
+
+        Builder.SetInsertPoint(After);
+        llvm::PHINode *Result = Builder.CreatePHI(Builder.getInt1Ty(), 2, "has_avx2");
+        Result->addIncoming(Builder.getFalse(), Before);
+        Result->addIncoming(HasAvx2, Check);
+        return Result;
+      }
+
+      case kFeatureLevelFp16: {
+        llvm::Type *Int64Ty = Builder.getInt64Ty();
+        llvm::Constant *GetAuxVal =
+            M.getOrInsertFunction(kGetAuxValName, Int64Ty, Int64Ty, nullptr);
+        llvm::Value *Hwcap = Builder.CreateCall(GetAuxVal, Builder.getInt64(kAtHwcap), "hwcap");
+        return createHasBits(Builder, Hwcap, kHwcapFphp | kHwcapAsimdhp);
+      }
+    }
+
+    return Builder.getFalse();
+  }
+
+  // Names of the feature levels to compile for, lowest first.
+  std::vector<std::string> mLevelNames;
+
+  // CPU and subtarget features of the baseline.
+  std::string mCPU;
+  std::string mFeatures;
+}; // end RSMultiversionPass
+
+char RSMultiversionPass::ID = 0;
+llvm::RegisterPass<RSMultiversionPass> X("rsmultiversion", "RS Kernel Multiversioning Pass");
+
+} // end anonymous namespace
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSMultiversionPass(const std::vector<std::string> &pLevels,
+                         const std::string &pCPU, const std::string &pFeatures) {
+  return new RSMultiversionPass(pLevels, pCPU, pFeatures);
+}
+
+} // end namespace bcc
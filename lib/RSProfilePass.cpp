@@ -0,0 +1,635 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Log.h"
+#include "RSTransforms.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Only used when the pass is run through opt; bcc passes the profile data
+// to the pass directly.
+static llvm::cl::opt<std::string>
+ProfileUseFile("rs-profile-use",
+               llvm::cl::desc("Annotate the script with the profile dumped from "
+                              "the .rs.profile section of an instrumented build"),
+               llvm::cl::value_desc("filename"));
+
+/*
+ * The counters of an instrumented script live in the exported variable
+ * .rs.profile, in the section of the same name:
+ *
+ *   struct {
+ *     uint32_t magic;        // kProfileMagic
+ *     uint32_t version;      // kProfileVersion
+ *     uint64_t layoutHash;   // Identifies the instrumented sites.
+ *     uint64_t numCounters;
+ *     uint64_t counters[numCounters];
+ *   };
+ *
+ * in target byte order.  The runtime dumps these bytes after a
+ * representative run; they are the profile data of the next build.
+ */
+const char kProfileName[] = ".rs.profile";
+const uint32_t kProfileMagic = 0x46505352;  // "RSPF"
+const uint32_t kProfileVersion = 1;
+const size_t kProfileHeaderSize = 24;
+const unsigned kProfileCountersField = 4;
+
+// A loop or function is hot if it runs at least 1/kHotFraction times as
+// often as the hottest one.
+const uint64_t kHotFraction = 100;
+
+// Minimum number of executions of a division before its divisor profile is
+// trusted.
+const uint64_t kMinDivisorSamples = 64;
+
+enum ProfileSiteKind {
+  // One counter: number of calls of the function.
+  kSiteEntry,
+  // One counter per successor of a conditional branch or switch.
+  kSiteBranch,
+  // Three counters for the divisor of an integer division or remainder:
+  // the majority value, its residual vote count, and the number of
+  // executions.
+  kSiteDivisor
+};
+
+struct ProfileSite {
+  ProfileSiteKind Kind;
+  // The first instruction of the function (kSiteEntry), the branch or
+  // switch, or the division.
+  llvm::Instruction *Inst;
+  uint64_t FirstCounter;
+};
+
+struct ProfileLayout {
+  std::vector<llvm::Function *> Functions;
+  std::vector<ProfileSite> Sites;
+  uint64_t NumCounters;
+  uint64_t Hash;
+};
+
+/*
+ * Returns whether F comes from the runtime library rather than the script.
+ * The runtime functions are C++-mangled overloads or use reserved names.
+ */
+bool isRuntimeFunction(const llvm::Function &F) {
+  return F.getName().startswith("_Z") || F.getName().startswith("__");
+}
+
+bool isProfiledDivision(const llvm::Instruction &I) {
+  switch (I.getOpcode()) {
+    case llvm::Instruction::UDiv:
+    case llvm::Instruction::SDiv:
+    case llvm::Instruction::URem:
+    case llvm::Instruction::SRem:
+      break;
+    default:
+      return false;
+  }
+  return I.getType()->isIntegerTy() && I.getType()->getIntegerBitWidth() <= 64 &&
+         !llvm::isa<llvm::Constant>(I.getOperand(1));
+}
+
+/*
+ * Compute the instrumented sites of M.  Both the instrumenting and the
+ * annotating builds call this on the same IR, and get the same layout.
+ *
+ * The profiled functions are the exported functions of the script (expanded
+ * kernels, invokables, root, init, ...) and the script functions they call,
+ * directly or not.
+ */
+void computeProfileLayout(llvm::Module &M, ProfileLayout &Layout) {
+  llvm::SmallPtrSet<llvm::Function *, 32> Profiled;
+  llvm::SmallVector<llvm::Function *, 32> Worklist;
+  for (llvm::Function &F : M) {
+    if (!F.isDeclaration() && !F.hasLocalLinkage() && !isRuntimeFunction(F) &&
+        Profiled.insert(&F).second)
+      Worklist.push_back(&F);
+  }
+  while (!Worklist.empty()) {
+    llvm::Function *F = Worklist.pop_back_val();
+    for (llvm::BasicBlock &BB : *F) {
+      for (llvm::Instruction &I : BB) {
+        llvm::CallSite CS(&I);
+        llvm::Function *Callee = CS ? CS.getCalledFunction() : nullptr;
+        if (Callee && !Callee->isDeclaration() && !isRuntimeFunction(*Callee) &&
+            Profiled.insert(Callee).second)
+          Worklist.push_back(Callee);
+      }
+    }
+  }
+
+  llvm::MD5 Hash;
+  Layout.NumCounters = 0;
+  auto AddSite = [&](ProfileSiteKind Kind, llvm::Instruction *Inst, uint64_t NumCounters) {
+    ProfileSite Site = { Kind, Inst, Layout.NumCounters };
+    Layout.Sites.push_back(Site);
+    Layout.NumCounters += NumCounters;
+    uint8_t Record[1 + sizeof(uint64_t)];
+    Record[0] = static_cast<uint8_t>(Kind);
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      Record[1 + i] = static_cast<uint8_t>(NumCounters >> (8 * i));
+    }
+    Hash.update(Record);
+  };
+
+  // Visit the functions in module order, so that the layout does not depend
+  // on the order of the calls.
+  for (llvm::Function &F : M) {
+    if (!Profiled.count(&F))
+      continue;
+
+    Layout.Functions.push_back(&F);
+    Hash.update(F.getName());
+    AddSite(kSiteEntry, &*F.getEntryBlock().getFirstInsertionPt(), 1);
+    for (llvm::BasicBlock &BB : F) {
+      for (llvm::Instruction &I : BB) {
+        if (isProfiledDivision(I)) {
+          AddSite(kSiteDivisor, &I, 3);
+        } else if (auto Branch = llvm::dyn_cast<llvm::BranchInst>(&I)) {
+          if (Branch->isConditional())
+            AddSite(kSiteBranch, Branch, 2);
+        } else if (auto Switch = llvm::dyn_cast<llvm::SwitchInst>(&I)) {
+          AddSite(kSiteBranch, Switch, Switch->getNumSuccessors());
+        }
+      }
+    }
+  }
+
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  Layout.Hash = 0;
+  for (int i = 0; i < 8; ++i) {
+    Layout.Hash |= static_cast<uint64_t>(Result[i]) << (8 * i);
+  }
+}
+
+/*
+ * RSProfileInstrumentPass - This pass instruments the script to count how
+ * often its functions are called, how often each successor of each
+ * conditional branch and switch is taken, and which value the divisor of
+ * each integer division or remainder most often has (with the majority
+ * vote algorithm), into the exported variable .rs.profile (see above).
+ *
+ * WARNINGS:
+ * - The counters are updated without synchronization, so concurrent
+ *   kernel invocations may lose counts.  The profile is only meant to be
+ *   representative.
+ */
+class RSProfileInstrumentPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  RSProfileInstrumentPass() : ModulePass(ID), Profile(nullptr) { }
+
+  virtual bool runOnModule(llvm::Module &M) override {
+    ProfileLayout Layout;
+    computeProfileLayout(M, Layout);
+    if (Layout.Sites.empty())
+      return false;
+
+    llvm::LLVMContext &Context = M.getContext();
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(Context);
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(Context);
+    llvm::ArrayType *CountersTy = llvm::ArrayType::get(Int64Ty, Layout.NumCounters);
+    llvm::StructType *ProfileTy =
+        llvm::StructType::get(Int32Ty, Int32Ty, Int64Ty, Int64Ty, CountersTy, nullptr);
+    llvm::Constant *Init[] = {
+      llvm::ConstantInt::get(Int32Ty, kProfileMagic),
+      llvm::ConstantInt::get(Int32Ty, kProfileVersion),
+      llvm::ConstantInt::get(Int64Ty, Layout.Hash),
+      llvm::ConstantInt::get(Int64Ty, Layout.NumCounters),
+      llvm::ConstantAggregateZero::get(CountersTy)
+    };
+    Profile = new llvm::GlobalVariable(M, ProfileTy, false, llvm::GlobalValue::ExternalLinkage,
+                                       llvm::ConstantStruct::get(ProfileTy, Init), kProfileName);
+    Profile->setSection(kProfileName);
+
+    for (const ProfileSite &Site : Layout.Sites) {
+      llvm::IRBuilder<> Builder(Site.Inst);
+      switch (Site.Kind) {
+        case kSiteEntry:
+          createIncrement(Builder, Builder.getInt64(Site.FirstCounter), Builder.getInt64(1));
+          break;
+
+        case kSiteBranch:
+          createIncrement(Builder, createSuccessorIndex(Builder, Site), Builder.getInt64(1));
+          break;
+
+        case kSiteDivisor:
+          createDivisorUpdate(Builder, Site);
+          break;
+      }
+    }
+    return true;
+  }
+
+  virtual const char *getPassName() const override {
+    return "Renderscript Profile Instrumentation";
+  }
+
+private:
+  llvm::Value *createCounterPtr(llvm::IRBuilder<> &Builder, llvm::Value *Index) {
+    llvm::Value *Indices[] = { Builder.getInt32(0), Builder.getInt32(kProfileCountersField),
+                               Index };
+    return Builder.CreateInBoundsGEP(Profile, Indices, "profile_counter");
+  }
+
+  void createIncrement(llvm::IRBuilder<> &Builder, llvm::Value *Index, llvm::Value *Amount) {
+    llvm::Value *Ptr = createCounterPtr(Builder, Index);
+    Builder.CreateStore(Builder.CreateAdd(Builder.CreateLoad(Ptr), Amount), Ptr);
+  }
+
+  // Returns the index of the counter of the successor that the branch or
+  // switch of Site is about to take.
+  static llvm::Value *createSuccessorIndex(llvm::IRBuilder<> &Builder, const ProfileSite &Site) {
+    if (auto Branch = llvm::dyn_cast<llvm::BranchInst>(Site.Inst)) {
+      return Builder.CreateSelect(Branch->getCondition(), Builder.getInt64(Site.FirstCounter),
+                                  Builder.getInt64(Site.FirstCounter + 1));
+    }
+
+    // Successor 0 of a switch is its default destination.
+    auto Switch = llvm::cast<llvm::SwitchInst>(Site.Inst);
+    llvm::Value *Index = Builder.getInt64(Site.FirstCounter);
+    for (auto Case : Switch->cases()) {
+      Index = Builder.CreateSelect(
+          Builder.CreateICmpEQ(Switch->getCondition(), Case.getCaseValue()),
+          Builder.getInt64(Site.FirstCounter + Case.getSuccessorIndex()), Index);
+    }
+    return Index;
+  }
+
+  /*
+   * Update the divisor counters of Site:
+   *
+   *   if (divisor == value) residual++;
+   *   else if (residual == 0) { value = divisor; residual = 1; }
+   *   else residual--;
+   *   total++;
+   */
+  void createDivisorUpdate(llvm::IRBuilder<> &Builder, const ProfileSite &Site) {
+    llvm::Instruction *Division = Site.Inst;
+    bool IsSigned = (Division->getOpcode() == llvm::Instruction::SDiv ||
+                     Division->getOpcode() == llvm::Instruction::SRem);
+    llvm::Value *Divisor =
+        Builder.CreateIntCast(Division->getOperand(1), Builder.getInt64Ty(), IsSigned);
+
+    llvm::Value *ValuePtr = createCounterPtr(Builder, Builder.getInt64(Site.FirstCounter));
+    llvm::Value *ResidualPtr = createCounterPtr(Builder, Builder.getInt64(Site.FirstCounter + 1));
+    llvm::Value *Value = Builder.CreateLoad(ValuePtr);
+    llvm::Value *Residual = Builder.CreateLoad(ResidualPtr);
+
+    llvm::Value *IsValue = Builder.CreateICmpEQ(Divisor, Value);
+    llvm::Value *IsUndecided = Builder.CreateICmpEQ(Residual, Builder.getInt64(0));
+    llvm::Value *NewResidual = Builder.CreateSelect(
+        IsValue, Builder.CreateAdd(Residual, Builder.getInt64(1)),
+        Builder.CreateSelect(IsUndecided, Builder.getInt64(1),
+                             Builder.CreateSub(Residual, Builder.getInt64(1))));
+    Builder.CreateStore(Builder.CreateSelect(IsUndecided, Divisor, Value), ValuePtr);
+    Builder.CreateStore(NewResidual, ResidualPtr);
+
+    createIncrement(Builder, Builder.getInt64(Site.FirstCounter + 2), Builder.getInt64(1));
+  }
+
+  // The .rs.profile variable.
+  llvm::GlobalVariable *Profile;
+}; // end RSProfileInstrumentPass
+
+/*
+ * RSProfileUsePass - This pass annotates the script with the profile
+ * collected by a build instrumented with RSProfileInstrumentPass, for LTO
+ * and code generation:
+ *
+ * - The entry counts of the profiled functions are recorded; functions that
+ *   were never called are marked "cold", and hot ones "inlinehint", which
+ *   the inliner uses to adjust its threshold.
+ *
+ * - Conditional branches and switches get "branch_weights", which block
+ *   placement (and the other users of branch probabilities) rely on.
+ *
+ * - Loops that are hot get "llvm.loop.unroll.enable", and those that never
+ *   ran, or run at most two iterations per entry on average,
+ *   "llvm.loop.unroll.disable".
+ *
+ * - An integer division or remainder whose divisor nearly always has the
+ *   same value V is rewritten to (divisor == V ? x op V : x op divisor), so
+ *   that the common case is strength-reduced.
+ *
+ * The pass must run at the same point of the pipeline, on the same script,
+ * as the instrumentation pass did.  If the profile does not match the script
+ * (per its layout hash), it is ignored.
+ */
+class RSProfileUsePass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  RSProfileUsePass() : ModulePass(ID) {
+    if (ProfileUseFile.empty())
+      return;
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> MB =
+        llvm::MemoryBuffer::getFile(ProfileUseFile);
+    if (!MB) {
+      ALOGE("Unable to read profile %s (%s)", ProfileUseFile.c_str(),
+            MB.getError().message().c_str());
+      return;
+    }
+    const uint8_t *Data = reinterpret_cast<const uint8_t *>((*MB)->getBufferStart());
+    mProfileData.assign(Data, Data + (*MB)->getBufferSize());
+  }
+
+  explicit RSProfileUsePass(const std::vector<uint8_t> &pProfileData)
+      : ModulePass(ID), mProfileData(pProfileData) { }
+
+  virtual bool runOnModule(llvm::Module &M) override {
+    ProfileLayout Layout;
+    computeProfileLayout(M, Layout);
+    if (Layout.Sites.empty() || !readCounters(Layout))
+      return false;
+
+    llvm::MDBuilder MDHelper(M.getContext());
+    llvm::DenseMap<llvm::Instruction *, uint64_t> BranchCounters;
+    llvm::SmallVector<const ProfileSite *, 8> Divisions;
+    uint64_t MaxEntryCount = 0;
+
+    for (const ProfileSite &Site : Layout.Sites) {
+      switch (Site.Kind) {
+        case kSiteEntry: {
+          uint64_t Count = Counters[Site.FirstCounter];
+          Site.Inst->getParent()->getParent()->setEntryCount(Count);
+          MaxEntryCount = std::max(MaxEntryCount, Count);
+          break;
+        }
+
+        case kSiteBranch: {
+          llvm::TerminatorInst *Terminator = llvm::cast<llvm::TerminatorInst>(Site.Inst);
+          llvm::ArrayRef<uint64_t> Counts(&Counters[Site.FirstCounter],
+                                          Terminator->getNumSuccessors());
+          BranchCounters[Terminator] = Site.FirstCounter;
+          llvm::SmallVector<uint32_t, 4> Weights;
+          if (scaleWeights(Counts, Weights)) {
+            Terminator->setMetadata(llvm::LLVMContext::MD_prof,
+                                    MDHelper.createBranchWeights(Weights));
+          }
+          break;
+        }
+
+        case kSiteDivisor:
+          Divisions.push_back(&Site);
+          break;
+      }
+    }
+
+    for (llvm::Function *F : Layout.Functions) {
+      if (F->hasFnAttribute(llvm::Attribute::NoInline) ||
+          F->hasFnAttribute(llvm::Attribute::AlwaysInline))
+        continue;
+
+      uint64_t Count = F->getEntryCount().getValue();
+      if (Count == 0) {
+        F->addFnAttr(llvm::Attribute::Cold);
+      } else if (Count * kHotFraction >= MaxEntryCount) {
+        F->addFnAttr(llvm::Attribute::InlineHint);
+      }
+    }
+
+    annotateLoops(Layout, BranchCounters);
+
+    // Rewriting divisions splits blocks, so do it last.
+    for (const ProfileSite *Site : Divisions) {
+      specializeDivision(*Site, MDHelper);
+    }
+
+    return true;
+  }
+
+  virtual const char *getPassName() const override {
+    return "Renderscript Profile Annotation";
+  }
+
+private:
+  static uint64_t readUInt64(const uint8_t *Data) {
+    uint64_t Value;
+    memcpy(&Value, Data, sizeof(Value));
+    return Value;
+  }
+
+  // Check the profile data against Layout, and read its counters.
+  bool readCounters(const ProfileLayout &Layout) {
+    if (mProfileData.size() < kProfileHeaderSize) {
+      ALOGW("Ignoring truncated profile");
+      return false;
+    }
+
+    uint32_t Magic, Version;
+    memcpy(&Magic, &mProfileData[0], sizeof(Magic));
+    memcpy(&Version, &mProfileData[4], sizeof(Version));
+    uint64_t Hash = readUInt64(&mProfileData[8]);
+    uint64_t NumCounters = readUInt64(&mProfileData[16]);
+    if (Magic != kProfileMagic || Version != kProfileVersion) {
+      ALOGW("Ignoring profile with unknown format (magic %x, version %u)", Magic, Version);
+      return false;
+    }
+    if (Hash != Layout.Hash || NumCounters != Layout.NumCounters ||
+        (mProfileData.size() - kProfileHeaderSize) / sizeof(uint64_t) < NumCounters) {
+      ALOGW("Ignoring profile that was not collected for this script");
+      return false;
+    }
+
+    Counters.clear();
+    for (uint64_t i = 0; i < NumCounters; ++i) {
+      Counters.push_back(readUInt64(&mProfileData[kProfileHeaderSize + i * sizeof(uint64_t)]));
+    }
+    return true;
+  }
+
+  // Scale Counts to 32-bit branch weights.  Returns false if all are zero.
+  static bool scaleWeights(llvm::ArrayRef<uint64_t> Counts,
+                           llvm::SmallVectorImpl<uint32_t> &Weights) {
+    uint64_t Max = *std::max_element(Counts.begin(), Counts.end());
+    if (Max == 0)
+      return false;
+
+    uint64_t Scale = Max / UINT32_MAX + 1;
+    for (uint64_t Count : Counts) {
+      Weights.push_back(static_cast<uint32_t>(Count / Scale));
+    }
+    return true;
+  }
+
+  static llvm::MDNode *createLoopID(llvm::LLVMContext &Context, const char *Hint) {
+    llvm::Metadata *HintNode = llvm::MDNode::get(Context, llvm::MDString::get(Context, Hint));
+    llvm::TempMDTuple Placeholder = llvm::MDNode::getTemporary(Context, llvm::None);
+    llvm::Metadata *Operands[] = { Placeholder.get(), HintNode };
+    llvm::MDNode *LoopID = llvm::MDNode::get(Context, Operands);
+    LoopID->replaceOperandWith(0, LoopID);
+    return LoopID;
+  }
+
+  /*
+   * Hint the unroller about the loops of the profiled functions, from the
+   * counts of their latch branches.  Loops that already carry loop metadata
+   * are left alone.
+   */
+  void annotateLoops(const ProfileLayout &Layout,
+                     const llvm::DenseMap<llvm::Instruction *, uint64_t> &BranchCounters) {
+    struct LoopProfile {
+      llvm::BranchInst *Latch;
+      uint64_t Iterations;
+      uint64_t Exits;
+    };
+    std::vector<LoopProfile> Loops;
+    uint64_t MaxIterations = 0;
+
+    for (llvm::Function *F : Layout.Functions) {
+      llvm::DominatorTree DT(*F);
+      llvm::LoopInfo LI;
+      LI.analyze(DT);
+
+      llvm::SmallVector<llvm::Loop *, 8> Worklist(LI.begin(), LI.end());
+      while (!Worklist.empty()) {
+        llvm::Loop *L = Worklist.pop_back_val();
+        Worklist.append(L->begin(), L->end());
+
+        llvm::BasicBlock *LatchBlock = L->getLoopLatch();
+        auto Latch = LatchBlock ? llvm::dyn_cast<llvm::BranchInst>(LatchBlock->getTerminator())
+                                : nullptr;
+        if (Latch == nullptr || Latch->getMetadata("llvm.loop") != nullptr)
+          continue;
+        auto Counter = BranchCounters.find(Latch);
+        if (Counter == BranchCounters.end())
+          continue;
+
+        unsigned Back = (Latch->getSuccessor(0) == L->getHeader()) ? 0 : 1;
+        if (L->contains(Latch->getSuccessor(1 - Back)))
+          continue;
+
+        LoopProfile Profile = { Latch, Counters[Counter->second + Back],
+                                Counters[Counter->second + 1 - Back] };
+        Loops.push_back(Profile);
+        MaxIterations = std::max(MaxIterations, Profile.Iterations);
+      }
+    }
+
+    for (const LoopProfile &Profile : Loops) {
+      llvm::LLVMContext &Context = Profile.Latch->getContext();
+      if (Profile.Iterations <= Profile.Exits) {
+        Profile.Latch->setMetadata("llvm.loop",
+                                   createLoopID(Context, "llvm.loop.unroll.disable"));
+      } else if (Profile.Iterations * kHotFraction >= MaxIterations) {
+        Profile.Latch->setMetadata("llvm.loop",
+                                   createLoopID(Context, "llvm.loop.unroll.enable"));
+      }
+    }
+  }
+
+  void specializeDivision(const ProfileSite &Site, llvm::MDBuilder &MDHelper) {
+    uint64_t Value = Counters[Site.FirstCounter];
+    uint64_t Residual = Counters[Site.FirstCounter + 1];
+    uint64_t Total = Counters[Site.FirstCounter + 2];
+    // The majority vote only guarantees that Value occurred at least Residual
+    // times; only specialize if that is at least half of the executions.
+    if (Total < kMinDivisorSamples || Residual * 2 < Total || Residual > Total || Value == 0)
+      return;
+
+    llvm::Instruction *Division = Site.Inst;
+    llvm::Constant *Divisor = llvm::ConstantInt::get(Division->getType(), Value);
+    if (llvm::cast<llvm::ConstantInt>(Divisor)->isZero())
+      return;
+
+    uint64_t Hits = Residual;
+    llvm::SmallVector<uint32_t, 2> Weights;
+    uint64_t Counts[] = { Hits, Total - Hits };
+    scaleWeights(Counts, Weights);
+
+    llvm::IRBuilder<> Builder(Division);
+    llvm::Value *IsDivisor = Builder.CreateICmpEQ(Division->getOperand(1), Divisor);
+    llvm::TerminatorInst *ThenTerm, *ElseTerm;
+    llvm::SplitBlockAndInsertIfThenElse(IsDivisor, Division, &ThenTerm, &ElseTerm,
+                                        MDHelper.createBranchWeights(Weights));
+
+    llvm::Instruction *Fast = Division->clone();
+    Fast->setOperand(1, Divisor);
+    Fast->insertBefore(ThenTerm);
+    llvm::Instruction *Slow = Division->clone();
+    Slow->insertBefore(ElseTerm);
+
+    llvm::PHINode *Result = llvm::PHINode::Create(Division->getType(), 2, "", Division);
+    Result->addIncoming(Fast, ThenTerm->getParent());
+    Result->addIncoming(Slow, ElseTerm->getParent());
+    Result->takeName(Division);
+    Division->replaceAllUsesWith(Result);
+    Division->eraseFromParent();
+  }
+
+  // Contents of the .rs.profile section of the instrumented build.
+  std::vector<uint8_t> mProfileData;
+
+  // Counters read from mProfileData.
+  std::vector<uint64_t> Counters;
+}; // end RSProfileUsePass
+
+char RSProfileInstrumentPass::ID = 0;
+llvm::RegisterPass<RSProfileInstrumentPass> X("rsprofilegen", "RS Profile Instrumentation Pass");
+
+char RSProfileUsePass::ID = 0;
+llvm::RegisterPass<RSProfileUsePass> Y("rsprofileuse", "RS Profile Annotation Pass");
+
+} // end anonymous namespace
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSProfileInstrumentPass() {
+  return new RSProfileInstrumentPass();
+}
+
+llvm::ModulePass *
+createRSProfileUsePass(const std::vector<uint8_t> &pProfileData) {
+  return new RSProfileUsePass(pProfileData);
+}
+
+} // end namespace bcc
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Log.h"
+#include "RSTransforms.h"
+#include "RSUtils.h"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <set>
+#include <string>
+
+namespace {
+
+const char kRelaxedCloneSuffix[] = ".relaxed";
+
+/*
+ * RSRelaxedPrecisionPass - This pass compiles the functions of relaxed
+ * precision scripts (#pragma rs_fp_relaxed) for relaxed precision, when they
+ * were merged into a module with functions of full precision scripts (as for
+ * script groups).  The module itself is then compiled for full precision,
+ * and RSCompilerDriver marks the functions of relaxed scripts with the
+ * kRelaxedPrecisionAttrName attribute before merging.
+ *
+ * For each such function, as well as the expanded functions of its kernels:
+ * - floating point operations get the "arcp" and "nsz" fast-math flags,
+ *   which carry over when the function is inlined into a full precision
+ *   one (a fused kernel, for example);
+ * - the function gets "less-precise-fpmad", so that the code generator may
+ *   contract multiplies and adds;
+ * - calls to runtime functions that do floating point arithmetic, or call
+ *   functions that do, are redirected to "<FUNCTION>.relaxed", an internal
+ *   copy of the runtime function compiled the same way.
+ *
+ * This pass should be run after the runtime library is linked (so that
+ * runtime functions have bodies to copy), after foreachexp, and before
+ * inlining.
+ */
+class RSRelaxedPrecisionPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  RSRelaxedPrecisionPass() : ModulePass(ID) { }
+
+  virtual bool runOnModule(llvm::Module &M) override {
+    std::set<std::string> RelaxedNames;
+    llvm::SmallVector<llvm::Function *, 16> Worklist;
+    for (llvm::Function &F : M) {
+      if (!F.isDeclaration() && F.hasFnAttribute(kRelaxedPrecisionAttrName)) {
+        RelaxedNames.insert(F.getName());
+        Worklist.push_back(&F);
+      }
+    }
+    if (Worklist.empty())
+      return false;
+
+    // The expanded functions of relaxed kernels ("<KERNEL>.expand" and its
+    // shape-specialized variants) were created after the functions were
+    // marked.
+    for (llvm::Function &F : M) {
+      llvm::StringRef Name = F.getName();
+      size_t Expand = Name.find(".expand");
+      if (F.isDeclaration() || F.hasFnAttribute(kRelaxedPrecisionAttrName) ||
+          Expand == llvm::StringRef::npos || !RelaxedNames.count(Name.substr(0, Expand)))
+        continue;
+
+      F.addFnAttr(kRelaxedPrecisionAttrName);
+      Worklist.push_back(&F);
+    }
+
+    while (!Worklist.empty()) {
+      llvm::Function *F = Worklist.pop_back_val();
+      relaxFunction(*F, Worklist);
+    }
+    return true;
+  }
+
+  virtual const char *getPassName() const override {
+    return "Renderscript Relaxed Precision";
+  }
+
+private:
+  // Returns whether F is a runtime function that does floating point
+  // arithmetic, itself or through the functions it calls: many runtime
+  // functions are thin wrappers that forward their arguments to another
+  // overload, or to an SC_* or libm function.
+  bool isFloatingPointRuntimeFunction(llvm::Function &F) {
+    if (F.isDeclaration() || !F.getName().startswith("_Z"))
+      return false;
+
+    return usesFloatingPoint(F);
+  }
+
+  // Returns whether F, or a function that it calls directly or indirectly,
+  // does floating point arithmetic.  A declaration is assumed to if it takes
+  // or returns floating point values.
+  bool usesFloatingPoint(llvm::Function &F) {
+    auto Known = UsesFloatingPoint.find(&F);
+    if (Known != UsesFloatingPoint.end())
+      return Known->second;
+
+    if (F.isDeclaration()) {
+      llvm::FunctionType *FTy = F.getFunctionType();
+      bool Result = FTy->getReturnType()->getScalarType()->isFloatingPointTy();
+      for (llvm::Type *ParamTy : FTy->params()) {
+        Result |= ParamTy->getScalarType()->isFloatingPointTy();
+      }
+      return UsesFloatingPoint[&F] = Result;
+    }
+
+    // While F is being looked at, calls back to it count as not doing any
+    // floating point arithmetic (the runtime library has no such cycles).
+    UsesFloatingPoint[&F] = false;
+    for (llvm::Instruction &I : llvm::instructions(F)) {
+      llvm::CallSite CS(&I);
+      llvm::Function *Callee = CS ? CS.getCalledFunction() : nullptr;
+      if (llvm::isa<llvm::FPMathOperator>(I) ||
+          (Callee != nullptr && usesFloatingPoint(*Callee)))
+        return UsesFloatingPoint[&F] = true;
+    }
+    return false;
+  }
+
+  // Returns the relaxed copy of the runtime function F, creating it (and
+  // adding it to Worklist) if needed.
+  llvm::Function *getRelaxedClone(llvm::Function *F,
+                                  llvm::SmallVectorImpl<llvm::Function *> &Worklist) {
+    llvm::Function *&Clone = RelaxedClones[F];
+    if (Clone != nullptr)
+      return Clone;
+
+    llvm::ValueToValueMapTy VMap;
+    Clone = llvm::CloneFunction(F, VMap, false);
+    Clone->setName(F->getName() + kRelaxedCloneSuffix);
+    Clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+    Clone->addFnAttr(kRelaxedPrecisionAttrName);
+    F->getParent()->getFunctionList().push_back(Clone);
+    Worklist.push_back(Clone);
+    return Clone;
+  }
+
+  void relaxFunction(llvm::Function &F, llvm::SmallVectorImpl<llvm::Function *> &Worklist) {
+    F.addFnAttr("less-precise-fpmad", "true");
+
+    llvm::FastMathFlags FMF;
+    FMF.setAllowReciprocal();
+    FMF.setNoSignedZeros();
+
+    for (llvm::Instruction &I : llvm::instructions(F)) {
+      if (llvm::isa<llvm::FPMathOperator>(I))
+        I.setFastMathFlags(FMF);
+
+      llvm::CallSite CS(&I);
+      llvm::Function *Callee = CS ? CS.getCalledFunction() : nullptr;
+      if (Callee == nullptr || Callee->hasFnAttribute(kRelaxedPrecisionAttrName) ||
+          !isFloatingPointRuntimeFunction(*Callee))
+        continue;
+
+      CS.setCalledFunction(getRelaxedClone(Callee, Worklist));
+    }
+  }
+
+  // Relaxed copies of runtime functions, by original.
+  llvm::DenseMap<llvm::Function *, llvm::Function *> RelaxedClones;
+
+  // Results of usesFloatingPoint(), by function.
+  llvm::DenseMap<llvm::Function *, bool> UsesFloatingPoint;
+}; // end RSRelaxedPrecisionPass
+
+char RSRelaxedPrecisionPass::ID = 0;
+llvm::RegisterPass<RSRelaxedPrecisionPass> X("rsrelaxedprecision",
+                                             "RS Relaxed Precision Pass");
+
+} // end anonymous namespace
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSRelaxedPrecisionPass() {
+  return new RSRelaxedPrecisionPass();
+}
+
+} // end namespace bcc
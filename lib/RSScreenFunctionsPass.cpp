@@ -17,6 +17,7 @@
 #include "Log.h"
 #include "RSTransforms.h"
 #include "RSStubsWhiteList.h"
+#include "RSUtils.h"
 
 #include <cstdlib>
 
@@ -50,7 +51,8 @@ private:
     // A global function symbol is legal if
     // a. it has a body, i.e. is not empty or
     // b. its name starts with "llvm." or
-    // c. it is present in the whitelist
+    // c. it is present in the whitelist or
+    // d. it is a C library function that code generated by bcc calls
 
     if (!F.empty())
       return true;
@@ -62,6 +64,9 @@ private:
     if (isPresent(whiteList, FName.str()))
       return true;
 
+    if (FName.equals(kGetAuxValName))
+      return true;
+
     return false;
   }
 
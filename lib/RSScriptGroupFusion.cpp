@@ -19,14 +19,18 @@
 #include "Assert.h"
 #include "Log.h"
 #include "bcc/BCCContext.h"
+#include "bcc/RSCompilerDriver.h"
 #include "bcc/Source.h"
 #include "bcinfo/MetadataExtractor.h"
+#include "rsDefines.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 using llvm::Function;
 using llvm::Module;
 
@@ -60,12 +64,6 @@ getFunction(Module* mergedModule, const Source* source, const int slot,
     return nullptr;
   }
 
-  if (metadata.getExportForEachInputCountList()[slot] > 1) {
-    ALOGE("Kernel fusion (module %s function %s): cannot handle multiple inputs",
-          source->getName().c_str(), functionName);
-    return nullptr;
-  }
-
   if (signature != nullptr) {
     *signature = metadata.getExportForEachSignatureList()[slot];
   }
@@ -75,35 +73,47 @@ getFunction(Module* mergedModule, const Source* source, const int slot,
   return function;
 }
 
-// The whitelist of supported signature bits. Context or user data arguments are
-// not currently supported in kernel fusion. To support them or any new kinds of
-// arguments in the future, it requires not only listing the signature bits here,
-// but also implementing additional necessary fusion logic in the getFusedFuncSig(),
-// getFusedFuncType(), and fuseKernels() functions below.
+// The whitelist of supported signature bits. User data arguments are not
+// supported in kernel fusion (and cannot appear on kernels anyway). To support
+// them or any new kinds of arguments in the future, it requires not only listing
+// the signature bits here, but also implementing additional necessary fusion
+// logic in the getFusedFuncSig(), getFusedFuncType(), and fuseKernels()
+// functions below.
 constexpr uint32_t ExpectedSignatureBits =
         bcinfo::MD_SIG_In |
         bcinfo::MD_SIG_Out |
+        bcinfo::MD_SIG_Ctxt |
         bcinfo::MD_SIG_X |
         bcinfo::MD_SIG_Y |
         bcinfo::MD_SIG_Z |
         bcinfo::MD_SIG_Kernel;
 
+// Returns the number of inputs of the fused kernel that the kernel at the given
+// position in a batch consumes. The first kernel consumes all its inputs. Any
+// later kernel receives its first input from the previous kernel in the batch,
+// and consumes its remaining inputs, which come from outside the batch.
+uint32_t getNumFusedInputs(const Source* source, const int slot, const bool first) {
+  bcinfo::MetadataExtractor &metadata = *source->getMetadata();
+  const uint32_t inputCount = metadata.getExportForEachInputCountList()[slot];
+  if (first || inputCount == 0) {
+    return inputCount;
+  }
+  return inputCount - 1;
+}
+
 int getFusedFuncSig(const std::vector<Source*>& sources,
                     const std::vector<int>& slots,
                     uint32_t* retSig) {
   *retSig = 0;
-  uint32_t firstSignature = 0;
   uint32_t signature = 0;
+  uint32_t numFusedInputs = 0;
   auto slotIter = slots.begin();
   for (const Source* source : sources) {
+    const bool first = (slotIter == slots.begin());
     const int slot = *slotIter++;
     bcinfo::MetadataExtractor &metadata = *source->getMetadata();
 
-    if (metadata.getExportForEachInputCountList()[slot] > 1) {
-      ALOGE("Kernel fusion (module %s slot %d): cannot handle multiple inputs",
-            source->getName().c_str(), slot);
-      return -1;
-    }
+    numFusedInputs += getNumFusedInputs(source, slot, first);
 
     signature = metadata.getExportForEachSignatureList()[slot];
     if (signature & ~ExpectedSignatureBits) {
@@ -112,17 +122,19 @@ int getFusedFuncSig(const std::vector<Source*>& sources,
       return -1;
     }
 
-    if (firstSignature == 0) {
-      firstSignature = signature;
-    }
-
     *retSig |= signature;
   }
 
-  if (!bcinfo::MetadataExtractor::hasForEachSignatureIn(firstSignature)) {
+  if (numFusedInputs == 0) {
     *retSig &= ~bcinfo::MD_SIG_In;
   }
 
+  if (numFusedInputs > RS_KERNEL_INPUT_LIMIT) {
+    ALOGE("Kernel fusion: fused kernel would take %u inputs (limit %d)",
+          numFusedInputs, RS_KERNEL_INPUT_LIMIT);
+    return -1;
+  }
+
   if (!bcinfo::MetadataExtractor::hasForEachSignatureOut(signature)) {
     *retSig &= ~bcinfo::MD_SIG_Out;
   }
@@ -141,14 +153,35 @@ llvm::FunctionType* getFusedFuncType(bcc::BCCContext& Context,
     return nullptr;
   }
 
-  const Function* firstF = getFunction(M, sources.front(), slots.front(), nullptr);
+  llvm::SmallVector<llvm::Type*, 8> ArgTys;
+  llvm::Type* ContextTy = nullptr;
+
+  // Inputs of the fused kernel, in batch order, followed by the context (if
+  // any kernel in the batch takes one) and the coordinates.
+  auto slotIter = slots.begin();
+  for (const Source* source : sources) {
+    const bool first = (slotIter == slots.begin());
+    const int slot = *slotIter++;
+    const Function* F = getFunction(M, source, slot, nullptr);
+
+    bccAssert (F != nullptr);
 
-  bccAssert (firstF != nullptr);
+    const uint32_t inputCount = source->getMetadata()->getExportForEachInputCountList()[slot];
+    const uint32_t numFusedInputs = getNumFusedInputs(source, slot, first);
+    const llvm::FunctionType* funcTy = F->getFunctionType();
+    for (uint32_t i = inputCount - numFusedInputs; i < inputCount; i++) {
+      ArgTys.push_back(funcTy->getParamType(i));
+    }
 
-  llvm::SmallVector<llvm::Type*, 8> ArgTys;
+    const uint32_t kernelSignature = source->getMetadata()->getExportForEachSignatureList()[slot];
+    if (ContextTy == nullptr &&
+        bcinfo::MetadataExtractor::hasForEachSignatureCtxt(kernelSignature)) {
+      ContextTy = funcTy->getParamType(inputCount);
+    }
+  }
 
-  if (bcinfo::MetadataExtractor::hasForEachSignatureIn(*signature)) {
-    ArgTys.push_back(firstF->arg_begin()->getType());
+  if (ContextTy != nullptr) {
+    ArgTys.push_back(ContextTy);
   }
 
   llvm::Type* I32Ty = llvm::IntegerType::get(Context.getLLVMContext(), 32);
@@ -171,22 +204,24 @@ llvm::FunctionType* getFusedFuncType(bcc::BCCContext& Context,
   return llvm::FunctionType::get(retTy, ArgTys, false);
 }
 
-}  // anonymous namespace
-
-bool fuseKernels(bcc::BCCContext& Context,
-                 const std::vector<Source *>& sources,
-                 const std::vector<int>& slots,
-                 const std::string& fusedName,
-                 Module* mergedModule) {
+// Creates the function of a kernel that calls the kernels in the given slots
+// in a chain (see fuseKernels()). Returns nullptr if the kernels cannot be
+// fused.
+Function* createFusedKernel(bcc::BCCContext& Context,
+                            const std::vector<Source *>& sources,
+                            const std::vector<int>& slots,
+                            const std::string& fusedName,
+                            Module* mergedModule,
+                            uint32_t* signature) {
   bccAssert(sources.size() == slots.size() && "sources and slots differ in size");
 
-  uint32_t fusedFunctionSignature;
+  uint32_t& fusedFunctionSignature = *signature;
 
   llvm::FunctionType* fusedType =
           getFusedFuncType(Context, sources, slots, mergedModule, &fusedFunctionSignature);
 
   if (fusedType == nullptr) {
-    return false;
+    return nullptr;
   }
 
   Function* fusedKernel =
@@ -199,10 +234,29 @@ bool fuseKernels(bcc::BCCContext& Context,
 
   Function::arg_iterator argIter = fusedKernel->arg_begin();
 
-  llvm::Value* dataElement = nullptr;
+  // Inputs of the fused kernel, consumed in batch order by the kernels.
+  std::vector<llvm::Value*> fusedInputs;
   if (bcinfo::MetadataExtractor::hasForEachSignatureIn(fusedFunctionSignature)) {
-    dataElement = &*(argIter++);
-    dataElement->setName("DataIn");
+    const size_t numFusedInputs = fusedKernel->arg_size() -
+        bcinfo::MetadataExtractor::hasForEachSignatureCtxt(fusedFunctionSignature) -
+        bcinfo::MetadataExtractor::hasForEachSignatureX(fusedFunctionSignature) -
+        bcinfo::MetadataExtractor::hasForEachSignatureY(fusedFunctionSignature) -
+        bcinfo::MetadataExtractor::hasForEachSignatureZ(fusedFunctionSignature);
+    for (size_t i = 0; i < numFusedInputs; i++) {
+      llvm::Value* input = &*(argIter++);
+      input->setName("DataIn");
+      fusedInputs.push_back(input);
+    }
+  }
+  auto fusedInputIter = fusedInputs.begin();
+
+  // Element produced by the previous kernel in the batch.
+  llvm::Value* dataElement = nullptr;
+
+  llvm::Value* context = nullptr;
+  if (bcinfo::MetadataExtractor::hasForEachSignatureCtxt(fusedFunctionSignature)) {
+    context = &*(argIter++);
+    context->setName("context");
   }
 
   llvm::Value* X = nullptr;
@@ -231,51 +285,69 @@ bool fuseKernels(bcc::BCCContext& Context,
     const Function* inputFunction =
             getFunction(mergedModule, source, slot, &inputFunctionSignature);
     if (inputFunction == nullptr) {
-      // Either failed to find the kernel function, or the function has multiple inputs.
-      return false;
+      // Failed to find the kernel function.
+      return nullptr;
     }
 
     // Don't try to fuse a non-kernel
     if (!bcinfo::MetadataExtractor::hasForEachSignatureKernel(inputFunctionSignature)) {
       ALOGE("Kernel fusion (module %s function %s): not a kernel",
             source->getName().c_str(), inputFunction->getName().str().c_str());
-      return false;
+      return nullptr;
     }
 
     std::vector<llvm::Value*> args;
 
     if (bcinfo::MetadataExtractor::hasForEachSignatureIn(inputFunctionSignature)) {
-      if (dataElement == nullptr) {
-        ALOGE("Kernel fusion (module %s function %s): expected input, but got null",
-              source->getName().c_str(), inputFunction->getName().str().c_str());
-        return false;
+      const llvm::FunctionType* funcTy = inputFunction->getFunctionType();
+      const uint32_t inputCount =
+          source->getMetadata()->getExportForEachInputCountList()[slot];
+
+      if (slotIter != slots.begin()) {
+        // The first input is the element produced by the previous kernel.
+        if (dataElement == nullptr) {
+          ALOGE("Kernel fusion (module %s function %s): expected input, but got null",
+                source->getName().c_str(), inputFunction->getName().str().c_str());
+          return nullptr;
+        }
+        args.push_back(dataElement);
+      }
+
+      // The remaining inputs come from outside the batch.
+      while (args.size() < inputCount) {
+        bccAssert(fusedInputIter != fusedInputs.end());
+        args.push_back(*fusedInputIter++);
       }
 
-      const llvm::FunctionType* funcTy = inputFunction->getFunctionType();
       llvm::Type* firstArgType = funcTy->getParamType(0);
 
-      if (dataElement->getType() != firstArgType) {
+      if (args.front()->getType() != firstArgType) {
         std::string msg;
         llvm::raw_string_ostream rso(msg);
         rso << "Mismatching argument type, expected ";
         firstArgType->print(rso);
         rso << ", received ";
-        dataElement->getType()->print(rso);
+        args.front()->getType()->print(rso);
         ALOGE("Kernel fusion (module %s function %s): %s", source->getName().c_str(),
               inputFunction->getName().str().c_str(), rso.str().c_str());
-        return false;
+        return nullptr;
       }
-
-      args.push_back(dataElement);
     } else {
       // Only the first kernel in a batch is allowed to have no input
       if (slotIter != slots.begin()) {
         ALOGE("Kernel fusion (module %s function %s): function not first in batch takes no input",
               source->getName().c_str(), inputFunction->getName().str().c_str());
-        return false;
+        return nullptr;
       }
     }
 
+    if (bcinfo::MetadataExtractor::hasForEachSignatureCtxt(inputFunctionSignature)) {
+      // Kernels from different modules may see distinct (but identical)
+      // rs_kernel_context types.
+      llvm::Type* contextTy = inputFunction->getFunctionType()->getParamType(args.size());
+      args.push_back(builder.CreatePointerCast(context, contextTy));
+    }
+
     if (bcinfo::MetadataExtractor::hasForEachSignatureX(inputFunctionSignature)) {
       args.push_back(X);
     }
@@ -293,12 +365,121 @@ bool fuseKernels(bcc::BCCContext& Context,
     slotIter++;
   }
 
+  bccAssert(fusedInputIter == fusedInputs.end());
+
   if (fusedKernel->getReturnType()->isVoidTy()) {
     builder.CreateRetVoid();
   } else {
     builder.CreateRet(dataElement);
   }
 
+  return fusedKernel;
+}
+
+// Creates a combiner for a fused reduce kernel whose reduce kernel lacks one,
+// by calling the accumulator function of the reduce kernel, which must be of
+// the form accumFn(accumType* accum, accumType in). This is what
+// RSKernelExpandPass does for the reduce kernel itself, but under a different
+// name, so that the combiner is private to the fused reduce kernel.
+Function* createFusedReduceCombiner(bcc::BCCContext& Context,
+                                    const Function* accumulator,
+                                    const std::string& combinerName,
+                                    Module* mergedModule) {
+  if (accumulator->arg_size() != 2) {
+    ALOGE("Kernel fusion (function %s): cannot derive combiner from accumulator",
+          accumulator->getName().str().c_str());
+    return nullptr;
+  }
+
+  auto accumulatorArgIter = accumulator->arg_begin();
+  llvm::Type* accumTy = (accumulatorArgIter++)->getType();
+  llvm::Type* inTy = accumulatorArgIter->getType();
+
+  llvm::FunctionType* combinerTy = llvm::FunctionType::get(
+      llvm::Type::getVoidTy(Context.getLLVMContext()), {accumTy, accumTy}, false);
+  Function* combiner = Function::Create(combinerTy, llvm::GlobalValue::InternalLinkage,
+                                        combinerName, mergedModule);
+
+  auto combinerArgIter = combiner->arg_begin();
+  llvm::Value* accum = &*(combinerArgIter++);
+  accum->setName("accum");
+  llvm::Value* other = &*(combinerArgIter++);
+  other->setName("other");
+
+  llvm::BasicBlock* block = llvm::BasicBlock::Create(Context.getLLVMContext(), "entry",
+                                                     combiner);
+  llvm::IRBuilder<> builder(block);
+
+  llvm::Value* in;
+  if (inTy->isPointerTy()) {
+    // Pass-by-pointer-to-copy of a large accumulator type.
+    in = builder.CreateAlloca(inTy->getPointerElementType(), nullptr, "caller_copy");
+    builder.CreateStore(builder.CreateLoad(other), in);
+  } else {
+    in = builder.CreateLoad(builder.CreatePointerCast(other, inTy->getPointerTo()));
+  }
+  builder.CreateCall((llvm::Value*)accumulator, {accum, in});
+  builder.CreateRetVoid();
+
+  return combiner;
+}
+
+// Size in bytes of a kernel argument or return value of the given type, as
+// stored in an allocation.
+uint64_t getElementSize(const llvm::DataLayout& DL, llvm::Type* Ty) {
+  if (Ty->isVoidTy()) {
+    return 0;
+  }
+  // Large structs are passed by pointer to a copy.
+  if (Ty->isPointerTy()) {
+    Ty = Ty->getPointerElementType();
+  }
+  return DL.getTypeAllocSize(Ty);
+}
+
+// Bytes read from and written to memory, per cell, by a (possibly fused)
+// kernel.
+struct MemoryTraffic {
+  uint64_t read;
+  uint64_t written;
+};
+
+// Memory traffic of a single kernel.
+MemoryTraffic getKernelTraffic(Source* source, const int slot) {
+  MemoryTraffic traffic = {0, 0};
+  const Function* F = getFunction(&source->getModule(), source, slot, nullptr);
+  if (F == nullptr) {
+    return traffic;
+  }
+
+  const llvm::DataLayout& DL = F->getParent()->getDataLayout();
+  const uint32_t inputCount = source->getMetadata()->getExportForEachInputCountList()[slot];
+  for (uint32_t i = 0; i < inputCount; i++) {
+    traffic.read += getElementSize(DL, F->getFunctionType()->getParamType(i));
+  }
+  traffic.written = getElementSize(DL, F->getReturnType());
+  return traffic;
+}
+
+llvm::Metadata* getOptionalNameMD(llvm::LLVMContext& ctxt, const char* name) {
+  return name ? llvm::MDString::get(ctxt, name) : nullptr;
+}
+
+}  // anonymous namespace
+
+bool fuseKernels(bcc::BCCContext& Context,
+                 const std::vector<Source *>& sources,
+                 const std::vector<int>& slots,
+                 const std::string& fusedName,
+                 Module* mergedModule) {
+  uint32_t fusedFunctionSignature;
+  if (createFusedKernel(Context, sources, slots, fusedName, mergedModule,
+                        &fusedFunctionSignature) == nullptr) {
+    return false;
+  }
+
+  llvm::LLVMContext& ctxt = Context.getLLVMContext();
+
   llvm::NamedMDNode* ExportForEachNameMD =
     mergedModule->getOrInsertNamedMetadata("#rs_export_foreach_name");
 
@@ -316,30 +497,368 @@ bool fuseKernels(bcc::BCCContext& Context,
   return true;
 }
 
-bool renameInvoke(BCCContext& Context, const Source* source, const int slot,
-                  const std::string& newName, Module* module) {
-  const llvm::Function* F = getInvokeFunction(*source, slot, module);
-  std::vector<llvm::Type*> params;
-  for (auto I = F->arg_begin(), E = F->arg_end(); I != E; ++I) {
-    params.push_back(I->getType());
+bool fuseKernelsIntoReduce(bcc::BCCContext& Context,
+                           const std::vector<Source *>& sources,
+                           const std::vector<int>& slots,
+                           const Source* reduceSource,
+                           const int reduceSlot,
+                           const std::string& fusedName,
+                           Module* mergedModule) {
+  llvm::LLVMContext& ctxt = Context.getLLVMContext();
+
+  if (reduceSlot < 0 ||
+      (size_t)reduceSlot >= reduceSource->getMetadata()->getExportReduceCount()) {
+    ALOGE("Kernel fusion (module %s reduce slot %d): no such reduce kernel",
+          reduceSource->getName().c_str(), reduceSlot);
+    return false;
+  }
+
+  const bcinfo::MetadataExtractor::Reduce& reduce =
+      reduceSource->getMetadata()->getExportReduceList()[reduceSlot];
+
+  const Function* accumulator = mergedModule->getFunction(reduce.mAccumulatorName);
+  if (accumulator == nullptr) {
+    ALOGE("Kernel fusion (module %s reduce slot %d): failed to find accumulator function",
+          reduceSource->getName().c_str(), reduceSlot);
+    return false;
+  }
+
+  if (reduce.mInputCount != 1) {
+    ALOGE("Kernel fusion (module %s function %s): accumulator must take exactly one input",
+          reduceSource->getName().c_str(), reduce.mAccumulatorName);
+    return false;
+  }
+
+  // The producer kernels, as an internal kernel that the new accumulator calls
+  // for each element.
+  uint32_t mapSignature;
+  Function* map = createFusedKernel(Context, sources, slots, fusedName + ".map",
+                                    mergedModule, &mapSignature);
+  if (map == nullptr) {
+    return false;
+  }
+  map->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+  auto accumulatorArgIter = accumulator->arg_begin();
+  llvm::Type* accumTy = (accumulatorArgIter++)->getType();
+  llvm::Type* inTy = (accumulatorArgIter++)->getType();
+  llvm::Type* elementTy = map->getReturnType();
+
+  if (!bcinfo::MetadataExtractor::hasForEachSignatureIn(mapSignature) ||
+      elementTy->isVoidTy() ||
+      (inTy != elementTy && inTy != elementTy->getPointerTo())) {
+    ALOGE("Kernel fusion (module %s function %s): producers do not match accumulator input",
+          reduceSource->getName().c_str(), reduce.mAccumulatorName);
+    return false;
+  }
+
+  // The new accumulator takes the inputs of the producers, followed by the
+  // special arguments that the producers or the accumulator take.
+  constexpr uint32_t specialBits =
+      bcinfo::MD_SIG_Ctxt | bcinfo::MD_SIG_X | bcinfo::MD_SIG_Y | bcinfo::MD_SIG_Z;
+  const uint32_t fusedSignature =
+      bcinfo::MD_SIG_In | ((mapSignature | reduce.mSignature) & specialBits);
+
+  const size_t numInputs = map->arg_size() -
+      bcinfo::MetadataExtractor::hasForEachSignatureCtxt(mapSignature) -
+      bcinfo::MetadataExtractor::hasForEachSignatureX(mapSignature) -
+      bcinfo::MetadataExtractor::hasForEachSignatureY(mapSignature) -
+      bcinfo::MetadataExtractor::hasForEachSignatureZ(mapSignature);
+
+  llvm::SmallVector<llvm::Type*, 8> argTys;
+  argTys.push_back(accumTy);
+  auto mapArgIter = map->arg_begin();
+  for (size_t i = 0; i < numInputs; i++) {
+    argTys.push_back((mapArgIter++)->getType());
+  }
+  if (bcinfo::MetadataExtractor::hasForEachSignatureCtxt(fusedSignature)) {
+    argTys.push_back(bcinfo::MetadataExtractor::hasForEachSignatureCtxt(mapSignature) ?
+                     mapArgIter->getType() : accumulatorArgIter->getType());
+  }
+  llvm::Type* I32Ty = llvm::IntegerType::get(ctxt, 32);
+  for (uint32_t bit : {bcinfo::MD_SIG_X, bcinfo::MD_SIG_Y, bcinfo::MD_SIG_Z}) {
+    if (fusedSignature & bit) {
+      argTys.push_back(I32Ty);
+    }
+  }
+
+  const std::string accumulatorName = fusedName + ".accum";
+  Function* fusedAccumulator = Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(ctxt), argTys, false),
+      llvm::GlobalValue::InternalLinkage, accumulatorName, mergedModule);
+
+  llvm::BasicBlock* block = llvm::BasicBlock::Create(ctxt, "entry", fusedAccumulator);
+  llvm::IRBuilder<> builder(block);
+
+  Function::arg_iterator argIter = fusedAccumulator->arg_begin();
+  llvm::Value* accum = &*(argIter++);
+  accum->setName("accum");
+
+  std::vector<llvm::Value*> mapArgs;
+  for (size_t i = 0; i < numInputs; i++) {
+    mapArgs.push_back(&*(argIter++));
+  }
+
+  // Special arguments, in signature order, for whichever callee takes them.
+  std::vector<llvm::Value*> accumulatorArgs;
+  for (uint32_t bit : {bcinfo::MD_SIG_Ctxt, bcinfo::MD_SIG_X, bcinfo::MD_SIG_Y,
+                       bcinfo::MD_SIG_Z}) {
+    if (!(fusedSignature & bit)) {
+      continue;
+    }
+    llvm::Value* arg = &*(argIter++);
+    if (mapSignature & bit) {
+      mapArgs.push_back(arg);
+    }
+    if (reduce.mSignature & bit) {
+      llvm::Type* paramTy = accumulator->getFunctionType()->getParamType(
+          2 + accumulatorArgs.size());
+      accumulatorArgs.push_back(builder.CreatePointerCast(arg, paramTy));
+    }
+  }
+
+  llvm::Value* element = builder.CreateCall(map, mapArgs);
+  if (inTy->isPointerTy() && inTy != elementTy) {
+    llvm::Value* copy = builder.CreateAlloca(elementTy, nullptr, "element_copy");
+    builder.CreateStore(element, copy);
+    element = copy;
+  }
+
+  accumulatorArgs.insert(accumulatorArgs.begin(), {accum, element});
+  builder.CreateCall((llvm::Value*)accumulator, accumulatorArgs);
+  builder.CreateRetVoid();
+
+  const char* combinerName = reduce.mCombinerName;
+  const std::string fusedCombinerName = fusedName + ".combiner";
+  if (combinerName == nullptr) {
+    if (createFusedReduceCombiner(Context, accumulator, fusedCombinerName,
+                                  mergedModule) == nullptr) {
+      return false;
+    }
+    combinerName = fusedCombinerName.c_str();
   }
-  llvm::Type* returnTy = F->getReturnType();
+
+  // Same layout as the reduce metadata emitted by slang:
+  //   !{name, accumulator data size, !{accumulator, signature},
+  //     initializer, combiner, outconverter, halter}
+  llvm::Metadata* accumulatorMD[] = {
+    llvm::MDString::get(ctxt, accumulatorName),
+    llvm::MDString::get(ctxt, llvm::utostr(fusedSignature))
+  };
+  llvm::Metadata* reduceMD[] = {
+    llvm::MDString::get(ctxt, fusedName),
+    llvm::MDString::get(ctxt, llvm::utostr(reduce.mAccumulatorDataSize)),
+    llvm::MDNode::get(ctxt, accumulatorMD),
+    getOptionalNameMD(ctxt, reduce.mInitializerName),
+    getOptionalNameMD(ctxt, combinerName),
+    getOptionalNameMD(ctxt, reduce.mOutConverterName),
+    getOptionalNameMD(ctxt, reduce.mHalterName)
+  };
+
+  llvm::NamedMDNode* ExportReduceMD =
+    mergedModule->getOrInsertNamedMetadata("#rs_export_reduce");
+  ExportReduceMD->addOperand(llvm::MDNode::get(ctxt, reduceMD));
+
+  return true;
+}
+
+bool planFusion(const std::vector<Source *>& sources,
+                const std::vector<ScriptGroupKernel>& kernels,
+                const std::string& namePrefix,
+                std::list<std::list<std::pair<int, int>>>* toFuse,
+                std::list<std::string>* fused,
+                std::string* report) {
+  const int numKernels = kernels.size();
+
+  // Number of kernel inputs each kernel's output feeds.
+  std::vector<int> numUses(numKernels, 0);
+  for (int i = 0; i < numKernels; i++) {
+    const ScriptGroupKernel& kernel = kernels[i];
+    if (kernel.source < 0 || (size_t)kernel.source >= sources.size() || kernel.slot < 0 ||
+        (size_t)kernel.slot >= sources[kernel.source]->getMetadata()->getExportForEachSignatureCount()) {
+      ALOGE("Fusion planning: kernel %d refers to unknown source %d slot %d",
+            i, kernel.source, kernel.slot);
+      return false;
+    }
+    for (int producer : kernel.inputProducers) {
+      if (producer < -1 || producer >= i) {
+        ALOGE("Fusion planning: kernel %d consumes kernel %d, which does not precede it",
+              i, producer);
+        return false;
+      }
+      if (producer >= 0) {
+        numUses[producer]++;
+      }
+    }
+  }
+
+  std::string plan;
+  llvm::raw_string_ostream planStream(plan);
+
+  std::vector<bool> inChain(numKernels, false);
+  int numFused = 0;
+  for (int head = 0; head < numKernels; head++) {
+    if (inChain[head]) {
+      continue;
+    }
+
+    std::vector<int> chain = {head};
+    std::vector<Source*> chainSources = {sources[kernels[head].source]};
+    std::vector<int> chainSlots = {kernels[head].slot};
+    MemoryTraffic unfused = getKernelTraffic(chainSources.back(), chainSlots.back());
+    MemoryTraffic fusedTraffic = unfused;
+
+    for (;;) {
+      const int tail = chain.back();
+      if (kernels[tail].outputLive || numUses[tail] != 1) {
+        break;
+      }
+
+      // The only consumer of the output must take it as its first input.
+      int consumer = tail + 1;
+      while (consumer < numKernels &&
+             std::find(kernels[consumer].inputProducers.begin(),
+                       kernels[consumer].inputProducers.end(),
+                       tail) == kernels[consumer].inputProducers.end()) {
+        consumer++;
+      }
+      if (consumer == numKernels || kernels[consumer].inputProducers.front() != tail) {
+        break;
+      }
+
+      // Its other inputs become inputs of the fused kernel, which is launched
+      // in place of the head of the chain, so they must be produced before it.
+      const std::vector<int>& producers = kernels[consumer].inputProducers;
+      if (std::any_of(producers.begin() + 1, producers.end(), [head](int p) {
+            return p >= head;
+          })) {
+        break;
+      }
+
+      Source* consumerSource = sources[kernels[consumer].source];
+      const int consumerSlot = kernels[consumer].slot;
+      const Function* tailF = getFunction(&chainSources.back()->getModule(),
+                                          chainSources.back(), chainSlots.back(), nullptr);
+      const Function* consumerF = getFunction(&consumerSource->getModule(),
+                                              consumerSource, consumerSlot, nullptr);
+      if (tailF == nullptr || consumerF == nullptr || consumerF->arg_empty() ||
+          tailF->getReturnType() != consumerF->getFunctionType()->getParamType(0)) {
+        break;
+      }
+
+      std::vector<Source*> candidateSources(chainSources);
+      std::vector<int> candidateSlots(chainSlots);
+      candidateSources.push_back(consumerSource);
+      candidateSlots.push_back(consumerSlot);
+      uint32_t signature;
+      if (getFusedFuncSig(candidateSources, candidateSlots, &signature) < 0) {
+        break;
+      }
+
+      // Fusing saves writing the intermediate element and reading it back,
+      // which is only worthwhile if the element takes any memory at all.
+      const MemoryTraffic consumerTraffic = getKernelTraffic(consumerSource, consumerSlot);
+      const uint64_t intermediate = fusedTraffic.written;
+      if (intermediate == 0 || consumerTraffic.read < intermediate) {
+        break;
+      }
+      const MemoryTraffic candidate = {
+        fusedTraffic.read + consumerTraffic.read - intermediate,
+        consumerTraffic.written
+      };
+
+      chain.push_back(consumer);
+      chainSources.swap(candidateSources);
+      chainSlots.swap(candidateSlots);
+      inChain[consumer] = true;
+      unfused.read += consumerTraffic.read;
+      unfused.written += consumerTraffic.written;
+      fusedTraffic = candidate;
+    }
+
+    if (chain.size() < 2) {
+      continue;
+    }
+
+    const std::string name = namePrefix + llvm::utostr(numFused++);
+    std::list<std::pair<int, int>> sourcesAndSlots;
+    planStream << name << ":";
+    for (int k : chain) {
+      sourcesAndSlots.push_back(std::make_pair(kernels[k].source, kernels[k].slot));
+      planStream << " " << k << "(" << kernels[k].source << "," << kernels[k].slot << ")";
+    }
+    planStream << " bytes/cell " << unfused.read + unfused.written << " -> "
+               << fusedTraffic.read + fusedTraffic.written << "\n";
+    toFuse->push_back(sourcesAndSlots);
+    fused->push_back(name);
+  }
+
+  if (numFused == 0) {
+    planStream << "no kernels fused\n";
+  }
+  planStream.flush();
+
+  ALOGV("Fusion plan:\n%s", plan.c_str());
+  if (report != nullptr) {
+    *report = plan;
+  }
+
+  return true;
+}
+
+bool batchInvokes(BCCContext& Context,
+                  const std::vector<Source *>& sources,
+                  const std::vector<int>& slots,
+                  const std::string& newName,
+                  Module* module) {
+  bccAssert(sources.size() == slots.size() && "sources and slots differ in size");
+
+  llvm::LLVMContext& ctxt = Context.getLLVMContext();
+  llvm::Type* I8PtrTy = llvm::Type::getInt8PtrTy(ctxt);
+  const llvm::DataLayout& DL = module->getDataLayout();
 
   llvm::FunctionType* batchFuncTy =
-          llvm::FunctionType::get(returnTy, params, false);
+          llvm::FunctionType::get(llvm::Type::getVoidTy(ctxt), {I8PtrTy}, false);
 
   llvm::Function* newF =
           llvm::Function::Create(batchFuncTy,
                                  llvm::GlobalValue::ExternalLinkage, newName,
                                  module);
 
-  llvm::BasicBlock* block = llvm::BasicBlock::Create(Context.getLLVMContext(),
-                                                     "entry", newF);
+  llvm::BasicBlock* block = llvm::BasicBlock::Create(ctxt, "entry", newF);
   llvm::IRBuilder<> builder(block);
 
-  llvm::Function::arg_iterator argIter = newF->arg_begin();
-  llvm::Value* arg1 = &*(argIter++);
-  builder.CreateCall((llvm::Value*)F, arg1);
+  llvm::Value* packedArgs = &*newF->arg_begin();
+  packedArgs->setName("packed_args");
+
+  // The arguments of each invokable (packed into a struct by its .helper
+  // function) follow each other in the buffer, each aligned as its struct.
+  uint64_t offset = 0;
+  auto slotIter = slots.begin();
+  for (const Source* source : sources) {
+    const int slot = *slotIter++;
+    const Function* F = getInvokeFunction(*source, slot, module);
+
+    std::vector<llvm::Value*> args;
+    if (F->arg_size() == 1 && F->arg_begin()->getType()->isPointerTy()) {
+      llvm::Type* argTy = F->arg_begin()->getType();
+      llvm::Type* packedTy = argTy->getPointerElementType();
+      const uint64_t alignment = DL.getABITypeAlignment(packedTy);
+      offset = (offset + alignment - 1) / alignment * alignment;
+      llvm::Value* argAddr = builder.CreateConstInBoundsGEP1_64(packedArgs, offset);
+      args.push_back(builder.CreatePointerCast(argAddr, argTy));
+      offset += DL.getTypeAllocSize(packedTy);
+    } else if (F->arg_size() != 0) {
+      ALOGE("Invoke batching (module %s function %s): expected packed arguments",
+            source->getName().c_str(), F->getName().str().c_str());
+      newF->eraseFromParent();
+      return false;
+    }
+
+    // Let the inliner fold the whole batch into this function.
+    llvm::CallInst* call = builder.CreateCall((llvm::Value*)F, args);
+    call->addAttribute(llvm::AttributeSet::FunctionIndex, llvm::Attribute::AlwaysInline);
+  }
 
   builder.CreateRetVoid();
 
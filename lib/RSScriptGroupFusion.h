@@ -17,8 +17,10 @@
 #ifndef BCC_RS_SCRIPT_GROUP_FUSION_H
 #define BCC_RS_SCRIPT_GROUP_FUSION_H
 
-#include <vector>
+#include <list>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace llvm {
 class Module;
@@ -28,9 +30,15 @@ namespace bcc {
 
 class Source;
 class BCCContext;
+struct ScriptGroupKernel;
 
 /// @brief Fuse kernels
 ///
+/// Each kernel after the first receives the element produced by the previous
+/// kernel as its first input. The inputs of the fused kernel are all inputs of
+/// the first kernel, followed by the remaining inputs of each later kernel in
+/// order; then comes an rs_kernel_context argument if any kernel takes one.
+///
 /// @param Context bcc context.
 /// @param sources The Sources containing the kernels.
 /// @param slots The slots where the kernels are located.
@@ -44,8 +52,70 @@ bool fuseKernels(BCCContext& Context,
                  const std::string& fusedName,
                  llvm::Module* mergedModule);
 
-bool renameInvoke(BCCContext& Context, const Source* source, const int slot,
-                  const std::string& newName, llvm::Module* mergedModule);
+/// @brief Fuse kernels into a general reduce kernel
+///
+/// Creates a reduce kernel named fusedName whose accumulator calls the kernels
+/// in the given slots in a chain (as fuseKernels() does) for each element, and
+/// accumulates the result with the accumulator of the reduce kernel in
+/// reduceSlot of reduceSource. The fused reduce kernel shares the initializer,
+/// combiner, outconverter and halter of that reduce kernel, and is described by
+/// #rs_export_reduce metadata like any other reduce kernel.
+///
+/// @return True, if kernels are successfully fused. False, otherwise.
+bool fuseKernelsIntoReduce(BCCContext& Context,
+                           const std::vector<Source *>& sources,
+                           const std::vector<int>& slots,
+                           const Source* reduceSource,
+                           const int reduceSlot,
+                           const std::string& fusedName,
+                           llvm::Module* mergedModule);
+
+/// @brief Plan kernel fusion for a script group
+///
+/// Greedily grows chains of kernels in which each kernel is the only consumer
+/// of the previous one's output, through its first input, and that output is
+/// not live after the script group. The other inputs of each kernel of a chain
+/// must come from outside the script group or from kernels that precede the
+/// head of the chain, since the fused kernel is launched in place of the head.
+/// A chain is extended only if fuseKernels() supports the resulting signature
+/// and fusing saves memory traffic: writing the intermediate element and
+/// reading it back, per cell.
+///
+/// @param sources The Sources containing the kernels (with metadata extracted).
+/// @param kernels The kernels of the script group, in execution order.
+/// @param namePrefix Prefix of the names of the fused kernels.
+/// @param toFuse Receives the chosen chains, as source-and-slot pairs.
+/// @param fused Receives the names of the fused kernels.
+/// @param report If not null, receives a description of the plan.
+/// @return False, if the script group is malformed. True, otherwise.
+bool planFusion(const std::vector<Source *>& sources,
+                const std::vector<ScriptGroupKernel>& kernels,
+                const std::string& namePrefix,
+                std::list<std::list<std::pair<int, int>>>* toFuse,
+                std::list<std::string>* fused,
+                std::string* report);
+
+/// @brief Batch invokables
+///
+/// Creates an invokable that calls the invokables in the given slots in order,
+/// so that one call from the driver executes the whole batch. The calls are
+/// marked alwaysinline, so that the batch becomes a single function.
+///
+/// The new invokable takes a single buffer with the arguments of the batch.
+/// Each invokable takes either no arguments, or a pointer to the struct that
+/// its .helper function packs its arguments into. These structs follow each
+/// other in the buffer in batch order: each starts at the first offset after
+/// the previous one that is a multiple of its ABI alignment in the module's
+/// data layout, and takes its alloc size. For example, { i8 }, { i16, i8 } and
+/// { double } are at offsets 0, 2 and 8. Invokables without arguments take no
+/// space in the buffer.
+///
+/// @return True, if the invokables are successfully batched. False, otherwise.
+bool batchInvokes(BCCContext& Context,
+                  const std::vector<Source *>& sources,
+                  const std::vector<int>& slots,
+                  const std::string& newName,
+                  llvm::Module* mergedModule);
 }
 
 #endif /* BCC_RS_SCRIPT_GROUP_FUSION_H */
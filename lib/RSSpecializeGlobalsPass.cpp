@@ -0,0 +1,290 @@
+/*
+ * Copyright 2016, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Log.h"
+#include "RSTransforms.h"
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Only used when the pass is run through opt, e.g.
+//   -rs-specialize-global=radius=05000000
+static llvm::cl::list<std::string>
+SpecializeGlobalOpts("rs-specialize-global",
+                     llvm::cl::desc("Specialize an exported global variable for a "
+                                    "value, given as <name>=<hex bytes in memory order>"),
+                     llvm::cl::value_desc("name=bytes"), llvm::cl::ZeroOrMore);
+
+/*
+ * RSSpecializeGlobalsPass - This pass specializes the script for known
+ * values of some of its exported global variables (filter radius, kernel
+ * size, flags, ...), so that LTO can fold them, and unroll the loops that
+ * they bound.
+ *
+ * Every load from such a global at a constant offset is replaced with the
+ * corresponding part of the value.  The global itself is kept, with its
+ * linkage, type and mutability unchanged, so that the set of exported
+ * symbols (and hence .rs.info and .rs.global_*) is the same as for an
+ * unspecialized build; only its initializer is changed to the value.
+ *
+ * A global is not specialized if the script may write to it (i.e., if its
+ * address is used for anything but loads), or if its type contains
+ * pointers (e.g., rs_allocation).
+ *
+ * WARNINGS:
+ * - If the driver changes the value of a specialized global (through
+ *   setVar or bind) after the script is created, the compiled code WILL
+ *   NOT SEE THE NEW VALUE.  Callers must recompile instead.
+ */
+class RSSpecializeGlobalsPass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  RSSpecializeGlobalsPass() : ModulePass(ID) {
+    for (const std::string &Opt : SpecializeGlobalOpts) {
+      size_t Separator = Opt.find('=');
+      std::vector<uint8_t> Bytes;
+      if (Separator == std::string::npos ||
+          !parseHexBytes(Opt.substr(Separator + 1), &Bytes)) {
+        ALOGE("Invalid global specialization '%s'", Opt.c_str());
+        continue;
+      }
+      mGlobals[Opt.substr(0, Separator)] = Bytes;
+    }
+  }
+
+  explicit RSSpecializeGlobalsPass(const bcc::SpecializedGlobalMap &pGlobals)
+      : ModulePass(ID), mGlobals(pGlobals) { }
+
+  virtual bool runOnModule(llvm::Module &M) override {
+    const llvm::DataLayout &DL = M.getDataLayout();
+    bool Changed = false;
+
+    for (const auto &Global : mGlobals) {
+      const std::string &Name = Global.first;
+      const std::vector<uint8_t> &Bytes = Global.second;
+
+      llvm::GlobalVariable *GV = M.getGlobalVariable(Name);
+      if (GV == nullptr || !GV->hasInitializer() || GV->hasLocalLinkage()) {
+        ALOGW("Cannot specialize '%s': not an exported global variable",
+              Name.c_str());
+        continue;
+      }
+
+      llvm::Type *ValueTy = GV->getType()->getPointerElementType();
+      if (DL.getTypeAllocSize(ValueTy) != Bytes.size()) {
+        ALOGW("Cannot specialize '%s': expected %u bytes, got %u", Name.c_str(),
+              static_cast<unsigned>(DL.getTypeAllocSize(ValueTy)),
+              static_cast<unsigned>(Bytes.size()));
+        continue;
+      }
+
+      llvm::Constant *Initializer = createConstant(ValueTy, Bytes.data(), DL);
+      if (Initializer == nullptr) {
+        ALOGW("Cannot specialize '%s': unsupported type", Name.c_str());
+        continue;
+      }
+
+      Loads.clear();
+      if (!collectLoads(GV, 0, DL)) {
+        ALOGW("Cannot specialize '%s': the script may write to it", Name.c_str());
+        continue;
+      }
+
+      // A common symbol must be zero-initialized; define it instead, which
+      // keeps it exported.
+      if (GV->hasCommonLinkage())
+        GV->setLinkage(llvm::GlobalValue::ExternalLinkage);
+      GV->setInitializer(Initializer);
+      for (const auto &LoadAndOffset : Loads) {
+        llvm::LoadInst *Load = LoadAndOffset.first;
+        int64_t Offset = LoadAndOffset.second;
+        if (Offset < 0 ||
+            static_cast<uint64_t>(Offset) + DL.getTypeStoreSize(Load->getType()) > Bytes.size())
+          continue;
+
+        llvm::Constant *Value = createConstant(Load->getType(), &Bytes[Offset], DL);
+        if (Value == nullptr)
+          continue;
+
+        Load->replaceAllUsesWith(Value);
+        Load->eraseFromParent();
+      }
+      Changed = true;
+    }
+
+    return Changed;
+  }
+
+  virtual const char *getPassName() const override {
+    return "Renderscript Global Variable Specialization";
+  }
+
+private:
+  static bool parseHexBytes(const std::string &Hex, std::vector<uint8_t> *Bytes) {
+    if (Hex.size() % 2 != 0)
+      return false;
+    for (size_t i = 0; i < Hex.size(); i += 2) {
+      char *End = nullptr;
+      std::string Digits = Hex.substr(i, 2);
+      unsigned long Byte = strtoul(Digits.c_str(), &End, 16);
+      if (*End != '\0')
+        return false;
+      Bytes->push_back(static_cast<uint8_t>(Byte));
+    }
+    return true;
+  }
+
+  /*
+   * Returns a constant of type Ty holding the value laid out in memory at
+   * Bytes, or nullptr if Ty contains pointers (or integers wider than 64
+   * bits).  Bytes must hold at least DL.getTypeStoreSize(Ty) bytes.
+   */
+  static llvm::Constant *createConstant(llvm::Type *Ty, const uint8_t *Bytes,
+                                        const llvm::DataLayout &DL) {
+    if (Ty->isIntegerTy()) {
+      uint64_t StoreSize = DL.getTypeStoreSize(Ty);
+      if (StoreSize > sizeof(uint64_t))
+        return nullptr;
+
+      uint64_t Value = 0;
+      for (uint64_t i = 0; i < StoreSize; ++i) {
+        uint64_t Byte = Bytes[DL.isLittleEndian() ? i : StoreSize - 1 - i];
+        Value |= Byte << (8 * i);
+      }
+      return llvm::ConstantInt::get(Ty, Value);
+    }
+
+    if (Ty->isHalfTy() || Ty->isFloatTy() || Ty->isDoubleTy()) {
+      llvm::Type *IntTy =
+          llvm::Type::getIntNTy(Ty->getContext(), Ty->getPrimitiveSizeInBits());
+      return llvm::ConstantExpr::getBitCast(createConstant(IntTy, Bytes, DL), Ty);
+    }
+
+    if (auto VectorTy = llvm::dyn_cast<llvm::VectorType>(Ty)) {
+      llvm::Type *ElementTy = VectorTy->getElementType();
+      uint64_t ElementSize = DL.getTypeAllocSize(ElementTy);
+      llvm::SmallVector<llvm::Constant *, 4> Elements;
+      for (unsigned i = 0; i < VectorTy->getNumElements(); ++i) {
+        llvm::Constant *Element = createConstant(ElementTy, Bytes + i * ElementSize, DL);
+        if (Element == nullptr)
+          return nullptr;
+        Elements.push_back(Element);
+      }
+      return llvm::ConstantVector::get(Elements);
+    }
+
+    if (auto ArrayTy = llvm::dyn_cast<llvm::ArrayType>(Ty)) {
+      llvm::Type *ElementTy = ArrayTy->getElementType();
+      uint64_t ElementSize = DL.getTypeAllocSize(ElementTy);
+      std::vector<llvm::Constant *> Elements;
+      for (uint64_t i = 0; i < ArrayTy->getNumElements(); ++i) {
+        llvm::Constant *Element = createConstant(ElementTy, Bytes + i * ElementSize, DL);
+        if (Element == nullptr)
+          return nullptr;
+        Elements.push_back(Element);
+      }
+      return llvm::ConstantArray::get(ArrayTy, Elements);
+    }
+
+    if (auto StructTy = llvm::dyn_cast<llvm::StructType>(Ty)) {
+      if (StructTy->isOpaque())
+        return nullptr;
+
+      const llvm::StructLayout *Layout = DL.getStructLayout(StructTy);
+      std::vector<llvm::Constant *> Elements;
+      for (unsigned i = 0; i < StructTy->getNumElements(); ++i) {
+        llvm::Constant *Element = createConstant(StructTy->getElementType(i),
+                                                 Bytes + Layout->getElementOffset(i), DL);
+        if (Element == nullptr)
+          return nullptr;
+        Elements.push_back(Element);
+      }
+      return llvm::ConstantStruct::get(StructTy, Elements);
+    }
+
+    return nullptr;
+  }
+
+  /*
+   * Collect the loads through the pointer Value into the global, along
+   * with their byte offsets from the start of the global (or -1 if the
+   * offset is not constant).  Returns false if the global may be written
+   * or its address may escape through Value.
+   */
+  bool collectLoads(llvm::Value *Value, int64_t Offset, const llvm::DataLayout &DL) {
+    for (llvm::User *User : Value->users()) {
+      if (auto Load = llvm::dyn_cast<llvm::LoadInst>(User)) {
+        if (Load->isVolatile())
+          return false;
+        Loads.push_back(std::make_pair(Load, Offset));
+      } else if (auto BitCast = llvm::dyn_cast<llvm::BitCastOperator>(User)) {
+        if (!collectLoads(BitCast, Offset, DL))
+          return false;
+      } else if (auto GEP = llvm::dyn_cast<llvm::GEPOperator>(User)) {
+        if (GEP->getPointerOperand() != Value)
+          return false;
+
+        llvm::APInt GEPOffset(DL.getPointerSizeInBits(GEP->getPointerAddressSpace()), 0);
+        int64_t NewOffset = -1;
+        if (Offset >= 0 && GEP->accumulateConstantOffset(DL, GEPOffset))
+          NewOffset = Offset + GEPOffset.getSExtValue();
+        if (!collectLoads(GEP, NewOffset, DL))
+          return false;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Values of the globals to specialize, by name.
+  bcc::SpecializedGlobalMap mGlobals;
+
+  // Loads of the global being specialized, with their offsets.
+  llvm::SmallVector<std::pair<llvm::LoadInst *, int64_t>, 8> Loads;
+}; // end RSSpecializeGlobalsPass
+
+char RSSpecializeGlobalsPass::ID = 0;
+llvm::RegisterPass<RSSpecializeGlobalsPass> X("rsspecglobals", "RS Global Specialization Pass");
+
+} // end anonymous namespace
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSSpecializeGlobalsPass(const SpecializedGlobalMap &pGlobals) {
+  return new RSSpecializeGlobalsPass(pGlobals);
+}
+
+} // end namespace bcc
@@ -17,6 +17,8 @@
 #ifndef BCC_RS_TRANSFORMS_H
 #define BCC_RS_TRANSFORMS_H
 
+#include "bcc/Script.h"
+
 namespace llvm {
   class ModulePass;
   class FunctionPass;
@@ -27,17 +29,35 @@ namespace bcc {
 extern const char BCC_INDEX_VAR_NAME[];
 
 llvm::ModulePass *
-createRSKernelExpandPass(bool pEnableStepOpt);
+createRSKernelExpandPass(bool pEnableStepOpt,
+                         const ExpandShapeHintMap &pShapeHints = ExpandShapeHintMap());
+
+llvm::ModulePass * createRSAllocationAccessPass();
+
+llvm::ModulePass *
+createRSSpecializeGlobalsPass(const SpecializedGlobalMap &pGlobals);
+
+llvm::ModulePass *
+createRSMultiversionPass(const std::vector<std::string> &pLevels,
+                         const std::string &pCPU, const std::string &pFeatures);
+
+llvm::ModulePass * createRSProfileInstrumentPass();
+
+llvm::ModulePass *
+createRSProfileUsePass(const std::vector<uint8_t> &pProfileData);
 
 llvm::FunctionPass *
 createRSInvariantPass();
 
+llvm::ModulePass * createRSRelaxedPrecisionPass();
+
 llvm::FunctionPass *
 createRSInvokeHelperPass();
 
-llvm::ModulePass * createRSEmbedInfoPass();
+llvm::ModulePass * createRSEmbedInfoPass(bool pEmbedBinary);
 
-llvm::ModulePass * createRSGlobalInfoPass(bool pSkipConstants);
+llvm::ModulePass * createRSGlobalInfoPass(bool pSkipConstants,
+                                          bool pEmbedIndex);
 
 llvm::ModulePass * createRSScreenFunctionsPass();
 
@@ -23,6 +23,7 @@
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/ADT/StringRef.h>
 
+#include <cctype>
 #include <string>
 
 namespace {
@@ -74,6 +75,24 @@ const char kSamplerTypeName[]    = "struct.rs_sampler";
 const char kScriptTypeName[]     = "struct.rs_script";
 const char kTypeTypeName[]       = "struct.rs_type";
 
+// Function attribute marking the functions of relaxed precision scripts in
+// modules that mix precisions (see RSRelaxedPrecisionPass).
+const char kRelaxedPrecisionAttrName[] = "rs-fp-relaxed";
+
+// TBAA nodes of the accesses to Allocations (see RSKernelExpandPass and
+// RSAllocationAccessPass).
+const char kRenderScriptTBAARootName[] = "RenderScript Distinct TBAA";
+const char kRenderScriptTBAANodeName[] = "RenderScript TBAA";
+
+// C library function called by the resolver of RSMultiversionPass, and
+// accepted by RSScreenFunctionsPass although it is not a runtime function.
+const char kGetAuxValName[] = "getauxval";
+
+// Optional name index of the .rs.global_* tables (see RSGlobalInfoPass).
+const char kRsGlobalNameHashes[] = ".rs.global_name_hashes";
+const char kRsGlobalIndexEntries[] = ".rs.global_index_entries";
+const char kRsGlobalIndex[] = ".rs.global_index";
+
 // Returns the RsDataType for a given input LLVM type.
 // This is only used to distinguish the associated RS object types (i.e.
 // rs_allocation, rs_element, rs_sampler, rs_script, and rs_type).
@@ -103,6 +122,22 @@ static inline bool isRsObjectType(const llvm::Type *T) {
   return getRsDataTypeForType(T) != RS_TYPE_NONE;
 }
 
+// Returns the source-level name of the (possibly Itanium-mangled) function
+// name Mangled, e.g. "rsGetElementAt_int" for
+// "_Z18rsGetElementAt_int13rs_allocationj".
+static inline llvm::StringRef getUnmangledFunctionName(llvm::StringRef Mangled) {
+  if (!Mangled.startswith("_Z"))
+    return Mangled;
+
+  size_t Pos = 2, Length = 0;
+  while (Pos < Mangled.size() && isdigit(Mangled[Pos])) {
+    Length = Length * 10 + (Mangled[Pos++] - '0');
+  }
+  if (Length == 0 || Pos + Length > Mangled.size())
+    return llvm::StringRef();
+  return Mangled.substr(Pos, Length);
+}
+
 }  // end namespace
 
 // When we have a general reduction kernel with no combiner function,
@@ -113,4 +148,13 @@ static inline std::string nameReduceCombinerFromAccumulator(llvm::StringRef accu
   return std::string(accumName) + ".combiner";
 }
 
+// Given the name of a foreach kernel and a shape hint for it, what should
+// be the name of its shape-specialized expanded function?  The driver looks
+// up this name to pick the specialized function for launches of that shape.
+static inline std::string nameExpandShapeVariant(llvm::StringRef kernelName,
+                                                 uint32_t dimX, uint32_t alignment) {
+  return std::string(kernelName) + ".expand.w" + std::to_string(dimX) +
+         "a" + std::to_string(alignment);
+}
+
 #endif // BCC_RS_UTILS_H
@@ -31,8 +31,10 @@ using namespace bcc;
 Script::Script(Source *pSource)
     : mSource(pSource),
       mOptimizationLevel(llvm::CodeGenOpt::Aggressive),
-      mLinkRuntimeCallback(nullptr), mEmbedInfo(false), mEmbedGlobalInfo(false),
-      mEmbedGlobalInfoSkipConstant(false) {}
+      mLinkRuntimeCallback(nullptr), mEmbedInfo(false), mEmbedBinaryInfo(false),
+      mEmbedGlobalInfo(false),
+      mEmbedGlobalInfoSkipConstant(false), mEmbedGlobalInfoIndex(false),
+      mProfileInstrument(false) {}
 
 bool Script::LinkRuntime(const char *core_lib) {
   bccAssert(core_lib != nullptr);
@@ -57,7 +57,7 @@ static inline std::unique_ptr<llvm::Module> helper_load_bitcode(llvm::LLVMContex
 
 static void helper_get_module_metadata_from_bitcode_wrapper(
     uint32_t *compilerVersion, uint32_t *optimizationLevel,
-    const bcinfo::BitcodeWrapper &wrapper) {
+    const bcinfo::BitcodeWrapperHeader &wrapper) {
   *compilerVersion = wrapper.getCompilerVersion();
   *optimizationLevel = wrapper.getOptimizationLevel();
 }
@@ -124,7 +124,7 @@ Source *Source::CreateFromBuffer(BCCContext &pContext,
 
   uint32_t compilerVersion, optimizationLevel;
   helper_get_module_metadata_from_bitcode_wrapper(&compilerVersion, &optimizationLevel,
-                                                  bcinfo::BitcodeWrapper(pBitcode, pBitcodeSize));
+                                                  bcinfo::BitcodeWrapperHeader(pBitcode, pBitcodeSize));
   Source *result = CreateFromModule(pContext, pName, *module,
                                     compilerVersion, optimizationLevel,
                                     /* pNoDelete */false);
@@ -148,8 +148,8 @@ Source *Source::CreateFromFile(BCCContext &pContext, const std::string &pPath) {
 
   uint32_t compilerVersion, optimizationLevel;
   helper_get_module_metadata_from_bitcode_wrapper(&compilerVersion, &optimizationLevel,
-                                                  bcinfo::BitcodeWrapper(input_data->getBufferStart(),
-                                                                         input_data->getBufferSize()));
+                                                  bcinfo::BitcodeWrapperHeader(input_data->getBufferStart(),
+                                                                               input_data->getBufferSize()));
 
   std::unique_ptr<llvm::MemoryBuffer> input_memory(input_data.release());
   auto managedModule = helper_load_bitcode(pContext.mImpl->mLLVMContext,
@@ -194,6 +194,36 @@ Source *Source::CreateFromModule(BCCContext &pContext, const char* name, llvm::M
   return result;
 }
 
+Source *Source::CreateFromVerifiedBuffer(BCCContext &pContext,
+                                         const char *pName,
+                                         const char *pBitcode,
+                                         size_t pBitcodeSize) {
+  llvm::MemoryBufferRef input_data(llvm::StringRef(pBitcode, pBitcodeSize),
+                                   pName);
+
+  llvm::ErrorOr<std::unique_ptr<llvm::Module> > moduleOrError =
+      llvm::parseBitcodeFile(input_data, pContext.mImpl->mLLVMContext);
+  if (std::error_code ec = moduleOrError.getError()) {
+    ALOGE("Unable to parse the bitcode of `%s'! (%s)", pName,
+          ec.message().c_str());
+    return nullptr;
+  }
+
+  // The wrapper information is part of the module already.
+  llvm::Module *module = moduleOrError.get().release();
+  Source *result = new (std::nothrow) Source(pName, pContext, *module);
+  if (result == nullptr) {
+    ALOGE("Out of memory during Source object allocation for `%s'!", pName);
+    delete module;
+  }
+  return result;
+}
+
+void Source::writeBitcode(llvm::SmallVectorImpl<char> &pBitcode) const {
+  llvm::raw_svector_ostream OS(pBitcode);
+  llvm::WriteBitcodeToFile(mModule, OS);
+}
+
 Source::Source(const char* name, BCCContext &pContext, llvm::Module &pModule,
                bool pNoDelete)
     : mName(name), mContext(pContext), mModule(&pModule), mMetadata(nullptr),
@@ -0,0 +1,84 @@
+; Driver for reduce-simd-equivalence.ll: runs the expanded accumulators of
+; that test over several spans of the same inputs, the way the runtime
+; does for one thread's share of a reduction, and prints the results.
+
+%RsLaunchDimensions = type { i32, i32, i32, i32, i32, [4 x i32] }
+%RsExpandKernelDriverInfoPfx = type { [8 x i8*], [8 x i32], i32, [8 x i8*], [8 x i32], i32, %RsLaunchDimensions, %RsLaunchDimensions, i8*, i32 }
+%struct.IndexedVal = type { i32, i32 }
+
+; The minimum -4 and the maximum 50 occur in several lanes, and on both
+; sides of the vector/scalar boundary of the longer spans.
+@ints = internal constant [37 x i32] [i32 5, i32 12, i32 50, i32 7, i32 -1, i32 3, i32 -4, i32 8, i32 21, i32 -4, i32 0, i32 17, i32 2, i32 50, i32 -3, i32 9, i32 4, i32 11, i32 6, i32 -2, i32 14, i32 1, i32 33, i32 -4, i32 19, i32 5, i32 50, i32 10, i32 -1, i32 2, i32 -4, i32 27, i32 8, i32 0, i32 13, i32 50, i32 -4]
+@bytes = internal constant [37 x i8] [i8 3, i8 -56, i8 17, i8 -6, i8 0, i8 -127, i8 64, i8 99, i8 1, i8 2, i8 -56, i8 45, i8 7, i8 8, i8 9, i8 31, i8 100, i8 77, i8 -6, i8 13, i8 -6, i8 11, i8 5, i8 -127, i8 66, i8 -16, i8 1, i8 2, i8 3, i8 4, i8 5, i8 6, i8 7, i8 8, i8 9, i8 10, i8 -6]
+
+@format = private unnamed_addr constant [48 x i8] c"%u %u: sum %d max %u argmin %d@%d argmax %d@%d\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+declare void @sumAccum.expand(%RsExpandKernelDriverInfoPfx*, i32, i32, i32*)
+declare void @maxAccum.expand(%RsExpandKernelDriverInfoPfx*, i32, i32, i8*)
+declare void @argminAccum.expand(%RsExpandKernelDriverInfoPfx*, i32, i32, %struct.IndexedVal*)
+declare void @argmaxAccum.expand(%RsExpandKernelDriverInfoPfx*, i32, i32, %struct.IndexedVal*)
+
+; Point the first input of %p at element %x1 of %buf.
+define internal void @setInput(%RsExpandKernelDriverInfoPfx* %p, i8* %buf, i32 %x1, i32 %size) {
+  %offset = mul i32 %x1, %size
+  %ptr = getelementptr inbounds i8, i8* %buf, i32 %offset
+  %inPtr = getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 0, i32 0
+  store i8* %ptr, i8** %inPtr
+  %inStride = getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 1, i32 0
+  store i32 %size, i32* %inStride
+  ret void
+}
+
+define internal void @runSpan(i32 %x1, i32 %x2) {
+  %p = alloca %RsExpandKernelDriverInfoPfx
+  %sum = alloca i32
+  %max = alloca i8
+  %argmin = alloca %struct.IndexedVal
+  %argmax = alloca %struct.IndexedVal
+  store %RsExpandKernelDriverInfoPfx zeroinitializer, %RsExpandKernelDriverInfoPfx* %p
+  store i32 0, i32* %sum
+  store i8 0, i8* %max
+  store %struct.IndexedVal { i32 2147483647, i32 -1 }, %struct.IndexedVal* %argmin
+  store %struct.IndexedVal { i32 -2147483648, i32 -1 }, %struct.IndexedVal* %argmax
+
+  call void @setInput(%RsExpandKernelDriverInfoPfx* %p, i8* bitcast ([37 x i32]* @ints to i8*), i32 %x1, i32 4)
+  call void @sumAccum.expand(%RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, i32* %sum)
+  call void @argminAccum.expand(%RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, %struct.IndexedVal* %argmin)
+  call void @argmaxAccum.expand(%RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, %struct.IndexedVal* %argmax)
+  call void @setInput(%RsExpandKernelDriverInfoPfx* %p, i8* getelementptr inbounds ([37 x i8], [37 x i8]* @bytes, i32 0, i32 0), i32 %x1, i32 1)
+  call void @maxAccum.expand(%RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, i8* %max)
+
+  %sumVal = load i32, i32* %sum
+  %maxVal = load i8, i8* %max
+  %maxExt = zext i8 %maxVal to i32
+  %argminValPtr = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %argmin, i32 0, i32 0
+  %argminVal = load i32, i32* %argminValPtr
+  %argminIdxPtr = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %argmin, i32 0, i32 1
+  %argminIdx = load i32, i32* %argminIdxPtr
+  %argmaxValPtr = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %argmax, i32 0, i32 0
+  %argmaxVal = load i32, i32* %argmaxValPtr
+  %argmaxIdxPtr = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %argmax, i32 0, i32 1
+  %argmaxIdx = load i32, i32* %argmaxIdxPtr
+  %fmt = getelementptr inbounds [48 x i8], [48 x i8]* @format, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %fmt, i32 %x1, i32 %x2, i32 %sumVal, i32 %maxExt,
+                              i32 %argminVal, i32 %argminIdx, i32 %argmaxVal, i32 %argmaxIdx)
+  ret void
+}
+
+define i32 @main() {
+  ; Spans shorter than, equal to and just over one vector of i32 inputs.
+  call void @runSpan(i32 0, i32 1)
+  call void @runSpan(i32 0, i32 3)
+  call void @runSpan(i32 0, i32 4)
+  call void @runSpan(i32 0, i32 5)
+  ; Spans with a remainder for both the i32 and the i8 vector widths,
+  ; including ones that do not start at the first element.
+  call void @runSpan(i32 0, i32 17)
+  call void @runSpan(i32 0, i32 37)
+  call void @runSpan(i32 3, i32 37)
+  call void @runSpan(i32 7, i32 29)
+  call void @runSpan(i32 10, i32 12)
+  ret i32 0
+}
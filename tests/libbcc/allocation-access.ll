@@ -0,0 +1,166 @@
+; Check that RSAllocationAccessPass makes kernels call copies of the linked
+; rsGetElementAt*() accessors whose Allocation field loads are invariant,
+; leaves the accessors called by other functions alone, and inlines untyped
+; rsGetElementAt() calls whose result only addresses loads and stores.
+
+; RUN: opt -load libbcc.so -rsallocaccess -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+%struct.rs_allocation = type { i64*, i64*, i64*, i64* }
+%struct.Allocation = type { i8*, i64, i32 }
+
+@gIn = common global %struct.rs_allocation zeroinitializer, align 8
+@gPtr = common global i8* null, align 8
+
+; Stand-in for the run-time library definition.
+define i8* @_Z14rsGetElementAt13rs_allocationjj(%struct.rs_allocation* nocapture readonly %a, i32 %x, i32 %y) {
+  %1 = getelementptr inbounds %struct.rs_allocation, %struct.rs_allocation* %a, i64 0, i32 0
+  %2 = load i64*, i64** %1, align 8
+  %3 = bitcast i64* %2 to %struct.Allocation*
+  %4 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %3, i64 0, i32 0
+  %5 = load i8*, i8** %4, align 8
+  %6 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %3, i64 0, i32 1
+  %7 = load i64, i64* %6, align 8
+  %8 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %3, i64 0, i32 2
+  %9 = load i32, i32* %8, align 8
+  %10 = mul i32 %9, %x
+  %11 = zext i32 %10 to i64
+  %12 = zext i32 %y to i64
+  %13 = mul i64 %12, %7
+  %14 = add i64 %13, %11
+  %15 = getelementptr inbounds i8, i8* %5, i64 %14
+  ret i8* %15
+}
+
+; CHECK-LABEL: define i8* @_Z14rsGetElementAt13rs_allocationjj(
+; CHECK-NOT: !invariant.load
+; CHECK: ret i8*
+
+define i32 @_Z18rsGetElementAt_int13rs_allocationj(%struct.rs_allocation* nocapture readonly %a, i32 %x) {
+  %1 = getelementptr inbounds %struct.rs_allocation, %struct.rs_allocation* %a, i64 0, i32 0
+  %2 = load i64*, i64** %1, align 8
+  %3 = bitcast i64* %2 to %struct.Allocation*
+  %4 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %3, i64 0, i32 0
+  %5 = load i8*, i8** %4, align 8
+  %6 = bitcast i8* %5 to i32*
+  %7 = getelementptr inbounds i32, i32* %6, i32 %x
+  %8 = load i32, i32* %7, align 4
+  ret i32 %8
+}
+
+; CHECK-LABEL: define i32 @_Z18rsGetElementAt_int13rs_allocationj(
+; CHECK-NOT: !invariant.load
+; CHECK: ret i32
+
+declare void @_Z21rsAllocationIoReceive13rs_allocation(%struct.rs_allocation*)
+
+; An invokable: the Allocation may be received between two accesses, so
+; the inlined field loads are not invariant.
+define i32 @gather(i32 %x) {
+  %tmp = alloca %struct.rs_allocation, align 8
+  %1 = bitcast %struct.rs_allocation* %tmp to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %1, i8* bitcast (%struct.rs_allocation* @gIn to i8*), i64 32, i32 8, i1 false)
+  %2 = call i8* @_Z14rsGetElementAt13rs_allocationjj(%struct.rs_allocation* %tmp, i32 %x, i32 0)
+  %3 = bitcast i8* %2 to i32*
+  %4 = load i32, i32* %3, align 4
+  ret i32 %4
+}
+
+; CHECK-LABEL: define i32 @gather(
+; CHECK-NOT: call i8* @_Z14rsGetElementAt13rs_allocationjj(
+; CHECK-NOT: !invariant.load
+; CHECK: load i32, i32* %{{.*}}, align 4, !tbaa ![[ALLOCATION:[0-9]+]]
+; CHECK: ret i32
+
+; A kernel: the copy of the accessor is inlined, with invariant field loads.
+define i32 @blur(i32 %in, i32 %x) {
+  %tmp = alloca %struct.rs_allocation, align 8
+  %1 = bitcast %struct.rs_allocation* %tmp to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %1, i8* bitcast (%struct.rs_allocation* @gIn to i8*), i64 32, i32 8, i1 false)
+  %2 = call i8* @_Z14rsGetElementAt13rs_allocationjj(%struct.rs_allocation* %tmp, i32 %x, i32 0)
+  %3 = bitcast i8* %2 to i32*
+  %4 = load i32, i32* %3, align 4
+  %5 = add i32 %4, %in
+  ret i32 %5
+}
+
+; CHECK-LABEL: define i32 @blur(
+; CHECK-NOT: call i8* @_Z14rsGetElementAt13rs_allocationjj
+; CHECK: load i64*, i64** %{{.*}}, align 8{{$}}
+; CHECK: load i8*, i8** %{{.*}}, align 8, !invariant.load
+; CHECK: load i64, i64* %{{.*}}, align 8, !invariant.load
+; CHECK: load i32, i32* %{{.*}}, align 8, !invariant.load
+; CHECK: load i32, i32* %{{.*}}, align 4, !tbaa ![[ALLOCATION]]
+; CHECK: ret i32
+
+; A kernel calling a typed accessor.
+define i32 @sample(i32 %in, i32 %x) {
+  %tmp = alloca %struct.rs_allocation, align 8
+  %1 = bitcast %struct.rs_allocation* %tmp to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %1, i8* bitcast (%struct.rs_allocation* @gIn to i8*), i64 32, i32 8, i1 false)
+  %2 = call i32 @_Z18rsGetElementAt_int13rs_allocationj(%struct.rs_allocation* %tmp, i32 %x)
+  ret i32 %2
+}
+
+; CHECK-LABEL: define i32 @sample(
+; CHECK: call i32 @_Z18rsGetElementAt_int13rs_allocationj.kernel(
+
+; A kernel that receives an Allocation keeps the original accessor.
+define i32 @receive(i32 %in, i32 %x) {
+  call void @_Z21rsAllocationIoReceive13rs_allocation(%struct.rs_allocation* @gIn)
+  %tmp = alloca %struct.rs_allocation, align 8
+  %1 = bitcast %struct.rs_allocation* %tmp to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %1, i8* bitcast (%struct.rs_allocation* @gIn to i8*), i64 32, i32 8, i1 false)
+  %2 = call i32 @_Z18rsGetElementAt_int13rs_allocationj(%struct.rs_allocation* %tmp, i32 %x)
+  ret i32 %2
+}
+
+; CHECK-LABEL: define i32 @receive(
+; CHECK: call i32 @_Z18rsGetElementAt_int13rs_allocationj(
+
+; The pointer escapes, so the call must stay.
+define void @escape(i32 %x) {
+  %tmp = alloca %struct.rs_allocation, align 8
+  %1 = bitcast %struct.rs_allocation* %tmp to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %1, i8* bitcast (%struct.rs_allocation* @gIn to i8*), i64 32, i32 8, i1 false)
+  %2 = call i8* @_Z14rsGetElementAt13rs_allocationjj(%struct.rs_allocation* %tmp, i32 %x, i32 0)
+  store i8* %2, i8** @gPtr, align 8
+  ret void
+}
+
+; CHECK-LABEL: define void @escape(
+; CHECK: call i8* @_Z14rsGetElementAt13rs_allocationjj(
+
+; CHECK-LABEL: define internal i8* @_Z14rsGetElementAt13rs_allocationjj.kernel(
+; CHECK: load i64*, i64** %{{[0-9]+}}, align 8{{$}}
+; CHECK: load i8*, i8** %{{[0-9]+}}, align 8, !invariant.load
+; CHECK: load i64, i64* %{{[0-9]+}}, align 8, !invariant.load
+; CHECK: load i32, i32* %{{[0-9]+}}, align 8, !invariant.load
+
+; CHECK-LABEL: define internal i32 @_Z18rsGetElementAt_int13rs_allocationj.kernel(
+; CHECK: load i64*, i64** %{{[0-9]+}}, align 8{{$}}
+; CHECK: load i8*, i8** %{{[0-9]+}}, align 8, !invariant.load
+; CHECK: load i32, i32* %{{[0-9]+}}, align 4{{$}}
+
+; CHECK-DAG: ![[ALLOCATION]] = !{![[ALLOCTY:[0-9]+]], ![[ALLOCTY]], i64 0}
+; CHECK-DAG: ![[ALLOCTY]] = !{!"allocation", ![[RSNODE:[0-9]+]], i64 0}
+; CHECK-DAG: ![[RSNODE]] = !{!"RenderScript TBAA", ![[RSROOT:[0-9]+]]}
+; CHECK-DAG: ![[RSROOT]] = !{!"RenderScript Distinct TBAA"}
+
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8* nocapture, i8* nocapture readonly, i64, i32, i1)
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3, !4, !5}
+!\23rs_export_foreach = !{!6, !7, !7, !7}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"blur"}
+!4 = !{!"sample"}
+!5 = !{!"receive"}
+!6 = !{!"0"}
+!7 = !{!"43"}
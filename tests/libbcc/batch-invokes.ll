@@ -0,0 +1,94 @@
+; Check that bcc -invoke batches invokables into a new exported invokable
+; that takes their packed arguments in one buffer, each struct aligned to
+; its own ABI alignment, and that inlines every invokable of the batch.
+
+; RUN: llvm-rs-as %s -o %t.bc
+; RUN: bcc -o batch_invokes -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi -emit-llvm \
+; RUN:      -invoke=setAll:0,0.0,2.0,1.0,3 %t.bc
+; RUN: FileCheck %s < %T/batch_invokes.o.ll
+
+; ModuleID = 'batch_invokes.bc'
+target datalayout = "e-p:32:32-i64:64-v128:64:128-n32-S64"
+target triple = "armv7-none-linux-gnueabi"
+
+@a = common global i8 0, align 1
+@b = common global double 0.000000e+00, align 8
+@c = common global i16 0, align 2
+@count = common global i32 0, align 4
+
+define void @root() {
+  ret void
+}
+
+; The invokables are not inlined anywhere else, but the calls of the batch
+; force them inline.
+
+; void setA(char v)
+define void @.helper_setA({ i8 }* nocapture readonly %args) #0 {
+  %1 = getelementptr inbounds { i8 }, { i8 }* %args, i32 0, i32 0
+  %2 = load i8, i8* %1, align 1
+  store i8 %2, i8* @a, align 1
+  ret void
+}
+
+; void setB(double v)
+define void @.helper_setB({ double }* nocapture readonly %args) #0 {
+  %1 = getelementptr inbounds { double }, { double }* %args, i32 0, i32 0
+  %2 = load double, double* %1, align 8
+  store double %2, double* @b, align 8
+  ret void
+}
+
+; void setC(short v, char unused)
+define void @.helper_setC({ i16, i8 }* nocapture readonly %args) #0 {
+  %1 = getelementptr inbounds { i16, i8 }, { i16, i8 }* %args, i32 0, i32 0
+  %2 = load i16, i16* %1, align 2
+  store i16 %2, i16* @c, align 2
+  ret void
+}
+
+; void bump()
+define void @bump() #0 {
+  %1 = load i32, i32* @count, align 4
+  %2 = add nsw i32 %1, 1
+  store i32 %2, i32* @count, align 4
+  ret void
+}
+
+; CHECK: @.rs.info = {{.*}}exportFuncCount: 5\0A.helper_setA\0A.helper_setB\0A.helper_setC\0Abump\0AsetAll\0A
+
+; The batch (setA, setC, setB, bump) finds { i8 } at offset 0, { i16, i8 }
+; at offset 2 and { double } at offset 8; bump takes no space.
+; CHECK-LABEL: define void @setAll(i8* {{.*}}%packed_args)
+; CHECK-NOT: call
+; CHECK-DAG: load i8, i8* %packed_args
+; CHECK-DAG: getelementptr inbounds i8, i8* %packed_args, i{{32|64}} 2
+; CHECK-DAG: getelementptr inbounds i8, i8* %packed_args, i{{32|64}} 8
+; CHECK-DAG: store i8 %{{[^ ,]+}}, i8* @a
+; CHECK-DAG: store i16 %{{[^ ,]+}}, i16* @c
+; CHECK-DAG: store double %{{[^ ,]+}}, double* @b
+; CHECK-DAG: store i32 %{{[^ ,]+}}, i32* @count
+; CHECK-NOT: call
+; CHECK: ret void
+
+attributes #0 = { noinline }
+
+!\23pragma = !{!0, !1}
+!\23rs_export_var = !{!2, !3, !4, !5}
+!\23rs_export_func = !{!6, !7, !8, !9}
+!\23rs_export_foreach_name = !{!10}
+!\23rs_export_foreach = !{!11}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"a", !"4"}
+!3 = !{!"b", !"3"}
+!4 = !{!"c", !"5"}
+!5 = !{!"count", !"6"}
+!6 = !{!".helper_setA"}
+!7 = !{!".helper_setB"}
+!8 = !{!".helper_setC"}
+!9 = !{!"bump"}
+!10 = !{!"root"}
+!11 = !{!"0"}
@@ -0,0 +1,77 @@
+; Check that RSKernelExpandPass expands a kernel laid out as fuseKernels()
+; lays out a fused kernel with several inputs and a context: one InPtr entry
+; per input, in order, then the context (the driver info, cast to
+; rs_kernel_context_t*) and the coordinates.
+
+; RUN: opt -load libbcc.so -kernelexp -S < %s | FileCheck %s
+
+; ModuleID = 'fused.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+%struct.rs_kernel_context_t = type opaque
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; float __attribute__((kernel)) blend(float a, float b)
+define internal float @blend(float %a, float %b) {
+  %1 = fadd float %a, %b
+  ret float %1
+}
+
+; float __attribute__((kernel)) scale(float in, float factor, rs_kernel_context context, uint32_t x)
+declare i32 @_Z11rsGetDimX19rs_kernel_context_t(%struct.rs_kernel_context_t*)
+
+define internal float @scale(float %in, float %factor, %struct.rs_kernel_context_t* %context, i32 %x) {
+  %1 = call i32 @_Z11rsGetDimX19rs_kernel_context_t(%struct.rs_kernel_context_t* %context)
+  %2 = icmp ult i32 %x, %1
+  %3 = fmul float %in, %factor
+  %4 = select i1 %2, float %3, float %in
+  ret float %4
+}
+
+; What fuseKernels() generates for the batch (blend, scale): all inputs of
+; blend, then the remaining input of scale, then the context and X.
+define float @blend_scale(float %DataIn, float %DataIn1, float %DataIn2,
+                          %struct.rs_kernel_context_t* %context, i32 %X) {
+  %1 = call float @blend(float %DataIn, float %DataIn1)
+  %2 = call float @scale(float %1, float %DataIn2, %struct.rs_kernel_context_t* %context, i32 %X)
+  ret float %2
+}
+
+; CHECK-LABEL: define void @blend_scale.expand(%RsExpandKernelDriverInfoPfx* {{.*}}%p, i32 %x1, i32 %x2, i32 %arg_outstep)
+; CHECK: %input_buf.gep{{[0-9]*}} = getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 0, i32 0
+; CHECK: %input_buf.gep{{[0-9]*}} = getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 0, i32 1
+; CHECK: %input_buf.gep{{[0-9]*}} = getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 0, i32 2
+; CHECK-NOT: i32 0, i32 0, i32 3
+; CHECK: [[CONTEXT:%[^ ]+]] = bitcast %RsExpandKernelDriverInfoPfx* %p to %struct.rs_kernel_context_t*
+; CHECK: %call.result = call float @blend_scale(float %{{[^ ,]+}}, float %{{[^ ,]+}}, float %{{[^ ,]+}}, %struct.rs_kernel_context_t* [[CONTEXT]], i32 %X)
+; CHECK: ret void
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3}
+!\23rs_export_foreach = !{!4, !5}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!6}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"blend_scale"}
+!4 = !{!"0"}
+; In | Out | X | Kernel | Ctxt
+!5 = !{!"171"}
+!6 = !{!"0", !"3"}
@@ -0,0 +1,70 @@
+; Check that RSKernelExpandPass emits, for a foreach kernel with a shape
+; hint, a variant of the expanded function with a constant trip count and
+; aligned inputs and output, besides the general expanded function.
+
+; RUN: opt -load libbcc.so -kernelexp -rs-expand-shape=inc:64:16 -rs-expand-shape=dbl:0:16 -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; Function Attrs: nounwind readnone
+define i32 @inc(i32 %in) #0 {
+  %1 = add nsw i32 %in, 1
+  ret i32 %1
+}
+
+; Function Attrs: nounwind readnone
+define i32 @dbl(i32 %in) #0 {
+  %1 = shl nsw i32 %in, 1
+  ret i32 %1
+}
+
+; CHECK-LABEL: define void @inc.expand(
+; CHECK-NOT: llvm.assume
+; CHECK: icmp ult i32 %x1, %x2
+; CHECK: call i32 @inc(
+
+; CHECK-LABEL: define void @inc.expand.w64a16(
+; CHECK: load i8*, i8** %out_buf.gep
+; CHECK: call void @llvm.assume(
+; CHECK: %input_buf = load i8*, i8** %input_buf.gep
+; CHECK: call void @llvm.assume(
+; CHECK: Loop:
+; CHECK: icmp ult i32 %{{.*}}, 64
+; CHECK: call i32 @inc(
+
+; CHECK-LABEL: define void @dbl.expand(
+; CHECK-NOT: define void @dbl.expand.
+
+attributes #0 = { nounwind readnone }
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3, !4}
+!\23rs_export_foreach = !{!5, !6, !6}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!7}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"inc"}
+!4 = !{!"dbl"}
+!5 = !{!"0"}
+!6 = !{!"35"}
+!7 = !{!"0", !"3"}
@@ -0,0 +1,66 @@
+; Check the kernel fusion plan that bcc -auto-merge chooses for a script
+; group: a kernel and its only consumer are fused, and a consumer whose other
+; input is produced after the head of the chain is not fused into it.
+
+; RUN: llvm-rs-as %s -o %t.bc
+
+; square -> negate
+; RUN: bcc -o fusion_plan_chain -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi \
+; RUN:      -group-kernel=0,1:-1 -group-kernel=0,2:0:live \
+; RUN:      -auto-merge=fused %t.bc 2>&1 | FileCheck %s --check-prefix=CHAIN
+
+; CHAIN: fusion plan:
+; CHAIN-NEXT: fused0: 0(0,1) 1(0,2) bytes/cell 16 -> 8
+
+; square, negate, add(square, negate): negate runs after square, so add
+; cannot be fused with square.
+; RUN: bcc -o fusion_plan_late -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi \
+; RUN:      -group-kernel=0,1:-1 -group-kernel=0,2:-1 -group-kernel=0,3:0.1:live \
+; RUN:      -auto-merge=fused %t.bc 2>&1 | FileCheck %s --check-prefix=LATE
+
+; LATE: fusion plan:
+; LATE-NEXT: no kernels fused
+
+; negate, square, add(square, negate): negate runs before square, so add
+; can be fused with square.
+; RUN: bcc -o fusion_plan_early -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi \
+; RUN:      -group-kernel=0,2:-1 -group-kernel=0,1:-1 -group-kernel=0,3:1.0:live \
+; RUN:      -auto-merge=fused %t.bc 2>&1 | FileCheck %s --check-prefix=EARLY
+
+; EARLY: fusion plan:
+; EARLY-NEXT: fused0: 1(0,1) 2(0,3) bytes/cell 20 -> 12
+
+; ModuleID = 'fusion_plan.bc'
+target datalayout = "e-p:32:32-i64:64-v128:64:128-n32-S64"
+target triple = "armv7-none-linux-gnueabi"
+
+define i32 @square(i32 %in) {
+  %1 = mul nsw i32 %in, %in
+  ret i32 %1
+}
+
+define i32 @negate(i32 %in) {
+  %1 = sub nsw i32 0, %in
+  ret i32 %1
+}
+
+define i32 @add(i32 %a, i32 %b) {
+  %1 = add nsw i32 %a, %b
+  ret i32 %1
+}
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3, !4, !5}
+!\23rs_export_foreach = !{!6, !7, !7, !7}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"square"}
+!4 = !{!"negate"}
+!5 = !{!"add"}
+!6 = !{!"0"}
+!7 = !{!"35"}
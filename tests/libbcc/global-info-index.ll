@@ -0,0 +1,37 @@
+; Check that RSGlobalInfoPass embeds the name index of the global variables
+; only when asked to, and that colliding names are probed linearly.
+
+; RUN: opt -load libbcc.so -embed-rs-global-info -rs-embed-global-index -S < %s | FileCheck %s
+; RUN: opt -load libbcc.so -embed-rs-global-info -S < %s | FileCheck %s --check-prefix=NOINDEX
+
+; ModuleID = 'globals.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+@gCount = global i32 0, align 4
+@gScale = global float 1.000000e+00, align 4
+@gOffset = global i32 0, align 4
+@gLimit = global i32 0, align 4
+
+; The hashes are FNV-1a, as rsInfoBinaryHash; gCount and gLimit both hash to
+; entry 5 of 8, so gLimit is in entry 6.
+; CHECK: @.rs.global_entries = constant i32 4
+; CHECK: @.rs.global_name_hashes = constant [4 x i32] [i32 1347318357, i32 1418409892, i32 -976456767, i32 1723826629]
+; CHECK: @.rs.global_index_entries = constant i32 8
+; CHECK: @.rs.global_index = constant [8 x i32] [i32 -1, i32 2, i32 -1, i32 -1, i32 1, i32 0, i32 3, i32 -1]
+
+; NOINDEX: @.rs.global_entries = constant i32 4
+; NOINDEX-NOT: @.rs.global_name_hashes
+; NOINDEX-NOT: @.rs.global_index
+
+!llvm.ident = !{!0}
+!\23pragma = !{!1, !2}
+!\23rs_export_var = !{!3, !4, !5, !6}
+
+!0 = !{!"clang version 3.6 "}
+!1 = !{!"version", !"1"}
+!2 = !{!"java_package_name", !"foo"}
+!3 = !{!"gCount", !"5"}
+!4 = !{!"gScale", !"1"}
+!5 = !{!"gOffset", !"5"}
+!6 = !{!"gLimit", !"5"}
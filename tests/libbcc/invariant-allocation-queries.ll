@@ -0,0 +1,176 @@
+; Check that RSAllocationAccessPass treats the Allocation queries like the
+; element accessors: kernels call copies of rsAllocationGetDim*(),
+; rsAllocationGetElement(), rsAllocationVLoadX_*() and rsGetElementAtYuv_*()
+; whose Allocation field loads are invariant, so that these loads leave the
+; loop of the expanded kernel, while invokables keep calling the originals.
+
+; RUN: opt -load libbcc.so -rsallocaccess -S < %s | FileCheck %s
+; RUN: opt -load libbcc.so -rsallocaccess -kernelexp -rsinvariant -inline -licm -S < %s \
+; RUN:     | FileCheck %s --check-prefix=LICM
+
+; ModuleID = 'queries.bc'
+target datalayout = "e-p:32:32-i64:64-v128:64:128-n32-S64"
+target triple = "armv7-none-linux-gnueabi"
+
+%struct.rs_allocation = type { i32* }
+%struct.Allocation = type { i8*, i32, i32, i32, i32, i32* }
+
+@gIn = common global %struct.rs_allocation zeroinitializer, align 4
+@gCount = common global i32 0, align 4
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; Stand-ins for the run-time library definitions, which take the
+; rs_allocation by value on ARM.
+
+define i32 @_Z19rsAllocationGetDimX13rs_allocation([1 x i32] %a.coerce) {
+  %1 = extractvalue [1 x i32] %a.coerce, 0
+  %2 = inttoptr i32 %1 to %struct.Allocation*
+  %3 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %2, i32 0, i32 2
+  %4 = load i32, i32* %3, align 4
+  ret i32 %4
+}
+
+; CHECK-LABEL: define i32 @_Z19rsAllocationGetDimX13rs_allocation(
+; CHECK-NOT: !invariant.load
+; CHECK: ret i32
+
+define i32 @_Z22rsAllocationGetElement13rs_allocation([1 x i32] %a.coerce) {
+  %1 = extractvalue [1 x i32] %a.coerce, 0
+  %2 = inttoptr i32 %1 to %struct.Allocation*
+  %3 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %2, i32 0, i32 5
+  %4 = load i32*, i32** %3, align 4
+  %5 = ptrtoint i32* %4 to i32
+  ret i32 %5
+}
+
+define <4 x float> @_Z25rsAllocationVLoadX_float413rs_allocationj([1 x i32] %a.coerce, i32 %x) {
+  %1 = extractvalue [1 x i32] %a.coerce, 0
+  %2 = inttoptr i32 %1 to %struct.Allocation*
+  %3 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %2, i32 0, i32 0
+  %4 = load i8*, i8** %3, align 4
+  %5 = bitcast i8* %4 to float*
+  %6 = getelementptr inbounds float, float* %5, i32 %x
+  %7 = bitcast float* %6 to <4 x float>*
+  %8 = load <4 x float>, <4 x float>* %7, align 4
+  ret <4 x float> %8
+}
+
+define zeroext i8 @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj([1 x i32] %a.coerce, i32 %x, i32 %y) {
+  %1 = extractvalue [1 x i32] %a.coerce, 0
+  %2 = inttoptr i32 %1 to %struct.Allocation*
+  %3 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %2, i32 0, i32 0
+  %4 = load i8*, i8** %3, align 4
+  %5 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %2, i32 0, i32 1
+  %6 = load i32, i32* %5, align 4
+  %7 = mul i32 %6, %y
+  %8 = add i32 %7, %x
+  %9 = getelementptr inbounds i8, i8* %4, i32 %8
+  %10 = load i8, i8* %9, align 1
+  ret i8 %10
+}
+
+; Not an Allocation query.
+define i32 @_Z11rsAtomicInc13rs_allocation([1 x i32] %a.coerce) {
+  %1 = extractvalue [1 x i32] %a.coerce, 0
+  %2 = inttoptr i32 %1 to %struct.Allocation*
+  %3 = getelementptr inbounds %struct.Allocation, %struct.Allocation* %2, i32 0, i32 2
+  %4 = load i32, i32* %3, align 4
+  ret i32 %4
+}
+
+; A kernel: the queries are redirected to their copies.
+define i32 @wrap(i32 %in, i32 %x) {
+  %1 = load [1 x i32], [1 x i32]* bitcast (%struct.rs_allocation* @gIn to [1 x i32]*), align 4
+  %2 = call i32 @_Z19rsAllocationGetDimX13rs_allocation([1 x i32] %1)
+  %3 = add i32 %in, %x
+  %4 = urem i32 %3, %2
+  %5 = call i32 @_Z22rsAllocationGetElement13rs_allocation([1 x i32] %1)
+  %6 = call <4 x float> @_Z25rsAllocationVLoadX_float413rs_allocationj([1 x i32] %1, i32 %4)
+  %7 = extractelement <4 x float> %6, i32 0
+  %8 = fptoui float %7 to i32
+  %9 = call zeroext i8 @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj([1 x i32] %1, i32 %4, i32 0)
+  %10 = zext i8 %9 to i32
+  %11 = call i32 @_Z11rsAtomicInc13rs_allocation([1 x i32] %1)
+  %12 = add i32 %5, %8
+  %13 = add i32 %12, %10
+  %14 = add i32 %13, %11
+  ret i32 %14
+}
+
+; CHECK-LABEL: define i32 @wrap(
+; CHECK: call i32 @_Z19rsAllocationGetDimX13rs_allocation.kernel(
+; CHECK: call i32 @_Z22rsAllocationGetElement13rs_allocation.kernel(
+; CHECK: call <4 x float> @_Z25rsAllocationVLoadX_float413rs_allocationj.kernel(
+; CHECK: call zeroext i8 @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj.kernel(
+; CHECK: call i32 @_Z11rsAtomicInc13rs_allocation(
+; CHECK: ret i32
+
+; An invokable: the Allocation may be resized between two calls, so it
+; keeps calling the queries whose loads are not invariant.
+define i32 @getDimX() {
+  %1 = load [1 x i32], [1 x i32]* bitcast (%struct.rs_allocation* @gIn to [1 x i32]*), align 4
+  %2 = call i32 @_Z19rsAllocationGetDimX13rs_allocation([1 x i32] %1)
+  store i32 %2, i32* @gCount, align 4
+  ret i32 %2
+}
+
+; CHECK-LABEL: define i32 @getDimX(
+; CHECK: call i32 @_Z19rsAllocationGetDimX13rs_allocation(
+; CHECK: ret i32
+
+; CHECK-LABEL: define internal i32 @_Z19rsAllocationGetDimX13rs_allocation.kernel(
+; CHECK: load i32, i32* %{{[0-9]+}}, align 4, !invariant.load
+; CHECK-LABEL: define internal i32 @_Z22rsAllocationGetElement13rs_allocation.kernel(
+; CHECK: load i32*, i32** %{{[0-9]+}}, align 4, !invariant.load
+; CHECK-LABEL: define internal <4 x float> @_Z25rsAllocationVLoadX_float413rs_allocationj.kernel(
+; CHECK: load i8*, i8** %{{[0-9]+}}, align 4, !invariant.load
+; CHECK: load <4 x float>, <4 x float>* %{{[0-9]+}}, align 4{{$}}
+; CHECK-LABEL: define internal zeroext i8 @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj.kernel(
+; CHECK: load i8*, i8** %{{[0-9]+}}, align 4, !invariant.load
+; CHECK: load i32, i32* %{{[0-9]+}}, align 4, !invariant.load
+; CHECK: load i8, i8* %{{[0-9]+}}, align 1{{$}}
+
+; Once the kernel is inlined into its expanded function, the Allocation
+; fields that the queries read are loaded before the loop; only the
+; elements themselves, and the field read by rsAtomicInc(), are loaded in
+; the loop.
+; LICM-LABEL: define void @wrap.expand(
+; LICM: getelementptr inbounds %struct.Allocation, %struct.Allocation* %{{[^ ,]+}}, i32 0, i32 5
+; LICM: Loop:
+; LICM-NOT: !invariant.load
+; LICM-NOT: getelementptr inbounds %struct.Allocation, %struct.Allocation* %{{[^ ,]+}}, i32 0, i32 5
+; LICM: load <4 x float>, <4 x float>*
+; LICM: load i8, i8*
+; LICM-NOT: !invariant.load
+; LICM: ret void
+
+!\23pragma = !{!0, !1}
+!\23rs_export_var = !{!2}
+!\23rs_export_func = !{!3}
+!\23rs_export_foreach_name = !{!4, !5}
+!\23rs_export_foreach = !{!6, !7}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!8}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"gIn", !"20"}
+!3 = !{!"getDimX"}
+!4 = !{!"root"}
+!5 = !{!"wrap"}
+!6 = !{!"0"}
+!7 = !{!"43"}
+!8 = !{!"0", !"3"}
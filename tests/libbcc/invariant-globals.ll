@@ -0,0 +1,65 @@
+; Check that RSInvariantPass marks loads of script globals that no code of
+; the script can write as invariant, and leaves alone the loads of globals
+; that are stored to, passed to calls, copied into, or accessed atomically
+; or volatilely.
+
+; RUN: opt -load libbcc.so -rsinvariant -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+%struct.Params = type { i32, float }
+
+@gRadius = global i32 0, align 4
+@gParams = global %struct.Params zeroinitializer, align 4
+@gCopied = global %struct.Params zeroinitializer, align 4
+@gStored = global i32 0, align 4
+@gEscaped = global i32 0, align 4
+@gFilled = global %struct.Params zeroinitializer, align 4
+@gFlag = global i32 0, align 4
+@gVolatile = global i32 0, align 4
+
+declare void @_Z8rsSetIntPi(i32*)
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8* nocapture, i8* nocapture readonly, i64, i32, i1)
+
+; CHECK-LABEL: define i32 @read(
+define i32 @read(%struct.Params* %tmp) {
+; CHECK: load i32, i32* @gRadius, align 4, !invariant.load
+  %1 = load i32, i32* @gRadius, align 4
+; CHECK: load float, float* getelementptr inbounds (%struct.Params, %struct.Params* @gParams, i64 0, i32 1), align 4, !invariant.load
+  %2 = load float, float* getelementptr inbounds (%struct.Params, %struct.Params* @gParams, i64 0, i32 1), align 4
+  %3 = fptosi float %2 to i32
+; Only read by a memcpy.
+; CHECK: load i32, i32* getelementptr inbounds (%struct.Params, %struct.Params* @gCopied, i64 0, i32 0), align 4, !invariant.load
+  %4 = load i32, i32* getelementptr inbounds (%struct.Params, %struct.Params* @gCopied, i64 0, i32 0), align 4
+  %5 = bitcast %struct.Params* %tmp to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %5, i8* bitcast (%struct.Params* @gCopied to i8*), i64 8, i32 4, i1 false)
+; CHECK: load i32, i32* @gStored, align 4{{$}}
+  %6 = load i32, i32* @gStored, align 4
+; CHECK: load i32, i32* @gEscaped, align 4{{$}}
+  %7 = load i32, i32* @gEscaped, align 4
+; CHECK: load i32, i32* getelementptr inbounds (%struct.Params, %struct.Params* @gFilled, i64 0, i32 0), align 4{{$}}
+  %8 = load i32, i32* getelementptr inbounds (%struct.Params, %struct.Params* @gFilled, i64 0, i32 0), align 4
+; CHECK: load i32, i32* @gFlag, align 4{{$}}
+  %9 = load i32, i32* @gFlag, align 4
+; CHECK: load volatile i32, i32* @gVolatile, align 4{{$}}
+  %10 = load volatile i32, i32* @gVolatile, align 4
+  %11 = add i32 %1, %3
+  %12 = add i32 %11, %4
+  %13 = add i32 %12, %6
+  %14 = add i32 %13, %7
+  %15 = add i32 %14, %8
+  %16 = add i32 %15, %9
+  %17 = add i32 %16, %10
+  ret i32 %17
+}
+
+define void @write(i32 %v, %struct.Params* %src) {
+  store i32 %v, i32* @gStored, align 4
+  call void @_Z8rsSetIntPi(i32* @gEscaped)
+  %1 = bitcast %struct.Params* %src to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* bitcast (%struct.Params* @gFilled to i8*), i8* %1, i64 8, i32 4, i1 false)
+  %2 = atomicrmw add i32* @gFlag, i32 1 seq_cst
+  ret void
+}
@@ -0,0 +1,82 @@
+; Check that bcc -merge fuses kernels into a new foreach kernel: the fused
+; kernel takes all inputs of the first kernel, then the remaining inputs of
+; the later ones, then the rs_kernel_context and the coordinates, and calls
+; each kernel on its share of them.  The kernel that takes a context is
+; fused both as the first and as the second kernel of a batch.
+
+; RUN: llvm-rs-as %s -o %t.bc
+; RUN: bcc -o merge_fused_context -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi -emit-llvm \
+; RUN:      -merge=blend_scale:0,1.0,2 -merge=scale_blend:0,2.0,1 %t.bc
+; RUN: FileCheck %s < %T/merge_fused_context.o.ll
+
+; ModuleID = 'merge_fused_context.bc'
+target datalayout = "e-p:32:32-i64:64-v128:64:128-n32-S64"
+target triple = "armv7-none-linux-gnueabi"
+
+%struct.rs_kernel_context_t = type opaque
+
+define void @root() {
+  ret void
+}
+
+; float __attribute__((kernel)) blend(float a, float b)
+define float @blend(float %a, float %b) #0 {
+  %1 = fadd float %a, %b
+  ret float %1
+}
+
+; float __attribute__((kernel)) scale(float in, float factor, rs_kernel_context context, uint32_t x)
+declare i32 @_Z11rsGetDimX19rs_kernel_context_t(%struct.rs_kernel_context_t*)
+
+define float @scale(float %in, float %factor, %struct.rs_kernel_context_t* %context, i32 %x) #0 {
+  %1 = call i32 @_Z11rsGetDimX19rs_kernel_context_t(%struct.rs_kernel_context_t* %context)
+  %2 = icmp ult i32 %x, %1
+  %3 = fmul float %in, %factor
+  %4 = select i1 %2, float %3, float %in
+  ret float %4
+}
+
+; Both fused kernels are exported with In | Out | X | Kernel | Ctxt.
+; CHECK: @.rs.info = {{.*}}exportForEachCount: 5\0A0 - root\0A35 - blend\0A171 - scale\0A171 - blend_scale\0A171 - scale_blend\0A
+
+; Script groups are always optimized, so the fused kernels are inlined into
+; their expanded functions; blend and scale are not, and the calls to them
+; show how the inputs of the fused kernel are handed out.  Each expanded
+; fused kernel reads three inputs and passes on the driver info as the
+; context.
+
+; blend consumes the first two inputs, and its result is the first input of
+; scale, which consumes the third one.
+; CHECK-LABEL: define void @blend_scale.expand(
+; CHECK: getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 0, i32 2
+; CHECK-NOT: i32 0, i32 0, i32 3
+; CHECK: [[BLEND:%[^ ]+]] = {{.*}}call {{.*}}float @blend(float %{{[^ ,]+}}, float %{{[^ ,]+}})
+; CHECK: call {{.*}}float @scale(float [[BLEND]], float %{{[^ ,]+}}, %struct.rs_kernel_context_t{{[.0-9]*}}* %{{[^ ,]+}}, i32 %{{[^ ,)]+}})
+; CHECK: ret void
+
+; scale consumes the first two inputs and the context, and its result is
+; the first input of blend, which consumes the third one.
+; CHECK-LABEL: define void @scale_blend.expand(
+; CHECK: getelementptr inbounds %RsExpandKernelDriverInfoPfx, %RsExpandKernelDriverInfoPfx* %p, i32 0, i32 0, i32 2
+; CHECK-NOT: i32 0, i32 0, i32 3
+; CHECK: [[SCALE:%[^ ]+]] = {{.*}}call {{.*}}float @scale(float %{{[^ ,]+}}, float %{{[^ ,]+}}, %struct.rs_kernel_context_t{{[.0-9]*}}* %{{[^ ,]+}}, i32 %{{[^ ,)]+}})
+; CHECK: call {{.*}}float @blend(float [[SCALE]], float %{{[^ ,]+}})
+; CHECK: ret void
+
+attributes #0 = { noinline }
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3, !4}
+!\23rs_export_foreach = !{!5, !6, !7}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"blend"}
+!4 = !{!"scale"}
+!5 = !{!"0"}
+; In | Out | Kernel
+!6 = !{!"35"}
+; In | Out | X | Kernel | Ctxt
+!7 = !{!"171"}
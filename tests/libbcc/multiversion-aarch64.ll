@@ -0,0 +1,50 @@
+; Check that RSMultiversionPass compiles expanded kernels for the AArch64
+; fp16 feature level, selected with getauxval(AT_HWCAP), and ignores the
+; x86 levels.
+
+; RUN: opt -load libbcc.so -rsmultiversion -rs-feature-level=avx2 -rs-feature-level=fp16 -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+%struct.RsExpandKernelDriverInfoPfx = type opaque
+
+define internal half @inc(half %in) {
+  %1 = fadd half %in, 0xH3C00
+  ret half %1
+}
+
+define void @inc.expand(%struct.RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, i32 %arg_outstep) {
+  %1 = call half @inc(half 0xH0000)
+  ret void
+}
+
+; HWCAP_FPHP | HWCAP_ASIMDHP
+; CHECK-LABEL: define internal void @.rs.multiversion.resolve()
+; CHECK-NOT: cpuid
+; CHECK: %hwcap = call i64 @getauxval(i64 16)
+; CHECK: and i64 %hwcap, 1536
+; CHECK: select i1 %{{.*}}, {{.*}} @inc.expand.fp16, {{.*}} @inc.expand.baseline
+; CHECK-NOT: @inc.expand.avx2
+
+; CHECK: define internal void @inc.expand.fp16({{.*}}) #[[FP16:[0-9]+]]
+; CHECK: attributes #[[FP16]] = { "target-features"="+fullfp16" }
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3}
+!\23rs_export_foreach = !{!4, !5}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!6}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"inc"}
+!4 = !{!"0"}
+!5 = !{!"35"}
+!6 = !{!"0", !"3"}
@@ -0,0 +1,69 @@
+; Check that RSMultiversionPass compiles expanded kernels for each CPU
+; feature level, and turns the exported expanded function into a stub
+; calling the version picked by the resolver.
+
+; RUN: opt -load libbcc.so -rsmultiversion -rs-feature-level=sse4.2 -rs-feature-level=avx2 -rs-feature-level=fp16 -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.RsExpandKernelDriverInfoPfx = type opaque
+
+; CHECK: @inc.expand.impl = internal global void (%struct.RsExpandKernelDriverInfoPfx*, i32, i32, i32)* null
+
+define internal i32 @inc(i32 %in) {
+  %1 = add nsw i32 %in, 1
+  ret i32 %1
+}
+
+; CHECK-LABEL: define void @inc.expand(
+; CHECK: %impl = load atomic {{.*}} @inc.expand.impl monotonic
+; CHECK: Resolve:
+; CHECK: call void @.rs.multiversion.resolve()
+; CHECK: Call:
+; CHECK: tail call void %callee(%struct.RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, i32 %arg_outstep)
+; CHECK-NOT: call i32 @inc(
+; CHECK: ret void
+define void @inc.expand(%struct.RsExpandKernelDriverInfoPfx* %p, i32 %x1, i32 %x2, i32 %arg_outstep) {
+  %1 = call i32 @inc(i32 %x1)
+  ret void
+}
+
+; CHECK-LABEL: define internal void @.rs.multiversion.resolve()
+; CHECK: asm "cpuid"
+; CHECK: CheckAvx2:
+; CHECK: asm "xgetbv"
+; CHECK: CheckedAvx2:
+; CHECK-NOT: getauxval
+; CHECK: select i1 %{{.*}}, {{.*}} @inc.expand.sse4.2, {{.*}} @inc.expand.baseline
+; CHECK: select i1 %has_avx2, {{.*}} @inc.expand.avx2
+; CHECK: store atomic {{.*}} @inc.expand.impl monotonic
+
+; CHECK: define internal void @inc.expand.baseline({{.*}}) {
+; CHECK: call i32 @inc(
+; CHECK: define internal void @inc.expand.sse4.2({{.*}}) #[[SSE42:[0-9]+]]
+; CHECK: call i32 @inc(
+; CHECK: define internal void @inc.expand.avx2({{.*}}) #[[AVX2:[0-9]+]]
+; CHECK: call i32 @inc(
+
+; CHECK: attributes #[[SSE42]] = { "target-features"="+sse4.2,+popcnt" }
+; CHECK: attributes #[[AVX2]] = { "target-features"="+avx,+avx2,+fma" }
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3}
+!\23rs_export_foreach = !{!4, !5}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!6}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"inc"}
+!4 = !{!"0"}
+!5 = !{!"35"}
+!6 = !{!"0", !"3"}
@@ -0,0 +1,66 @@
+; Check that RSKernelExpandPass separates the input loads from the output
+; store of a kernel with scoped alias metadata, guarded by a run-time
+; check that the input and output cells of the span do not overlap.
+
+; RUN: opt -load libbcc.so -kernelexp -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; Function Attrs: nounwind readnone
+define i32 @add(i32 %in0, i32 %in1) #0 {
+  %1 = add nsw i32 %in0, %in1
+  ret i32 %1
+}
+
+; CHECK-LABEL: define void @add.expand(
+; CHECK: Begin:
+; CHECK: %in_begin = ptrtoint i8* %in_buf to i64
+; CHECK: br i1 %{{.*}}, label %NoAlias, label %MayAlias
+; CHECK: NoAlias:
+; CHECK: load i32, i32* %{{.*}}, !tbaa !{{[0-9]+}}, !alias.scope ![[IN0:[0-9]+]], !noalias ![[OUT:[0-9]+]]
+; CHECK: load i32, i32* %{{.*}}, !tbaa !{{[0-9]+}}, !alias.scope ![[IN1:[0-9]+]], !noalias ![[OUT]]
+; CHECK: store i32 %call.result, i32* %{{.*}}, !tbaa !{{[0-9]+}}, !alias.scope ![[OUT]], !noalias ![[INS:[0-9]+]]
+; CHECK: MayAlias:
+; CHECK-NOT: !alias.scope
+; CHECK: ret void
+
+; CHECK-DAG: ![[OUT]] = !{![[OUTSCOPE:[0-9]+]]}
+; CHECK-DAG: ![[OUTSCOPE]] = distinct !{![[OUTSCOPE]], ![[DOMAIN:[0-9]+]], !"output"}
+; CHECK-DAG: ![[DOMAIN]] = distinct !{![[DOMAIN]], !"add.expand"}
+; CHECK-DAG: ![[IN0]] = !{![[IN0SCOPE:[0-9]+]]}
+; CHECK-DAG: ![[IN0SCOPE]] = distinct !{![[IN0SCOPE]], ![[DOMAIN]], !"input0"}
+; CHECK-DAG: ![[IN1]] = !{![[IN1SCOPE:[0-9]+]]}
+; CHECK-DAG: ![[INS]] = !{![[IN0SCOPE]], ![[IN1SCOPE]]}
+
+attributes #0 = { nounwind readnone }
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3}
+!\23rs_export_foreach = !{!4, !5}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!6}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"add"}
+!4 = !{!"0"}
+!5 = !{!"35"}
+!6 = !{!"0", !"3"}
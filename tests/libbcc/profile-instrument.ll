@@ -0,0 +1,56 @@
+; Check that RSProfileInstrumentPass counts function calls, branch
+; directions and divisors of the script functions (but not of the runtime
+; library) in .rs.profile.
+
+; RUN: opt -load libbcc.so -rsprofilegen -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; 7 counters: the entry of @clamp, the two successors of its branch, the
+; entry of @clamp.expand, and the divisor of its udiv (value, residual vote
+; count and executions).
+; CHECK: @.rs.profile = global { i32, i32, i64, i64, [7 x i64] } { i32 1179669330, i32 1, i64 {{-?[0-9]+}}, i64 7, [7 x i64] zeroinitializer }, section ".rs.profile"
+
+; CHECK-LABEL: define internal i32 @clamp(
+; CHECK: load i64, i64* getelementptr inbounds ({{.*}} @.rs.profile, i32 0, i32 4, i64 0)
+; CHECK: %[[IDX:.*]] = select i1 %cmp, i64 1, i64 2
+; CHECK: getelementptr inbounds {{.*}} @.rs.profile, i32 0, i32 4, i64 %[[IDX]]
+; CHECK: br i1 %cmp
+; CHECK-NOT: @.rs.profile
+; CHECK: ret i32
+define internal i32 @clamp(i32 %in) {
+  %cmp = icmp sgt i32 %in, 255
+  br i1 %cmp, label %big, label %small
+
+big:
+  ret i32 255
+
+small:
+  %v = call i32 @_Z3absi(i32 %in)
+  ret i32 %v
+}
+
+; CHECK-LABEL: define i32 @clamp.expand(
+; CHECK: getelementptr inbounds ({{.*}} @.rs.profile, i32 0, i32 4, i64 3)
+; CHECK: %[[DIVISOR:.*]] = zext i32 %d to i64
+; CHECK: icmp eq i64 %[[DIVISOR]]
+; CHECK: getelementptr inbounds ({{.*}} @.rs.profile, i32 0, i32 4, i64 6)
+; CHECK: udiv i32 %x, %d
+define i32 @clamp.expand(i32 %x, i32 %d) {
+  %q = udiv i32 %x, %d
+  %r = call i32 @clamp(i32 %q)
+  ret i32 %r
+}
+
+; Runtime functions are not instrumented.
+; CHECK-LABEL: define i32 @_Z3absi(
+; CHECK-NOT: @.rs.profile
+; CHECK: ret i32
+define i32 @_Z3absi(i32 %v) {
+  %neg = icmp slt i32 %v, 0
+  %n = sub i32 0, %v
+  %r = select i1 %neg, i32 %n, i32 %v
+  ret i32 %r
+}
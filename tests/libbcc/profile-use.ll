@@ -0,0 +1,103 @@
+; Check that RSProfileUsePass annotates the script with the counters of a
+; profile collected for it: entry counts, cold and inlinehint attributes,
+; branch weights, unroll hints on loop latches, and divisions specialized
+; for their majority divisor.  A profile of another layout is ignored.
+
+; The profile: magic, version, layout hash and 10 counters, in the order
+; RSProfileInstrumentPass lays them out.
+; RUN: printf '\122\123\120\106\001\000\000\000' > %t.prof
+; RUN: printf '\146\317\120\033\053\232\070\005' >> %t.prof
+; RUN: printf '\012\000\000\000\000\000\000\000' >> %t.prof
+; @hot: entry = 10
+; RUN: printf '\012\000\000\000\000\000\000\000' >> %t.prof
+; @hot: divisor value = 4, residual = 600, executions = 1000
+; RUN: printf '\004\000\000\000\000\000\000\000' >> %t.prof
+; RUN: printf '\130\002\000\000\000\000\000\000' >> %t.prof
+; RUN: printf '\350\003\000\000\000\000\000\000' >> %t.prof
+; @hot: latch = 990 back, 10 out
+; RUN: printf '\336\003\000\000\000\000\000\000' >> %t.prof
+; RUN: printf '\012\000\000\000\000\000\000\000' >> %t.prof
+; @never: entry = 0
+; RUN: printf '\000\000\000\000\000\000\000\000' >> %t.prof
+; @tiny: entry = 5, latch = 5 back, 5 out
+; RUN: printf '\005\000\000\000\000\000\000\000' >> %t.prof
+; RUN: printf '\005\000\000\000\000\000\000\000' >> %t.prof
+; RUN: printf '\005\000\000\000\000\000\000\000' >> %t.prof
+; RUN: opt -load libbcc.so -rsprofileuse -rs-profile-use=%t.prof -S < %s | FileCheck %s
+
+; The same header with another layout hash.
+; RUN: printf '\122\123\120\106\001\000\000\000' > %t.other.prof
+; RUN: printf '\000\000\000\000\000\000\000\000' >> %t.other.prof
+; RUN: tail -c 88 %t.prof >> %t.other.prof
+; RUN: opt -load libbcc.so -rsprofileuse -rs-profile-use=%t.other.prof -S < %s | FileCheck %s --check-prefix=OTHER
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; CHECK-LABEL: define i32 @hot(i32 %n, i32 %d) #[[HOTATTRS:[0-9]+]] !prof ![[HOTENTRY:[0-9]+]]
+; CHECK: [[ISDIVISOR:%[^ ]+]] = icmp eq i32 %d, 4
+; CHECK: br i1 [[ISDIVISOR]], label %{{[^ ,]+}}, label %{{[^ ,]+}}, !prof ![[DIVWEIGHTS:[0-9]+]]
+; CHECK: [[FAST:%[^ ]+]] = udiv i32 %i, 4
+; CHECK: [[SLOW:%[^ ]+]] = udiv i32 %i, %d
+; CHECK: %q = phi i32 [ [[FAST]], %{{[^ ,]+}} ], [ [[SLOW]], %{{[^ ,]+}} ]
+; CHECK: br i1 %cmp, label %loop, label %exit, !prof ![[HOTWEIGHTS:[0-9]+]], !llvm.loop ![[HOTLOOP:[0-9]+]]
+; OTHER-LABEL: define i32 @hot(i32 %n, i32 %d) {
+; OTHER-NOT: !prof
+; OTHER: udiv i32 %i, %d
+; OTHER-NOT: !prof
+; OTHER: br i1 %cmp, label %loop, label %exit{{$}}
+define i32 @hot(i32 %n, i32 %d) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %q = udiv i32 %i, %d
+  %acc.next = add i32 %acc, %q
+  %i.next = add i32 %i, 1
+  %cmp = icmp ult i32 %i.next, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 %acc.next
+}
+
+; CHECK-LABEL: define i32 @never(i32 %x) #[[NEVERATTRS:[0-9]+]] !prof ![[NEVERENTRY:[0-9]+]]
+define i32 @never(i32 %x) {
+  %y = mul i32 %x, %x
+  ret i32 %y
+}
+
+; CHECK-LABEL: define i32 @tiny(i32 %n) #[[HOTATTRS]] !prof ![[TINYENTRY:[0-9]+]]
+; CHECK: br i1 %cmp, label %loop, label %exit, !prof ![[TINYWEIGHTS:[0-9]+]], !llvm.loop ![[TINYLOOP:[0-9]+]]
+define i32 @tiny(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %i.next = add i32 %i, 1
+  %cmp = icmp ult i32 %i.next, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 %i.next
+}
+
+; CHECK-DAG: attributes #[[HOTATTRS]] = { inlinehint }
+; CHECK-DAG: attributes #[[NEVERATTRS]] = { cold }
+; CHECK-DAG: ![[HOTENTRY]] = !{!"function_entry_count", i64 10}
+; CHECK-DAG: ![[NEVERENTRY]] = !{!"function_entry_count", i64 0}
+; CHECK-DAG: ![[TINYENTRY]] = !{!"function_entry_count", i64 5}
+; CHECK-DAG: ![[DIVWEIGHTS]] = !{!"branch_weights", i32 600, i32 400}
+; CHECK-DAG: ![[HOTWEIGHTS]] = !{!"branch_weights", i32 990, i32 10}
+; CHECK-DAG: ![[HOTLOOP]] = {{(distinct )?}}!{![[HOTLOOP]], ![[ENABLE:[0-9]+]]}
+; CHECK-DAG: ![[ENABLE]] = !{!"llvm.loop.unroll.enable"}
+; CHECK-DAG: ![[TINYWEIGHTS]] = !{!"branch_weights", i32 5, i32 5}
+; CHECK-DAG: ![[TINYLOOP]] = {{(distinct )?}}!{![[TINYLOOP]], ![[DISABLE:[0-9]+]]}
+; CHECK-DAG: ![[DISABLE]] = !{!"llvm.loop.unroll.disable"}
+
+; OTHER-NOT: attributes
+; OTHER-NOT: function_entry_count
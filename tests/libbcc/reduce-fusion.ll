@@ -0,0 +1,57 @@
+; Check that bcc -reduce fuses a foreach kernel into a general reduce kernel:
+; the new kernel is exported in #rs_export_reduce with slang's layout (and
+; is read back as such into .rs.info), its accumulator takes the reduce
+; accumulator's data, and it computes the producer before accumulating.
+
+; RUN: llvm-rs-as %s -o %t.bc
+; RUN: bcc -o reduce_fusion -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi -emit-llvm \
+; RUN:      -reduce=sumsq:0,1.0,0 %t.bc
+; RUN: FileCheck %s < %T/reduce_fusion.o.ll
+
+; ModuleID = 'reduce_fusion.bc'
+target datalayout = "e-p:32:32-i64:64-v128:64:128-n32-S64"
+target triple = "armv7-none-linux-gnueabi"
+
+; int __attribute__((kernel)) square(int in)
+define i32 @square(i32 %in) {
+  %1 = mul nsw i32 %in, %in
+  ret i32 %1
+}
+
+; #pragma rs reduce(sum) accumulator(sumAccum)
+define internal void @sumAccum(i32* nocapture %accum, i32 %val) {
+  %1 = load i32, i32* %accum, align 4
+  %2 = add nsw i32 %1, %val
+  store i32 %2, i32* %accum, align 4
+  ret void
+}
+
+; CHECK: @.rs.info = {{.*}}exportReduceCount: 2\0A1 - 4 - sum - . - sumAccum - sumAccum.combiner - . - .\0A1 - 4 - sumsq - . - sumsq.accum - sumsq.combiner - . - .\0A
+
+; sum has no combiner, so the fused kernel gets its own.
+; CHECK: define {{.*}}void @sumsq.combiner(i32* {{.*}}%accum, i32* {{.*}}%other)
+
+; The accumulator of the fused kernel takes the same data as sumAccum, and
+; squares each input before adding it.
+; CHECK-LABEL: define void @sumsq.accum.expand(%RsExpandKernelDriverInfoPfx* {{.*}}%p, i32 %x1, i32 %x2, i32* {{.*}}%accum)
+; CHECK: = mul
+; CHECK: ret void
+
+; CHECK: !\23rs_export_reduce = !{![[SUM:[0-9]+]], ![[SUMSQ:[0-9]+]]}
+; CHECK-DAG: ![[SUMSQ]] = !{!"sumsq", !"4", ![[SUMSQACCUM:[0-9]+]], null, !"sumsq.combiner", null, null}
+; CHECK-DAG: ![[SUMSQACCUM]] = !{!"sumsq.accum", !"1"}
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3}
+!\23rs_export_foreach = !{!4, !5}
+!\23rs_export_reduce = !{!6}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"square"}
+!4 = !{!"0"}
+!5 = !{!"35"}
+!6 = !{!"sum", !"4", !7}
+!7 = !{!"sumAccum", !"1"}
@@ -0,0 +1,80 @@
+; Check that RSKernelExpandPass calls the halter of a general reduce kernel
+; from the expanded accumulator every -rs-reduce-halter-stride elements, and
+; leaves the loop once it returns true; that an accumulator with a halter is
+; not vectorized; and that a stride of 0 disables the check.
+
+; RUN: opt -load libbcc.so -kernelexp -S < %s | FileCheck %s
+; RUN: opt -load libbcc.so -kernelexp -rs-reduce-halter-stride=16 -S < %s | FileCheck %s --check-prefix=STRIDE16
+; RUN: opt -load libbcc.so -kernelexp -rs-reduce-halter-stride=0 -S < %s | FileCheck %s --check-prefix=NOHALTER
+
+; ModuleID = 'reduce_halter.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; int sum, saturating at 1000
+define internal void @sumAccum(i32* nocapture %accum, i32 %val) {
+  %1 = load i32, i32* %accum, align 4
+  %2 = add nsw i32 %1, %val
+  store i32 %2, i32* %accum, align 4
+  ret void
+}
+
+define internal i1 @sumHalter(i32* nocapture %accum) {
+  %1 = load i32, i32* %accum, align 4
+  %2 = icmp sge i32 %1, 1000
+  ret i1 %2
+}
+
+; CHECK-LABEL: define void @sumAccum.expand(
+; CHECK-NOT: SimdLoop
+; CHECK: Loop:
+; CHECK: %X = load i32
+; CHECK: call void @sumAccum(i32* %accum
+; CHECK: [[OFFSET:%[^ ]+]] = sub nuw i32 %X, %x1
+; CHECK: %halter.count = add nuw i32 [[OFFSET]], 1
+; CHECK: [[REM:%[^ ]+]] = urem i32 %halter.count, 64
+; CHECK: [[DUE:%[^ ]+]] = icmp eq i32 [[REM]], 0
+; CHECK: br i1 [[DUE]], label %Halter, label %Latch
+; CHECK: Halter:
+; CHECK: [[HALTED:%[^ ]+]] = call i1 @sumHalter(i32* %accum)
+; CHECK: [[STOP:%[^ ]+]] = icmp ne i1 [[HALTED]], false
+; CHECK: br i1 [[STOP]], label %{{[^ ,]+}}, label %Latch
+; CHECK: Latch:
+
+; STRIDE16-LABEL: define void @sumAccum.expand(
+; STRIDE16: urem i32 %halter.count, 16
+; STRIDE16: call i1 @sumHalter(
+
+; NOHALTER-LABEL: define void @sumAccum.expand(
+; NOHALTER-NOT: @sumHalter
+; NOHALTER: SimdLoop:
+; NOHALTER-NOT: @sumHalter
+; NOHALTER: call void @sumAccum(
+; NOHALTER-NOT: @sumHalter
+; NOHALTER: ret void
+
+!\23pragma = !{!0, !1}
+!\23rs_export_reduce = !{!2}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!4}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"examples"}
+!2 = !{!"sum", !"4", !3, null, null, null, !"sumHalter"}
+!3 = !{!"sumAccum", !"1"}
+!4 = !{!"0", !"3"}
@@ -0,0 +1,129 @@
+; Check that the vectorized expansion of general reduce accumulators computes
+; the same results as the scalar expansion: both are run by the driver in
+; Inputs/reduce-simd-driver.ll over spans whose lengths are not multiples
+; of the vector width, with ties for the arg-min (first occurrence) and
+; arg-max (last occurrence) accumulators.
+
+; RUN: opt -load libbcc.so -kernelexp -S < %s | FileCheck %s
+; RUN: opt -load libbcc.so -kernelexp %s -o %t.simd.bc
+; RUN: opt -load libbcc.so -kernelexp -rs-simd-reduce=false %s -o %t.scalar.bc
+; RUN: llvm-link %t.simd.bc %S/Inputs/reduce-simd-driver.ll -o %t.simd.linked.bc
+; RUN: llvm-link %t.scalar.bc %S/Inputs/reduce-simd-driver.ll -o %t.scalar.linked.bc
+; RUN: lli %t.simd.linked.bc > %t.simd.out
+; RUN: lli %t.scalar.linked.bc > %t.scalar.out
+; RUN: diff %t.scalar.out %t.simd.out
+; RUN: FileCheck %s --check-prefix=RESULT < %t.simd.out
+
+; No target, so that lli runs the expanded accumulators on the host.
+; ModuleID = 'reduce_simd_equivalence.bc'
+
+%struct.IndexedVal = type { i32, i32 }
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; int sum
+define internal void @sumAccum(i32* nocapture %accum, i32 %val) {
+  %1 = load i32, i32* %accum, align 4
+  %2 = add nsw i32 %1, %val
+  store i32 %2, i32* %accum, align 4
+  ret void
+}
+
+; uchar max
+define internal void @maxAccum(i8* nocapture %accum, i8 %val) {
+  %1 = load i8, i8* %accum, align 1
+  %2 = icmp ugt i8 %val, %1
+  %3 = select i1 %2, i8 %val, i8 %1
+  store i8 %3, i8* %accum, align 1
+  ret void
+}
+
+; int argmin, first occurrence
+define internal void @argminAccum(%struct.IndexedVal* nocapture %accum, i32 %val, i32 %x) {
+  %1 = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %accum, i64 0, i32 0
+  %2 = load i32, i32* %1, align 4
+  %3 = icmp slt i32 %val, %2
+  br i1 %3, label %4, label %6
+
+; <label>:4
+  store i32 %val, i32* %1, align 4
+  %5 = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %accum, i64 0, i32 1
+  store i32 %x, i32* %5, align 4
+  br label %6
+
+; <label>:6
+  ret void
+}
+
+; int argmax, last occurrence
+define internal void @argmaxAccum(%struct.IndexedVal* nocapture %accum, i32 %val, i32 %x) {
+  %1 = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %accum, i64 0, i32 0
+  %2 = load i32, i32* %1, align 4
+  %3 = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %accum, i64 0, i32 1
+  %4 = load i32, i32* %3, align 4
+  %5 = icmp sge i32 %val, %2
+  %6 = select i1 %5, i32 %val, i32 %2
+  %7 = select i1 %5, i32 %x, i32 %4
+  store i32 %6, i32* %1, align 4
+  store i32 %7, i32* %3, align 4
+  ret void
+}
+
+define internal void @argminCombine(%struct.IndexedVal* nocapture %accum, %struct.IndexedVal* nocapture %other) {
+  ret void
+}
+
+define internal void @argmaxCombine(%struct.IndexedVal* nocapture %accum, %struct.IndexedVal* nocapture %other) {
+  ret void
+}
+
+; All of the accumulators are vectorized, so the driver compares the two
+; expansions for each of them.
+; CHECK-LABEL: define void @sumAccum.expand(
+; CHECK: SimdLoop:
+; CHECK-LABEL: define void @maxAccum.expand(
+; CHECK: SimdLoop:
+; CHECK-LABEL: define void @argminAccum.expand(
+; CHECK: SimdLoop:
+; CHECK-LABEL: define void @argmaxAccum.expand(
+; CHECK: SimdLoop:
+
+; RESULT: 0 1: sum 5 max 3 argmin 5@0 argmax 5@0
+; RESULT-NEXT: 0 3: sum 67 max 200 argmin 5@0 argmax 50@2
+; RESULT-NEXT: 0 4: sum 74 max 250 argmin 5@0 argmax 50@2
+; RESULT-NEXT: 0 5: sum 73 max 250 argmin -1@4 argmax 50@2
+; RESULT-NEXT: 0 17: sum 176 max 250 argmin -4@6 argmax 50@13
+; RESULT-NEXT: 0 37: sum 410 max 250 argmin -4@6 argmax 50@35
+; RESULT-NEXT: 3 37: sum 343 max 250 argmin -4@6 argmax 50@35
+; RESULT-NEXT: 7 29: sum 246 max 250 argmin -4@9 argmax 50@26
+; RESULT-NEXT: 10 12: sum 17 max 200 argmin 0@10 argmax 17@11
+
+!\23pragma = !{!0, !1}
+!\23rs_export_reduce = !{!2, !4, !6, !8}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!10}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"examples"}
+!2 = !{!"sum", !"4", !3}
+!3 = !{!"sumAccum", !"1"}
+!4 = !{!"max", !"1", !5}
+!5 = !{!"maxAccum", !"1"}
+!6 = !{!"argmin", !"8", !7, null, !"argminCombine"}
+!7 = !{!"argminAccum", !"9"}
+!8 = !{!"argmax", !"8", !9, null, !"argmaxCombine"}
+!9 = !{!"argmaxAccum", !"9"}
+!10 = !{!"0", !"3"}
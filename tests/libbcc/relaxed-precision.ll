@@ -0,0 +1,110 @@
+; Check that RSRelaxedPrecisionPass compiles the functions marked as coming
+; from relaxed precision scripts, and their expanded kernels, for relaxed
+; precision, calling relaxed copies of the runtime functions (including those
+; that only forward to floating point functions), and leaves the other
+; functions alone.
+
+; RUN: opt -load libbcc.so -rsrelaxedprecision -S < %s | FileCheck %s
+
+; ModuleID = 'Merged Script Group'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; CHECK-LABEL: define float @relaxed(float %in)
+; CHECK: fmul nsz arcp float %in, %in
+; CHECK: call float @_Z4sqrtf.relaxed(float
+define float @relaxed(float %in) #0 {
+  %sq = fmul float %in, %in
+  %r = call float @_Z4sqrtf(float %sq)
+  ret float %r
+}
+
+; CHECK-LABEL: define void @relaxed.expand(float* %p)
+; CHECK: fadd nsz arcp float
+define void @relaxed.expand(float* %p) {
+  %v = load float, float* %p, align 4
+  %c = call float @relaxed(float %v)
+  %s = fadd float %c, 1.000000e+00
+  store float %s, float* %p, align 4
+  ret void
+}
+
+; CHECK-LABEL: define float @full(float %in)
+; CHECK: fmul float %in, %in
+; CHECK: call float @_Z4sqrtf(float
+define float @full(float %in) #1 {
+  %sq = fmul float %in, %in
+  %r = call float @_Z4sqrtf(float %sq)
+  ret float %r
+}
+
+; CHECK-LABEL: define void @full.expand(float* %p)
+; CHECK: fadd float
+define void @full.expand(float* %p) {
+  %v = load float, float* %p, align 4
+  %c = call float @full(float %v)
+  %s = fadd float %c, 1.000000e+00
+  store float %s, float* %p, align 4
+  ret void
+}
+
+; CHECK-LABEL: define float @_Z4sqrtf(float %x)
+; CHECK: fmul float %x, 5.000000e-01
+define float @_Z4sqrtf(float %x) #1 {
+  %h = fmul float %x, 5.000000e-01
+  ret float %h
+}
+
+; Runtime wrappers that do no floating point arithmetic themselves, but
+; forward to a declaration that takes floats, or to another runtime function
+; that does, with the vectors passed as integers as on ARM.
+; CHECK-LABEL: define <2 x i64> @wrappers(float %in, <2 x i64> %v, float* %s, float* %c)
+; CHECK: call void @_Z6sincosfPfS_.relaxed(float %in, float* %s, float* %c)
+; CHECK: call <2 x i64> @_Z4halfDv4_f.relaxed(<2 x i64> %v)
+define <2 x i64> @wrappers(float %in, <2 x i64> %v, float* %s, float* %c) #0 {
+  call void @_Z6sincosfPfS_(float %in, float* %s, float* %c)
+  %h = call <2 x i64> @_Z4halfDv4_f(<2 x i64> %v)
+  ret <2 x i64> %h
+}
+
+declare void @SC_sincosf(float, float*, float*)
+
+; CHECK-LABEL: define void @_Z6sincosfPfS_(float %x, float* %s, float* %c)
+; CHECK: call void @SC_sincosf(float %x, float* %s, float* %c)
+define void @_Z6sincosfPfS_(float %x, float* %s, float* %c) #1 {
+  call void @SC_sincosf(float %x, float* %s, float* %c)
+  ret void
+}
+
+; CHECK-LABEL: define <2 x i64> @_Z4halfDv4_f(<2 x i64> %v)
+; CHECK: call <2 x i64> @_Z9half_implDv4_f(<2 x i64> %v)
+define <2 x i64> @_Z4halfDv4_f(<2 x i64> %v) #1 {
+  %r = call <2 x i64> @_Z9half_implDv4_f(<2 x i64> %v)
+  ret <2 x i64> %r
+}
+
+; CHECK-LABEL: define <2 x i64> @_Z9half_implDv4_f(<2 x i64> %v)
+; CHECK: fmul <4 x float>
+define <2 x i64> @_Z9half_implDv4_f(<2 x i64> %v) #1 {
+  %f = bitcast <2 x i64> %v to <4 x float>
+  %h = fmul <4 x float> %f, <float 5.000000e-01, float 5.000000e-01, float 5.000000e-01, float 5.000000e-01>
+  %r = bitcast <4 x float> %h to <2 x i64>
+  ret <2 x i64> %r
+}
+
+; CHECK-LABEL: define internal void @_Z6sincosfPfS_.relaxed(float %x, float* %s, float* %c)
+; CHECK: call void @SC_sincosf(float %x, float* %s, float* %c)
+
+; CHECK-LABEL: define internal <2 x i64> @_Z4halfDv4_f.relaxed(<2 x i64> %v)
+; CHECK: call <2 x i64> @_Z9half_implDv4_f.relaxed(<2 x i64> %v)
+
+; CHECK-LABEL: define internal <2 x i64> @_Z9half_implDv4_f.relaxed(<2 x i64> %v)
+; CHECK: fmul nsz arcp <4 x float>
+
+; CHECK-LABEL: define internal float @_Z4sqrtf.relaxed(float %x)
+; CHECK: fmul nsz arcp float %x, 5.000000e-01
+
+; CHECK: attributes #{{[0-9]+}} = { "less-precise-fpmad"="true" "rs-fp-relaxed" }
+
+attributes #0 = { "rs-fp-relaxed" }
+attributes #1 = { nounwind }
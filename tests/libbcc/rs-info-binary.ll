@@ -0,0 +1,69 @@
+; Check the binary form of the RS Info that bcc -embedRSInfo -rs-info-binary
+; embeds in the .rs.info.bin section: the header and table layout, the hash
+; table of the kernels, and the string table.  Without exported symbols, the
+; hash table is empty and the string table follows the last table.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: bcc -o rs_info_binary -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi -O0 \
+; RUN:      -embedRSInfo -rs-info-binary %t.bc
+; RUN: readelf --wide --hex-dump=.rs.info.bin %T/rs_info_binary.o \
+; RUN:      | FileCheck %s
+; RUN: readelf --wide --string-dump=.rs.info.bin %T/rs_info_binary.o \
+; RUN:      | FileCheck %s --check-prefix=STRINGS
+
+; RUN: grep -v rs_export_foreach %s | llvm-as -o %t.nosymbols.bc
+; RUN: bcc -o rs_info_binary_nosymbols -output_path %T -bclib libclcore.bc \
+; RUN:      -mtriple armv7-none-linux-gnueabi -O0 \
+; RUN:      -embedRSInfo -rs-info-binary %t.nosymbols.bc
+; RUN: readelf --wide --hex-dump=.rs.info.bin %T/rs_info_binary_nosymbols.o \
+; RUN:      | FileCheck %s --check-prefix=NOSYMBOLS
+
+; Magic, version and header size.
+; CHECK: 0x00000000 23525349 01000000 60000000
+; Variables and functions: none.
+; CHECK-NEXT: 0x00000010
+; CHECK-NEXT: 0x00000020 60000000 00000000 60000000 00000000
+; Two foreach kernels, then no reduce kernels.
+; CHECK-NEXT: 0x00000030 60000000 02000000 70000000 00000000
+; Two pragmas, then no object slots.
+; CHECK-NEXT: 0x00000040 70000000 02000000 80000000 00000000
+; A hash table of 4 entries for the 2 kernels, then the strings.
+; CHECK-NEXT: 0x00000050 80000000 04000000 a0000000
+
+; STRINGS: root
+; STRINGS: swizzle
+; STRINGS: version
+; STRINGS: java_package_name
+; STRINGS: foo
+
+; NOSYMBOLS: 0x00000000 23525349 01000000 60000000
+; NOSYMBOLS-NEXT: 0x00000010
+; NOSYMBOLS-NEXT: 0x00000020 60000000 00000000 60000000 00000000
+; NOSYMBOLS-NEXT: 0x00000030 60000000 00000000 60000000 00000000
+; NOSYMBOLS-NEXT: 0x00000040 60000000 02000000 70000000 00000000
+; NOSYMBOLS-NEXT: 0x00000050 70000000 00000000 70000000
+
+; ModuleID = 'rs_info_binary.bc'
+target datalayout = "e-p:32:32-i64:64-v128:64:128-n32-S64"
+target triple = "armv7-none-linux-gnueabi"
+
+define void @root() {
+  ret void
+}
+
+define <4 x i8> @swizzle(<4 x i8> %in) {
+  %1 = shufflevector <4 x i8> %in, <4 x i8> undef, <4 x i32> <i32 3, i32 2, i32 1, i32 0>
+  ret <4 x i8> %1
+}
+
+!\23pragma = !{!0, !1}
+!\23rs_export_foreach_name = !{!2, !3}
+!\23rs_export_foreach = !{!4, !5}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"root"}
+!3 = !{!"swizzle"}
+!4 = !{!"0"}
+!5 = !{!"35"}
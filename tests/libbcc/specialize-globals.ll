@@ -0,0 +1,55 @@
+; Check that RSSpecializeGlobalsPass folds loads of specialized exported
+; globals, keeps the globals themselves exported and writable, and leaves
+; alone globals that the script writes to.
+
+; RUN: opt -load libbcc.so -rsspecglobals -rs-specialize-global=radius=05000000 -rs-specialize-global=weights=0000803f00000040 -rs-specialize-global=counter=01000000 -rs-specialize-global=missing=00 -S < %s | FileCheck %s
+
+; ModuleID = 'blur.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; CHECK: @radius = global i32 5, align 4
+; CHECK: @weights = global [2 x float] [float 1.000000e+00, float 2.000000e+00], align 4
+; CHECK: @counter = common global i32 0, align 4
+@radius = common global i32 0, align 4
+@weights = global [2 x float] zeroinitializer, align 4
+@counter = common global i32 0, align 4
+
+; CHECK-LABEL: define i32 @getRadius(
+; CHECK-NOT: load
+; CHECK: ret i32 5
+define i32 @getRadius() {
+  %1 = load i32, i32* @radius, align 4
+  ret i32 %1
+}
+
+; CHECK-LABEL: define float @getWeights(
+; CHECK: %1 = fadd float 1.000000e+00, 2.000000e+00
+; CHECK: load float, float* %p
+define float @getWeights(i32 %i) {
+  %1 = load float, float* getelementptr inbounds ([2 x float], [2 x float]* @weights, i64 0, i64 0), align 4
+  %2 = load float, float* getelementptr inbounds ([2 x float], [2 x float]* @weights, i64 0, i64 1), align 4
+  %3 = fadd float %1, %2
+  %p = getelementptr inbounds [2 x float], [2 x float]* @weights, i64 0, i32 %i
+  %4 = load float, float* %p, align 4
+  %5 = fadd float %3, %4
+  ret float %5
+}
+
+; CHECK-LABEL: define void @count(
+; CHECK: load i32, i32* @counter
+define void @count() {
+  %1 = load i32, i32* @counter, align 4
+  %2 = add nsw i32 %1, 1
+  store i32 %2, i32* @counter, align 4
+  ret void
+}
+
+!\23pragma = !{!0, !1}
+!\23rs_export_var = !{!2, !3, !4}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"foo"}
+!2 = !{!"radius", !"5"}
+!3 = !{!"weights", !"6"}
+!4 = !{!"counter", !"5"}
@@ -0,0 +1,73 @@
+; Check that a kernel which cannot see pointers into allocations keeps
+; TBAA tags that are connected to the C/C++ TBAA tree, even if another
+; kernel of the same script calls rsGetElementAt().
+
+; RUN: opt -load libbcc.so -kernelexp -S < %s | FileCheck %s
+
+; ModuleID = 'kernel.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; Function Attrs: nounwind readnone
+define i32 @add1(i32 %in) #0 {
+  %1 = add nsw i32 %in, 1
+  ret i32 %1
+}
+
+define internal void @helper() {
+  call void @_Z14rsGetElementAt13rs_allocationj()
+  ret void
+}
+
+define i32 @getter(i32 %in) {
+  call void @helper()
+  ret i32 %in
+}
+
+attributes #0 = { nounwind readnone }
+
+; CHECK-LABEL: define void @add1.expand(
+; CHECK: store i32 %call.result, i32* {{.*}}, !tbaa ![[CLEAN:[0-9]+]]
+; CHECK-LABEL: define void @getter.expand(
+; CHECK: store i32 %call.result, i32* {{.*}}, !tbaa ![[EXPOSED:[0-9]+]]
+
+; CHECK-DAG: ![[CLEAN]] = !{![[CLEANTY:[0-9]+]], ![[CLEANTY]], i64 0}
+; CHECK-DAG: ![[CLEANTY]] = !{!"allocation", ![[CLEANNODE:[0-9]+]], i64 0}
+; CHECK-DAG: ![[CLEANNODE]] = !{!"RenderScript Kernel TBAA", ![[CROOT:[0-9]+]]}
+; CHECK-DAG: ![[CROOT]] = !{!"Simple C/C++ TBAA"}
+; CHECK-DAG: ![[EXPOSED]] = !{![[EXPOSEDTY:[0-9]+]], ![[EXPOSEDTY]], i64 0}
+; CHECK-DAG: ![[EXPOSEDTY]] = !{!"allocation", ![[EXPOSEDNODE:[0-9]+]], i64 0}
+; CHECK-DAG: ![[EXPOSEDNODE]] = !{!"RenderScript TBAA", ![[RSROOT:[0-9]+]]}
+; CHECK-DAG: ![[RSROOT]] = !{!"RenderScript Distinct TBAA"}
+
+!llvm.ident = !{!0}
+!\23pragma = !{!1, !2}
+!\23rs_export_foreach_name = !{!3, !4, !5}
+!\23rs_export_foreach = !{!6, !7, !7}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!8}
+
+!0 = !{!"clang version 3.6 "}
+!1 = !{!"version", !"1"}
+!2 = !{!"java_package_name", !"foo"}
+!3 = !{!"root"}
+!4 = !{!"add1"}
+!5 = !{!"getter"}
+!6 = !{!"0"}
+!7 = !{!"35"}
+!8 = !{!"0", !"3"}
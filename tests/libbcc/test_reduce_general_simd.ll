@@ -0,0 +1,149 @@
+; Check that RSKernelExpandPass vectorizes the expanded accumulators of
+; recognized general reduce kernels, and that the scalar expansion is
+; used for everything else (and for all kernels with -rs-simd-reduce=false).
+; This only checks the shape of the generated code; reduce-simd-equivalence.ll
+; runs the two expansions and compares their results.
+
+; RUN: opt -load libbcc.so -kernelexp -S < %s | FileCheck %s
+; RUN: opt -load libbcc.so -kernelexp -rs-simd-reduce=false -S < %s | FileCheck %s --check-prefix=SCALAR
+
+; ModuleID = 'reduce_simd.bc'
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-none-linux-gnueabi"
+
+%struct.IndexedVal = type { i32, i32 }
+
+; Declarations expected by the expansion pass.
+declare void @_Z14rsGetElementAt13rs_allocationj()
+declare void @_Z14rsGetElementAt13rs_allocationjj()
+declare void @_Z14rsGetElementAt13rs_allocationjjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjj()
+declare void @_Z14rsSetElementAt13rs_allocationPvjjj()
+declare void @_Z25rsGetElementAtYuv_uchar_Y13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_U13rs_allocationjj()
+declare void @_Z25rsGetElementAtYuv_uchar_V13rs_allocationjj()
+
+; int sum
+define internal void @sumAccum(i32* nocapture %accum, i32 %val) {
+  %1 = load i32, i32* %accum, align 4
+  %2 = add nsw i32 %1, %val
+  store i32 %2, i32* %accum, align 4
+  ret void
+}
+
+; float2 sum that allows reassociation
+define internal void @sum2Accum(<2 x float>* nocapture %accum, <2 x float> %val) {
+  %1 = load <2 x float>, <2 x float>* %accum, align 8
+  %2 = fadd fast <2 x float> %1, %val
+  store <2 x float> %2, <2 x float>* %accum, align 8
+  ret void
+}
+
+; float sum that must keep its order of evaluation
+define internal void @strictSumAccum(float* nocapture %accum, float %val) {
+  %1 = load float, float* %accum, align 4
+  %2 = fadd float %1, %val
+  store float %2, float* %accum, align 4
+  ret void
+}
+
+; uchar max
+define internal void @maxAccum(i8* nocapture %accum, i8 %val) {
+  %1 = load i8, i8* %accum, align 1
+  %2 = icmp ugt i8 %val, %1
+  %3 = select i1 %2, i8 %val, i8 %1
+  store i8 %3, i8* %accum, align 1
+  ret void
+}
+
+; int argmin, first occurrence
+define internal void @argminAccum(%struct.IndexedVal* nocapture %accum, i32 %val, i32 %x) {
+  %1 = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %accum, i64 0, i32 0
+  %2 = load i32, i32* %1, align 4
+  %3 = icmp slt i32 %val, %2
+  br i1 %3, label %4, label %6
+
+; <label>:4
+  store i32 %val, i32* %1, align 4
+  %5 = getelementptr inbounds %struct.IndexedVal, %struct.IndexedVal* %accum, i64 0, i32 1
+  store i32 %x, i32* %5, align 4
+  br label %6
+
+; <label>:6
+  ret void
+}
+
+define internal void @argminCombine(%struct.IndexedVal* nocapture %accum, %struct.IndexedVal* nocapture %other) {
+  ret void
+}
+
+; CHECK-LABEL: define void @sumAccum.expand(
+; CHECK: SimdPreheader:
+; CHECK: load <4 x i32>, <4 x i32>*
+; CHECK: SimdLoop:
+; CHECK: add <4 x i32>
+; CHECK: SimdReduce:
+; CHECK: shufflevector <4 x i32> %simd_result, <4 x i32> undef, <2 x i32> <i32 0, i32 1>
+; CHECK: shufflevector <4 x i32> %simd_result, <4 x i32> undef, <2 x i32> <i32 2, i32 3>
+; CHECK: SimdExit:
+; CHECK: %scalar_x1 = phi i32
+; CHECK: Loop:
+; CHECK: call void @sumAccum(
+
+; SCALAR-LABEL: define void @sumAccum.expand(
+; SCALAR-NOT: <4 x i32>
+; SCALAR: Loop:
+; SCALAR: call void @sumAccum(
+
+; CHECK-LABEL: define void @sum2Accum.expand(
+; CHECK: load <4 x float>, <4 x float>*
+; CHECK: fadd fast <4 x float>
+; CHECK: shufflevector <4 x float> %simd_result, <4 x float> undef, <2 x i32> <i32 0, i32 1>
+; CHECK: fadd fast <2 x float>
+; CHECK: call void @sum2Accum(
+
+; CHECK-LABEL: define void @strictSumAccum.expand(
+; CHECK-NOT: Simd
+; CHECK: call void @strictSumAccum(
+
+; CHECK-LABEL: define void @maxAccum.expand(
+; CHECK: load <16 x i8>, <16 x i8>*
+; CHECK: icmp ugt <16 x i8>
+; CHECK: select <16 x i1>
+; CHECK: extractelement <1 x i8>
+; CHECK: call void @maxAccum(
+
+; CHECK-LABEL: define void @argminAccum.expand(
+; CHECK: load <4 x i32>, <4 x i32>*
+; CHECK: %simd_x = add nuw <4 x i32>
+; CHECK: icmp slt <4 x i32>
+; CHECK: icmp ult <2 x i32>
+; CHECK: call void @argminAccum(
+
+; SCALAR-LABEL: define void @argminAccum.expand(
+; SCALAR-NOT: <4 x i32>
+; SCALAR: call void @argminAccum(
+
+!\23pragma = !{!0, !1}
+!\23rs_export_reduce = !{!2, !4, !6, !8, !10}
+
+; The following named metadata would not be present in a bitcode file,
+; but instead synthesized by bcc from the bitcode wrapper.  However,
+; for this test case, we're not running bcc, but instead opt, and so
+; we never get the opportunity to synthesize this named metadata.
+!\23rs_wrapper = !{!12}
+
+!0 = !{!"version", !"1"}
+!1 = !{!"java_package_name", !"examples"}
+!2 = !{!"sum", !"4", !3}
+!3 = !{!"sumAccum", !"1"}
+!4 = !{!"sum2", !"8", !5}
+!5 = !{!"sum2Accum", !"1"}
+!6 = !{!"strictSum", !"4", !7}
+!7 = !{!"strictSumAccum", !"1"}
+!8 = !{!"max", !"1", !9}
+!9 = !{!"maxAccum", !"1"}
+!10 = !{!"argmin", !"8", !11, null, !"argminCombine"}
+!11 = !{!"argminAccum", !"9"}
+!12 = !{!"0", !"3"}
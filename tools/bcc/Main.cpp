@@ -67,6 +67,27 @@ OptMergePlans("merge", llvm::cl::ZeroOrMore,
                llvm::cl::desc("Lists of kernels to merge (as source-and-slot "
                               "pairs) and names for the final merged kernels"));
 
+llvm::cl::list<std::string>
+OptReducePlans("reduce", llvm::cl::ZeroOrMore,
+               llvm::cl::desc("Lists of kernels to merge into a general reduce "
+                              "kernel (as source-and-slot pairs, the last one "
+                              "naming a reduce slot) and names for the final "
+                              "merged reduce kernels"));
+
+llvm::cl::list<std::string>
+OptGroupKernels("group-kernel", llvm::cl::ZeroOrMore,
+                llvm::cl::desc("Kernels of a script group for -auto-merge, in "
+                               "execution order, as <source>,<slot>[:<producers>]"
+                               "[:live], where <producers> lists, for each input, "
+                               "the index of the producing kernel or -1, "
+                               "separated by '.'"));
+
+llvm::cl::opt<std::string>
+OptAutoMerge("auto-merge",
+             llvm::cl::desc("Choose the kernels to merge from the -group-kernel "
+                            "graph, naming merged kernels with this prefix"),
+             llvm::cl::value_desc("prefix"));
+
 llvm::cl::list<std::string>
 OptInvokes("invoke", llvm::cl::ZeroOrMore,
            llvm::cl::desc("Invocable functions"));
@@ -106,6 +127,14 @@ llvm::cl::alias OptTargetTripleC("C", llvm::cl::NotHidden,
                                  llvm::cl::desc("Alias for -mtriple"),
                                  llvm::cl::aliasopt(OptTargetTriple));
 
+llvm::cl::list<std::string>
+OptFeatureLevels("feature-level", llvm::cl::ZeroOrMore,
+                 llvm::cl::desc("Also compile expanded kernels for a CPU "
+                                "feature level (sse4.2 or avx2 on x86, fp16 on "
+                                "AArch64), from lowest to highest; the best "
+                                "supported one is selected at run time"),
+                 llvm::cl::value_desc("level"));
+
 llvm::cl::opt<bool>
 OptRSDebugContext("rs-debug-ctx",
     llvm::cl::desc("Enable build to work with a RenderScript debug context"));
@@ -119,12 +148,46 @@ OptRSGlobalInfoSkipConstant("rs-global-info-skip-constant",
     llvm::cl::desc("Skip embedding information about constant global "
                    "variables in the code"));
 
+llvm::cl::opt<bool>
+OptRSGlobalInfoIndex("rs-global-info-index",
+    llvm::cl::desc("Also embed a hash index of the names of the global "
+                   "variables in the code"));
+
+llvm::cl::opt<bool>
+OptRSInfoBinary("rs-info-binary",
+    llvm::cl::desc("Also embed the RS Info in binary form (.rs.info.bin); "
+                   "to be used with -embedRSInfo"));
+
 llvm::cl::opt<std::string>
 OptChecksum("build-checksum",
             llvm::cl::desc("Embed a checksum of this compiler invocation for"
                            " cache invalidation at a later time"),
             llvm::cl::value_desc("checksum"));
 
+llvm::cl::list<std::string>
+OptSpecializeGlobals("specialize-global", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Compile an exported global variable as a constant with "
+                   "the given value (bytes in memory order, in hex)"),
+    llvm::cl::value_desc("name=bytes"));
+
+llvm::cl::list<std::string>
+OptExpandShapes("expand-shape", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Also expand a foreach kernel for whole rows of the given "
+                   "number of cells, starting at addresses with the given "
+                   "alignment"),
+    llvm::cl::value_desc("kernel:dimX:alignment"));
+
+llvm::cl::opt<bool>
+OptProfileGenerate("profile-generate",
+    llvm::cl::desc("Instrument the code to collect an execution profile in "
+                   "the .rs.profile section"));
+
+llvm::cl::opt<std::string>
+OptProfileUse("profile-use",
+    llvm::cl::desc("Optimize for the execution profile dumped from the "
+                   ".rs.profile section of a -profile-generate build"),
+    llvm::cl::value_desc("filename"));
+
 #ifdef __ANDROID__
 llvm::cl::opt<std::string>
 OptVendorPlugin("plugin", llvm::cl::ZeroOrMore,
@@ -194,6 +257,77 @@ void extractSourcesAndSlots(const llvm::cl::list<std::string>& optList,
   }
 }
 
+bool extractGroupKernels(const llvm::cl::list<std::string>& optList,
+                         std::vector<ScriptGroupKernel>* kernels) {
+  for (unsigned i = 0; i < optList.size(); ++i) {
+    std::istringstream iss(optList[i]);
+    std::string sourceAndSlot, producers, live;
+    getline(iss, sourceAndSlot, ':');
+    getline(iss, producers, ':');
+    getline(iss, live, ':');
+
+    ScriptGroupKernel kernel;
+    size_t found = sourceAndSlot.find(',');
+    if (found == std::string::npos) {
+      llvm::errs() << "Malformed group kernel '" << optList[i] << "'\n";
+      return false;
+    }
+    kernel.source = std::stoi(sourceAndSlot.substr(0, found));
+    kernel.slot = std::stoi(sourceAndSlot.substr(found + 1));
+
+    std::istringstream producerStream(producers);
+    std::string s;
+    while (getline(producerStream, s, '.')) {
+      kernel.inputProducers.push_back(std::stoi(s));
+    }
+
+    kernel.outputLive = (live == "live");
+    kernels->push_back(kernel);
+  }
+  return true;
+}
+
+bool extractSpecializedGlobals(const llvm::cl::list<std::string>& optList,
+                               RSCompilerDriver* RSCD) {
+  for (unsigned i = 0; i < optList.size(); ++i) {
+    const std::string& opt = optList[i];
+    size_t found = opt.find('=');
+    std::string hex = (found == std::string::npos) ? "" : opt.substr(found + 1);
+    if (hex.empty() || hex.size() % 2 != 0 ||
+        hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+      llvm::errs() << "Malformed global specialization '" << opt << "'\n";
+      return false;
+    }
+
+    std::vector<uint8_t> value;
+    for (size_t j = 0; j < hex.size(); j += 2) {
+      value.push_back(static_cast<uint8_t>(std::stoi(hex.substr(j, 2), nullptr, 16)));
+    }
+    RSCD->setSpecializedGlobal(opt.substr(0, found).c_str(), value.data(),
+                               value.size());
+  }
+  return true;
+}
+
+bool extractExpandShapes(const llvm::cl::list<std::string>& optList,
+                         RSCompilerDriver* RSCD) {
+  for (unsigned i = 0; i < optList.size(); ++i) {
+    std::istringstream iss(optList[i]);
+    std::string kernel, dimX, alignment;
+    if (!getline(iss, kernel, ':') || !getline(iss, dimX, ':') ||
+        !getline(iss, alignment) || kernel.empty() || dimX.empty() ||
+        alignment.empty() ||
+        dimX.find_first_not_of("0123456789") != std::string::npos ||
+        alignment.find_first_not_of("0123456789") != std::string::npos) {
+      llvm::errs() << "Malformed kernel shape '" << optList[i] << "'\n";
+      return false;
+    }
+    RSCD->setExpandShapeHint(kernel.c_str(), std::stoul(dimX),
+                             std::stoul(alignment));
+  }
+  return true;
+}
+
 bool compileScriptGroup(BCCContext& Context, RSCompilerDriver& RSCD) {
   std::vector<bcc::Source*> sources;
   for (unsigned i = 0; i < OptInputFilenames.size(); ++i) {
@@ -210,10 +344,25 @@ bool compileScriptGroup(BCCContext& Context, RSCompilerDriver& RSCD) {
   std::list<std::list<std::pair<int, int>>> sourcesAndSlots;
   extractSourcesAndSlots(OptMergePlans, &fusedKernelNames, &sourcesAndSlots);
 
+  if (!OptAutoMerge.empty()) {
+    std::vector<ScriptGroupKernel> groupKernels;
+    std::string report;
+    if (!extractGroupKernels(OptGroupKernels, &groupKernels) ||
+        !RSCD.planScriptGroupFusion(sources, groupKernels, OptAutoMerge,
+                                    &sourcesAndSlots, &fusedKernelNames, &report)) {
+      return false;
+    }
+    std::cerr << "fusion plan:" << std::endl << report;
+  }
+
   std::list<std::string> invokeBatchNames;
   std::list<std::list<std::pair<int, int>>> invokeSourcesAndSlots;
   extractSourcesAndSlots(OptInvokes, &invokeBatchNames, &invokeSourcesAndSlots);
 
+  std::list<std::string> fusedReduceNames;
+  std::list<std::list<std::pair<int, int>>> reduceSourcesAndSlots;
+  extractSourcesAndSlots(OptReducePlans, &fusedReduceNames, &reduceSourcesAndSlots);
+
   std::string outputFilepath(OptOutputPath);
   outputFilepath.append("/");
   outputFilepath.append(OptOutputFilename);
@@ -222,7 +371,8 @@ bool compileScriptGroup(BCCContext& Context, RSCompilerDriver& RSCD) {
     Context, outputFilepath.c_str(), OptBCLibFilename.c_str(),
     OptBCLibRelaxedFilename.c_str(), OptEmitLLVM, OptChecksum.c_str(),
     sources, sourcesAndSlots, fusedKernelNames,
-    invokeSourcesAndSlots, invokeBatchNames);
+    invokeSourcesAndSlots, invokeBatchNames,
+    reduceSourcesAndSlots, fusedReduceNames);
 
   return success;
 }
@@ -260,6 +410,9 @@ bool ConfigCompiler(RSCompilerDriver &pRSCD) {
     }
   }
 
+  config->setFeatureLevels(std::vector<std::string>(OptFeatureLevels.begin(),
+                                                    OptFeatureLevels.end()));
+
   pRSCD.setConfig(config);
   Compiler::ErrorCode result = RSC->config(*config);
 
@@ -275,6 +428,40 @@ bool ConfigCompiler(RSCompilerDriver &pRSCD) {
     pRSCD.setEmbedGlobalInfoSkipConstant(true);
   }
 
+  if (OptRSGlobalInfoIndex) {
+    pRSCD.setEmbedGlobalInfoIndex(true);
+  }
+
+  if (OptRSInfoBinary) {
+    pRSCD.setEmbedBinaryInfo(true);
+  }
+
+  if (!extractSpecializedGlobals(OptSpecializeGlobals, &pRSCD) ||
+      !extractExpandShapes(OptExpandShapes, &pRSCD)) {
+    return false;
+  }
+
+  if (OptProfileGenerate && !OptProfileUse.empty()) {
+    llvm::errs() << "-profile-generate and -profile-use are exclusive\n";
+    return false;
+  }
+
+  if (OptProfileGenerate) {
+    pRSCD.setProfileInstrument(true);
+  }
+
+  if (!OptProfileUse.empty()) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> profile =
+        llvm::MemoryBuffer::getFile(OptProfileUse);
+    if (profile.getError()) {
+      llvm::errs() << "Failed to load profile from " << OptProfileUse << " ("
+                   << profile.getError().message() << ")\n";
+      return false;
+    }
+    pRSCD.setProfileData((*profile)->getBufferStart(),
+                         (*profile)->getBufferSize());
+  }
+
   if (result != Compiler::kSuccess) {
     llvm::errs() << "Failed to configure the compiler! (detail: "
                  << Compiler::GetErrorString(result) << ")\n";
@@ -327,7 +514,7 @@ int main(int argc, char **argv) {
     rscdi(&RSCD);
   }
 
-  if (OptMergePlans.size() > 0) {
+  if (OptMergePlans.size() > 0 || OptReducePlans.size() > 0 || !OptAutoMerge.empty()) {
     bool success = compileScriptGroup(context, RSCD);
 
     if (!success) {
@@ -14,13 +14,17 @@
  * limitations under the License.
  */
 
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <ctype.h>
 #include <stdlib.h>
 
 #include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/Config/config.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/FileSystem.h>
@@ -64,6 +68,16 @@ llvm::cl::alias OptTargetTripleC("C", llvm::cl::NotHidden,
                                  llvm::cl::desc("Alias for -mtriple"),
                                  llvm::cl::aliasopt(OptTargetTriple));
 
+// Each -abi compiles the input for one more target, in one invocation: the
+// input is read and verified once, and the targets are compiled
+// concurrently.  -mtriple, -rt-path and -o are then ignored.
+llvm::cl::list<std::string>
+OptAbis("abi", llvm::cl::ZeroOrMore,
+        llvm::cl::desc("Compile for the given target triple, with the given "
+                       "runtime library, to the given output file (may be "
+                       "repeated)"),
+        llvm::cl::value_desc("triple:rt-path:output"));
+
 //===----------------------------------------------------------------------===//
 // Compiler Options
 //===----------------------------------------------------------------------===//
@@ -144,11 +158,12 @@ Script *PrepareScript(BCCContext &pContext,
 }
 
 static inline
-bool ConfigCompiler(RSCompilerDriver &pCompilerDriver) {
+bool ConfigCompiler(RSCompilerDriver &pCompilerDriver,
+                    const std::string &pTargetTriple) {
   Compiler *compiler = pCompilerDriver.getCompiler();
   CompilerConfig *config = nullptr;
 
-  config = new (std::nothrow) CompilerConfig(OptTargetTriple);
+  config = new (std::nothrow) CompilerConfig(pTargetTriple);
   if (config == nullptr) {
     llvm::errs() << "Out of memory when create the compiler configuration!\n";
     return false;
@@ -246,11 +261,124 @@ std::string DetermineOutputFilename(const std::string &pOutputPath) {
   return output_path.c_str();
 }
 
+// One target of -abi.
+struct AbiTarget {
+  std::string mTriple;
+  std::string mRuntimePath;
+  std::string mOutput;
+
+  // Each target has its own context (LLVM contexts can't be used
+  // concurrently) and compiler.  mScript must be destroyed before mContext.
+  BCCContext mContext;
+  RSCompilerDriver mCompilerDriver;
+  std::unique_ptr<Script> mScript;
+  bool mSuccess;
+
+  AbiTarget() : mSuccess(false) { }
+};
+
+// The triple has no ':', but the paths may start with a drive letter
+// (C:\ or C:/), so the output is split off at the last ':' that is not the
+// drive letter of the output.
+static bool ParseAbiTarget(const std::string &pAbi, AbiTarget &pTarget) {
+  size_t first = pAbi.find(':');
+  size_t second = pAbi.rfind(':');
+  if (second != std::string::npos && second >= first + 3 &&
+      pAbi[second - 2] == ':' && isalpha(static_cast<unsigned char>(pAbi[second - 1])) &&
+      second + 1 < pAbi.size() && (pAbi[second + 1] == '\\' || pAbi[second + 1] == '/')) {
+    second -= 2;
+  }
+  if (first == std::string::npos || second == first) {
+    llvm::errs() << "Invalid -abi `" << pAbi
+                 << "' (expected triple:rt-path:output)!\n";
+    return false;
+  }
+  pTarget.mTriple = pAbi.substr(0, first);
+  pTarget.mRuntimePath = pAbi.substr(first + 1, second - first - 1);
+  pTarget.mOutput = pAbi.substr(second + 1);
+  return true;
+}
+
+// Compile the script for each of OptAbis, concurrently.
+static bool CompileForAbis(Script &pScript) {
+  std::vector<std::unique_ptr<AbiTarget>> targets;
+  for (const std::string &abi : OptAbis) {
+    std::unique_ptr<AbiTarget> target(new AbiTarget());
+    if (!ParseAbiTarget(abi, *target) ||
+        !ConfigCompiler(target->mCompilerDriver, target->mTriple)) {
+      return false;
+    }
+    targets.push_back(std::move(target));
+  }
+
+  // The global merge option is shared by the targets' compilers: set it
+  // here, before they run concurrently, rather than in each of them.
+  if (!targets.empty()) {
+    RSCompilerDriver::setGlobalMergeOption(
+        targets[0]->mCompilerDriver.getEnableGlobalMerge());
+  }
+  for (const auto &target : targets) {
+    target->mCompilerDriver.setGlobalMergeSetByCaller(true);
+  }
+
+  // Each target gets a copy of the (already verified) script in its own
+  // context, parsed from one serialization of it.
+  llvm::SmallVector<char, 0> bitcode;
+  pScript.getSource().writeBitcode(bitcode);
+  const std::string name = pScript.getSource().getName();
+
+  auto compile = [&bitcode, &name](AbiTarget *pTarget) {
+    Source *source = Source::CreateFromVerifiedBuffer(
+        pTarget->mContext, name.c_str(), bitcode.data(), bitcode.size());
+    if (source == nullptr) {
+      return;
+    }
+    pTarget->mScript.reset(new (std::nothrow) Script(source));
+    if (pTarget->mScript == nullptr) {
+      delete source;
+      return;
+    }
+    pTarget->mSuccess = pTarget->mCompilerDriver.buildForCompatLib(
+        *pTarget->mScript, pTarget->mOutput.c_str(), nullptr,
+        pTarget->mRuntimePath.c_str(), false);
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < targets.size(); i++) {
+    threads.emplace_back(compile, targets[i].get());
+  }
+  if (!targets.empty()) {
+    compile(targets[0].get());
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  bool success = true;
+  for (const auto &target : targets) {
+    if (!target->mSuccess) {
+      llvm::errs() << "Failed to compile script for " << target->mTriple
+                   << "!\n";
+      success = false;
+    }
+  }
+  return success;
+}
+
 int main(int argc, char **argv) {
   llvm::cl::SetVersionPrinter(BCCVersionPrinter);
   llvm::cl::ParseCommandLineOptions(argc, argv);
   init::Initialize();
 
+  if (!OptAbis.empty()) {
+    BCCContext context;
+    std::unique_ptr<Script> s(PrepareScript(context, OptInputFilenames));
+    if (s == nullptr || !CompileForAbis(*s)) {
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
   if (OptRuntimePath.empty()) {
     fprintf(stderr, "You must set \"-rt-path </path/to/libclcore.bc>\" with "
                     "this tool\n");
@@ -261,7 +389,7 @@ int main(int argc, char **argv) {
   RSCompilerDriver rscd;
   Compiler compiler;
 
-  if (!ConfigCompiler(rscd)) {
+  if (!ConfigCompiler(rscd, OptTargetTriple)) {
     return EXIT_FAILURE;
   }
 
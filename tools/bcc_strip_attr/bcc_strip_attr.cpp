@@ -24,11 +24,17 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/SystemUtils.h"
 #include "llvm/Support/ToolOutputFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 using namespace llvm;
 
 static cl::list<std::string>
@@ -43,6 +49,20 @@ static cl::opt<bool>
 OutputAssembly("S",
                cl::desc("Write output as LLVM assembly"), cl::Hidden);
 
+// Each -pair strips one more file, instead of the positional input; the
+// pairs are processed concurrently, each with its own LLVMContext.
+static cl::list<std::string>
+Pairs("pair", cl::ZeroOrMore,
+      cl::desc("Strip the input file into the output file (may be "
+               "repeated)"),
+      cl::value_desc("input=output"));
+
+static cl::opt<unsigned>
+Jobs("j", cl::desc("Number of threads for -pair (default: one per CPU)"),
+     cl::init(0));
+
+static const char *ProgramName;
+
 namespace {
   class StripAttributes : public ModulePass {
   public:
@@ -93,36 +113,54 @@ static RegisterPass<StripAttributes> RPSA("StripAttributes",
     "Strip Function Attributes Pass");
 
 
-static inline std::unique_ptr<Module> LoadFile(const char *argv0,
-                                               const std::string &FN,
-                                               LLVMContext& Context) {
+// Loads FN. Bitcode is loaded lazily: function bodies are only read when the
+// module is written out, since the attributes to strip are on the functions
+// themselves.
+static inline std::unique_ptr<Module> LoadFile(const std::string &FN,
+                                               LLVMContext& Context,
+                                               raw_ostream &Errs) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFileOrSTDIN(FN);
+  if (std::error_code EC = BufferOrErr.getError()) {
+    Errs << ProgramName << ": " << FN << ": " << EC.message() << '\n';
+    return std::unique_ptr<Module>();
+  }
+
+  std::unique_ptr<MemoryBuffer> &Buffer = BufferOrErr.get();
+  const unsigned char *Start =
+      reinterpret_cast<const unsigned char *>(Buffer->getBufferStart());
+  if (isBitcode(Start, Start + Buffer->getBufferSize())) {
+    ErrorOr<std::unique_ptr<Module>> ModuleOrErr =
+        getLazyBitcodeModule(std::move(Buffer), Context);
+    if (std::error_code EC = ModuleOrErr.getError()) {
+      Errs << ProgramName << ": " << FN << ": " << EC.message() << '\n';
+      return std::unique_ptr<Module>();
+    }
+    return std::move(ModuleOrErr.get());   // Load successful!
+  }
+
   SMDiagnostic Err;
-  std::unique_ptr<Module> Result = parseIRFile(FN, Err, Context);
+  std::unique_ptr<Module> Result =
+      parseIR(Buffer->getMemBufferRef(), Err, Context);
   if (Result) {
     return Result;   // Load successful!
   }
 
-  Err.print(argv0, errs());
+  Err.print(ProgramName, Errs);
   return std::unique_ptr<Module>();
 }
 
-
-int main(int argc, char **argv) {
-  // Print a stack trace if we signal out.
-  sys::PrintStackTraceOnErrorSignal(argv[0]);
-  PrettyStackTraceProgram X(argc, argv);
-
+// Strips the function attributes of InputFilename into OutputFilename, with
+// a context of its own, reporting errors to Errs.
+static bool StripFile(const std::string &InputFilename,
+                      const std::string &OutputFilename, raw_ostream &Errs) {
   LLVMContext Context;
-  llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
-  cl::ParseCommandLineOptions(argc, argv, "strip function attribute pass\n");
 
-  std::string ErrorMessage;
-
-  std::unique_ptr<Module> M(LoadFile(argv[0], InputFilenames[0], Context));
+  std::unique_ptr<Module> M(LoadFile(InputFilename, Context, Errs));
   if (M.get() == 0) {
-    errs() << argv[0] << ": error loading file '"
-           << InputFilenames[0] << "'\n";
-    return 1;
+    Errs << ProgramName << ": error loading file '"
+         << InputFilename << "'\n";
+    return false;
   }
 
   // Perform the actual function attribute stripping.
@@ -130,17 +168,24 @@ int main(int argc, char **argv) {
   PM.add(createStripAttributePass());
   PM.run(*M.get());
 
+  // Verifying and writing the module needs the function bodies.
+  if (std::error_code EC = M->materializeAll()) {
+    Errs << ProgramName << ": " << InputFilename << ": " << EC.message()
+         << '\n';
+    return false;
+  }
+
   std::error_code EC;
   tool_output_file Out(OutputFilename.c_str(), EC,
                        sys::fs::F_None);
   if (EC) {
-    errs() << EC.message() << '\n';
-    return 1;
+    Errs << EC.message() << '\n';
+    return false;
   }
 
   if (verifyModule(*M)) {
-    errs() << argv[0] << ": stripped module is broken!\n";
-    return 1;
+    Errs << ProgramName << ": stripped module is broken!\n";
+    return false;
   }
 
   if (OutputAssembly) {
@@ -151,5 +196,72 @@ int main(int argc, char **argv) {
 
   Out.keep();
 
-  return 0;
+  return true;
+}
+
+// Strips each of Pairs on a pool of Jobs threads.
+static bool StripPairs() {
+  std::vector<std::pair<std::string, std::string>> Files;
+  for (const std::string &Pair : Pairs) {
+    size_t Separator = Pair.find('=');
+    if (Separator == std::string::npos) {
+      errs() << ProgramName << ": invalid -pair '" << Pair
+             << "' (expected input=output)\n";
+      return false;
+    }
+    Files.push_back(std::make_pair(Pair.substr(0, Separator),
+                                   Pair.substr(Separator + 1)));
+  }
+
+  unsigned ThreadCount = Jobs ? Jobs : std::thread::hardware_concurrency();
+  ThreadCount = std::max(1u, std::min<unsigned>(ThreadCount, Files.size()));
+
+  // Errors are reported per file, in order, once all are done.
+  std::vector<std::string> Errors(Files.size());
+  std::atomic<size_t> Next(0);
+  std::atomic<bool> Success(true);
+  auto Worker = [&]() {
+    for (size_t I = Next++; I < Files.size(); I = Next++) {
+      raw_string_ostream Errs(Errors[I]);
+      if (!StripFile(Files[I].first, Files[I].second, Errs)) {
+        Success = false;
+      }
+    }
+  };
+
+  std::vector<std::thread> Threads;
+  for (unsigned I = 1; I < ThreadCount; ++I) {
+    Threads.emplace_back(Worker);
+  }
+  Worker();
+  for (std::thread &Thread : Threads) {
+    Thread.join();
+  }
+
+  for (const std::string &Error : Errors) {
+    errs() << Error;
+  }
+  return Success;
+}
+
+
+int main(int argc, char **argv) {
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+
+  llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+  cl::ParseCommandLineOptions(argc, argv, "strip function attribute pass\n");
+  ProgramName = argv[0];
+
+  if (!Pairs.empty()) {
+    return StripPairs() ? 0 : 1;
+  }
+
+  if (InputFilenames.empty()) {
+    errs() << argv[0] << ": no input file\n";
+    return 1;
+  }
+
+  return StripFile(InputFilenames[0], OutputFilename, errs()) ? 0 : 1;
 }